@@ -224,21 +224,35 @@ typedef enum {
   /*! POSIX poll() */
   ARES_EVSYS_POLL = 4,
   /*! last fallback on Unix-like systems, select() */
-  ARES_EVSYS_SELECT = 5
+  ARES_EVSYS_SELECT = 5,
+  /*! Linux io_uring */
+  ARES_EVSYS_IOURING = 6
 } ares_evsys_t;
 
+/*! Values for ARES_OPT_SERVER_SELECTION */
+typedef enum {
+  /*! First healthy server, or a random healthy server with ARES_OPT_ROTATE */
+  ARES_SERVER_SELECT_DEFAULT = 0,
+  /*! Pick two random healthy servers and use the one with the lower
+   *  smoothed latency, weighted by its outstanding queries */
+  ARES_SERVER_SELECT_LATENCY = 1
+} ares_server_select_t;
+
 /* Flag values */
-#define ARES_FLAG_USEVC       (1 << 0)
-#define ARES_FLAG_PRIMARY     (1 << 1)
-#define ARES_FLAG_IGNTC       (1 << 2)
-#define ARES_FLAG_NORECURSE   (1 << 3)
-#define ARES_FLAG_STAYOPEN    (1 << 4)
-#define ARES_FLAG_NOSEARCH    (1 << 5)
-#define ARES_FLAG_NOALIASES   (1 << 6)
-#define ARES_FLAG_NOCHECKRESP (1 << 7)
-#define ARES_FLAG_EDNS        (1 << 8)
-#define ARES_FLAG_NO_DFLT_SVR (1 << 9)
-#define ARES_FLAG_DNS0x20     (1 << 10)
+#define ARES_FLAG_USEVC           (1 << 0)
+#define ARES_FLAG_PRIMARY         (1 << 1)
+#define ARES_FLAG_IGNTC           (1 << 2)
+#define ARES_FLAG_NORECURSE       (1 << 3)
+#define ARES_FLAG_STAYOPEN        (1 << 4)
+#define ARES_FLAG_NOSEARCH        (1 << 5)
+#define ARES_FLAG_NOALIASES       (1 << 6)
+#define ARES_FLAG_NOCHECKRESP     (1 << 7)
+#define ARES_FLAG_EDNS            (1 << 8)
+#define ARES_FLAG_NO_DFLT_SVR     (1 << 9)
+#define ARES_FLAG_DNS0x20         (1 << 10)
+#define ARES_FLAG_COALESCE        (1 << 11)
+#define ARES_FLAG_MULTICORE       (1 << 12)
+#define ARES_FLAG_PARALLEL_SEARCH (1 << 13)
 
 /* Option mask values */
 #define ARES_OPT_FLAGS           (1 << 0)
@@ -265,6 +279,13 @@ typedef enum {
 #define ARES_OPT_QUERY_CACHE     (1 << 21)
 #define ARES_OPT_EVENT_THREAD    (1 << 22)
 #define ARES_OPT_SERVER_FAILOVER (1 << 23)
+#define ARES_OPT_QCACHE_MAX_ENTRIES   (1 << 24)
+#define ARES_OPT_QCACHE_STALE         (1 << 25)
+#define ARES_OPT_TIMEOUT_PERCENTILE   (1 << 26)
+#define ARES_OPT_HOSTS_CHECK_INTERVAL (1 << 27)
+#define ARES_OPT_EVENT_THREADS        (1 << 28)
+#define ARES_OPT_SERVER_SELECTION     (1 << 29)
+#define ARES_OPT_HEDGE                (1 << 30)
 
 /* Nameinfo flag values */
 #define ARES_NI_NOFQDN        (1 << 0)
@@ -394,6 +415,16 @@ struct ares_options {
   unsigned int qcache_max_ttl;   /* Maximum TTL for query cache, 0=disabled */
   ares_evsys_t evsys;
   struct ares_server_failover_options server_failover_opts;
+  unsigned int qcache_max_entries; /* Maximum query cache entries, 0=unlimited */
+  size_t       qcache_max_bytes;   /* Maximum query cache memory, 0=unlimited */
+  unsigned int qcache_stale_ttl;   /* Seconds to serve expired entries */
+  unsigned int qcache_prefetch_pct; /* % of TTL left to trigger refresh */
+  unsigned int timeout_percentile;  /* Latency percentile used as timeout */
+  unsigned int hosts_check_ms;      /* Minimum ms between hosts checks */
+  unsigned int event_threads;       /* Number of event threads */
+  ares_server_select_t server_selection; /* Server selection policy */
+  unsigned int hedge_percentile;    /* Latency percentile to hedge after */
+  unsigned int hedge_max_pct;       /* Max % of queries that may be hedged */
 };
 
 struct hostent;
@@ -456,6 +487,10 @@ typedef int (*ares_sock_config_callback)(ares_socket_t socket_fd, int type,
 typedef void (*ares_addrinfo_callback)(void *arg, int status, int timeouts,
                                        struct ares_addrinfo *res);
 
+typedef void (*ares_addrinfo_incremental_callback)(
+  void *arg, int status, int timeouts, struct ares_addrinfo *res,
+  ares_bool_t is_final);
+
 typedef void (*ares_server_state_callback)(const char *server_string,
                                            ares_bool_t success, int flags,
                                            void *data);
@@ -551,6 +586,27 @@ CARES_EXTERN void ares_getaddrinfo(ares_channel_t *channel, const char *node,
                                    const struct ares_addrinfo_hints *hints,
                                    ares_addrinfo_callback callback, void *arg);
 
+/*! Like ares_getaddrinfo(), but when both address families are queried the
+ *  addresses of the first family to answer are delivered right away with
+ *  is_final set to ARES_FALSE, so connection attempts can start early
+ *  (RFC 8305).  The other family is then given delay_ms to answer, after
+ *  which the sorted addresses of both are delivered with is_final set to
+ *  ARES_TRUE.  The callback is always invoked exactly once with is_final set.
+ *
+ *  \param[in] channel   Initialized c-ares channel
+ *  \param[in] node      Name to look up
+ *  \param[in] service   Service name or port number, may be NULL
+ *  \param[in] hints     Lookup hints, may be NULL
+ *  \param[in] delay_ms  Resolution delay in milliseconds, 0 for the RFC 8305
+ *                       recommendation of 50ms
+ *  \param[in] callback  Callback invoked with each result
+ *  \param[in] arg       Argument passed to the callback
+ */
+CARES_EXTERN void ares_getaddrinfo_incremental(
+  ares_channel_t *channel, const char *node, const char *service,
+  const struct ares_addrinfo_hints *hints, unsigned int delay_ms,
+  ares_addrinfo_incremental_callback callback, void *arg);
+
 CARES_EXTERN void ares_freeaddrinfo(struct ares_addrinfo *ai);
 
 /*
@@ -621,9 +677,20 @@ typedef enum {
   ARES_SOCKET_BIND_CLIENT = 1 << 1
 } ares_socket_bind_flags_t;
 
+/*! Datagram descriptor used by the optional batched socket functions in
+ *  struct ares_socket_functions_ex */
+typedef struct {
+  /*! Buffer holding the datagram.  Must not be modified when sending. */
+  void  *buffer;
+  /*! Length of the datagram.  When receiving, this is the size of the buffer
+   *  on input and the length of the datagram received on output. */
+  size_t length;
+} ares_socket_msg_t;
+
 /*! Socket functions to call rather than using OS-native functions */
 struct ares_socket_functions_ex {
-  /*! ABI Version: must be "1" */
+  /*! ABI Version: must be "1" or "2".  Version 2 adds the batched datagram
+   *  functions */
   unsigned int version;
 
   /*! Flags indicating behavior of the subsystem. One or more
@@ -798,6 +865,47 @@ struct ares_socket_functions_ex {
    */
   const char *(*aif_indextoname)(unsigned int ifindex, char *ifname_buf,
                                  size_t ifname_buf_len, void *user_data);
+
+  /*! Optional, version 2+. Send multiple datagrams on a connected UDP socket
+   *  in a single call, such as via sendmmsg().  If not specified, each
+   *  datagram is sent individually via asendto().
+   *
+   *  \param[in] sock      Socket file descriptor returned from asocket.
+   *  \param[in] msgs      Array of datagrams to send, in order.
+   *  \param[in] cnt       Number of datagrams in msgs.
+   *  \param[in] flags     Flags for writing, same as asendto().
+   *  \param[in] user_data Pointer provided to ares_set_socket_functions_ex().
+   *  \return Number of datagrams sent which may be less than cnt.  -1 on error
+   *          with appropriate errno (or WSASetLastError()) set, such as
+   *          EWOULDBLOCK / EAGAIN.  If the error is ENOSYS the function will not
+   *          be called again and datagrams will be sent individually.
+   */
+  ares_ssize_t (*asendmmsg)(ares_socket_t sock, const ares_socket_msg_t *msgs,
+                            size_t cnt, int flags, void *user_data);
+
+  /*! Optional, version 2+. Receive multiple datagrams on a connected UDP
+   *  socket in a single call, such as via recvmmsg().  Only used when
+   *  ARES_SOCKFUNC_FLAG_NONBLOCKING is set, and must not block waiting for
+   *  the array to be filled.  Only datagrams from the connected peer may be
+   *  returned.  If not specified, each datagram is read individually via
+   *  arecvfrom().
+   *
+   *  \param[in]     sock      Socket file descriptor returned from asocket.
+   *  \param[in,out] msgs      Array of buffers to receive into.  On return the
+   *                           length of each received datagram is updated.  A
+   *                           length greater than the buffer size indicates
+   *                           the datagram was truncated.
+   *  \param[in]     cnt       Number of entries in msgs.
+   *  \param[in]     flags     Flags for reading, same as arecvfrom().
+   *  \param[in]     user_data Pointer provided to
+   *                           ares_set_socket_functions_ex().
+   *  \return Number of datagrams received.  -1 on error with appropriate errno
+   *          (or WSASetLastError()) set, such as EWOULDBLOCK / EAGAIN.  If the
+   *          error is ENOSYS the function will not be called again and
+   *          datagrams will be read individually.
+   */
+  ares_ssize_t (*arecvmmsg)(ares_socket_t sock, ares_socket_msg_t *msgs,
+                            size_t cnt, int flags, void *user_data);
 };
 
 /*! Override the native socket functions for the OS with the provided set.
@@ -1186,6 +1294,65 @@ CARES_EXTERN int   ares_set_servers_ports_csv(ares_channel_t *channel,
                                               const char     *servers);
 CARES_EXTERN char *ares_get_servers_csv(const ares_channel_t *channel);
 
+/*! Retrieve a latency percentile observed for a configured server, using the
+ *  most recent time period that has enough samples.
+ *
+ *  \param[in]  channel    Initialized c-ares channel
+ *  \param[in]  server     Server address as formatted by ares_get_servers_csv()
+ *  \param[in]  percentile Percentile to retrieve, 1-100
+ *  \param[out] latency_ms Latency in milliseconds
+ *  \return ARES_SUCCESS on success, ARES_ENOTFOUND if the server is not
+ *          configured, ARES_ENODATA if there are not enough samples
+ */
+CARES_EXTERN ares_status_t ares_get_server_latency(
+  const ares_channel_t *channel, const char *server, unsigned int percentile,
+  unsigned int *latency_ms);
+
+/*! How queries are spread across the UDP sockets of a server, see
+ *  ares_set_udp_sockets() */
+typedef enum {
+  /*! Use each socket in turn */
+  ARES_UDP_BALANCE_ROUND_ROBIN = 0,
+  /*! Use the socket with the fewest queries awaiting a response */
+  ARES_UDP_BALANCE_LEAST_LOADED = 1
+} ares_udp_balance_t;
+
+/*! Set the number of UDP sockets, each with its own source port, that may be
+ *  used concurrently to send queries to each server.  The default is 1.
+ *
+ *  \param[in] channel     Initialized c-ares channel
+ *  \param[in] num_sockets Maximum number of UDP sockets per server, 1-64
+ *  \param[in] balance     How queries are assigned to the sockets
+ *  \return ARES_SUCCESS on success, ARES_EFORMERR on invalid parameters
+ */
+CARES_EXTERN ares_status_t ares_set_udp_sockets(ares_channel_t    *channel,
+                                                size_t             num_sockets,
+                                                ares_udp_balance_t balance);
+
+/*! Statistics for one UDP socket of a server, see ares_get_server_udp_stats()
+ */
+typedef struct {
+  unsigned short local_port;   /*!< Local (source) port, 0 if unknown */
+  size_t         queries_sent; /*!< Queries sent on the socket */
+  size_t         answers;      /*!< Answers received on the socket */
+  size_t         outstanding;  /*!< Queries awaiting a response */
+} ares_udp_stats_t;
+
+/*! Retrieve statistics for each UDP socket currently open to a server.
+ *
+ *  \param[in]     channel   Initialized c-ares channel
+ *  \param[in]     server    Server address as formatted by
+ *                           ares_get_servers_csv()
+ *  \param[out]    stats     Array to fill in
+ *  \param[in,out] num_stats On input the number of entries in stats, on
+ *                           output the number of entries filled in
+ *  \return ARES_SUCCESS on success, ARES_ENOTFOUND if the server is not
+ *          configured
+ */
+CARES_EXTERN ares_status_t ares_get_server_udp_stats(
+  const ares_channel_t *channel, const char *server, ares_udp_stats_t *stats,
+  size_t *num_stats);
+
 CARES_EXTERN CARES_DEPRECATED_FOR(ares_get_servers_csv) int ares_get_servers(
   const ares_channel_t *channel, struct ares_addr_node **servers);
 
@@ -1228,6 +1395,37 @@ CARES_EXTERN ares_status_t ares_queue_wait_empty(ares_channel_t *channel,
  */
 CARES_EXTERN size_t ares_queue_active_queries(const ares_channel_t *channel);
 
+
+/*! Query cache statistics that may be retrieved via ares_qcache_stat() */
+typedef enum {
+  /*! Number of entries currently in the cache */
+  ARES_QCACHE_STAT_ENTRIES = 1,
+  /*! Approximate number of bytes of memory used by cached entries */
+  ARES_QCACHE_STAT_BYTES = 2,
+  /*! Number of lookups answered from the cache */
+  ARES_QCACHE_STAT_HITS = 3,
+  /*! Number of lookups not found in the cache */
+  ARES_QCACHE_STAT_MISSES = 4,
+  /*! Number of entries evicted before expiration to stay within the
+   *  configured limits */
+  ARES_QCACHE_STAT_EVICTIONS = 5,
+  /*! Number of lookups answered with an expired entry, see
+   *  ARES_OPT_QCACHE_STALE */
+  ARES_QCACHE_STAT_STALE_HITS = 6,
+  /*! Number of background refreshes of cached entries issued */
+  ARES_QCACHE_STAT_REFRESHES = 7
+} ares_qcache_stat_t;
+
+/*! Retrieve a query cache statistic.  Counters are cumulative for the life
+ *  of the channel.
+ *
+ *  \param[in] channel Initialized ares channel
+ *  \param[in] stat    Statistic to retrieve
+ *  \return Value of the statistic, or 0 if the query cache is disabled
+ */
+CARES_EXTERN size_t ares_qcache_stat(const ares_channel_t *channel,
+                                     ares_qcache_stat_t    stat);
+
 #ifdef __cplusplus
 }
 #endif
@@ -419,7 +419,11 @@ typedef enum {
   /*! Parse Authority from later RFCs (no name compression) as RAW */
   ARES_DNS_PARSE_NS_EXT_RAW = 1 << 4,
   /*! Parse Additional from later RFCs (no name compression) as RAW */
-  ARES_DNS_PARSE_AR_EXT_RAW = 1 << 5
+  ARES_DNS_PARSE_AR_EXT_RAW = 1 << 5,
+  /*! Allocate the parsed record and all of its data from a single arena that
+   *  is released in one step by ares_dns_record_destroy().  Best suited to
+   *  records that are read but rarely modified. */
+  ARES_DNS_PARSE_ARENA = 1 << 6
 } ares_dns_parse_flags_t;
 
 /*! String representation of DNS Record Type
@@ -77,6 +77,8 @@ void ares_cancel(ares_channel_t *channel)
     ares_llist_destroy(list_copy);
   }
 
+  ares_submit_cancel(channel, ARES_ECANCELLED);
+
   /* See if the connections should be cleaned up */
   ares_check_cleanup_conns(channel);
 
@@ -85,3 +87,21 @@ void ares_cancel(ares_channel_t *channel)
 done:
   ares_channel_unlock(channel);
 }
+
+void ares_cancel_query(ares_channel_t *channel, unsigned short qid,
+                       ares_callback_dnsrec callback, const void *arg)
+{
+  ares_query_t *query =
+    ares_htable_szvp_get_direct(channel->queries_by_qid, qid);
+
+  /* The qid may have completed and been reused, or the query may have been
+   * joined to another one (ARES_FLAG_COALESCE), only cancel our own */
+  if (query == NULL || !ares_query_callback_match(query, callback, arg)) {
+    return;
+  }
+
+  query->callback(query->arg, ARES_ECANCELLED, 0, NULL);
+  ares_free_query(query);
+
+  ares_queue_notify_empty(channel);
+}
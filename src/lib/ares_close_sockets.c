@@ -37,6 +37,10 @@ static void ares_requeue_queries(ares_conn_t  *conn,
   ares_tvnow(&now);
 
   while ((query = ares_llist_first_val(conn->queries_to_conn)) != NULL) {
+    /* A hedged query is still waiting on its other server */
+    if (ares_query_drop_leg(query, conn)) {
+      continue;
+    }
     ares_requeue_query(query, &now, requeue_status, ARES_TRUE, NULL, NULL);
   }
 }
@@ -67,7 +71,7 @@ void ares_close_connection(ares_conn_t *conn, ares_status_t requeue_status)
 
   ares_socket_close(channel, conn->fd);
 
-  ares_free(conn);
+  ares_pool_put(channel->conn_pool, conn);
 }
 
 void ares_close_sockets(ares_server_t *server)
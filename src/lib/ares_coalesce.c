@@ -0,0 +1,254 @@
+/* MIT License
+ *
+ * Copyright (c) The c-ares project and its contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#include "ares_private.h"
+#include "dsa/ares_htable.h"
+
+/* In-flight query coalescing (ARES_FLAG_COALESCE).
+ *
+ * The first query for a given question becomes the leader and is sent as
+ * normal, but its callback is replaced with one that fans the response out to
+ * every caller that asked the same question while it was in flight.  Questions
+ * are identified using the same key as the query cache, followed by the send
+ * flags, as a caller that e.g. asked for no retries must not wait on a query
+ * that will be retried. */
+
+/*! Longest key, the query cache key plus the send flags */
+#define ARES_COALESCE_KEY_MAXLEN (ARES_QCACHE_KEY_MAXLEN + 1)
+
+typedef struct {
+  const unsigned char *data;
+  size_t               len;
+} ares_coalesce_key_t;
+
+typedef struct {
+  ares_callback_dnsrec callback;
+  void                *arg;
+} ares_coalesce_waiter_t;
+
+/*! Group of callers waiting on a single query, allocated as
+ *    [group][key bytes] */
+typedef struct {
+  ares_coalesce_key_t key;
+  ares_channel_t     *channel;
+  unsigned short      qid;
+  ares_array_t       *waiters;
+} ares_coalesce_group_t;
+
+struct ares_coalesce {
+  ares_htable_t *groups;
+};
+
+static unsigned int ares_coalesce_key_hash(const void *key, unsigned int seed)
+{
+  const ares_coalesce_key_t *k = key;
+  return ares_htable_hash_FNV1a(k->data, k->len, seed);
+}
+
+static const void *ares_coalesce_key_bucket(const void *bucket)
+{
+  const ares_coalesce_group_t *group = bucket;
+  return &group->key;
+}
+
+static ares_bool_t ares_coalesce_key_eq(const void *key1, const void *key2)
+{
+  const ares_coalesce_key_t *k1 = key1;
+  const ares_coalesce_key_t *k2 = key2;
+
+  if (k1->len != k2->len) {
+    return ARES_FALSE;
+  }
+
+  return memcmp(k1->data, k2->data, k1->len) == 0 ? ARES_TRUE : ARES_FALSE;
+}
+
+static void ares_coalesce_bucket_free(void *bucket)
+{
+  /* Groups are owned by the leader query */
+  (void)bucket;
+}
+
+/* Build the key for a request into a buffer of at least
+ * ARES_COALESCE_KEY_MAXLEN bytes */
+static ares_bool_t ares_coalesce_key(const ares_dns_record_t *dnsrec,
+                                     ares_send_flags_t        flags,
+                                     unsigned char *buf, ares_coalesce_key_t *key)
+{
+  size_t len;
+
+  if (!ares_qcache_key(dnsrec, buf, &len)) {
+    return ARES_FALSE;
+  }
+
+  buf[len++] = (unsigned char)flags;
+  key->data  = buf;
+  key->len   = len;
+  return ARES_TRUE;
+}
+
+ares_coalesce_t *ares_coalesce_create(void)
+{
+  ares_coalesce_t *coalesce = ares_malloc_zero(sizeof(*coalesce));
+
+  if (coalesce == NULL) {
+    return NULL; /* LCOV_EXCL_LINE: OutOfMemory */
+  }
+
+  coalesce->groups =
+    ares_htable_create(ares_coalesce_key_hash, ares_coalesce_key_bucket,
+                       ares_coalesce_bucket_free, ares_coalesce_key_eq);
+  if (coalesce->groups == NULL) {
+    ares_free(coalesce); /* LCOV_EXCL_LINE: OutOfMemory */
+    return NULL;         /* LCOV_EXCL_LINE: OutOfMemory */
+  }
+
+  return coalesce;
+}
+
+void ares_coalesce_destroy(ares_coalesce_t *coalesce)
+{
+  if (coalesce == NULL) {
+    return;
+  }
+
+  ares_htable_destroy(coalesce->groups);
+  ares_free(coalesce);
+}
+
+ares_bool_t ares_coalesce_join(ares_channel_t          *channel,
+                               ares_send_flags_t        flags,
+                               const ares_dns_record_t *dnsrec,
+                               ares_callback_dnsrec callback, void *arg,
+                               unsigned short *qid)
+{
+  unsigned char          keybuf[ARES_COALESCE_KEY_MAXLEN];
+  ares_coalesce_key_t    key;
+  ares_coalesce_group_t *group;
+  ares_coalesce_waiter_t waiter;
+
+  if (channel->coalesce == NULL ||
+      ares_htable_num_keys(channel->coalesce->groups) == 0) {
+    return ARES_FALSE;
+  }
+
+  if (!ares_coalesce_key(dnsrec, flags, keybuf, &key)) {
+    return ARES_FALSE;
+  }
+
+  group = ares_htable_get(channel->coalesce->groups, &key);
+  if (group == NULL) {
+    return ARES_FALSE;
+  }
+
+  waiter.callback = callback;
+  waiter.arg      = arg;
+  if (ares_array_insertdata_last(group->waiters, &waiter) != ARES_SUCCESS) {
+    return ARES_FALSE; /* LCOV_EXCL_LINE: OutOfMemory */
+  }
+
+  if (qid != NULL) {
+    *qid = group->qid;
+  }
+
+  return ARES_TRUE;
+}
+
+static void ares_coalesce_cb(void *arg, ares_status_t status, size_t timeouts,
+                             const ares_dns_record_t *dnsrec)
+{
+  ares_coalesce_group_t *group = arg;
+  size_t                 i;
+
+  /* Remove first so any identical queries enqueued by the callbacks go out on
+   * the wire rather than attaching to a query that has already completed */
+  if (group->channel->coalesce != NULL) {
+    ares_htable_remove(group->channel->coalesce->groups, &group->key);
+  }
+
+  for (i = 0; i < ares_array_len(group->waiters); i++) {
+    const ares_coalesce_waiter_t *waiter =
+      ares_array_at_const(group->waiters, i);
+    waiter->callback(waiter->arg, status, timeouts, dnsrec);
+  }
+
+  ares_array_destroy(group->waiters);
+  ares_free(group);
+}
+
+void ares_coalesce_lead(ares_channel_t *channel, ares_send_flags_t flags,
+                        ares_query_t *query)
+{
+  unsigned char          keybuf[ARES_COALESCE_KEY_MAXLEN];
+  ares_coalesce_key_t    key;
+  ares_coalesce_group_t *group;
+  ares_coalesce_waiter_t waiter;
+
+  if (channel->coalesce == NULL ||
+      !ares_coalesce_key(query->query, flags, keybuf, &key)) {
+    return;
+  }
+
+  /* Only a single leader per question, another query for the same question
+   * may have been sent without being eligible to join */
+  if (ares_htable_get(channel->coalesce->groups, &key) != NULL) {
+    return;
+  }
+
+  group = ares_malloc_zero(sizeof(*group) + key.len);
+  if (group == NULL) {
+    return; /* LCOV_EXCL_LINE: OutOfMemory */
+  }
+
+  memcpy((unsigned char *)(group + 1), key.data, key.len);
+  group->key.data = (const unsigned char *)(group + 1);
+  group->key.len  = key.len;
+  group->channel  = channel;
+  group->qid      = query->qid;
+  group->waiters  = ares_array_create(sizeof(ares_coalesce_waiter_t), NULL);
+  if (group->waiters == NULL) {
+    goto fail; /* LCOV_EXCL_LINE: OutOfMemory */
+  }
+
+  waiter.callback = query->callback;
+  waiter.arg      = query->arg;
+  if (ares_array_insertdata_last(group->waiters, &waiter) != ARES_SUCCESS) {
+    goto fail; /* LCOV_EXCL_LINE: OutOfMemory */
+  }
+
+  if (!ares_htable_insert(channel->coalesce->groups, group)) {
+    goto fail; /* LCOV_EXCL_LINE: OutOfMemory */
+  }
+
+  query->callback = ares_coalesce_cb;
+  query->arg      = group;
+  return;
+
+/* LCOV_EXCL_START: OutOfMemory */
+fail:
+  ares_array_destroy(group->waiters);
+  ares_free(group);
+  /* LCOV_EXCL_STOP */
+}
@@ -100,6 +100,9 @@
 /* Define to 1 if you have the epoll{_create,ctl,wait} functions. */
 #cmakedefine HAVE_EPOLL 1
 
+/* Define to 1 if io_uring with multishot poll can be used. */
+#cmakedefine HAVE_IO_URING 1
+
 /* Define to 1 if you have the fcntl function. */
 #cmakedefine HAVE_FCNTL 1
 
@@ -260,12 +263,18 @@
 /* Define to 1 if you have the recvfrom function. */
 #cmakedefine HAVE_RECVFROM 1
 
+/* Define to 1 if you have the recvmmsg function. */
+#cmakedefine HAVE_RECVMMSG 1
+
 /* Define to 1 if you have the send function. */
 #cmakedefine HAVE_SEND 1
 
 /* Define to 1 if you have the sendto function. */
 #cmakedefine HAVE_SENDTO 1
 
+/* Define to 1 if you have the sendmmsg function. */
+#cmakedefine HAVE_SENDMMSG 1
+
 /* Define to 1 if you have the setsockopt function. */
 #cmakedefine HAVE_SETSOCKOPT 1
 
@@ -356,6 +365,9 @@
 /* Define to 1 if you have the <sys/epoll.h> header file. */
 #cmakedefine HAVE_SYS_EPOLL_H 1
 
+/* Define to 1 if you have the <linux/io_uring.h> header file. */
+#cmakedefine HAVE_LINUX_IO_URING_H 1
+
 /* Define to 1 if you have the <sys/select.h> header file. */
 #cmakedefine HAVE_SYS_SELECT_H 1
 
@@ -77,6 +77,27 @@ ares_conn_err_t ares_conn_read(ares_conn_t *conn, void *data, size_t len,
   return err;
 }
 
+ares_conn_err_t ares_conn_read_msgs(ares_conn_t *conn, ares_socket_msg_t *msgs,
+                                    size_t cnt, size_t *recvd)
+{
+  ares_conn_err_t err;
+
+  if (conn->flags & ARES_CONN_FLAG_TCP) {
+    *recvd = 0;
+    return ARES_CONN_ERR_NOTIMP;
+  }
+
+  err = ares_socket_recv_msgs(conn->server->channel, conn->fd, msgs, cnt,
+                              recvd);
+
+  /* Toggle connected state if needed */
+  if (err == ARES_CONN_ERR_SUCCESS) {
+    conn->state_flags |= ARES_CONN_STATE_CONNECTED;
+  }
+
+  return err;
+}
+
 /* Use like:
  *   struct sockaddr_storage sa_storage;
  *   ares_socklen_t          salen     = sizeof(sa_storage);
@@ -161,7 +182,7 @@ static ares_status_t ares_conn_set_self_ip(ares_conn_t *conn, ares_bool_t early)
     return ARES_ECONNREFUSED;
   }
 
-  if (!ares_sockaddr_to_ares_addr(&conn->self_ip, NULL,
+  if (!ares_sockaddr_to_ares_addr(&conn->self_ip, &conn->self_port,
                                   (struct sockaddr *)(void *)&sa_storage)) {
     return ARES_ECONNREFUSED;
   }
@@ -231,6 +252,58 @@ done:
   return err;
 }
 
+/* Send the length-prefixed UDP datagrams queued in out_buf using the batched
+ * socket function.  Returns ARES_CONN_ERR_NOTIMP if unsupported, in which case
+ * nothing was sent. */
+static ares_conn_err_t ares_conn_write_msgs(ares_conn_t *conn)
+{
+  ares_channel_t   *channel = conn->server->channel;
+  ares_socket_msg_t msgs[ARES_SOCKET_MSGS_MAX];
+
+  while (ares_buf_len(conn->out_buf) > 0) {
+    const unsigned char *data;
+    size_t               data_len;
+    size_t               pos     = 0;
+    size_t               cnt     = 0;
+    size_t               sent    = 0;
+    size_t               consume = 0;
+    size_t               i;
+    ares_conn_err_t      err;
+
+    /* Build the message array directly over the framed buffer */
+    data = ares_buf_peek(conn->out_buf, &data_len);
+    while (cnt < ARES_SOCKET_MSGS_MAX && pos + 2 <= data_len) {
+      size_t msg_len = ((size_t)data[pos] << 8) | (size_t)data[pos + 1];
+
+      if (pos + 2 + msg_len > data_len) {
+        break;
+      }
+
+      /* Cast off const */
+      msgs[cnt].buffer = (void *)((size_t)(data + pos + 2));
+      msgs[cnt].length = msg_len;
+      cnt++;
+      pos += 2 + msg_len;
+    }
+
+    if (cnt == 0) {
+      return ARES_CONN_ERR_INVALID;
+    }
+
+    err = ares_socket_write_msgs(channel, conn->fd, msgs, cnt, &sent);
+    if (err != ARES_CONN_ERR_SUCCESS) {
+      return err;
+    }
+
+    for (i = 0; i < sent; i++) {
+      consume += 2 + msgs[i].length;
+    }
+    ares_buf_consume(conn->out_buf, consume);
+  }
+
+  return ARES_CONN_ERR_SUCCESS;
+}
+
 ares_status_t ares_conn_flush(ares_conn_t *conn)
 {
   const unsigned char *data;
@@ -248,6 +321,29 @@ ares_status_t ares_conn_flush(ares_conn_t *conn)
     tfo = ARES_TRUE;
   }
 
+  /* UDP sends one datagram per query, so batch them into as few system calls
+   * as possible.  Falls back to sending individually if not supported. */
+  if (!(conn->flags & ARES_CONN_FLAG_TCP)) {
+    err = ares_conn_write_msgs(conn);
+    if (err == ARES_CONN_ERR_SUCCESS) {
+      status = ARES_SUCCESS;
+      goto done;
+    }
+    if (err == ARES_CONN_ERR_WOULDBLOCK) {
+      ares_conn_sock_state_cb_update(conn, ARES_CONN_STATE_READ |
+                                             ARES_CONN_STATE_WRITE);
+      return ARES_SUCCESS;
+    }
+    if (err == ARES_CONN_ERR_INVALID) {
+      status = ARES_EFORMERR;
+      goto done;
+    }
+    if (err != ARES_CONN_ERR_NOTIMP) {
+      status = ARES_ECONNREFUSED;
+      goto done;
+    }
+  }
+
   do {
     if (ares_buf_len(conn->out_buf) == 0) {
       status = ARES_SUCCESS;
@@ -352,12 +448,11 @@ ares_status_t ares_open_connection(ares_conn_t   **conn_out,
 
   *conn_out = NULL;
 
-  conn = ares_malloc(sizeof(*conn));
+  conn = ares_pool_get(channel->conn_pool);
   if (conn == NULL) {
     return ARES_ENOMEM; /* LCOV_EXCL_LINE: OutOfMemory */
   }
 
-  memset(conn, 0, sizeof(*conn));
   conn->fd              = ARES_SOCKET_BAD;
   conn->server          = server;
   conn->queries_to_conn = ares_llist_create(NULL);
@@ -372,6 +467,7 @@ ares_status_t ares_open_connection(ares_conn_t   **conn_out,
     goto done;
     /* LCOV_EXCL_STOP */
   }
+  ares_llist_set_node_pool(conn->queries_to_conn, channel->node_pool);
 
   /* Try to enable TFO always if using TCP. it will fail later on if its
    * really not supported when we try to enable it on the socket. */
@@ -491,7 +587,7 @@ done:
     ares_socket_close(channel, conn->fd);
     ares_buf_destroy(conn->out_buf);
     ares_buf_destroy(conn->in_buf);
-    ares_free(conn);
+    ares_pool_put(channel->conn_pool, conn);
   } else {
     *conn_out = conn;
   }
@@ -509,3 +605,47 @@ ares_conn_t *ares_conn_from_fd(const ares_channel_t *channel, ares_socket_t fd)
 
   return ares_llist_node_val(node);
 }
+
+ares_status_t ares_get_server_udp_stats(const ares_channel_t *channel,
+                                        const char           *server,
+                                        ares_udp_stats_t     *stats,
+                                        size_t               *num_stats)
+{
+  ares_status_t        status;
+  const ares_server_t *s;
+  ares_llist_node_t   *node;
+  size_t               cnt = 0;
+
+  if (channel == NULL || ares_strlen(server) == 0 || num_stats == NULL ||
+      (stats == NULL && *num_stats != 0)) {
+    return ARES_EFORMERR;
+  }
+
+  ares_channel_lock(channel);
+
+  status = ares_find_server(channel, server, &s);
+  if (status != ARES_SUCCESS) {
+    goto done;
+  }
+
+  /* UDP connections are always at the front of the list */
+  for (node = ares_llist_node_first(s->connections);
+       node != NULL && cnt < *num_stats; node = ares_llist_node_next(node)) {
+    const ares_conn_t *conn = ares_llist_node_val(node);
+
+    if (conn->flags & ARES_CONN_FLAG_TCP) {
+      break;
+    }
+
+    stats[cnt].local_port   = conn->self_port;
+    stats[cnt].queries_sent = conn->total_queries;
+    stats[cnt].answers      = conn->total_answers;
+    stats[cnt].outstanding  = ares_llist_len(conn->queries_to_conn);
+    cnt++;
+  }
+
+done:
+  ares_channel_unlock(channel);
+  *num_stats = cnt;
+  return status;
+}
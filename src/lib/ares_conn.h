@@ -73,9 +73,15 @@ struct ares_conn {
    *  handled gracefully, but UDP will always have a full message */
   ares_buf_t             *in_buf;
 
+  /*! Local port, only known for UDP if getsockname() is available */
+  unsigned short          self_port;
+
   /* total number of queries run on this connection since it was established */
   size_t                  total_queries;
 
+  /*! Number of answers received on this connection */
+  size_t                  total_answers;
+
   /* list of outstanding queries to this connection */
   ares_llist_t           *queries_to_conn;
 };
@@ -90,6 +96,9 @@ typedef enum {
   ARES_METRIC_COUNT        /*!< Count of buckets, not a real bucket */
 } ares_server_bucket_t;
 
+/*! Number of log-linear latency histogram slots, covers 0ms to ~32s */
+#define ARES_METRICS_HIST_LEN 104
+
 /*! Data metrics collected for each bucket */
 typedef struct {
   time_t        ts;             /*!< Timestamp divided by bucket divisor */
@@ -97,11 +106,14 @@ typedef struct {
   unsigned int  latency_max_ms; /*!< Maximum latency for queries */
   ares_uint64_t total_ms;       /*!< Cumulative query time for bucket */
   ares_uint64_t total_count;    /*!< Number of queries for bucket */
+  unsigned int  hist[ARES_METRICS_HIST_LEN]; /*!< Latency histogram */
 
   time_t        prev_ts;        /*!< Previous period bucket timestamp */
   ares_uint64_t
     prev_total_ms; /*!< Previous period bucket cumulative query time */
   ares_uint64_t prev_total_count; /*!< Previous period bucket query count */
+  unsigned int
+    prev_hist[ARES_METRICS_HIST_LEN]; /*!< Previous period histogram */
 } ares_server_metrics_t;
 
 typedef enum {
@@ -150,6 +162,11 @@ struct ares_server {
                                           * server due to prior failures */
   ares_llist_t         *connections;
   ares_conn_t          *tcp_conn;
+  size_t                udp_next; /* Round-robin position among UDP conns */
+
+  /*! Server sent a UDP answer larger than the advertised EDNS payload size,
+   *  so its datagrams are read individually rather than in batches */
+  ares_bool_t           udp_nobatch;
 
   /* The next time when we will retry this server if it has hit failures */
   ares_timeval_t        next_retry_time;
@@ -157,6 +174,11 @@ struct ares_server {
   /*! Buckets for collecting metrics about the server */
   ares_server_metrics_t metrics[ARES_METRIC_COUNT];
 
+  /*! Exponentially weighted moving average of the response latency in
+   *  microseconds, used for ARES_SERVER_SELECT_LATENCY.  0 until the first
+   *  response. */
+  unsigned int          latency_ewma_us;
+
   /*! RFC 7873/9018 DNS Cookies */
   ares_cookie_t         cookie;
 
@@ -178,6 +200,8 @@ ares_conn_err_t ares_conn_write(ares_conn_t *conn, const void *data, size_t len,
 ares_status_t   ares_conn_flush(ares_conn_t *conn);
 ares_conn_err_t ares_conn_read(ares_conn_t *conn, void *data, size_t len,
                                size_t *read_bytes);
+ares_conn_err_t ares_conn_read_msgs(ares_conn_t *conn, ares_socket_msg_t *msgs,
+                                    size_t cnt, size_t *recvd);
 ares_conn_t *ares_conn_from_fd(const ares_channel_t *channel, ares_socket_t fd);
 void         ares_conn_sock_state_cb_update(ares_conn_t            *conn,
                                             ares_conn_state_flags_t flags);
@@ -394,6 +394,12 @@ ares_status_t ares_cookie_validate(ares_query_t            *query,
     return ARES_SUCCESS;
   }
 
+  /* A hedged request went to two servers, each with its own client cookie,
+   * but only holds the one written last */
+  if (query->hedged) {
+    req_cookie = cookie->client;
+  }
+
   /* If 8-byte prefix for returned cookie doesn't match the requested cookie,
    * drop for spoofing */
   if (resp_cookie && memcmp(req_cookie, resp_cookie, 8) != 0) {
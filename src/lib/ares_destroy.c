@@ -82,6 +82,9 @@ void ares_destroy(ares_channel_t *channel)
     node = next;
   }
 
+  /* Requests the event thread never picked up */
+  ares_submit_cancel(channel, ARES_EDESTRUCTION);
+
   ares_queue_notify_empty(channel);
 
 #ifndef NDEBUG
@@ -90,7 +93,9 @@ void ares_destroy(ares_channel_t *channel)
    */
   assert(ares_llist_len(channel->all_queries) == 0);
   assert(ares_htable_szvp_num_keys(channel->queries_by_qid) == 0);
-  assert(ares_slist_len(channel->queries_by_timeout) == 0);
+  assert(ares_twheel_len(channel->queries_by_timeout) == 0);
+  assert(ares_twheel_len(channel->queries_by_hedge) == 0);
+  assert(ares_twheel_len(channel->queries_by_deadline) == 0);
 #endif
 
   ares_destroy_servers_state(channel);
@@ -115,9 +120,14 @@ void ares_destroy(ares_channel_t *channel)
   }
 
   ares_llist_destroy(channel->all_queries);
-  ares_slist_destroy(channel->queries_by_timeout);
+  ares_twheel_destroy(channel->queries_by_timeout);
+  ares_twheel_destroy(channel->queries_by_hedge);
+  ares_twheel_destroy(channel->queries_by_deadline);
   ares_htable_szvp_destroy(channel->queries_by_qid);
   ares_htable_asvp_destroy(channel->connnode_by_socket);
+  ares_pool_destroy(channel->query_pool);
+  ares_pool_destroy(channel->conn_pool);
+  ares_pool_destroy(channel->node_pool);
 
   ares_free(channel->sortlist);
   ares_free(channel->lookups);
@@ -128,6 +138,9 @@ void ares_destroy(ares_channel_t *channel)
   ares_hosts_file_destroy(channel->hf);
 
   ares_qcache_destroy(channel->qcache);
+  ares_coalesce_destroy(channel->coalesce);
+  ares_submit_destroy(channel->submit);
+  ares_srcaddr_cache_destroy(channel->srcaddr_cache);
 
   ares_channel_threading_destroy(channel);
 
@@ -58,6 +58,19 @@
 
 #include "ares_dns.h"
 
+struct host_query;
+
+/* State for one name of a lookup with ARES_FLAG_PARALLEL_SEARCH */
+struct host_name {
+  struct host_query    *hquery;
+  struct ares_addrinfo *ai;        /* results for this name */
+  unsigned short        qid_a;     /* qid for A request */
+  unsigned short        qid_aaaa;  /* qid for AAAA request */
+  size_t                remaining; /* number of DNS answers waiting for */
+  ares_status_t         status;    /* status of the last answer */
+  ares_status_t         addinfostatus; /* parse status of the last answer */
+};
+
 struct host_query {
   ares_channel_t            *channel;
   char                      *name;
@@ -84,8 +97,28 @@ struct host_query {
 
   /* Track nodata responses to possibly override final result */
   size_t                nodata_cnt;
+
+  /* With ARES_FLAG_PARALLEL_SEARCH every name is queried at once, and
+   * next_name_idx is the next name whose answers are to be considered */
+  struct host_name     *pnames;
+  size_t                refcnt; /* Outstanding queries, plus one while sending */
+  ares_bool_t           done;   /* Callback has been invoked */
+
+  /* ares_getaddrinfo_incremental() delivered the first family's addresses */
+  ares_bool_t           early_sent;
 };
 
+/* RFC 8305 Section 3 recommended Resolution Delay */
+#define RESOLUTION_DELAY_MS 50
+
+/* Argument of ares_getaddrinfo_incremental_cb(), which delivers the final
+ * result to the ares_addrinfo_incremental_callback */
+typedef struct {
+  ares_addrinfo_incremental_callback callback;
+  void                              *arg;
+  unsigned int                       delay_ms;
+} ares_addrinfo_incremental_arg_t;
+
 static const struct ares_addrinfo_hints default_hints = {
   0,         /* ai_flags */
   AF_UNSPEC, /* ai_family */
@@ -95,6 +128,9 @@ static const struct ares_addrinfo_hints default_hints = {
 
 /* forward declarations */
 static ares_bool_t next_dns_lookup(struct host_query *hquery);
+static void        host_parallel_callback(void *arg, ares_status_t status,
+                                          size_t                   timeouts,
+                                          const ares_dns_record_t *dnsrec);
 
 struct ares_addrinfo_cname *
   ares_append_addrinfo_cname(struct ares_addrinfo_cname **head)
@@ -320,33 +356,82 @@ static ares_bool_t fake_addrinfo(const char *name, unsigned short port,
 
 static void hquery_free(struct host_query *hquery, ares_bool_t cleanup_ai)
 {
+  size_t i;
+
   if (cleanup_ai) {
     ares_freeaddrinfo(hquery->ai);
   }
+  if (hquery->pnames != NULL) {
+    for (i = 0; i < hquery->names_cnt; i++) {
+      ares_freeaddrinfo(hquery->pnames[i].ai);
+    }
+    ares_free(hquery->pnames);
+  }
   ares_strsplit_free(hquery->names, hquery->names_cnt);
   ares_free(hquery->name);
   ares_free(hquery->lookups);
   ares_free(hquery);
 }
 
-static void end_hquery(struct host_query *hquery, ares_status_t status)
+static void hquery_release(struct host_query *hquery)
+{
+  hquery->refcnt--;
+  if (hquery->refcnt == 0) {
+    hquery_free(hquery, ARES_TRUE);
+  }
+}
+
+/* A parallel lookup is only freed once all of its answers are in, any still
+ * outstanding are cancelled */
+static void end_hquery_parallel(struct host_query *hquery, ares_status_t status)
+{
+  size_t i;
+
+  hquery->ai   = NULL; /* Now owned by the caller */
+  hquery->done = ARES_TRUE;
+
+  /* The channel is already ending every query */
+  if (status == ARES_ECANCELLED || status == ARES_EDESTRUCTION) {
+    return;
+  }
+
+  for (i = 0; i < hquery->names_cnt; i++) {
+    struct host_name *pname = &hquery->pnames[i];
+    if (pname->remaining) {
+      ares_cancel_query(hquery->channel, pname->qid_a, host_parallel_callback,
+                        pname);
+    }
+    if (pname->remaining) {
+      ares_cancel_query(hquery->channel, pname->qid_aaaa,
+                        host_parallel_callback, pname);
+    }
+  }
+}
+
+static void hquery_sort_ai(const struct host_query *hquery,
+                           struct ares_addrinfo    *ai)
 {
   struct ares_addrinfo_node  sentinel;
   struct ares_addrinfo_node *next;
 
-  if (status == ARES_SUCCESS) {
-    if (!(hquery->hints.ai_flags & ARES_AI_NOSORT) && hquery->ai->nodes) {
-      sentinel.ai_next = hquery->ai->nodes;
-      ares_sortaddrinfo(hquery->channel, &sentinel);
-      hquery->ai->nodes = sentinel.ai_next;
-    }
-    next = hquery->ai->nodes;
+  if (!(hquery->hints.ai_flags & ARES_AI_NOSORT) && ai->nodes) {
+    sentinel.ai_next = ai->nodes;
+    ares_sortaddrinfo(hquery->channel, &sentinel);
+    ai->nodes = sentinel.ai_next;
+  }
+  next = ai->nodes;
 
-    while (next) {
-      next->ai_socktype = hquery->hints.ai_socktype;
-      next->ai_protocol = hquery->hints.ai_protocol;
-      next              = next->ai_next;
-    }
+  while (next) {
+    next->ai_socktype = hquery->hints.ai_socktype;
+    next->ai_protocol = hquery->hints.ai_protocol;
+    next              = next->ai_next;
+  }
+}
+
+static void end_hquery(struct host_query *hquery, ares_status_t status)
+{
+  if (status == ARES_SUCCESS) {
+    hquery_sort_ai(hquery, hquery->ai);
   } else {
     /* Clean up what we have collected by so far. */
     ares_freeaddrinfo(hquery->ai);
@@ -354,6 +439,10 @@ static void end_hquery(struct host_query *hquery, ares_status_t status)
   }
 
   hquery->callback(hquery->arg, (int)status, (int)hquery->timeouts, hquery->ai);
+  if (hquery->pnames != NULL) {
+    end_hquery_parallel(hquery, status);
+    return;
+  }
   hquery_free(hquery, ARES_FALSE);
 }
 
@@ -464,16 +553,15 @@ static void next_lookup(struct host_query *hquery, ares_status_t status)
   }
 }
 
-static void terminate_retries(const struct host_query *hquery,
-                              unsigned short           qid)
+static void terminate_retries(const ares_channel_t *channel,
+                              unsigned short qid_a, unsigned short qid_aaaa,
+                              size_t remaining, unsigned short qid)
 {
-  unsigned short term_qid =
-    (qid == hquery->qid_a) ? hquery->qid_aaaa : hquery->qid_a;
-  const ares_channel_t *channel = hquery->channel;
-  ares_query_t         *query   = NULL;
+  unsigned short term_qid = (qid == qid_a) ? qid_aaaa : qid_a;
+  ares_query_t  *query    = NULL;
 
   /* No other outstanding queries, nothing to do */
-  if (!hquery->remaining) {
+  if (!remaining) {
     return;
   }
 
@@ -497,6 +585,180 @@ static ares_bool_t ai_has_ipv4(struct ares_addrinfo *ai)
   return ARES_FALSE;
 }
 
+static struct ares_addrinfo *ai_dup(const struct ares_addrinfo *src)
+{
+  struct ares_addrinfo             *ai = ares_malloc_zero(sizeof(*ai));
+  const struct ares_addrinfo_cname *cname;
+  const struct ares_addrinfo_node  *node;
+
+  if (ai == NULL) {
+    return NULL; /* LCOV_EXCL_LINE: OutOfMemory */
+  }
+
+  if (src->name != NULL) {
+    ai->name = ares_strdup(src->name);
+    if (ai->name == NULL) {
+      goto fail; /* LCOV_EXCL_LINE: OutOfMemory */
+    }
+  }
+
+  for (cname = src->cnames; cname != NULL; cname = cname->next) {
+    struct ares_addrinfo_cname *c = ares_append_addrinfo_cname(&ai->cnames);
+    if (c == NULL) {
+      goto fail; /* LCOV_EXCL_LINE: OutOfMemory */
+    }
+    c->ttl = cname->ttl;
+    if (cname->alias != NULL) {
+      c->alias = ares_strdup(cname->alias);
+      if (c->alias == NULL) {
+        goto fail; /* LCOV_EXCL_LINE: OutOfMemory */
+      }
+    }
+    if (cname->name != NULL) {
+      c->name = ares_strdup(cname->name);
+      if (c->name == NULL) {
+        goto fail; /* LCOV_EXCL_LINE: OutOfMemory */
+      }
+    }
+  }
+
+  for (node = src->nodes; node != NULL; node = node->ai_next) {
+    struct ares_addrinfo_node *n = ares_append_addrinfo_node(&ai->nodes);
+    if (n == NULL) {
+      goto fail; /* LCOV_EXCL_LINE: OutOfMemory */
+    }
+    n->ai_ttl      = node->ai_ttl;
+    n->ai_flags    = node->ai_flags;
+    n->ai_family   = node->ai_family;
+    n->ai_socktype = node->ai_socktype;
+    n->ai_protocol = node->ai_protocol;
+    n->ai_addr     = ares_malloc((size_t)node->ai_addrlen);
+    if (n->ai_addr == NULL) {
+      goto fail; /* LCOV_EXCL_LINE: OutOfMemory */
+    }
+    memcpy(n->ai_addr, node->ai_addr, (size_t)node->ai_addrlen);
+    n->ai_addrlen = node->ai_addrlen;
+  }
+
+  return ai;
+
+/* LCOV_EXCL_START: OutOfMemory */
+fail:
+  ares_freeaddrinfo(ai);
+  return NULL;
+  /* LCOV_EXCL_STOP */
+}
+
+static void ares_getaddrinfo_incremental_cb(void *arg, int status,
+                                            int                   timeouts,
+                                            struct ares_addrinfo *res)
+{
+  ares_addrinfo_incremental_arg_t *iarg = arg;
+
+  iarg->callback(iarg->arg, status, timeouts, res, ARES_TRUE);
+  ares_free(iarg);
+}
+
+/* For ares_getaddrinfo_incremental(), deliver the addresses of the first
+ * family to answer, and give the query for the other family the resolution
+ * delay to answer before the lookup ends without it.  callback and cbarg are
+ * what the queries of the name were sent with. */
+static void host_early_result(struct host_query          *hquery,
+                              const struct ares_addrinfo *ai,
+                              unsigned short qid_a, unsigned short qid_aaaa,
+                              ares_callback_dnsrec callback, const void *cbarg)
+{
+  const ares_addrinfo_incremental_arg_t *iarg;
+  struct ares_addrinfo                  *early;
+  ares_query_t                          *query;
+
+  if (hquery->callback != ares_getaddrinfo_incremental_cb ||
+      hquery->early_sent || ai->nodes == NULL) {
+    return;
+  }
+
+  iarg               = hquery->arg;
+  hquery->early_sent = ARES_TRUE;
+
+  /* Only the query still awaiting an answer is left to match */
+  query = ares_htable_szvp_get_direct(hquery->channel->queries_by_qid, qid_a);
+  if (query != NULL && ares_query_callback_match(query, callback, cbarg)) {
+    ares_query_set_deadline(query, iarg->delay_ms);
+  }
+  query =
+    ares_htable_szvp_get_direct(hquery->channel->queries_by_qid, qid_aaaa);
+  if (query != NULL && ares_query_callback_match(query, callback, cbarg)) {
+    ares_query_set_deadline(query, iarg->delay_ms);
+  }
+
+  early = ai_dup(ai);
+  if (early == NULL) {
+    return; /* LCOV_EXCL_LINE: OutOfMemory */
+  }
+  hquery_sort_ai(hquery, early);
+
+  /* Must be last, hquery may be gone once the callback returns */
+  iarg->callback(iarg->arg, ARES_SUCCESS, (int)hquery->timeouts, early,
+                 ARES_FALSE);
+}
+
+/* Decide how the lookup goes on once all the answers for a name are in.
+ * Returns ARES_TRUE if the next name should be tried, with *result the status
+ * to carry along, otherwise *result is the status to end the lookup with. */
+static ares_bool_t host_name_next(struct host_query          *hquery,
+                                  const char                 *name,
+                                  const struct ares_addrinfo *ai,
+                                  ares_status_t               status,
+                                  ares_status_t               addinfostatus,
+                                  ares_status_t              *result)
+{
+  if (status == ARES_EDESTRUCTION || status == ARES_ECANCELLED) {
+    /* must make sure we don't do next_lookup() on destroy or cancel,
+     * and return the appropriate status.  We won't return a partial
+     * result in this case. */
+    *result = status;
+    return ARES_FALSE;
+  }
+
+  if (addinfostatus != ARES_SUCCESS && addinfostatus != ARES_ENODATA) {
+    /* error in parsing result e.g. no memory */
+    if (addinfostatus == ARES_EBADRESP && ai->nodes) {
+      /* We got a bad response from server, but at least one query
+       * ended with ARES_SUCCESS */
+      *result = ARES_SUCCESS;
+    } else {
+      *result = addinfostatus;
+    }
+    return ARES_FALSE;
+  }
+
+  if (ai->nodes) {
+    /* at least one query ended with ARES_SUCCESS */
+    *result = ARES_SUCCESS;
+    return ARES_FALSE;
+  }
+
+  if (status == ARES_ENOTFOUND || status == ARES_ENODATA ||
+      addinfostatus == ARES_ENODATA) {
+    if (status == ARES_ENODATA || addinfostatus == ARES_ENODATA) {
+      hquery->nodata_cnt++;
+    }
+    *result = hquery->nodata_cnt ? ARES_ENODATA : status;
+    return ARES_TRUE;
+  }
+
+  if ((status == ARES_ESERVFAIL || status == ARES_EREFUSED) &&
+      ares_name_label_cnt(name) == 1) {
+    /* Issue #852, systemd-resolved may return SERVFAIL or REFUSED on a
+     * single label domain name. */
+    *result = hquery->nodata_cnt ? ARES_ENODATA : status;
+    return ARES_TRUE;
+  }
+
+  *result = status;
+  return ARES_FALSE;
+}
+
 static void host_callback(void *arg, ares_status_t status, size_t timeouts,
                           const ares_dns_record_t *dnsrec)
 {
@@ -533,46 +795,99 @@ static void host_callback(void *arg, ares_status_t status, size_t timeouts,
      * reliable we can drop this ipv4 check.
      */
     if (addinfostatus == ARES_SUCCESS && ai_has_ipv4(hquery->ai)) {
-      terminate_retries(hquery, ares_dns_record_get_id(dnsrec));
+      terminate_retries(hquery->channel, hquery->qid_a, hquery->qid_aaaa,
+                        hquery->remaining, ares_dns_record_get_id(dnsrec));
     }
   }
 
   if (!hquery->remaining) {
-    if (status == ARES_EDESTRUCTION || status == ARES_ECANCELLED) {
-      /* must make sure we don't do next_lookup() on destroy or cancel,
-       * and return the appropriate status.  We won't return a partial
-       * result in this case. */
-      end_hquery(hquery, status);
-    } else if (addinfostatus != ARES_SUCCESS && addinfostatus != ARES_ENODATA) {
-      /* error in parsing result e.g. no memory */
-      if (addinfostatus == ARES_EBADRESP && hquery->ai->nodes) {
-        /* We got a bad response from server, but at least one query
-         * ended with ARES_SUCCESS */
-        end_hquery(hquery, ARES_SUCCESS);
+    ares_status_t result;
+    if (host_name_next(hquery, hquery->names[hquery->next_name_idx - 1],
+                       hquery->ai, status, addinfostatus, &result)) {
+      next_lookup(hquery, result);
+    } else {
+      end_hquery(hquery, result);
+    }
+  } else {
+    host_early_result(hquery, hquery->ai, hquery->qid_a, hquery->qid_aaaa,
+                      host_callback, hquery);
+  }
+
+  /* at this point we keep on waiting for the next query to finish */
+}
+
+/* Consider the answers of a parallel lookup in search order, stopping at the
+ * first name that is still waiting on answers. */
+static void host_parallel_advance(struct host_query *hquery)
+{
+  ares_status_t result = ARES_ENOTFOUND;
+
+  while (hquery->next_name_idx < hquery->names_cnt) {
+    struct host_name     *pname = &hquery->pnames[hquery->next_name_idx];
+    struct ares_addrinfo *ai;
+
+    if (pname->remaining) {
+      host_early_result(hquery, pname->ai, pname->qid_a, pname->qid_aaaa,
+                        host_parallel_callback, pname);
+      return;
+    }
+
+    if (!host_name_next(hquery, hquery->names[hquery->next_name_idx],
+                        pname->ai, pname->status, pname->addinfostatus,
+                        &result)) {
+      /* Hand the results for this name to the lookup */
+      ai         = hquery->ai;
+      hquery->ai = pname->ai;
+      pname->ai  = ai;
+      end_hquery(hquery, result);
+      return;
+    }
+    hquery->next_name_idx++;
+  }
+
+  /* Every name came up empty, carry on with the remaining lookups */
+  next_lookup(hquery, result);
+}
+
+static void host_parallel_callback(void *arg, ares_status_t status,
+                                   size_t                   timeouts,
+                                   const ares_dns_record_t *dnsrec)
+{
+  struct host_name  *pname         = arg;
+  struct host_query *hquery        = pname->hquery;
+  ares_status_t      addinfostatus = ARES_SUCCESS;
+
+  hquery->timeouts += timeouts;
+  pname->remaining--;
+
+  if (!hquery->done) {
+    if (status == ARES_SUCCESS) {
+      if (dnsrec == NULL) {
+        addinfostatus = ARES_EBADRESP; /* LCOV_EXCL_LINE: DefensiveCoding */
       } else {
-        end_hquery(hquery, addinfostatus);
+        addinfostatus =
+          ares_parse_into_addrinfo(dnsrec, ARES_TRUE, hquery->port, pname->ai);
       }
-    } else if (hquery->ai->nodes) {
-      /* at least one query ended with ARES_SUCCESS */
-      end_hquery(hquery, ARES_SUCCESS);
-    } else if (status == ARES_ENOTFOUND || status == ARES_ENODATA ||
-               addinfostatus == ARES_ENODATA) {
-      if (status == ARES_ENODATA || addinfostatus == ARES_ENODATA) {
-        hquery->nodata_cnt++;
+
+      /* See host_callback() */
+      if (addinfostatus == ARES_SUCCESS && ai_has_ipv4(pname->ai)) {
+        terminate_retries(hquery->channel, pname->qid_a, pname->qid_aaaa,
+                          pname->remaining, ares_dns_record_get_id(dnsrec));
       }
-      next_lookup(hquery, hquery->nodata_cnt ? ARES_ENODATA : status);
-    } else if ((status == ARES_ESERVFAIL || status == ARES_EREFUSED) &&
-               ares_name_label_cnt(hquery->names[hquery->next_name_idx - 1]) ==
-                 1) {
-      /* Issue #852, systemd-resolved may return SERVFAIL or REFUSED on a
-       * single label domain name. */
-      next_lookup(hquery, hquery->nodata_cnt ? ARES_ENODATA : status);
-    } else {
-      end_hquery(hquery, status);
+    }
+
+    pname->status        = status;
+    pname->addinfostatus = addinfostatus;
+
+    if (!pname->remaining) {
+      host_parallel_advance(hquery);
+    } else if (pname == &hquery->pnames[hquery->next_name_idx]) {
+      host_early_result(hquery, pname->ai, pname->qid_a, pname->qid_aaaa,
+                        host_parallel_callback, pname);
     }
   }
 
-  /* at this point we keep on waiting for the next query to finish */
+  hquery_release(hquery);
 }
 
 static ares_bool_t numeric_service_to_port(const char *service,
@@ -705,14 +1020,104 @@ void ares_getaddrinfo(ares_channel_t *channel, const char *name,
   ares_channel_unlock(channel);
 }
 
+void ares_getaddrinfo_incremental(ares_channel_t *channel, const char *name,
+                                  const char                       *service,
+                                  const struct ares_addrinfo_hints *hints,
+                                  unsigned int                      delay_ms,
+                                  ares_addrinfo_incremental_callback callback,
+                                  void                              *arg)
+{
+  ares_addrinfo_incremental_arg_t *iarg;
+
+  if (channel == NULL) {
+    return;
+  }
+
+  iarg = ares_malloc(sizeof(*iarg));
+  if (iarg == NULL) {
+    /* LCOV_EXCL_START: OutOfMemory */
+    callback(arg, ARES_ENOMEM, 0, NULL, ARES_TRUE);
+    return;
+    /* LCOV_EXCL_STOP */
+  }
+
+  iarg->callback = callback;
+  iarg->arg      = arg;
+  iarg->delay_ms = delay_ms ? delay_ms : RESOLUTION_DELAY_MS;
+
+  ares_channel_lock(channel);
+  ares_getaddrinfo_int(channel, name, service, hints,
+                       ares_getaddrinfo_incremental_cb, iarg);
+  ares_channel_unlock(channel);
+}
+
+/* Send the queries for every name at once.  The answers are considered in
+ * search order, so the result is the same as trying one name at a time, but a
+ * miss doesn't cost a round trip per name. */
+static void next_dns_lookup_parallel(struct host_query *hquery)
+{
+  size_t i;
+
+  hquery->pnames =
+    ares_malloc_zero(sizeof(*hquery->pnames) * hquery->names_cnt);
+  if (hquery->pnames == NULL) {
+    end_hquery(hquery, ARES_ENOMEM); /* LCOV_EXCL_LINE: OutOfMemory */
+    return;                          /* LCOV_EXCL_LINE: OutOfMemory */
+  }
+
+  /* Hold a reference so answers delivered while sending (such as from the
+   * cache) can't free the lookup */
+  hquery->refcnt = 1;
+
+  for (i = 0; i < hquery->names_cnt; i++) {
+    struct host_name *pname = &hquery->pnames[i];
+
+    pname->hquery    = hquery;
+    pname->remaining = (hquery->hints.ai_family == AF_UNSPEC) ? 2 : 1;
+    pname->ai        = ares_malloc_zero(sizeof(*pname->ai));
+    if (pname->ai == NULL) {
+      /* LCOV_EXCL_START: OutOfMemory */
+      end_hquery(hquery, ARES_ENOMEM);
+      hquery_release(hquery);
+      return;
+      /* LCOV_EXCL_STOP */
+    }
+  }
+
+  for (i = 0; i < hquery->names_cnt && !hquery->done; i++) {
+    struct host_name *pname = &hquery->pnames[i];
+    const char       *name  = hquery->names[i];
+
+    if (hquery->hints.ai_family != AF_INET6) {
+      hquery->refcnt++;
+      ares_query_nolock(hquery->channel, name, ARES_CLASS_IN, ARES_REC_TYPE_A,
+                        host_parallel_callback, pname, &pname->qid_a);
+    }
+    if (hquery->hints.ai_family != AF_INET && !hquery->done) {
+      hquery->refcnt++;
+      ares_query_nolock(hquery->channel, name, ARES_CLASS_IN,
+                        ARES_REC_TYPE_AAAA, host_parallel_callback, pname,
+                        &pname->qid_aaaa);
+    }
+  }
+
+  hquery_release(hquery);
+}
+
 static ares_bool_t next_dns_lookup(struct host_query *hquery)
 {
   const char *name = NULL;
 
-  if (hquery->next_name_idx >= hquery->names_cnt) {
+  if (hquery->next_name_idx >= hquery->names_cnt || hquery->pnames != NULL) {
     return ARES_FALSE;
   }
 
+  if (hquery->channel->flags & ARES_FLAG_PARALLEL_SEARCH &&
+      hquery->names_cnt > 1) {
+    next_dns_lookup_parallel(hquery);
+    return ARES_TRUE;
+  }
+
   name = hquery->names[hquery->next_name_idx++];
 
   /* NOTE: hquery may be invalidated during the call to ares_query_qid(),
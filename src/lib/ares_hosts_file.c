@@ -24,6 +24,7 @@
  * SPDX-License-Identifier: MIT
  */
 #include "ares_private.h"
+#include "dsa/ares_htable.h"
 #ifdef HAVE_SYS_TYPES_H
 #  include <sys/types.h>
 #endif
@@ -46,6 +47,9 @@
 #  define WIN_PATH_HOSTS       "\\hosts"
 #endif
 
+/* How often a hosts file watched for changes is still checked, at most */
+#define ARES_HOSTS_WATCHED_CHECK_MS 60000
+
 /* HOSTS FILE PROCESSING OVERVIEW
  * ==============================
  * The hosts file on the system contains static entries to be processed locally
@@ -56,9 +60,16 @@
  * We are caching the entire parsed hosts file for performance reasons.  Some
  * files may be quite sizable and as per Issue #458 can approach 1/2MB in size,
  * and the parse overhead on a rapid succession of queries can be quite large.
- * The entries are stored in forwards and backwards hashtables so we can get
- * O(1) performance on lookup.  The file is cached until the file modification
- * timestamp changes.
+ * Block lists can even have hundreds of thousands of entries.  The file is
+ * cached until the file modification timestamp changes.
+ *
+ * Since every address and every hostname can only belong to a single entry,
+ * the cache stores exactly one small record per unique address and per unique
+ * hostname in flat arrays, chained together per entry by index.  Hostnames are
+ * interned into a single buffer.  Forwards and backwards lookups use open
+ * addressing indexes over the records so we get O(1) performance on lookup
+ * without per-node allocations, which keeps the parse time and memory usage
+ * proportional to the number of unique names.
  *
  * The hosts file processing is quite unique. It has to merge all related hosts
  * and ips into a single entry due to file formatting requirements.  For
@@ -81,23 +92,71 @@
  * since they are related.  It is unlikely this will matter in the real world.
  */
 
+/*! Sentinel for "no record" in the index and record chains */
+#define ARES_HOSTS_NONE 0xFFFFFFFFU
+
+/*! Slot in an open addressing index.  The hash is stored so probing rarely
+ *  needs to look at the record, and growing never does. */
+typedef struct {
+  unsigned int hash;
+  unsigned int rec;
+} ares_hosts_slot_t;
+
+/*! Open addressing (linear probing) index of records, kept at most half full
+ */
+typedef struct {
+  ares_hosts_slot_t *slots;
+  size_t             size; /*!< Power of 2 */
+  size_t             cnt;
+} ares_hosts_index_t;
+
+/*! Address record, there is only ever one per unique address */
+typedef struct {
+  struct ares_addr addr;
+  unsigned int     entry; /*!< Owning entry */
+  unsigned int     next;  /*!< Next address of the same entry */
+} ares_hosts_ip_t;
+
+/*! Hostname record, there is only ever one per unique hostname */
+typedef struct {
+  unsigned int name;  /*!< Offset of the interned name in names */
+  unsigned int entry; /*!< Owning entry */
+  unsigned int next;  /*!< Next hostname of the same entry */
+} ares_hosts_name_t;
+
 struct ares_hosts_file {
-  time_t               ts;
+  time_t             ts;
   /*! cache the filename so we know if the filename changes it automatically
    *  invalidates the cache */
-  char                *filename;
-  /*! iphash is the owner of the 'entry' object as there is only ever a single
-   *  match to the object. */
-  ares_htable_strvp_t *iphash;
-  /*! hosthash does not own the entry so won't free on destruction */
-  ares_htable_strvp_t *hosthash;
+  char              *filename;
+  /*! Whether the filename came from the CARES_HOSTS environment variable */
+  ares_bool_t        use_env;
+  /*! Changes are signalled via ares_hosts_file_changed() so the file only
+   *  needs an occasional stat() in case a change wasn't reported */
+  ares_bool_t        watched;
+  /*! Don't stat() the file again until this time */
+  ares_timeval_t     next_check;
+  unsigned int       seed;
+  /*! Interned hostnames, each NULL terminated */
+  ares_buf_t        *names;
+  /*! Array of ares_hosts_entry_t */
+  ares_array_t      *entries;
+  /*! Array of ares_hosts_ip_t */
+  ares_array_t      *ips;
+  /*! Array of ares_hosts_name_t */
+  ares_array_t      *hosts;
+  ares_hosts_index_t ipidx;
+  ares_hosts_index_t hostidx;
 };
 
+/*! Group of related addresses and hostnames, the records are chained in the
+ *  order they were seen in the file */
 struct ares_hosts_entry {
-  size_t        refcnt; /*! If the entry is stored multiple times in the
-                         *  ip address hash, we have to reference count it */
-  ares_llist_t *ips;
-  ares_llist_t *hosts;
+  const ares_hosts_file_t *hf;
+  unsigned int             ips;
+  unsigned int             ips_last;
+  unsigned int             hosts;
+  unsigned int             hosts_last;
 };
 
 const void *ares_dns_pton(const char *ipaddr, struct ares_addr *addr,
@@ -136,53 +195,6 @@ const void *ares_dns_pton(const char *ipaddr, struct ares_addr *addr,
   return ptr;
 }
 
-static ares_bool_t ares_normalize_ipaddr(const char *ipaddr, char *out,
-                                         size_t out_len)
-{
-  struct ares_addr data;
-  const void      *addr;
-  size_t           addr_len = 0;
-
-  memset(&data, 0, sizeof(data));
-  data.family = AF_UNSPEC;
-
-  addr = ares_dns_pton(ipaddr, &data, &addr_len);
-  if (addr == NULL) {
-    return ARES_FALSE;
-  }
-
-  if (!ares_inet_ntop(data.family, addr, out, (ares_socklen_t)out_len)) {
-    return ARES_FALSE; /* LCOV_EXCL_LINE: DefensiveCoding */
-  }
-
-  return ARES_TRUE;
-}
-
-static void ares_hosts_entry_destroy(ares_hosts_entry_t *entry)
-{
-  if (entry == NULL) {
-    return;
-  }
-
-  /* Honor reference counting */
-  if (entry->refcnt != 0) {
-    entry->refcnt--;
-  }
-
-  if (entry->refcnt > 0) {
-    return;
-  }
-
-  ares_llist_destroy(entry->hosts);
-  ares_llist_destroy(entry->ips);
-  ares_free(entry);
-}
-
-static void ares_hosts_entry_destroy_cb(void *entry)
-{
-  ares_hosts_entry_destroy(entry);
-}
-
 void ares_hosts_file_destroy(ares_hosts_file_t *hf)
 {
   if (hf == NULL) {
@@ -190,8 +202,12 @@ void ares_hosts_file_destroy(ares_hosts_file_t *hf)
   }
 
   ares_free(hf->filename);
-  ares_htable_strvp_destroy(hf->hosthash);
-  ares_htable_strvp_destroy(hf->iphash);
+  ares_buf_destroy(hf->names);
+  ares_array_destroy(hf->entries);
+  ares_array_destroy(hf->ips);
+  ares_array_destroy(hf->hosts);
+  ares_free(hf->ipidx.slots);
+  ares_free(hf->hostidx.slots);
   ares_free(hf);
 }
 
@@ -204,18 +220,22 @@ static ares_hosts_file_t *ares_hosts_file_create(const char *filename)
 
   hf->ts = time(NULL);
 
+  /* Names come from the file which may not be under the user's control (such
+   * as downloaded block lists), so don't use a predictable hash seed */
+  hf->seed = (unsigned int)((size_t)hf & 0xFFFFFFFF) |
+             (unsigned int)(((ares_uint64_t)hf->ts) & 0xFFFFFFFF);
+
   hf->filename = ares_strdup(filename);
   if (hf->filename == NULL) {
     goto fail;
   }
 
-  hf->iphash = ares_htable_strvp_create(ares_hosts_entry_destroy_cb);
-  if (hf->iphash == NULL) {
-    goto fail;
-  }
-
-  hf->hosthash = ares_htable_strvp_create(NULL);
-  if (hf->hosthash == NULL) {
+  hf->names   = ares_buf_create();
+  hf->entries = ares_array_create(sizeof(ares_hosts_entry_t), NULL);
+  hf->ips     = ares_array_create(sizeof(ares_hosts_ip_t), NULL);
+  hf->hosts   = ares_array_create(sizeof(ares_hosts_name_t), NULL);
+  if (hf->names == NULL || hf->entries == NULL || hf->ips == NULL ||
+      hf->hosts == NULL) {
     goto fail;
   }
 
@@ -226,289 +246,397 @@ fail:
   return NULL;
 }
 
-typedef enum {
-  ARES_MATCH_NONE   = 0,
-  ARES_MATCH_IPADDR = 1,
-  ARES_MATCH_HOST   = 2
-} ares_hosts_file_match_t;
-
-static ares_status_t ares_hosts_file_merge_entry(
-  const ares_hosts_file_t *hf, ares_hosts_entry_t *existing,
-  ares_hosts_entry_t *entry, ares_hosts_file_match_t matchtype)
+static ares_status_t ares_hosts_index_insert(ares_hosts_index_t *idx,
+                                             unsigned int        hash,
+                                             unsigned int        rec)
 {
-  ares_llist_node_t *node;
+  size_t mask;
+  size_t i;
+
+  if ((idx->cnt + 1) * 2 > idx->size) {
+    ares_hosts_slot_t *slots;
+    size_t             size = idx->size ? idx->size * 2 : 64;
+
+    slots = ares_malloc(size * sizeof(*slots));
+    if (slots == NULL) {
+      return ARES_ENOMEM;
+    }
+    memset(slots, 0xFF, size * sizeof(*slots));
 
-  /* If we matched on IP address, we know there can only be 1, so there's no
-   * reason to do anything */
-  if (matchtype != ARES_MATCH_IPADDR) {
-    while ((node = ares_llist_node_first(entry->ips)) != NULL) {
-      const char *ipaddr = ares_llist_node_val(node);
+    mask = size - 1;
+    for (i = 0; i < idx->size; i++) {
+      size_t j;
 
-      if (ares_htable_strvp_get_direct(hf->iphash, ipaddr) != NULL) {
-        ares_llist_node_destroy(node);
+      if (idx->slots[i].rec == ARES_HOSTS_NONE) {
         continue;
       }
 
-      ares_llist_node_mvparent_last(node, existing->ips);
+      j = idx->slots[i].hash & mask;
+      while (slots[j].rec != ARES_HOSTS_NONE) {
+        j = (j + 1) & mask;
+      }
+      slots[j] = idx->slots[i];
     }
+
+    ares_free(idx->slots);
+    idx->slots = slots;
+    idx->size  = size;
   }
 
+  mask = idx->size - 1;
+  i    = hash & mask;
+  while (idx->slots[i].rec != ARES_HOSTS_NONE) {
+    i = (i + 1) & mask;
+  }
+
+  idx->slots[i].hash = hash;
+  idx->slots[i].rec  = rec;
+  idx->cnt++;
+  return ARES_SUCCESS;
+}
 
-  while ((node = ares_llist_node_first(entry->hosts)) != NULL) {
-    const char *hostname = ares_llist_node_val(node);
+static size_t ares_hosts_addr_len(const struct ares_addr *addr)
+{
+  return addr->family == AF_INET ? sizeof(addr->addr.addr4)
+                                 : sizeof(addr->addr.addr6);
+}
 
-    if (ares_htable_strvp_get_direct(hf->hosthash, hostname) != NULL) {
-      ares_llist_node_destroy(node);
-      continue;
-    }
+static unsigned int ares_hosts_ip_hash(const ares_hosts_file_t *hf,
+                                       const struct ares_addr  *addr)
+{
+  return ares_htable_hash_FNV1a((const unsigned char *)&addr->addr,
+                                ares_hosts_addr_len(addr),
+                                hf->seed ^ (unsigned int)addr->family);
+}
 
-    ares_llist_node_mvparent_last(node, existing->hosts);
-  }
+static unsigned int ares_hosts_name_hash(const ares_hosts_file_t *hf,
+                                         const char              *name)
+{
+  return ares_htable_hash_FNV1a_casecmp((const unsigned char *)name,
+                                        ares_strlen(name), hf->seed);
+}
 
-  ares_hosts_entry_destroy(entry);
-  return ARES_SUCCESS;
+static const char *ares_hosts_name_str(const ares_hosts_file_t *hf,
+                                       const ares_hosts_name_t *rec)
+{
+  size_t len;
+  return (const char *)ares_buf_peek(hf->names, &len) + rec->name;
 }
 
-static ares_hosts_file_match_t
-  ares_hosts_file_match(const ares_hosts_file_t *hf, ares_hosts_entry_t *entry,
-                        ares_hosts_entry_t **match)
+static unsigned int ares_hosts_ip_find(const ares_hosts_file_t *hf,
+                                       const struct ares_addr  *addr,
+                                       unsigned int             hash)
 {
-  ares_llist_node_t *node;
-  *match = NULL;
+  size_t mask = hf->ipidx.size - 1;
+  size_t i;
 
-  for (node = ares_llist_node_first(entry->ips); node != NULL;
-       node = ares_llist_node_next(node)) {
-    const char *ipaddr = ares_llist_node_val(node);
-    *match             = ares_htable_strvp_get_direct(hf->iphash, ipaddr);
-    if (*match != NULL) {
-      return ARES_MATCH_IPADDR;
-    }
+  if (hf->ipidx.size == 0) {
+    return ARES_HOSTS_NONE;
   }
 
-  for (node = ares_llist_node_first(entry->hosts); node != NULL;
-       node = ares_llist_node_next(node)) {
-    const char *host = ares_llist_node_val(node);
-    *match           = ares_htable_strvp_get_direct(hf->hosthash, host);
-    if (*match != NULL) {
-      return ARES_MATCH_HOST;
+  for (i = hash & mask; hf->ipidx.slots[i].rec != ARES_HOSTS_NONE;
+       i = (i + 1) & mask) {
+    const ares_hosts_ip_t *rec;
+
+    if (hf->ipidx.slots[i].hash != hash) {
+      continue;
+    }
+
+    rec = ares_array_at_const(hf->ips, hf->ipidx.slots[i].rec);
+    if (rec->addr.family == addr->family &&
+        memcmp(&rec->addr.addr, &addr->addr, ares_hosts_addr_len(addr)) ==
+          0) {
+      return hf->ipidx.slots[i].rec;
     }
   }
 
-  return ARES_MATCH_NONE;
+  return ARES_HOSTS_NONE;
 }
 
-/*! entry is invalidated upon calling this function, always, even on error */
-static ares_status_t ares_hosts_file_add(ares_hosts_file_t  *hosts,
-                                         ares_hosts_entry_t *entry)
+static unsigned int ares_hosts_name_find(const ares_hosts_file_t *hf,
+                                         const char              *name,
+                                         unsigned int             hash)
 {
-  ares_hosts_entry_t     *match  = NULL;
-  ares_status_t           status = ARES_SUCCESS;
-  ares_llist_node_t      *node;
-  ares_hosts_file_match_t matchtype;
-  size_t                  num_hostnames;
+  size_t mask = hf->hostidx.size - 1;
+  size_t i;
 
-  /* Record the number of hostnames in this entry file.  If we merge into an
-   * existing record, these will be *appended* to the entry, so we'll count
-   * backwards when adding to the hosts hashtable */
-  num_hostnames = ares_llist_len(entry->hosts);
+  if (hf->hostidx.size == 0) {
+    return ARES_HOSTS_NONE;
+  }
 
-  matchtype = ares_hosts_file_match(hosts, entry, &match);
+  for (i = hash & mask; hf->hostidx.slots[i].rec != ARES_HOSTS_NONE;
+       i = (i + 1) & mask) {
+    const ares_hosts_name_t *rec;
 
-  if (matchtype != ARES_MATCH_NONE) {
-    status = ares_hosts_file_merge_entry(hosts, match, entry, matchtype);
-    if (status != ARES_SUCCESS) {
-      ares_hosts_entry_destroy(entry); /* LCOV_EXCL_LINE: DefensiveCoding */
-      return status;                   /* LCOV_EXCL_LINE: DefensiveCoding */
+    if (hf->hostidx.slots[i].hash != hash) {
+      continue;
+    }
+
+    rec = ares_array_at_const(hf->hosts, hf->hostidx.slots[i].rec);
+    if (ares_strcaseeq(ares_hosts_name_str(hf, rec), name)) {
+      return hf->hostidx.slots[i].rec;
     }
-    /* entry was invalidated above by merging */
-    entry = match;
   }
 
-  if (matchtype != ARES_MATCH_IPADDR) {
-    const char *ipaddr = ares_llist_last_val(entry->ips);
+  return ARES_HOSTS_NONE;
+}
 
-    if (!ares_htable_strvp_get(hosts->iphash, ipaddr, NULL)) {
-      if (!ares_htable_strvp_insert(hosts->iphash, ipaddr, entry)) {
-        ares_hosts_entry_destroy(entry);
-        return ARES_ENOMEM;
-      }
-      entry->refcnt++;
-    }
+static ares_status_t ares_hosts_entry_create(ares_hosts_file_t *hf,
+                                             unsigned int      *entry_idx)
+{
+  ares_hosts_entry_t *entry = NULL;
+  ares_status_t       status;
+
+  *entry_idx = (unsigned int)ares_array_len(hf->entries);
+
+  status = ares_array_insert_last((void **)&entry, hf->entries);
+  if (status != ARES_SUCCESS) {
+    return status;
   }
 
-  /* Go backwards, on a merge, hostnames are appended.  Breakout once we've
-   * consumed all the hosts that we appended */
-  for (node = ares_llist_node_last(entry->hosts); node != NULL;
-       node = ares_llist_node_prev(node)) {
-    const char *val = ares_llist_node_val(node);
+  entry->hf         = hf;
+  entry->ips        = ARES_HOSTS_NONE;
+  entry->ips_last   = ARES_HOSTS_NONE;
+  entry->hosts      = ARES_HOSTS_NONE;
+  entry->hosts_last = ARES_HOSTS_NONE;
+  return ARES_SUCCESS;
+}
 
-    if (num_hostnames == 0) {
-      break;
-    }
+static ares_status_t ares_hosts_ip_add(ares_hosts_file_t      *hf,
+                                       unsigned int            entry_idx,
+                                       const struct ares_addr *addr,
+                                       unsigned int            hash)
+{
+  ares_hosts_entry_t *entry;
+  ares_hosts_ip_t    *rec = NULL;
+  unsigned int        idx = (unsigned int)ares_array_len(hf->ips);
+  ares_status_t       status;
 
-    num_hostnames--;
+  status = ares_array_insert_last((void **)&rec, hf->ips);
+  if (status != ARES_SUCCESS) {
+    return status;
+  }
 
-    /* first hostname match wins.  If we detect a duplicate hostname for another
-     * ip it will automatically be added to the same entry */
-    if (ares_htable_strvp_get(hosts->hosthash, val, NULL)) {
-      continue;
-    }
+  rec->addr  = *addr;
+  rec->entry = entry_idx;
+  rec->next  = ARES_HOSTS_NONE;
 
-    if (!ares_htable_strvp_insert(hosts->hosthash, val, entry)) {
-      return ARES_ENOMEM;
-    }
+  entry = ares_array_at(hf->entries, entry_idx);
+  if (entry->ips_last == ARES_HOSTS_NONE) {
+    entry->ips = idx;
+  } else {
+    ares_hosts_ip_t *last = ares_array_at(hf->ips, entry->ips_last);
+    last->next            = idx;
   }
+  entry->ips_last = idx;
 
-  return ARES_SUCCESS;
+  return ares_hosts_index_insert(&hf->ipidx, hash, idx);
 }
 
-static ares_bool_t ares_hosts_entry_isdup(ares_hosts_entry_t *entry,
-                                          const char         *host)
+static ares_status_t ares_hosts_name_add(ares_hosts_file_t *hf,
+                                         unsigned int       entry_idx,
+                                         const char *name, unsigned int hash)
 {
-  ares_llist_node_t *node;
+  ares_hosts_entry_t *entry;
+  ares_hosts_name_t  *rec = NULL;
+  unsigned int        idx = (unsigned int)ares_array_len(hf->hosts);
+  size_t              offset;
+  ares_status_t       status;
 
-  for (node = ares_llist_node_first(entry->ips); node != NULL;
-       node = ares_llist_node_next(node)) {
-    const char *myhost = ares_llist_node_val(node);
-    if (ares_strcaseeq(myhost, host)) {
-      return ARES_TRUE;
-    }
+  /* Intern the name, including the NULL terminator */
+  offset = ares_buf_len(hf->names);
+  status = ares_buf_append(hf->names, (const unsigned char *)name,
+                           ares_strlen(name) + 1);
+  if (status != ARES_SUCCESS) {
+    return status;
   }
 
-  return ARES_FALSE;
+  status = ares_array_insert_last((void **)&rec, hf->hosts);
+  if (status != ARES_SUCCESS) {
+    return status;
+  }
+
+  rec->name  = (unsigned int)offset;
+  rec->entry = entry_idx;
+  rec->next  = ARES_HOSTS_NONE;
+
+  entry = ares_array_at(hf->entries, entry_idx);
+  if (entry->hosts_last == ARES_HOSTS_NONE) {
+    entry->hosts = idx;
+  } else {
+    ares_hosts_name_t *last = ares_array_at(hf->hosts, entry->hosts_last);
+    last->next              = idx;
+  }
+  entry->hosts_last = idx;
+
+  return ares_hosts_index_insert(&hf->hostidx, hash, idx);
 }
 
-static ares_status_t ares_parse_hosts_hostnames(ares_buf_t         *buf,
-                                                ares_hosts_entry_t *entry)
+/*! Fetch the next hostname on the current line.  hostname is set to an empty
+ *  string for tokens that are not valid hostnames and should be skipped.
+ *  Returns ARES_ENOTFOUND at the end of the line, and ARES_EBADSTR if the token
+ *  could not be read at all */
+static ares_status_t ares_parse_hosts_hostname(ares_buf_t *buf, char *hostname,
+                                               size_t hostname_len)
 {
-  entry->hosts = ares_llist_create(ares_free);
-  if (entry->hosts == NULL) {
-    return ARES_ENOMEM;
+  unsigned char comment = '#';
+
+  ares_buf_consume_whitespace(buf, ARES_FALSE);
+
+  if (ares_buf_len(buf) == 0) {
+    return ARES_ENOTFOUND;
   }
 
-  /* Parse hostnames and aliases */
-  while (ares_buf_len(buf)) {
-    char          hostname[256];
-    char         *temp;
-    ares_status_t status;
-    unsigned char comment = '#';
+  /* See if it is a comment, if so stop processing */
+  if (ares_buf_begins_with(buf, &comment, 1)) {
+    return ARES_ENOTFOUND;
+  }
 
-    ares_buf_consume_whitespace(buf, ARES_FALSE);
+  ares_buf_tag(buf);
 
-    if (ares_buf_len(buf) == 0) {
-      break;
-    }
+  /* Must be at end of line */
+  if (ares_buf_consume_nonwhitespace(buf) == 0) {
+    return ARES_ENOTFOUND;
+  }
 
-    /* See if it is a comment, if so stop processing */
-    if (ares_buf_begins_with(buf, &comment, 1)) {
-      break;
-    }
+  if (ares_buf_tag_fetch_string(buf, hostname, hostname_len) != ARES_SUCCESS) {
+    return ARES_EBADSTR;
+  }
 
-    ares_buf_tag(buf);
+  /* Validate it is a valid hostname characterset */
+  if (!ares_is_hostname(hostname)) {
+    hostname[0] = 0;
+  }
 
-    /* Must be at end of line */
-    if (ares_buf_consume_nonwhitespace(buf) == 0) {
-      break;
-    }
+  return ARES_SUCCESS;
+}
 
-    status = ares_buf_tag_fetch_string(buf, hostname, sizeof(hostname));
+/*! Parse the hostnames for an address and merge them into the index.  This is
+ *  done in two passes over the line, the first to find an existing entry the
+ *  line relates to and the second to add anything not yet known to it. */
+static ares_status_t ares_parse_hosts_hostnames(ares_hosts_file_t      *hf,
+                                                ares_buf_t             *buf,
+                                                const struct ares_addr *addr)
+{
+  char          hostname[256];
+  size_t        start     = ares_buf_get_position(buf);
+  size_t        cnt       = 0;
+  unsigned int  ip_hash   = ares_hosts_ip_hash(hf, addr);
+  unsigned int  entry_idx = ARES_HOSTS_NONE;
+  unsigned int  rec_idx;
+  ares_status_t status;
+
+  /* If we matched on IP address, we know there can only be 1 */
+  rec_idx = ares_hosts_ip_find(hf, addr, ip_hash);
+  if (rec_idx != ARES_HOSTS_NONE) {
+    entry_idx = ((const ares_hosts_ip_t *)ares_array_at_const(hf->ips, rec_idx))
+                  ->entry;
+  }
+
+  while ((status = ares_parse_hosts_hostname(buf, hostname,
+                                             sizeof(hostname))) !=
+         ARES_ENOTFOUND) {
+    /* Bad entry, just ignore as long as its not the first.  If its the first,
+     * it must be valid */
     if (status != ARES_SUCCESS) {
-      /* Bad entry, just ignore as long as its not the first.  If its the first,
-       * it must be valid */
-      if (ares_llist_len(entry->hosts) == 0) {
+      if (cnt == 0) {
         return ARES_EBADSTR;
       }
-
       continue;
     }
 
-    /* Validate it is a valid hostname characterset */
-    if (!ares_is_hostname(hostname)) {
+    if (hostname[0] == 0) {
       continue;
     }
 
-    /* Don't add a duplicate to the same entry */
-    if (ares_hosts_entry_isdup(entry, hostname)) {
-      continue;
+    cnt++;
+
+    if (entry_idx == ARES_HOSTS_NONE) {
+      rec_idx =
+        ares_hosts_name_find(hf, hostname, ares_hosts_name_hash(hf, hostname));
+      if (rec_idx != ARES_HOSTS_NONE) {
+        entry_idx = ((const ares_hosts_name_t *)ares_array_at_const(hf->hosts,
+                                                                    rec_idx))
+                      ->entry;
+      }
     }
+  }
 
-    /* Add to list */
-    temp = ares_strdup(hostname);
-    if (temp == NULL) {
-      return ARES_ENOMEM;
+  /* Must have at least 1 entry */
+  if (cnt == 0) {
+    return ARES_EBADSTR;
+  }
+
+  if (entry_idx == ARES_HOSTS_NONE) {
+    status = ares_hosts_entry_create(hf, &entry_idx);
+    if (status != ARES_SUCCESS) {
+      return status;
     }
+  }
 
-    if (ares_llist_insert_last(entry->hosts, temp) == NULL) {
-      ares_free(temp);
-      return ARES_ENOMEM;
+  if (ares_hosts_ip_find(hf, addr, ip_hash) == ARES_HOSTS_NONE) {
+    status = ares_hosts_ip_add(hf, entry_idx, addr, ip_hash);
+    if (status != ARES_SUCCESS) {
+      return status;
     }
   }
 
-  /* Must have at least 1 entry */
-  if (ares_llist_len(entry->hosts) == 0) {
-    return ARES_EBADSTR;
+  /* first hostname match wins.  If we detect a duplicate hostname for another
+   * ip it will automatically be added to the same entry */
+  ares_buf_set_position(buf, start);
+  while ((status = ares_parse_hosts_hostname(buf, hostname,
+                                             sizeof(hostname))) !=
+         ARES_ENOTFOUND) {
+    unsigned int hash;
+
+    if (status != ARES_SUCCESS || hostname[0] == 0) {
+      continue;
+    }
+
+    hash = ares_hosts_name_hash(hf, hostname);
+    if (ares_hosts_name_find(hf, hostname, hash) != ARES_HOSTS_NONE) {
+      continue;
+    }
+
+    status = ares_hosts_name_add(hf, entry_idx, hostname, hash);
+    if (status != ARES_SUCCESS) {
+      return status;
+    }
   }
 
   return ARES_SUCCESS;
 }
 
-static ares_status_t ares_parse_hosts_ipaddr(ares_buf_t          *buf,
-                                             ares_hosts_entry_t **entry_out)
+static ares_status_t ares_parse_hosts_ipaddr(ares_buf_t       *buf,
+                                             struct ares_addr *addr)
 {
-  char                addr[INET6_ADDRSTRLEN];
-  char               *temp;
-  ares_hosts_entry_t *entry = NULL;
-  ares_status_t       status;
-
-  *entry_out = NULL;
+  char          ipaddr[INET6_ADDRSTRLEN];
+  size_t        addr_len = 0;
+  ares_status_t status;
 
   ares_buf_tag(buf);
   ares_buf_consume_nonwhitespace(buf);
-  status = ares_buf_tag_fetch_string(buf, addr, sizeof(addr));
+  status = ares_buf_tag_fetch_string(buf, ipaddr, sizeof(ipaddr));
   if (status != ARES_SUCCESS) {
     return status;
   }
 
-  /* Validate and normalize the ip address format */
-  if (!ares_normalize_ipaddr(addr, addr, sizeof(addr))) {
+  /* Validate the ip address format */
+  memset(addr, 0, sizeof(*addr));
+  addr->family = AF_UNSPEC;
+  if (ares_dns_pton(ipaddr, addr, &addr_len) == NULL) {
     return ARES_EBADSTR;
   }
 
-  entry = ares_malloc_zero(sizeof(*entry));
-  if (entry == NULL) {
-    return ARES_ENOMEM;
-  }
-
-  entry->ips = ares_llist_create(ares_free);
-  if (entry->ips == NULL) {
-    ares_hosts_entry_destroy(entry);
-    return ARES_ENOMEM;
-  }
-
-  temp = ares_strdup(addr);
-  if (temp == NULL) {
-    ares_hosts_entry_destroy(entry);
-    return ARES_ENOMEM;
-  }
-
-  if (ares_llist_insert_first(entry->ips, temp) == NULL) {
-    ares_free(temp);
-    ares_hosts_entry_destroy(entry);
-    return ARES_ENOMEM;
-  }
-
-  *entry_out = entry;
-
   return ARES_SUCCESS;
 }
 
 static ares_status_t ares_parse_hosts(const char         *filename,
                                       ares_hosts_file_t **out)
 {
-  ares_buf_t         *buf    = NULL;
-  ares_status_t       status = ARES_EBADRESP;
-  ares_hosts_file_t  *hf     = NULL;
-  ares_hosts_entry_t *entry  = NULL;
+  ares_buf_t        *buf    = NULL;
+  ares_status_t      status = ARES_EBADRESP;
+  ares_hosts_file_t *hf     = NULL;
 
   *out = NULL;
 
@@ -530,7 +658,8 @@ static ares_status_t ares_parse_hosts(const char         *filename,
   }
 
   while (ares_buf_len(buf)) {
-    unsigned char comment = '#';
+    unsigned char    comment = '#';
+    struct ares_addr addr;
 
     /* -- Start of new line here -- */
 
@@ -548,10 +677,7 @@ static ares_status_t ares_parse_hosts(const char         *filename,
     }
 
     /* Pull off ip address */
-    status = ares_parse_hosts_ipaddr(buf, &entry);
-    if (status == ARES_ENOMEM) {
-      goto done;
-    }
+    status = ares_parse_hosts_ipaddr(buf, &addr);
     if (status != ARES_SUCCESS) {
       /* Bad line, consume and go onto next */
       ares_buf_consume_line(buf, ARES_TRUE);
@@ -559,32 +685,18 @@ static ares_status_t ares_parse_hosts(const char         *filename,
     }
 
     /* Parse of the hostnames */
-    status = ares_parse_hosts_hostnames(buf, entry);
+    status = ares_parse_hosts_hostnames(hf, buf, &addr);
     if (status == ARES_ENOMEM) {
       goto done;
-    } else if (status != ARES_SUCCESS) {
-      /* Bad line, consume and go onto next */
-      ares_hosts_entry_destroy(entry);
-      entry = NULL;
-      ares_buf_consume_line(buf, ARES_TRUE);
-      continue;
-    }
-
-    /* Append the successful entry to the hosts file */
-    status = ares_hosts_file_add(hf, entry);
-    entry  = NULL; /* is always invalidated by this function, even on error */
-    if (status != ARES_SUCCESS) {
-      goto done;
     }
 
-    /* Go to next line */
+    /* Go to next line, also skips a bad line */
     ares_buf_consume_line(buf, ARES_TRUE);
   }
 
   status = ARES_SUCCESS;
 
 done:
-  ares_hosts_entry_destroy(entry);
   ares_buf_destroy(buf);
   if (status != ARES_SUCCESS) {
     ares_hosts_file_destroy(hf);
@@ -692,26 +804,91 @@ static ares_status_t ares_hosts_path(const ares_channel_t *channel,
   return ARES_SUCCESS;
 }
 
+void ares_hosts_file_changed(ares_channel_t *channel)
+{
+  ares_channel_lock(channel);
+  channel->hosts_changed = ARES_TRUE;
+  ares_channel_unlock(channel);
+}
+
+/* Whether we need to resolve the path and stat() the file to determine if
+ * the cached copy is still current */
+static ares_bool_t ares_hosts_check_due(const ares_channel_t *channel,
+                                        ares_bool_t           use_env,
+                                        const ares_timeval_t *now)
+{
+  const ares_hosts_file_t *hf = channel->hf;
+
+  if (hf == NULL || hf->use_env != use_env || channel->hosts_changed) {
+    return ARES_TRUE;
+  }
+
+  /* Cheap to check, and avoids serving a stale file if it is repointed */
+  if (use_env && !ares_strcaseeq(getenv("CARES_HOSTS"), hf->filename)) {
+    return ARES_TRUE;
+  }
+
+  return ares_timedout(now, &hf->next_check);
+}
+
 static ares_status_t ares_hosts_update(ares_channel_t *channel,
                                        ares_bool_t     use_env)
 {
-  ares_status_t status;
-  char         *filename = NULL;
+  ares_status_t  status;
+  char          *filename    = NULL;
+  unsigned int   interval_ms = 0;
+  ares_timeval_t now;
+
+  ares_tvnow(&now);
+
+  if (!ares_hosts_check_due(channel, use_env, &now)) {
+    return ARES_SUCCESS;
+  }
+
+  /* Cleared before the stat() so a change after this point is picked up */
+  channel->hosts_changed = ARES_FALSE;
 
   status = ares_hosts_path(channel, use_env, &filename);
   if (status != ARES_SUCCESS) {
     return status;
   }
 
-  if (!ares_hosts_expired(filename, channel->hf)) {
-    ares_free(filename);
-    return ARES_SUCCESS;
+  if (ares_hosts_expired(filename, channel->hf)) {
+    ares_hosts_file_destroy(channel->hf);
+    channel->hf = NULL;
+
+    status = ares_parse_hosts(filename, &channel->hf);
+    if (status != ARES_SUCCESS) {
+      goto done;
+    }
+
+    /* The configuration change monitor only watches /etc */
+    channel->hf->use_env = use_env;
+    channel->hf->watched =
+      (channel->hosts_watched && ares_streq(filename, "/etc/hosts"))
+        ? ARES_TRUE
+        : ARES_FALSE;
   }
 
-  ares_hosts_file_destroy(channel->hf);
-  channel->hf = NULL;
+  if (channel->optmask & ARES_OPT_HOSTS_CHECK_INTERVAL) {
+    interval_ms = channel->hosts_check_ms;
+  }
+
+  /* A watched file is still checked now and then, in case the monitor missed
+   * a change (e.g. its event queue overflowed) */
+  if (channel->hf->watched && interval_ms < ARES_HOSTS_WATCHED_CHECK_MS) {
+    interval_ms = ARES_HOSTS_WATCHED_CHECK_MS;
+  }
 
-  status = ares_parse_hosts(filename, &channel->hf);
+  channel->hf->next_check       = now;
+  channel->hf->next_check.sec  += interval_ms / 1000;
+  channel->hf->next_check.usec += (interval_ms % 1000) * 1000;
+  if (channel->hf->next_check.usec >= 1000000) {
+    channel->hf->next_check.sec  += 1;
+    channel->hf->next_check.usec -= 1000000;
+  }
+
+done:
   ares_free(filename);
   return status;
 }
@@ -720,8 +897,11 @@ ares_status_t ares_hosts_search_ipaddr(ares_channel_t *channel,
                                        ares_bool_t use_env, const char *ipaddr,
                                        const ares_hosts_entry_t **entry)
 {
-  ares_status_t status;
-  char          addr[INET6_ADDRSTRLEN];
+  ares_status_t          status;
+  struct ares_addr       addr;
+  size_t                 addr_len = 0;
+  unsigned int           idx;
+  const ares_hosts_ip_t *rec;
 
   *entry = NULL;
 
@@ -734,15 +914,20 @@ ares_status_t ares_hosts_search_ipaddr(ares_channel_t *channel,
     return ARES_ENOTFOUND; /* LCOV_EXCL_LINE: DefensiveCoding */
   }
 
-  if (!ares_normalize_ipaddr(ipaddr, addr, sizeof(addr))) {
+  memset(&addr, 0, sizeof(addr));
+  addr.family = AF_UNSPEC;
+  if (ares_dns_pton(ipaddr, &addr, &addr_len) == NULL) {
     return ARES_EBADNAME;
   }
 
-  *entry = ares_htable_strvp_get_direct(channel->hf->iphash, addr);
-  if (*entry == NULL) {
+  idx = ares_hosts_ip_find(channel->hf, &addr,
+                           ares_hosts_ip_hash(channel->hf, &addr));
+  if (idx == ARES_HOSTS_NONE) {
     return ARES_ENOTFOUND;
   }
 
+  rec    = ares_array_at_const(channel->hf->ips, idx);
+  *entry = ares_array_at_const(channel->hf->entries, rec->entry);
   return ARES_SUCCESS;
 }
 
@@ -750,7 +935,9 @@ ares_status_t ares_hosts_search_host(ares_channel_t *channel,
                                      ares_bool_t use_env, const char *host,
                                      const ares_hosts_entry_t **entry)
 {
-  ares_status_t status;
+  ares_status_t            status;
+  unsigned int             idx;
+  const ares_hosts_name_t *rec;
 
   *entry = NULL;
 
@@ -763,11 +950,18 @@ ares_status_t ares_hosts_search_host(ares_channel_t *channel,
     return ARES_ENOTFOUND; /* LCOV_EXCL_LINE: DefensiveCoding */
   }
 
-  *entry = ares_htable_strvp_get_direct(channel->hf->hosthash, host);
-  if (*entry == NULL) {
+  if (host == NULL) {
+    return ARES_ENOTFOUND; /* LCOV_EXCL_LINE: DefensiveCoding */
+  }
+
+  idx = ares_hosts_name_find(channel->hf, host,
+                             ares_hosts_name_hash(channel->hf, host));
+  if (idx == ARES_HOSTS_NONE) {
     return ARES_ENOTFOUND;
   }
 
+  rec    = ares_array_at_const(channel->hf->hosts, idx);
+  *entry = ares_array_at_const(channel->hf->entries, rec->entry);
   return ARES_SUCCESS;
 }
 
@@ -777,18 +971,21 @@ static ares_status_t
 {
   struct ares_addrinfo_cname *cname  = NULL;
   struct ares_addrinfo_cname *cnames = NULL;
+  const ares_hosts_file_t    *hf     = entry->hf;
+  const ares_hosts_name_t    *rec;
   const char                 *primaryhost;
-  ares_llist_node_t          *node;
   ares_status_t               status;
   size_t                      cnt = 0;
 
-  node        = ares_llist_node_first(entry->hosts);
-  primaryhost = ares_llist_node_val(node);
-  /* Skip to next node to start with aliases */
-  node = ares_llist_node_next(node);
+  rec         = ares_array_at_const(hf->hosts, entry->hosts);
+  primaryhost = ares_hosts_name_str(hf, rec);
 
-  while (node != NULL) {
-    const char *host = ares_llist_node_val(node);
+  /* Skip to next record to start with aliases */
+  while (rec->next != ARES_HOSTS_NONE) {
+    const char *host;
+
+    rec  = ares_array_at_const(hf->hosts, rec->next);
+    host = ares_hosts_name_str(hf, rec);
 
     /* Cap at 100 entries. , some people use
      * https://github.com/StevenBlack/hosts and we don't need 200k+ aliases */
@@ -814,8 +1011,6 @@ static ares_status_t
       status = ARES_ENOMEM; /* LCOV_EXCL_LINE: OutOfMemory */
       goto done;            /* LCOV_EXCL_LINE: OutOfMemory */
     }
-
-    node = ares_llist_node_next(node);
   }
 
   /* No entries, add only primary */
@@ -853,7 +1048,7 @@ ares_status_t ares_hosts_entry_to_addrinfo(const ares_hosts_entry_t *entry,
   ares_status_t               status  = ARES_ENOTFOUND;
   struct ares_addrinfo_cname *cnames  = NULL;
   struct ares_addrinfo_node  *ainodes = NULL;
-  ares_llist_node_t          *node;
+  unsigned int                idx;
 
   switch (family) {
     case AF_INET:
@@ -873,22 +1068,17 @@ ares_status_t ares_hosts_entry_to_addrinfo(const ares_hosts_entry_t *entry,
     }
   }
 
-  for (node = ares_llist_node_first(entry->ips); node != NULL;
-       node = ares_llist_node_next(node)) {
-    struct ares_addr addr;
-    const void      *ptr     = NULL;
-    size_t           ptr_len = 0;
-    const char      *ipaddr  = ares_llist_node_val(node);
+  for (idx = entry->ips; idx != ARES_HOSTS_NONE;) {
+    const ares_hosts_ip_t *rec = ares_array_at_const(entry->hf->ips, idx);
 
-    memset(&addr, 0, sizeof(addr));
-    addr.family = family;
-    ptr         = ares_dns_pton(ipaddr, &addr, &ptr_len);
+    idx = rec->next;
 
-    if (ptr == NULL) {
+    if (family != AF_UNSPEC && family != rec->addr.family) {
       continue;
     }
 
-    status = ares_append_ai_node(addr.family, port, 0, ptr, &ainodes);
+    status = ares_append_ai_node(rec->addr.family, port, 0, &rec->addr.addr,
+                                 &ainodes);
     if (status != ARES_SUCCESS) {
       goto done; /* LCOV_EXCL_LINE: DefensiveCoding */
     }
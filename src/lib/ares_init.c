@@ -69,28 +69,6 @@ int ares_init(ares_channel_t **channelptr)
   return ares_init_options(channelptr, NULL, 0);
 }
 
-static int ares_query_timeout_cmp_cb(const void *arg1, const void *arg2)
-{
-  const ares_query_t *q1 = arg1;
-  const ares_query_t *q2 = arg2;
-
-  if (q1->timeout.sec > q2->timeout.sec) {
-    return 1;
-  }
-  if (q1->timeout.sec < q2->timeout.sec) {
-    return -1;
-  }
-
-  if (q1->timeout.usec > q2->timeout.usec) {
-    return 1;
-  }
-  if (q1->timeout.usec < q2->timeout.usec) {
-    return -1;
-  }
-
-  return 0;
-}
-
 static int server_sort_cb(const void *data1, const void *data2)
 {
   const ares_server_t *s1 = data1;
@@ -145,6 +123,10 @@ static ares_status_t init_by_defaults(ares_channel_t *channel)
     channel->tries = DEFAULT_TRIES;
   }
 
+  if (channel->udp_sockets == 0) {
+    channel->udp_sockets = 1;
+  }
+
   if (ares_slist_len(channel->servers) == 0) {
     /* Add a default local named server to the channel unless configured not
      * to (in which case return an error).
@@ -240,6 +222,7 @@ int ares_init_options(ares_channel_t           **channelptr,
 {
   ares_channel_t *channel;
   ares_status_t   status = ARES_SUCCESS;
+  ares_timeval_t  now;
 
   if (ares_library_initialized() != ARES_SUCCESS) {
     return ARES_ENOTINITIALIZED; /* LCOV_EXCL_LINE: n/a on non-WinSock */
@@ -281,26 +264,54 @@ int ares_init_options(ares_channel_t           **channelptr,
     goto done;
   }
 
+  /* Object pools, so steady-state query traffic doesn't hit the allocator */
+  channel->query_pool = ares_pool_create(sizeof(ares_query_t),
+                                         ARES_POOL_MAX_QUERIES);
+  channel->conn_pool  = ares_pool_create(sizeof(ares_conn_t),
+                                         ARES_POOL_MAX_CONNS);
+  /* Each query sits in all_queries and in its connection's list */
+  channel->node_pool  = ares_llist_node_pool_create(ARES_POOL_MAX_QUERIES * 2);
+  if (channel->query_pool == NULL || channel->conn_pool == NULL ||
+      channel->node_pool == NULL) {
+    status = ARES_ENOMEM;
+    goto done;
+  }
+
   /* Initialize our lists of queries */
   channel->all_queries = ares_llist_create(NULL);
   if (channel->all_queries == NULL) {
     status = ARES_ENOMEM;
     goto done;
   }
+  ares_llist_set_node_pool(channel->all_queries, channel->node_pool);
 
   channel->queries_by_qid = ares_htable_szvp_create(NULL);
-  if (channel->queries_by_qid == NULL) {
+  if (channel->queries_by_qid == NULL ||
+      !ares_htable_szvp_enable_pool(channel->queries_by_qid,
+                                    ARES_POOL_MAX_QUERIES)) {
     status = ARES_ENOMEM;
     goto done;
   }
 
-  channel->queries_by_timeout =
-    ares_slist_create(channel->rand_state, ares_query_timeout_cmp_cb, NULL);
+  ares_tvnow(&now);
+  channel->queries_by_timeout = ares_twheel_create(&now);
   if (channel->queries_by_timeout == NULL) {
     status = ARES_ENOMEM;
     goto done;
   }
 
+  channel->queries_by_hedge = ares_twheel_create(&now);
+  if (channel->queries_by_hedge == NULL) {
+    status = ARES_ENOMEM;
+    goto done;
+  }
+
+  channel->queries_by_deadline = ares_twheel_create(&now);
+  if (channel->queries_by_deadline == NULL) {
+    status = ARES_ENOMEM;
+    goto done;
+  }
+
   channel->connnode_by_socket = ares_htable_asvp_create(NULL);
   if (channel->connnode_by_socket == NULL) {
     status = ARES_ENOMEM;
@@ -324,11 +335,24 @@ int ares_init_options(ares_channel_t           **channelptr,
    * completely unused.  This reduces the number of different code paths that
    * might be followed even if there is a minor performance hit. */
   status = ares_qcache_create(channel->rand_state, channel->qcache_max_ttl,
+                              channel->qcache_max_entries,
+                              channel->qcache_max_bytes,
+                              channel->qcache_stale_ttl,
+                              channel->qcache_prefetch_pct,
+                              (channel->flags & ARES_FLAG_MULTICORE)
+                                ? ARES_QCACHE_SHARDS
+                                : 1,
                               &channel->qcache);
   if (status != ARES_SUCCESS) {
     goto done; /* LCOV_EXCL_LINE: OutOfMemory */
   }
 
+  channel->coalesce = ares_coalesce_create();
+  if (channel->coalesce == NULL) {
+    status = ARES_ENOMEM; /* LCOV_EXCL_LINE: OutOfMemory */
+    goto done;            /* LCOV_EXCL_LINE: OutOfMemory */
+  }
+
   if (status == ARES_SUCCESS) {
     status = ares_init_by_sysconfig(channel);
     if (status != ARES_SUCCESS) {
@@ -352,6 +376,15 @@ int ares_init_options(ares_channel_t           **channelptr,
   if (channel->optmask & ARES_OPT_EVENT_THREAD) {
     ares_event_thread_t *e = NULL;
 
+    /* Must exist before the event thread is started as it drains it */
+    if (channel->flags & ARES_FLAG_MULTICORE) {
+      channel->submit = ares_submit_create();
+      if (channel->submit == NULL) {
+        status = ARES_ENOMEM; /* LCOV_EXCL_LINE: OutOfMemory */
+        goto done;            /* LCOV_EXCL_LINE: OutOfMemory */
+      }
+    }
+
     status = ares_event_thread_init(channel);
     if (status != ARES_SUCCESS) {
       goto done; /* LCOV_EXCL_LINE: UntestablePath */
@@ -414,6 +447,11 @@ ares_status_t ares_reinit(ares_channel_t *channel)
 
   ares_channel_lock(channel);
 
+  /* Network configuration may have changed, so source addresses are no
+   * longer known to be valid */
+  ares_srcaddr_cache_destroy(channel->srcaddr_cache);
+  channel->srcaddr_cache = NULL;
+
   /* If a reinit is already in process, lets not do it again. Or if we are
    * shutting down, skip. */
   if (!channel->sys_up || channel->reinit_pending) {
@@ -504,6 +542,8 @@ int ares_dup(ares_channel_t **dest, const ares_channel_t *src)
               sizeof((*dest)->local_dev_name));
   (*dest)->local_ip4 = src->local_ip4;
   memcpy((*dest)->local_ip6, src->local_ip6, sizeof(src->local_ip6));
+  (*dest)->udp_sockets = src->udp_sockets;
+  (*dest)->udp_balance = src->udp_balance;
   ares_channel_unlock(src);
 
   /* Servers are a bit unique as ares_init_options() only allows ipv4 servers
@@ -578,6 +618,26 @@ void ares_set_local_dev(ares_channel_t *channel, const char *local_dev_name)
   ares_channel_unlock(channel);
 }
 
+/*! Upper bound for ares_set_udp_sockets(), mostly to catch misuse */
+#define ARES_UDP_SOCKETS_MAX 64
+
+ares_status_t ares_set_udp_sockets(ares_channel_t *channel, size_t num_sockets,
+                                   ares_udp_balance_t balance)
+{
+  if (channel == NULL || num_sockets == 0 ||
+      num_sockets > ARES_UDP_SOCKETS_MAX ||
+      (balance != ARES_UDP_BALANCE_ROUND_ROBIN &&
+       balance != ARES_UDP_BALANCE_LEAST_LOADED)) {
+    return ARES_EFORMERR;
+  }
+
+  ares_channel_lock(channel);
+  channel->udp_sockets = num_sockets;
+  channel->udp_balance = balance;
+  ares_channel_unlock(channel);
+  return ARES_SUCCESS;
+}
+
 int ares_set_sortlist(ares_channel_t *channel, const char *sortstr)
 {
   size_t           nsort    = 0;
@@ -63,9 +63,16 @@
  * - maximum latency
  * - total time
  * - count
+ * - latency histogram
  * NOTE: average latency is (total time / count), we will calculate this
  *       dynamically when needed
  *
+ * The latency histogram is log-linear (in the spirit of HdrHistogram): values
+ * below 8ms get an exact slot, after that each power of 2 is split into 8
+ * linear sub-buckets so the relative error is bounded at 12.5%.  With 104
+ * slots this covers up to ~32s, anything larger lands in the last slot.  A
+ * percentile is reported as the upper bound of the slot it lands in.
+ *
  * Basic algorithm for calculating timeout to use would be:
  * - Scan from most recent bucket to least recent
  * - Check timestamp of bucket, if doesn't match current time, continue to next
@@ -76,6 +83,9 @@
  * - If bucket is selected, take ("total time" / count) as Average latency,
  *   multiply by "Average Latency Multiplier", bound by "Minimum Timeout" and
  *   "Maximum Timeout"
+ * - If ARES_OPT_TIMEOUT_PERCENTILE is set, the configured percentile from the
+ *   histogram of the selected bucket is used as-is instead of the multiplied
+ *   average, as it already accounts for the slower recursive lookups
  * NOTE: The timeout calculated may not be the timeout used.  If we are retrying
  * the query on the same server another time, then it will use a larger value
  *
@@ -87,10 +97,15 @@
  * - Compare current minimum and maximum recorded latency against query time and
  *   adjust if necessary
  * - Increment "count" by 1 and "total time" by the query time
+ * - Increment the histogram slot for the query time
  *
  * Other Notes:
- * - This is always-on, the only user-configurable value is the initial
- *   timeout which will simply re-uses the current option.
+ * - This is always-on, the only user-configurable values are the initial
+ *   timeout which will simply re-uses the current option, and the optional
+ *   timeout percentile.
+ * - Percentiles are exposed to applications via ares_get_server_latency().
+ * - If ARES_OPT_HEDGE is set, a query still unanswered after the configured
+ *   percentile of its server's latency is also sent to a second server.
  * - Minimum and Maximum latencies for a bucket are currently unused but are
  *   there in case we find a need for them in the future.
  */
@@ -110,6 +125,10 @@
 /*! Minimum queries required to form an average */
 #define MIN_COUNT_FOR_AVERAGE 3
 
+/*! Number of bits of linear sub-buckets per power of 2 in the histogram */
+#define HIST_SUB_BITS 3
+#define HIST_SUB_LEN  (1U << HIST_SUB_BITS)
+
 static time_t ares_metric_timestamp(ares_server_bucket_t  bucket,
                                     const ares_timeval_t *now,
                                     ares_bool_t           is_previous)
@@ -145,6 +164,122 @@ static time_t ares_metric_timestamp(ares_server_bucket_t  bucket,
   return (time_t)(now->sec / divisor);
 }
 
+static size_t ares_metrics_hist_idx(unsigned int ms)
+{
+  size_t       msb = 0;
+  size_t       shift;
+  size_t       idx;
+  unsigned int val;
+
+  if (ms < HIST_SUB_LEN) {
+    return ms;
+  }
+
+  for (val = ms >> 1; val != 0; val >>= 1) {
+    msb++;
+  }
+
+  shift = msb - HIST_SUB_BITS;
+  idx   = ((msb - HIST_SUB_BITS + 1) << HIST_SUB_BITS) +
+        ((ms >> shift) & (HIST_SUB_LEN - 1));
+  if (idx >= ARES_METRICS_HIST_LEN) {
+    idx = ARES_METRICS_HIST_LEN - 1;
+  }
+  return idx;
+}
+
+/* Upper bound of the values that land in the slot */
+static unsigned int ares_metrics_hist_value(size_t idx)
+{
+  size_t shift;
+  size_t sub;
+
+  if (idx < HIST_SUB_LEN) {
+    return (unsigned int)idx;
+  }
+
+  shift = (idx >> HIST_SUB_BITS) - 1;
+  sub   = idx & (HIST_SUB_LEN - 1);
+  return (unsigned int)((((HIST_SUB_LEN + sub) << shift) + (1U << shift)) - 1);
+}
+
+void ares_metrics_hist_add(unsigned int *hist, unsigned int ms)
+{
+  size_t idx = ares_metrics_hist_idx(ms);
+
+  /* Saturate rather than wrap */
+  if (hist[idx] != 0xFFFFFFFF) {
+    hist[idx]++;
+  }
+}
+
+unsigned int ares_metrics_hist_percentile(const unsigned int *hist,
+                                          unsigned int        percentile)
+{
+  ares_uint64_t count = 0;
+  ares_uint64_t rank;
+  ares_uint64_t seen = 0;
+  size_t        i;
+
+  if (percentile == 0 || percentile > 100) {
+    return 0;
+  }
+
+  for (i = 0; i < ARES_METRICS_HIST_LEN; i++) {
+    count += hist[i];
+  }
+
+  if (count == 0) {
+    return 0;
+  }
+
+  /* Nearest-rank */
+  rank = ((count * percentile) + 99) / 100;
+
+  for (i = 0; i < ARES_METRICS_HIST_LEN; i++) {
+    seen += hist[i];
+    if (seen >= rank) {
+      break;
+    }
+  }
+
+  if (i == ARES_METRICS_HIST_LEN) {
+    i = ARES_METRICS_HIST_LEN - 1; /* LCOV_EXCL_LINE: DefensiveCoding */
+  }
+
+  return ares_metrics_hist_value(i);
+}
+
+/* Smoothed latency used for server selection.  Uses a gain of 1/8, the same
+ * as the smoothed RTT of TCP (RFC 6298), so a few slow responses move it but
+ * a single outlier doesn't dominate. */
+static void ares_metrics_ewma_update(ares_server_t        *server,
+                                     const ares_timeval_t *tvdiff)
+{
+  ares_uint64_t sample_us =
+    ((ares_uint64_t)tvdiff->sec * 1000000) + (ares_uint64_t)tvdiff->usec;
+  ares_uint64_t ewma_us = server->latency_ewma_us;
+
+  /* Way past any sane timeout, just keep the math in range */
+  if (sample_us > 60000000) {
+    sample_us = 60000000;
+  }
+  if (sample_us == 0) {
+    sample_us = 1;
+  }
+
+  if (ewma_us == 0) {
+    ewma_us = sample_us;
+  } else {
+    ewma_us = ewma_us - (ewma_us / 8) + (sample_us / 8);
+  }
+  if (ewma_us == 0) {
+    ewma_us = 1;
+  }
+
+  server->latency_ewma_us = (unsigned int)ewma_us;
+}
+
 void ares_metrics_record(const ares_query_t *query, ares_server_t *server,
                          ares_status_t status, const ares_dns_record_t *dnsrec)
 {
@@ -175,6 +310,8 @@ void ares_metrics_record(const ares_query_t *query, ares_server_t *server,
     query_ms = 1;
   }
 
+  ares_metrics_ewma_update(server, &tvdiff);
+
   /* Place in each bucket */
   for (i = 0; i < ARES_METRIC_COUNT; i++) {
     time_t ts = ares_metric_timestamp(i, &now, ARES_FALSE);
@@ -184,11 +321,14 @@ void ares_metrics_record(const ares_query_t *query, ares_server_t *server,
       server->metrics[i].prev_ts          = server->metrics[i].ts;
       server->metrics[i].prev_total_ms    = server->metrics[i].total_ms;
       server->metrics[i].prev_total_count = server->metrics[i].total_count;
-      server->metrics[i].ts               = ts;
-      server->metrics[i].latency_min_ms   = 0;
-      server->metrics[i].latency_max_ms   = 0;
-      server->metrics[i].total_ms         = 0;
-      server->metrics[i].total_count      = 0;
+      memcpy(server->metrics[i].prev_hist, server->metrics[i].hist,
+             sizeof(server->metrics[i].prev_hist));
+      server->metrics[i].ts             = ts;
+      server->metrics[i].latency_min_ms = 0;
+      server->metrics[i].latency_max_ms = 0;
+      server->metrics[i].total_ms       = 0;
+      server->metrics[i].total_count    = 0;
+      memset(server->metrics[i].hist, 0, sizeof(server->metrics[i].hist));
     }
 
     if (server->metrics[i].latency_min_ms == 0 ||
@@ -202,16 +342,18 @@ void ares_metrics_record(const ares_query_t *query, ares_server_t *server,
 
     server->metrics[i].total_count++;
     server->metrics[i].total_ms += (ares_uint64_t)query_ms;
+    ares_metrics_hist_add(server->metrics[i].hist, query_ms);
   }
 }
 
-size_t ares_metrics_server_timeout(const ares_server_t  *server,
-                                   const ares_timeval_t *now)
+/* Select the most recent bucket with enough samples to be meaningful */
+static ares_bool_t ares_metrics_select(const ares_server_t  *server,
+                                       const ares_timeval_t *now,
+                                       ares_uint64_t        *total_ms,
+                                       ares_uint64_t        *total_count,
+                                       const unsigned int  **hist)
 {
-  const ares_channel_t *channel = server->channel;
-  ares_server_bucket_t  i;
-  size_t                timeout_ms = 0;
-  size_t                max_timeout_ms;
+  ares_server_bucket_t i;
 
   for (i = 0; i < ARES_METRIC_COUNT; i++) {
     time_t ts = ares_metric_timestamp(i, now, ARES_FALSE);
@@ -226,18 +368,38 @@ size_t ares_metrics_server_timeout(const ares_server_t  *server,
         /* Move onto next bucket */
         continue;
       }
-      /* Calculate average time for previous bucket */
-      timeout_ms = (size_t)(server->metrics[i].prev_total_ms /
-                            server->metrics[i].prev_total_count);
+      *total_ms    = server->metrics[i].prev_total_ms;
+      *total_count = server->metrics[i].prev_total_count;
+      *hist        = server->metrics[i].prev_hist;
     } else {
-      /* Calculate average time for current bucket*/
-      timeout_ms =
-        (size_t)(server->metrics[i].total_ms / server->metrics[i].total_count);
+      *total_ms    = server->metrics[i].total_ms;
+      *total_count = server->metrics[i].total_count;
+      *hist        = server->metrics[i].hist;
     }
+    return ARES_TRUE;
+  }
 
-    /* Multiply average by constant to get timeout value */
-    timeout_ms *= AVG_TIMEOUT_MULTIPLIER;
-    break;
+  return ARES_FALSE;
+}
+
+size_t ares_metrics_server_timeout(const ares_server_t  *server,
+                                   const ares_timeval_t *now)
+{
+  const ares_channel_t *channel    = server->channel;
+  size_t                timeout_ms = 0;
+  size_t                max_timeout_ms;
+  ares_uint64_t         total_ms;
+  ares_uint64_t         total_count;
+  const unsigned int   *hist;
+
+  if (ares_metrics_select(server, now, &total_ms, &total_count, &hist)) {
+    if (channel->optmask & ARES_OPT_TIMEOUT_PERCENTILE) {
+      timeout_ms =
+        ares_metrics_hist_percentile(hist, channel->timeout_percentile);
+    } else {
+      /* Multiply average by constant to get timeout value */
+      timeout_ms = (size_t)(total_ms / total_count) * AVG_TIMEOUT_MULTIPLIER;
+    }
   }
 
   /* If we're here, that means its the first query for the server, so we just
@@ -259,3 +421,58 @@ size_t ares_metrics_server_timeout(const ares_server_t  *server,
 
   return timeout_ms;
 }
+
+size_t ares_metrics_server_percentile(const ares_server_t  *server,
+                                      const ares_timeval_t *now,
+                                      unsigned int          percentile)
+{
+  ares_uint64_t       total_ms;
+  ares_uint64_t       total_count;
+  const unsigned int *hist;
+
+  if (!ares_metrics_select(server, now, &total_ms, &total_count, &hist)) {
+    return 0;
+  }
+
+  return ares_metrics_hist_percentile(hist, percentile);
+}
+
+ares_status_t ares_get_server_latency(const ares_channel_t *channel,
+                                      const char           *server,
+                                      unsigned int          percentile,
+                                      unsigned int         *latency_ms)
+{
+  ares_status_t        status;
+  const ares_server_t *s;
+  ares_timeval_t       now;
+  ares_uint64_t        total_ms;
+  ares_uint64_t        total_count;
+  const unsigned int  *hist;
+
+  if (channel == NULL || ares_strlen(server) == 0 || percentile == 0 ||
+      percentile > 100 || latency_ms == NULL) {
+    return ARES_EFORMERR;
+  }
+
+  *latency_ms = 0;
+
+  ares_channel_lock(channel);
+
+  status = ares_find_server(channel, server, &s);
+  if (status != ARES_SUCCESS) {
+    goto done;
+  }
+
+  ares_tvnow(&now);
+
+  if (!ares_metrics_select(s, &now, &total_ms, &total_count, &hist)) {
+    status = ARES_ENODATA;
+    goto done;
+  }
+
+  *latency_ms = ares_metrics_hist_percentile(hist, percentile);
+
+done:
+  ares_channel_unlock(channel);
+  return status;
+}
@@ -233,6 +233,37 @@ int ares_save_options(const ares_channel_t *channel,
     options->server_failover_opts.retry_delay  = channel->server_retry_delay;
   }
 
+  if (channel->optmask & ARES_OPT_QCACHE_MAX_ENTRIES) {
+    options->qcache_max_entries = (unsigned int)channel->qcache_max_entries;
+    options->qcache_max_bytes   = channel->qcache_max_bytes;
+  }
+
+  if (channel->optmask & ARES_OPT_QCACHE_STALE) {
+    options->qcache_stale_ttl    = channel->qcache_stale_ttl;
+    options->qcache_prefetch_pct = channel->qcache_prefetch_pct;
+  }
+
+  if (channel->optmask & ARES_OPT_TIMEOUT_PERCENTILE) {
+    options->timeout_percentile = channel->timeout_percentile;
+  }
+
+  if (channel->optmask & ARES_OPT_HOSTS_CHECK_INTERVAL) {
+    options->hosts_check_ms = channel->hosts_check_ms;
+  }
+
+  if (channel->optmask & ARES_OPT_EVENT_THREADS) {
+    options->event_threads = channel->event_threads;
+  }
+
+  if (channel->optmask & ARES_OPT_SERVER_SELECTION) {
+    options->server_selection = channel->server_selection;
+  }
+
+  if (channel->optmask & ARES_OPT_HEDGE) {
+    options->hedge_percentile = channel->hedge_percentile;
+    options->hedge_max_pct    = channel->hedge_max_pct;
+  }
+
   *optmask = (int)channel->optmask;
 
   return ARES_SUCCESS;
@@ -486,6 +517,60 @@ ares_status_t ares_init_by_options(ares_channel_t            *channel,
     channel->server_retry_delay  = options->server_failover_opts.retry_delay;
   }
 
+  if (optmask & ARES_OPT_QCACHE_MAX_ENTRIES) {
+    channel->qcache_max_entries = options->qcache_max_entries;
+    channel->qcache_max_bytes   = options->qcache_max_bytes;
+  }
+
+  if (optmask & ARES_OPT_QCACHE_STALE) {
+    if (options->qcache_prefetch_pct > 100) {
+      optmask &= ~(ARES_OPT_QCACHE_STALE);
+    } else {
+      channel->qcache_stale_ttl    = options->qcache_stale_ttl;
+      channel->qcache_prefetch_pct = options->qcache_prefetch_pct;
+    }
+  }
+
+  if (optmask & ARES_OPT_TIMEOUT_PERCENTILE) {
+    if (options->timeout_percentile == 0 || options->timeout_percentile > 100) {
+      optmask &= ~(ARES_OPT_TIMEOUT_PERCENTILE);
+    } else {
+      channel->timeout_percentile = options->timeout_percentile;
+    }
+  }
+
+  if (optmask & ARES_OPT_HOSTS_CHECK_INTERVAL) {
+    channel->hosts_check_ms = options->hosts_check_ms;
+  }
+
+  /* Meaningless without ARES_OPT_EVENT_THREAD */
+  if (optmask & ARES_OPT_EVENT_THREADS) {
+    if (options->event_threads == 0 || !(optmask & ARES_OPT_EVENT_THREAD)) {
+      optmask &= ~(ARES_OPT_EVENT_THREADS);
+    } else {
+      channel->event_threads = options->event_threads;
+    }
+  }
+
+  if (optmask & ARES_OPT_SERVER_SELECTION) {
+    if (options->server_selection != ARES_SERVER_SELECT_DEFAULT &&
+        options->server_selection != ARES_SERVER_SELECT_LATENCY) {
+      optmask &= ~(ARES_OPT_SERVER_SELECTION);
+    } else {
+      channel->server_selection = options->server_selection;
+    }
+  }
+
+  if (optmask & ARES_OPT_HEDGE) {
+    if (options->hedge_percentile == 0 || options->hedge_percentile > 100 ||
+        options->hedge_max_pct == 0 || options->hedge_max_pct > 100) {
+      optmask &= ~(ARES_OPT_HEDGE);
+    } else {
+      channel->hedge_percentile = options->hedge_percentile;
+      channel->hedge_max_pct    = options->hedge_max_pct;
+    }
+  }
+
   channel->optmask = (unsigned int)optmask;
 
   return ARES_SUCCESS;
@@ -45,9 +45,12 @@
 #include "util/ares_math.h"
 #include "util/ares_time.h"
 #include "util/ares_rand.h"
+#include "ares_arena.h"
 #include "ares_array.h"
+#include "ares_pool.h"
 #include "ares_llist.h"
 #include "dsa/ares_slist.h"
+#include "dsa/ares_twheel.h"
 #include "ares_htable_strvp.h"
 #include "ares_htable_szvp.h"
 #include "ares_htable_asvp.h"
@@ -131,6 +134,10 @@ W32_FUNC const char *_w32_GetHostsFile(void);
 #define DEFAULT_SERVER_RETRY_CHANCE 10
 #define DEFAULT_SERVER_RETRY_DELAY  5000
 
+/* Maximum number of released objects each channel keeps around for reuse */
+#define ARES_POOL_MAX_QUERIES 256
+#define ARES_POOL_MAX_CONNS   16
+
 struct ares_query;
 typedef struct ares_query ares_query_t;
 
@@ -146,13 +153,25 @@ struct ares_query {
    * Node object for each list entry the query belongs to in order to
    * make removal operations O(1).
    */
-  ares_slist_node_t   *node_queries_by_timeout;
+  ares_twheel_timer_t  node_queries_by_timeout;
   ares_llist_node_t   *node_queries_to_conn;
   ares_llist_node_t   *node_all_queries;
 
   /* connection handle query is associated with */
   ares_conn_t         *conn;
 
+  /* Hedged copy of the query sent to a second server, the first of the two
+   * connections to answer wins */
+  ares_twheel_timer_t  node_queries_by_hedge;
+  ares_llist_node_t   *node_hedge_to_conn;
+  ares_conn_t         *hedge_conn;
+  ares_timeval_t       hedge_ts; /*!< Timestamp hedge_conn was sent to */
+  ares_bool_t          hedged;   /*!< Current attempt has been hedged */
+
+  /* Time by which the query is given up on, whatever its retries, see
+   * ares_query_set_deadline() */
+  ares_twheel_timer_t  node_queries_by_deadline;
+
   /* Query */
   ares_dns_record_t   *query;
 
@@ -177,6 +196,15 @@ struct apattern {
 struct ares_qcache;
 typedef struct ares_qcache ares_qcache_t;
 
+struct ares_coalesce;
+typedef struct ares_coalesce ares_coalesce_t;
+
+struct ares_submit;
+typedef struct ares_submit ares_submit_t;
+
+struct ares_srcaddr_cache;
+typedef struct ares_srcaddr_cache ares_srcaddr_cache_t;
+
 struct ares_hosts_file;
 typedef struct ares_hosts_file ares_hosts_file_t;
 
@@ -199,6 +227,18 @@ struct ares_channeldata {
   char                *lookups;
   size_t               ednspsz;
   unsigned int         qcache_max_ttl;
+  size_t               qcache_max_entries;
+  size_t               qcache_max_bytes;
+  unsigned int         qcache_stale_ttl;
+  unsigned int         qcache_prefetch_pct;
+  unsigned int         timeout_percentile;
+  unsigned int         hosts_check_ms;
+  unsigned int         event_threads;
+  ares_server_select_t server_selection;
+  size_t               udp_sockets;
+  ares_udp_balance_t   udp_balance;
+  unsigned int         hedge_percentile;
+  unsigned int         hedge_max_pct;
   ares_evsys_t         evsys;
   unsigned int         optmask;
 
@@ -229,7 +269,14 @@ struct ares_channeldata {
   ares_htable_szvp_t  *queries_by_qid;
 
   /* Queries bucketed by timeout, for quickly handling timeouts: */
-  ares_slist_t        *queries_by_timeout;
+  ares_twheel_t       *queries_by_timeout;
+  /* Queries waiting to be hedged to a second server, see ARES_OPT_HEDGE */
+  ares_twheel_t       *queries_by_hedge;
+  /* Hedge budget in hundredths of a hedge, each query sent earns
+   * hedge_max_pct and each hedge spends 100 */
+  unsigned int         hedge_credit;
+  /* Queries that are to be given up on at a set time */
+  ares_twheel_t       *queries_by_deadline;
 
   /* Map linked list node member for connection to file descriptor.  We use
    * the node instead of the connection object itself so we can quickly look
@@ -237,6 +284,13 @@ struct ares_channeldata {
    * scan all connections) */
   ares_htable_asvp_t  *connnode_by_socket;
 
+  /* Recycled query objects, connection objects, and list nodes for
+   * all_queries and the per-connection query lists.  Protected by the
+   * channel lock. */
+  ares_pool_t         *query_pool;
+  ares_pool_t         *conn_pool;
+  ares_pool_t         *node_pool;
+
   ares_sock_state_cb   sock_state_cb;
   void                *sock_state_cb_data;
 
@@ -270,9 +324,25 @@ struct ares_channeldata {
   /* Cache of local hosts file */
   ares_hosts_file_t                  *hf;
 
+  /* Hosts file changes are reported by the configuration change monitor */
+  ares_bool_t                         hosts_watched;
+
+  /* Hosts file was reported as changed since it was last checked */
+  ares_bool_t                         hosts_changed;
+
   /* Query Cache */
   ares_qcache_t                      *qcache;
 
+  /* In-flight queries by question, used by ARES_FLAG_COALESCE */
+  ares_coalesce_t                    *coalesce;
+
+  /* Requests waiting to be picked up by the event thread, used by
+   * ARES_FLAG_MULTICORE with ARES_OPT_EVENT_THREAD */
+  ares_submit_t                      *submit;
+
+  /* Source addresses by destination, used by ares_sortaddrinfo() */
+  ares_srcaddr_cache_t               *srcaddr_cache;
+
   /* Fields controlling server failover behavior.
    * The retry chance is the probability (1/N) by which we will retry a failed
    * server instead of the best server when selecting a server to send queries
@@ -307,6 +377,13 @@ ares_bool_t   ares_is_onion_domain(const char *name);
 /* Returns one of the normal ares status codes like ARES_SUCCESS */
 ares_status_t ares_send_query(ares_server_t *requested_server /* Optional */,
                               ares_query_t *query, const ares_timeval_t *now);
+/*! Drop one leg of a hedged query, keeping the query outstanding on the
+ *  other.  Returns ARES_FALSE if the query isn't hedged on the connection. */
+ares_bool_t   ares_query_drop_leg(ares_query_t *query, const ares_conn_t *conn);
+/*! Give up on a query with ARES_ETIMEOUT once timeout_ms has passed, even if
+ *  it has retries left.  Unlike a timeout, the server isn't held responsible.
+ *  Replaces any deadline set before. */
+void          ares_query_set_deadline(ares_query_t *query, size_t timeout_ms);
 ares_status_t ares_requeue_query(ares_query_t *query, const ares_timeval_t *now,
                                  ares_status_t            status,
                                  ares_bool_t              inc_try_count,
@@ -344,6 +421,20 @@ void ares_dnsrec_convert_cb(void *arg, ares_status_t status, size_t timeouts,
 
 void ares_free_query(ares_query_t *query);
 
+/*! Whether the query will deliver its answer to the given callback and arg,
+ *  either directly or by way of ares_query_nolock().
+ */
+ares_bool_t ares_query_callback_match(const ares_query_t  *query,
+                                      ares_callback_dnsrec callback,
+                                      const void          *arg);
+
+/*! Cancel a single outstanding query, invoking its callback with
+ *  ARES_ECANCELLED.  Nothing is done unless the query identified by qid still
+ *  belongs to the given callback and arg, see ares_query_callback_match().
+ */
+void ares_cancel_query(ares_channel_t *channel, unsigned short qid,
+                       ares_callback_dnsrec callback, const void *arg);
+
 unsigned short ares_generate_new_id(ares_rand_state *state);
 ares_status_t  ares_expand_name_validated(const unsigned char *encoded,
                                           const unsigned char *abuf, size_t alen,
@@ -417,6 +508,12 @@ ares_status_t ares_cat_domain(const char *name, const char *domain, char **s);
 ares_status_t ares_sortaddrinfo(ares_channel_t            *channel,
                                 struct ares_addrinfo_node *ai_node);
 
+/*! Destroy the source address cache used by ares_sortaddrinfo().
+ *
+ *  \param[in] cache  Cache to destroy, may be NULL
+ */
+void          ares_srcaddr_cache_destroy(ares_srcaddr_cache_t *cache);
+
 void          ares_freeaddrinfo_nodes(struct ares_addrinfo_node *ai_node);
 ares_bool_t   ares_is_localhost(const char *name);
 
@@ -474,11 +571,19 @@ ares_status_t ares_in_addr_to_sconfig_llist(const struct in_addr *servers,
                                             ares_llist_t        **llist);
 ares_status_t ares_get_server_addr(const ares_server_t *server,
                                    ares_buf_t          *buf);
+/*! Find a configured server by its address as formatted by
+ *  ares_get_servers_csv().  Must be holding the channel lock. */
+ares_status_t ares_find_server(const ares_channel_t *channel,
+                               const char *addr, const ares_server_t **server);
 
 struct ares_hosts_entry;
 typedef struct ares_hosts_entry ares_hosts_entry_t;
 
 void                            ares_hosts_file_destroy(ares_hosts_file_t *hf);
+
+/*! Signal that the hosts file may have changed.  Used by the configuration
+ *  change monitor when channel->hosts_watched is set, takes the channel lock */
+void          ares_hosts_file_changed(ares_channel_t *channel);
 ares_status_t ares_hosts_search_ipaddr(ares_channel_t *channel,
                                        ares_bool_t use_env, const char *ipaddr,
                                        const ares_hosts_entry_t **entry);
@@ -516,6 +621,13 @@ ares_status_t ares_send_nolock(ares_channel_t *channel, ares_server_t *server,
                                ares_callback_dnsrec callback, void *arg,
                                unsigned short *qid);
 
+/* With ARES_FLAG_MULTICORE, answer the request from the query cache without
+ * taking the channel lock.  Returns ARES_TRUE if the callback was invoked,
+ * otherwise the request must go through ares_send_nolock(). */
+ares_bool_t ares_send_cached(ares_channel_t          *channel,
+                             const ares_dns_record_t *dnsrec,
+                             ares_callback_dnsrec callback, void *arg);
+
 /* Same as ares_gethostbyaddr() except does not take a channel lock.  Use this
  * if a channel lock is already held */
 void ares_gethostbyaddr_nolock(ares_channel_t *channel, const void *addr,
@@ -539,27 +651,64 @@ void ares_gethostbyaddr_nolock(ares_channel_t *channel, const void *addr,
 ares_status_t ares_dns_name_parse(ares_buf_t *buf, char **name,
                                   ares_bool_t is_hostname);
 
+/*! Same as ares_dns_name_parse(), but appends the parsed name to a
+ *  caller-supplied buffer rather than allocating a new string.  This lets a
+ *  caller decoding many names reuse one scratch buffer.
+ *
+ *  \param[in]     buf         Initialized buffer object
+ *  \param[in,out] namebuf     Buffer to append the name to, or NULL to only
+ *                             validate and skip the name.
+ *  \param[in]     is_hostname if ARES_TRUE, will validate the character set
+ *                             for a valid hostname or will return error.
+ *  \return ARES_SUCCESS on success
+ */
+ares_status_t ares_dns_name_parse_buf(ares_buf_t *buf, ares_buf_t *namebuf,
+                                      ares_bool_t is_hostname);
+
+/*! Name compression table used while writing a DNS message */
+typedef struct ares_dns_nametable ares_dns_nametable_t;
+
 /*! Write the DNS name to the buffer in the DNS domain-name syntax as a
  *  series of labels.  The maximum domain name length is 255 characters with
  *  each label being a maximum of 63 characters.  If the validate_hostname
  *  flag is set, it will strictly validate the character set.
  *
  *  \param[in,out]  buf   Initialized buffer object to write name to
- *  \param[in,out]  list  Pointer passed by reference to maintain a list of
- *                        domain name to indexes used for name compression.
- *                        Pass NULL (not by reference) if name compression isn't
- *                        desired.  Otherwise the list will be automatically
- *                        created upon first entry.
+ *  \param[in,out]  list  Pointer passed by reference to maintain a table of
+ *                        domain name suffixes to indexes used for name
+ *                        compression. Pass NULL (not by reference) if name
+ *                        compression isn't desired.  Otherwise the table will
+ *                        be automatically created upon first entry and must be
+ *                        destroyed with ares_dns_nametable_destroy().
  *  \param[in]      validate_hostname Validate the hostname character set.
  *  \param[in]      name              Name to write out, it may have escape
  *                                    sequences.
  *  \return ARES_SUCCESS on success, most likely ARES_EBADNAME if the name is
  *          bad.
  */
-ares_status_t ares_dns_name_write(ares_buf_t *buf, ares_llist_t **list,
+ares_status_t ares_dns_name_write(ares_buf_t *buf, ares_dns_nametable_t **list,
                                   ares_bool_t validate_hostname,
                                   const char *name);
 
+/*! Check that a name could be written by ares_dns_name_write(), without
+ *  writing it.  Used to reject bad names up front when a record is copied
+ *  rather than serialized.
+ *
+ *  \param[in] name              Name to check, it may have escape sequences.
+ *  \param[in] validate_hostname Validate the hostname character set.
+ *  \return ARES_SUCCESS if the name is valid, ARES_EBADNAME for a bad
+ *          character or escape, or ARES_EBADQUERY if a label or the name is
+ *          too long to be encoded in a message.
+ */
+ares_status_t ares_dns_name_validate(const char *name,
+                                     ares_bool_t validate_hostname);
+
+/*! Destroy a name compression table created by ares_dns_name_write().
+ *
+ *  \param[in] tbl  Table to destroy, may be NULL
+ */
+void ares_dns_nametable_destroy(ares_dns_nametable_t *tbl);
+
 /*! Check if the queue is empty, if so, wake any waiters.  This is only
  *  effective if built with threading support.
  *
@@ -578,24 +727,142 @@ ares_bool_t   ares_subnet_match(const struct ares_addr *addr,
                                 unsigned char           netmask);
 ares_bool_t   ares_addr_is_linklocal(const struct ares_addr *addr);
 
+/* Maximum length of a binary cache key.  This is enough for the 2 byte header
+ * plus a single question with a maximum length wire-format name (255 bytes),
+ * type and class.  Anything longer is simply not cached. */
+#define ARES_QCACHE_KEY_MAXLEN 512
+
+/*! Generate the binary key used to identify identical questions.
+ *
+ *  \param[in]  dnsrec DNS request
+ *  \param[out] buf    Buffer of at least ARES_QCACHE_KEY_MAXLEN bytes
+ *  \param[out] len    Length of key written to buf
+ *  \return ARES_FALSE if a key cannot be generated for the request
+ */
+ares_bool_t   ares_qcache_key(const ares_dns_record_t *dnsrec,
+                              unsigned char *buf, size_t *len);
+
+/*! Number of shards the query cache index is split into with
+ *  ARES_FLAG_MULTICORE */
+#define ARES_QCACHE_SHARDS 16
+
 void          ares_qcache_destroy(ares_qcache_t *cache);
+/*! Create a query cache.  max_entries and max_bytes bound the size of the
+ *  cache, evicting least recently used entries as needed, 0 is unlimited.
+ *  stale_ttl is the number of seconds past expiration an entry may still be
+ *  served while it is refreshed in the background, and prefetch_pct is the
+ *  percentage of the TTL remaining at which a hit triggers a refresh.  With
+ *  more than one shard the index is split and locked independently of the
+ *  channel so ares_qcache_fetch_copy() may be used without the channel
+ *  lock. */
 ares_status_t ares_qcache_create(ares_rand_state *rand_state,
-                                 unsigned int     max_ttl,
-                                 ares_qcache_t  **cache_out);
+                                 unsigned int max_ttl, size_t max_entries,
+                                 size_t max_bytes, unsigned int stale_ttl,
+                                 unsigned int prefetch_pct, size_t shards,
+                                 ares_qcache_t **cache_out);
 void          ares_qcache_flush(ares_qcache_t *cache);
+/*! Insert a response into the query cache.  The parsed response is used for
+ *  validation and TTL calculation, but the cache itself only retains a copy
+ *  of the wire-format response which is materialized on first use. */
 ares_status_t ares_qcache_insert(ares_channel_t          *channel,
                                  const ares_timeval_t    *now,
                                  const ares_query_t      *query,
-                                 const ares_dns_record_t *dnsrec);
+                                 const ares_dns_record_t *dnsrec,
+                                 const unsigned char *abuf, size_t alen);
+/*! Fetch a response from the query cache.  The returned record is owned by
+ *  the cache and is only valid while the channel lock is held. */
 ares_status_t ares_qcache_fetch(ares_channel_t           *channel,
                                 const ares_timeval_t     *now,
                                 const ares_dns_record_t  *dnsrec,
                                 const ares_dns_record_t **dnsrec_resp);
+/*! Fetch a private copy of a response from the query cache without holding
+ *  the channel lock, only safe on a sharded cache.  Misses and hits that
+ *  need to trigger a background refresh return ARES_ENOTFOUND and must be
+ *  retried through ares_qcache_fetch() with the channel lock held.
+ *
+ *  \param[in]  qcache      Query cache, may be NULL
+ *  \param[in]  now         Current time
+ *  \param[in]  dnsrec      DNS request
+ *  \param[out] dnsrec_resp Response, must be freed by the caller
+ *  \return ARES_SUCCESS on a hit
+ */
+ares_status_t ares_qcache_fetch_copy(ares_qcache_t           *qcache,
+                                     const ares_timeval_t    *now,
+                                     const ares_dns_record_t *dnsrec,
+                                     ares_dns_record_t      **dnsrec_resp);
+
+ares_coalesce_t *ares_coalesce_create(void);
+void             ares_coalesce_destroy(ares_coalesce_t *coalesce);
+
+/*! Attach the callback to an identical query already in flight, sent with
+ *  the same flags.
+ *
+ *  \param[in]  channel  Initialized ares channel
+ *  \param[in]  flags    Send flags of the request
+ *  \param[in]  dnsrec   DNS request
+ *  \param[in]  callback Callback to invoke with the shared response
+ *  \param[in]  arg      Argument passed to callback
+ *  \param[out] qid      Optional, query id of the in-flight query
+ *  \return ARES_TRUE if attached, ARES_FALSE if a new query must be sent
+ */
+ares_bool_t ares_coalesce_join(ares_channel_t          *channel,
+                               ares_send_flags_t        flags,
+                               const ares_dns_record_t *dnsrec,
+                               ares_callback_dnsrec callback, void *arg,
+                               unsigned short *qid);
+
+/*! Register a newly created query so later identical queries sent with the
+ *  same flags may attach to it.  The query's callback is replaced with one
+ *  that fans the response out to every attached caller.  Failure just means
+ *  the query isn't shared. */
+void ares_coalesce_lead(ares_channel_t *channel, ares_send_flags_t flags,
+                        ares_query_t *query);
+
+ares_submit_t *ares_submit_create(void);
+void           ares_submit_destroy(ares_submit_t *submit);
+
+/*! Hand a request to the event thread without taking the channel lock.
+ *
+ *  \param[in] channel  Initialized ares channel
+ *  \param[in] dnsrec   DNS request, ownership is taken on success
+ *  \param[in] callback Callback to invoke once the request completes
+ *  \param[in] arg      Argument passed to callback
+ *  \return ARES_TRUE if queued, ARES_FALSE if the request must be sent
+ *          inline
+ */
+ares_bool_t    ares_submit_enqueue(ares_channel_t      *channel,
+                                   ares_dns_record_t   *dnsrec,
+                                   ares_callback_dnsrec callback, void *arg);
+
+/*! Number of requests waiting on the event thread, does not require the
+ *  channel lock */
+size_t         ares_submit_pending(const ares_channel_t *channel);
+
+/*! Send all queued requests.  Called by the event thread without the channel
+ *  lock held. */
+void           ares_submit_process(ares_channel_t *channel);
+
+/*! Fail all queued requests with the given status.  Must be holding the
+ *  channel lock. */
+void           ares_submit_cancel(ares_channel_t *channel, ares_status_t status);
 
 void   ares_metrics_record(const ares_query_t *query, ares_server_t *server,
                            ares_status_t status, const ares_dns_record_t *dnsrec);
 size_t ares_metrics_server_timeout(const ares_server_t  *server,
                                    const ares_timeval_t *now);
+/*! Latency percentile observed for the server in milliseconds, or 0 if there
+ *  aren't enough samples yet */
+size_t ares_metrics_server_percentile(const ares_server_t  *server,
+                                      const ares_timeval_t *now,
+                                      unsigned int          percentile);
+
+/*! Record a latency sample into a histogram of ARES_METRICS_HIST_LEN slots */
+void         ares_metrics_hist_add(unsigned int *hist, unsigned int ms);
+
+/*! Nearest-rank percentile (1-100) of a latency histogram, reported as the
+ *  upper bound of the matching slot.  Returns 0 if the histogram is empty */
+unsigned int ares_metrics_hist_percentile(const unsigned int *hist,
+                                          unsigned int        percentile);
 
 ares_status_t ares_cookie_apply(ares_dns_record_t *dnsrec, ares_conn_t *conn,
                                 const ares_timeval_t *now);
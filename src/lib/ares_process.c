@@ -53,6 +53,8 @@ static ares_status_t process_read(ares_channel_t       *channel,
                                   const ares_timeval_t *now);
 static ares_status_t process_timeouts(ares_channel_t       *channel,
                                       const ares_timeval_t *now);
+static ares_status_t ares_send_hedge(ares_query_t         *query,
+                                     const ares_timeval_t *now);
 static ares_status_t process_answer(ares_channel_t      *channel,
                                     const unsigned char *abuf, size_t alen,
                                     ares_conn_t          *conn,
@@ -67,14 +69,64 @@ static void        end_query(ares_channel_t *channel, ares_server_t *server,
                              ares_dns_record_t *dnsrec,
                              ares_array_t **requeue);
 
-static void        ares_query_remove_from_conn(ares_query_t *query)
+static void        ares_query_remove_hedge(ares_query_t *query)
+{
+  ares_twheel_cancel(query->channel->queries_by_hedge,
+                     &query->node_queries_by_hedge);
+  ares_llist_node_destroy(query->node_hedge_to_conn);
+  query->node_hedge_to_conn = NULL;
+  query->hedge_conn         = NULL;
+}
+
+static void ares_query_remove_from_conn(ares_query_t *query)
 {
   /* If its not part of a connection, it can't be tracked for timeouts either */
-  ares_slist_node_destroy(query->node_queries_by_timeout);
+  ares_twheel_cancel(query->channel->queries_by_timeout,
+                     &query->node_queries_by_timeout);
   ares_llist_node_destroy(query->node_queries_to_conn);
-  query->node_queries_by_timeout = NULL;
-  query->node_queries_to_conn    = NULL;
-  query->conn                    = NULL;
+  query->node_queries_to_conn = NULL;
+  query->conn                 = NULL;
+  ares_query_remove_hedge(query);
+}
+
+ares_bool_t ares_query_drop_leg(ares_query_t *query, const ares_conn_t *conn)
+{
+  if (query->hedge_conn == NULL) {
+    return ARES_FALSE;
+  }
+
+  if (conn == query->conn) {
+    /* Promote the hedge to be the only leg */
+    ares_llist_node_destroy(query->node_queries_to_conn);
+    query->node_queries_to_conn = query->node_hedge_to_conn;
+    query->conn                 = query->hedge_conn;
+    query->ts                   = query->hedge_ts;
+  } else if (conn == query->hedge_conn) {
+    ares_llist_node_destroy(query->node_hedge_to_conn);
+  } else {
+    return ARES_FALSE;
+  }
+
+  query->node_hedge_to_conn = NULL;
+  query->hedge_conn         = NULL;
+  return ARES_TRUE;
+}
+
+/* The first leg of a hedged query timed out, but the hedge may still answer.
+ * Keep waiting on the hedge alone, for as long as the first leg was given
+ * counting from when the hedge was sent. */
+static void ares_query_promote_hedge(ares_query_t *query)
+{
+  ares_timeval_t budget;
+
+  ares_timeval_diff(&budget, &query->ts, &query->timeout);
+  ares_query_drop_leg(query, query->conn);
+
+  query->timeout = query->ts;
+  timeadd(&query->timeout,
+          (size_t)budget.sec * 1000 + (size_t)budget.usec / 1000);
+  ares_twheel_arm(query->channel->queries_by_timeout,
+                  &query->node_queries_by_timeout, &query->timeout);
 }
 
 /* Invoke the server state callback after a success or failure */
@@ -190,6 +242,16 @@ static void timeadd(ares_timeval_t *now, size_t millisecs)
   }
 }
 
+void ares_query_set_deadline(ares_query_t *query, size_t timeout_ms)
+{
+  ares_timeval_t deadline;
+
+  ares_tvnow(&deadline);
+  timeadd(&deadline, timeout_ms);
+  ares_twheel_arm(query->channel->queries_by_deadline,
+                  &query->node_queries_by_deadline, &deadline);
+}
+
 static ares_status_t ares_process_fds_nolock(ares_channel_t         *channel,
                                              const ares_fd_events_t *events,
                                              size_t nevents, unsigned int flags)
@@ -425,32 +487,164 @@ void ares_process_pending_write(ares_channel_t *channel)
    */
   channel->notify_pending_write = ARES_FALSE;
 
+restart:
   for (node = ares_slist_node_first(channel->servers); node != NULL;
        node = ares_slist_node_next(node)) {
-    ares_server_t *server = ares_slist_node_val(node);
-    ares_conn_t   *conn   = server->tcp_conn;
-    ares_status_t  status;
+    ares_server_t     *server = ares_slist_node_val(node);
+    ares_llist_node_t *cnode;
 
-    if (conn == NULL) {
-      continue;
-    }
+    /* Both TCP and UDP may have pending data, UDP datagrams can be sent as
+     * a batch if supported by the socket functions */
+    for (cnode = ares_llist_node_first(server->connections); cnode != NULL;
+         cnode = ares_llist_node_next(cnode)) {
+      ares_conn_t  *conn = ares_llist_node_val(cnode);
+      ares_status_t status;
 
-    /* Enqueue any pending data if there is any */
-    status = ares_conn_flush(conn);
-    if (status != ARES_SUCCESS) {
-      handle_conn_error(conn, ARES_TRUE, status);
+      if (ares_buf_len(conn->out_buf) == 0) {
+        continue;
+      }
+
+      /* Enqueue any pending data if there is any */
+      status = ares_conn_flush(conn);
+      if (status != ARES_SUCCESS) {
+        /* Connection cleanup may requeue queries which can modify the list
+         * of connections, so start over */
+        handle_conn_error(conn, ARES_TRUE, status);
+        goto restart;
+      }
     }
   }
 
   ares_channel_unlock(channel);
 }
 
+/* A datagram that didn't fit its receive buffer can't be read again.  Reduce
+ * it to the header and question with the TC bit set, as a server honoring
+ * our advertised payload size would have sent, so its query is retried over
+ * TCP.  Returns the new length, or 0 if the question itself was cut off. */
+static size_t truncated_to_tc(unsigned char *msg, size_t len)
+{
+  size_t         pos = 12;
+  unsigned short qdcount;
+  unsigned short i;
+
+  if (len < pos) {
+    return 0;
+  }
+
+  qdcount = (unsigned short)((msg[4] << 8) | msg[5]);
+  for (i = 0; i < qdcount; i++) {
+    /* Name is a sequence of labels ending in a root label or pointer */
+    while (pos < len && msg[pos] != 0 && (msg[pos] & 0xC0) != 0xC0) {
+      pos += 1 + msg[pos];
+    }
+    if (pos >= len) {
+      return 0;
+    }
+    pos += (msg[pos] == 0) ? 1 : 2;
+
+    /* Type and class */
+    pos += 4;
+    if (pos > len) {
+      return 0;
+    }
+  }
+
+  msg[2] |= 0x02;
+  memset(msg + 6, 0, 6);
+  return pos;
+}
+
+/* Read UDP datagrams in batches directly into the length-prefixed in_buf
+ * framing.  Returns ARES_CONN_ERR_NOTIMP if unsupported, or if any remaining
+ * datagrams must be read individually. */
+static ares_conn_err_t read_conn_msgs(ares_conn_t *conn)
+{
+  const ares_channel_t *channel = conn->server->channel;
+  ares_socket_msg_t     msgs[ARES_SOCKET_MSGS_MAX];
+  size_t                msg_len;
+  size_t                cnt;
+
+  /* Responses are bounded by the advertised EDNS payload size, and share
+   * the same 64k read budget as the single datagram path */
+  msg_len = channel->ednspsz < 512 ? 512 : channel->ednspsz;
+  cnt     = 65535 / (msg_len + 2);
+  if (cnt > ARES_SOCKET_MSGS_MAX) {
+    cnt = ARES_SOCKET_MSGS_MAX;
+  }
+  if (cnt < 2 || conn->server->udp_nobatch) {
+    return ARES_CONN_ERR_NOTIMP;
+  }
+
+  while (1) {
+    size_t          len = cnt * (msg_len + 2);
+    size_t          recvd;
+    size_t          written = 0;
+    size_t          i;
+    unsigned char  *ptr;
+    ares_conn_err_t err;
+
+    ptr = ares_buf_append_start(conn->in_buf, &len);
+    if (ptr == NULL) {
+      return ARES_CONN_ERR_NOMEM;
+    }
+
+    /* Leave room for the length prefix ahead of each datagram */
+    for (i = 0; i < cnt; i++) {
+      msgs[i].buffer = ptr + (i * (msg_len + 2)) + 2;
+      msgs[i].length = msg_len;
+    }
+
+    err = ares_conn_read_msgs(conn, msgs, cnt, &recvd);
+    if (err != ARES_CONN_ERR_SUCCESS) {
+      ares_buf_append_finish(conn->in_buf, 0);
+      return err;
+    }
+
+    /* Compact the datagrams into consecutive frames.  A server that ignored
+     * the advertised payload size is likely to do so again, so once that is
+     * seen the remaining datagrams are read individually and in full */
+    for (i = 0; i < recvd; i++) {
+      if (msgs[i].length > msg_len) {
+        conn->server->udp_nobatch = ARES_TRUE;
+        msgs[i].length            = truncated_to_tc(msgs[i].buffer, msg_len);
+      }
+      ptr[written]     = (unsigned char)((msgs[i].length >> 8) & 0xFF);
+      ptr[written + 1] = (unsigned char)(msgs[i].length & 0xFF);
+      memmove(ptr + written + 2, msgs[i].buffer, msgs[i].length);
+      written += 2 + msgs[i].length;
+    }
+    ares_buf_append_finish(conn->in_buf, written);
+
+    /* Socket drained */
+    if (recvd < cnt) {
+      return ARES_CONN_ERR_SUCCESS;
+    }
+
+    if (conn->server->udp_nobatch) {
+      return ARES_CONN_ERR_NOTIMP;
+    }
+  }
+}
+
 static ares_status_t read_conn_packets(ares_conn_t *conn)
 {
   ares_bool_t           read_again;
   ares_conn_err_t       err;
   const ares_channel_t *channel = conn->server->channel;
 
+  if (!(conn->flags & ARES_CONN_FLAG_TCP)) {
+    err = read_conn_msgs(conn);
+    if (err == ARES_CONN_ERR_NOMEM) {
+      handle_conn_error(conn, ARES_FALSE /* not critical to connection */,
+                        ARES_SUCCESS);
+      return ARES_ENOMEM;
+    }
+    if (err != ARES_CONN_ERR_NOTIMP) {
+      goto done;
+    }
+  }
+
   do {
     size_t         count;
     size_t         len = 65535;
@@ -507,6 +701,7 @@ static ares_status_t read_conn_packets(ares_conn_t *conn)
      * a blocking socket and would cause recvfrom to hang. */
   } while (read_again);
 
+done:
   if (err != ARES_CONN_ERR_SUCCESS && err != ARES_CONN_ERR_WOULDBLOCK) {
     handle_conn_error(conn, ARES_TRUE, ARES_ECONNREFUSED);
     return ARES_ECONNREFUSED;
@@ -614,6 +809,7 @@ static ares_status_t read_answers(ares_conn_t *conn, const ares_timeval_t *now)
     data_len -= 2;
 
     /* We finished reading this answer; process it */
+    conn->total_answers++;
     status = process_answer(channel, data, data_len, conn, now, &requeue);
     if (status != ARES_SUCCESS) {
       handle_conn_error(conn, ARES_TRUE, status);
@@ -695,26 +891,43 @@ static ares_status_t process_read(ares_channel_t       *channel,
 static ares_status_t process_timeouts(ares_channel_t       *channel,
                                       const ares_timeval_t *now)
 {
-  ares_slist_node_t *node;
-  ares_status_t      status = ARES_SUCCESS;
-
-  /* Just keep popping off the first as this list will re-sort as things come
-   * and go.  We don't want to try to rely on 'next' as some operation might
-   * cause a cleanup of that pointer and would become invalid */
-  while ((node = ares_slist_node_first(channel->queries_by_timeout)) != NULL) {
-    ares_query_t *query = ares_slist_node_val(node);
-    ares_conn_t  *conn;
-
-    /* Since this is sorted, as soon as we hit a query that isn't timed out,
-     * break */
-    if (!ares_timedout(now, &query->timeout)) {
-      break;
+  ares_query_t *query;
+  ares_status_t status = ARES_SUCCESS;
+
+  /* Queries that are slow to answer get hedged before they time out */
+  while ((query = ares_twheel_expire(channel->queries_by_hedge, now)) !=
+         NULL) {
+    status = ares_send_hedge(query, now);
+    if (status == ARES_ENOMEM) {
+      goto done;
     }
+  }
+
+  /* Queries past their deadline are given up on without blaming the server */
+  while ((query = ares_twheel_expire(channel->queries_by_deadline, now)) !=
+         NULL) {
+    end_query(channel, NULL, query, ARES_ETIMEOUT, NULL, NULL);
+  }
+
+  /* Just keep popping off expired timers one at a time as handling a timeout
+   * may arm or cancel others */
+  while ((query = ares_twheel_expire(channel->queries_by_timeout, now)) !=
+         NULL) {
+    ares_conn_t *conn;
 
     query->timeouts++;
 
     conn = query->conn;
     server_increment_failures(conn->server, query->using_tcp);
+
+    /* Only the first server is to blame, the hedge is still in flight */
+    if (query->hedge_conn != NULL) {
+      query->error_status = ARES_ETIMEOUT;
+      query->try_count++;
+      ares_query_promote_hedge(query);
+      continue;
+    }
+
     status = ares_requeue_query(query, now, ARES_ETIMEOUT, ARES_TRUE, NULL,
       NULL);
     if (status == ARES_ENOMEM) {
@@ -823,7 +1036,7 @@ static ares_status_t process_answer(ares_channel_t      *channel,
   }
 
   /* Parse the response */
-  status = ares_dns_parse(abuf, alen, 0, &rdnsrec);
+  status = ares_dns_parse(abuf, alen, ARES_DNS_PARSE_ARENA, &rdnsrec);
   if (status != ARES_SUCCESS) {
     /* Malformations are never accepted */
     status = ARES_EBADRESP;
@@ -858,6 +1071,21 @@ static ares_status_t process_answer(ares_channel_t      *channel,
     goto cleanup;
   }
 
+  /* If the query was hedged and the hedge answered first, it becomes the
+   * query's main leg.  The other leg is forgotten once the query completes and
+   * is not counted as a failure for its server.  Send times are swapped too
+   * as the other leg is promoted back if this answer is rejected. */
+  if (query->hedge_conn == conn) {
+    ares_llist_node_t *node     = query->node_hedge_to_conn;
+    ares_timeval_t     ts       = query->ts;
+    query->node_hedge_to_conn   = query->node_queries_to_conn;
+    query->node_queries_to_conn = node;
+    query->hedge_conn           = query->conn;
+    query->conn                 = conn;
+    query->ts                   = query->hedge_ts;
+    query->hedge_ts             = ts;
+  }
+
   /* At this point we know we've received an answer for this query, so we should
    * remove it from the connection's queue so we can possibly invalidate the
    * connection. Delay cleaning up the connection though as we may enqueue
@@ -916,6 +1144,13 @@ static ares_status_t process_answer(ares_channel_t      *channel,
       }
 
       server_increment_failures(server, query->using_tcp);
+
+      /* The other leg of a hedged query may still give a good answer */
+      if (ares_query_drop_leg(query, conn)) {
+        status = ARES_SUCCESS;
+        goto cleanup;
+      }
+
       status = ares_requeue_query(query, now, status, ARES_TRUE, rdnsrec,
         requeue);
       rdnsrec = NULL; /* Free'd by ares_requeue_query() */
@@ -929,9 +1164,8 @@ static ares_status_t process_answer(ares_channel_t      *channel,
     }
   }
 
-  /* If cache insertion was successful, it took ownership.  We ignore
-   * other cache insertion failures. */
-  ares_qcache_insert(channel, now, query, rdnsrec);
+  /* We ignore cache insertion failures. */
+  ares_qcache_insert(channel, now, query, rdnsrec, abuf, alen);
 
   server_set_good(server, query->using_tcp);
   end_query(channel, server, query, ARES_SUCCESS, rdnsrec, requeue);
@@ -1063,6 +1297,77 @@ static ares_server_t *ares_random_server(ares_channel_t *channel)
   return NULL;
 }
 
+/* Number of queries sent to the server that are still awaiting a response */
+static size_t ares_server_outstanding(const ares_server_t *server)
+{
+  ares_llist_node_t *node;
+  size_t             cnt = 0;
+
+  for (node = ares_llist_node_first(server->connections); node != NULL;
+       node = ares_llist_node_next(node)) {
+    const ares_conn_t *conn = ares_llist_node_val(node);
+    cnt                    += ares_llist_len(conn->queries_to_conn);
+  }
+
+  return cnt;
+}
+
+/* Expected cost of sending a query to the server, its smoothed latency scaled
+ * by the queries already waiting on it.  A server that hasn't answered yet
+ * costs nothing so it gets measured. */
+static ares_uint64_t ares_server_cost(const ares_server_t *server)
+{
+  return (ares_uint64_t)server->latency_ewma_us *
+         (ares_uint64_t)(ares_server_outstanding(server) + 1);
+}
+
+/* Power of two choices: pick two distinct random servers among the *best*
+ * ones and use the cheaper of the two.  Unlike always taking the fastest
+ * server, this still spreads load so a burst of queries doesn't pile onto one
+ * server and the latency of the others stays known. */
+static ares_server_t *ares_latency_server(ares_channel_t *channel)
+{
+  unsigned short     r[2];
+  size_t             idx1;
+  size_t             idx2;
+  size_t             cnt;
+  ares_slist_node_t *node;
+  ares_server_t     *server1     = NULL;
+  ares_server_t     *server2     = NULL;
+  size_t             num_servers = count_highest_prio_servers(channel);
+
+  if (num_servers <= 1) {
+    return ares_slist_first_val(channel->servers);
+  }
+
+  ares_rand_bytes(channel->rand_state, (unsigned char *)r, sizeof(r));
+  idx1 = r[0] % num_servers;
+  idx2 = r[1] % (num_servers - 1);
+  if (idx2 >= idx1) {
+    idx2++;
+  }
+
+  cnt = 0;
+  for (node = ares_slist_node_first(channel->servers);
+       node != NULL && (server1 == NULL || server2 == NULL);
+       node = ares_slist_node_next(node)) {
+    if (cnt == idx1) {
+      server1 = ares_slist_node_val(node);
+    } else if (cnt == idx2) {
+      server2 = ares_slist_node_val(node);
+    }
+    cnt++;
+  }
+
+  /* Silence coverity, not possible */
+  if (server1 == NULL || server2 == NULL) {
+    return server1 != NULL ? server1 : server2;
+  }
+
+  return ares_server_cost(server2) < ares_server_cost(server1) ? server2
+                                                               : server1;
+}
+
 static void server_probe_cb(void *arg, ares_status_t status, size_t timeouts,
                             const ares_dns_record_t *dnsrec)
 {
@@ -1187,34 +1492,67 @@ static ares_conn_t *ares_fetch_connection(const ares_channel_t *channel,
                                           const ares_query_t   *query)
 {
   ares_llist_node_t *node;
-  ares_conn_t       *conn;
+  ares_conn_t       *conn = NULL;
+  ares_conn_t       *best = NULL;
+  size_t             cnt  = 0;
+  size_t             idx;
 
   if (query->using_tcp) {
     return server->tcp_conn;
   }
 
-  /* Fetch existing UDP connection */
-  node = ares_llist_node_first(server->connections);
-  if (node == NULL) {
+  /* If the associated server has failures, don't use it.  It should be cleaned
+   * up later. */
+  if (server->consec_failures > 0) {
     return NULL;
   }
 
-  conn = ares_llist_node_val(node);
-  /* Not UDP, skip */
-  if (conn->flags & ARES_CONN_FLAG_TCP) {
-    return NULL;
+  /* Count the usable UDP connections, they are at the front of the list with
+   * the newest first */
+  for (node = ares_llist_node_first(server->connections);
+       node != NULL && cnt < channel->udp_sockets;
+       node = ares_llist_node_next(node)) {
+    conn = ares_llist_node_val(node);
+
+    /* Not UDP, no more UDP connections */
+    if (conn->flags & ARES_CONN_FLAG_TCP) {
+      break;
+    }
+
+    /* Used too many times */
+    if (channel->udp_max_queries > 0 &&
+        conn->total_queries >= channel->udp_max_queries) {
+      continue;
+    }
+
+    if (best == NULL || ares_llist_len(conn->queries_to_conn) <
+                          ares_llist_len(best->queries_to_conn)) {
+      best = conn;
+    }
+    cnt++;
   }
 
-  /* If the associated server has failures, don't use it.  It should be cleaned
-   * up later. */
-  if (conn->server->consec_failures > 0) {
+  /* Open another socket until the server has as many as configured */
+  if (cnt < channel->udp_sockets) {
     return NULL;
   }
 
-  /* Used too many times */
-  if (channel->udp_max_queries > 0 &&
-      conn->total_queries >= channel->udp_max_queries) {
-    return NULL;
+  if (channel->udp_balance == ARES_UDP_BALANCE_LEAST_LOADED) {
+    return best;
+  }
+
+  /* Round robin across the same connections */
+  idx = server->udp_next++ % cnt;
+  for (node = ares_llist_node_first(server->connections); node != NULL;
+       node = ares_llist_node_next(node)) {
+    conn = ares_llist_node_val(node);
+    if (channel->udp_max_queries > 0 &&
+        conn->total_queries >= channel->udp_max_queries) {
+      continue;
+    }
+    if (idx-- == 0) {
+      break;
+    }
   }
 
   return conn;
@@ -1248,12 +1586,12 @@ static ares_status_t ares_conn_query_write(ares_conn_t          *conn,
     return ARES_SUCCESS;
   }
 
-  /* Delay actual write if possible (TCP only, and only if callback
-   * configured) */
-  if (channel->notify_pending_write_cb && !channel->notify_pending_write &&
-      conn->flags & ARES_CONN_FLAG_TCP) {
-    channel->notify_pending_write = ARES_TRUE;
-    channel->notify_pending_write_cb(channel->notify_pending_write_cb_data);
+  /* Delay actual write if possible (only if callback configured) */
+  if (channel->notify_pending_write_cb) {
+    if (!channel->notify_pending_write) {
+      channel->notify_pending_write = ARES_TRUE;
+      channel->notify_pending_write_cb(channel->notify_pending_write_cb_data);
+    }
     return ARES_SUCCESS;
   }
 
@@ -1262,6 +1600,143 @@ static ares_status_t ares_conn_query_write(ares_conn_t          *conn,
   return ares_conn_flush(conn);
 }
 
+/*! Each hedge costs this much credit, so a query earning hedge_max_pct keeps
+ *  hedges to that percentage of the queries sent */
+#define HEDGE_COST 100
+
+/*! Maximum credit that can be saved up, the largest burst of hedges allowed
+ *  after a quiet period */
+#define HEDGE_CREDIT_MAX (HEDGE_COST * 10)
+
+/* Next best server to hedge a query to, the cheapest healthy server other
+ * than the one the query is already waiting on */
+static ares_server_t *ares_hedge_server(const ares_channel_t *channel,
+                                        const ares_server_t  *exclude)
+{
+  ares_slist_node_t *node;
+  ares_server_t     *best      = NULL;
+  ares_uint64_t      best_cost = 0;
+
+  for (node = ares_slist_node_first(channel->servers); node != NULL;
+       node = ares_slist_node_next(node)) {
+    ares_server_t *server = ares_slist_node_val(node);
+    ares_uint64_t  cost;
+
+    /* Sorted by failures, so there are no healthy servers left */
+    if (server->consec_failures > 0) {
+      break;
+    }
+
+    if (server == exclude) {
+      continue;
+    }
+
+    cost = ares_server_cost(server);
+    if (best == NULL || cost < best_cost) {
+      best      = server;
+      best_cost = cost;
+    }
+  }
+
+  return best;
+}
+
+/* Schedule a hedge for a query just sent for the first time, once it has been
+ * waiting longer than the configured latency percentile of its server */
+static void ares_query_arm_hedge(ares_query_t         *query,
+                                 const ares_server_t  *server,
+                                 size_t                timeplus,
+                                 const ares_timeval_t *now)
+{
+  ares_channel_t *channel = query->channel;
+  ares_timeval_t  tv;
+  size_t          delay;
+
+  if (!(channel->optmask & ARES_OPT_HEDGE) || query->no_retries ||
+      query->try_count != 0 || ares_slist_len(channel->servers) < 2) {
+    return;
+  }
+
+  channel->hedge_credit += channel->hedge_max_pct;
+  if (channel->hedge_credit > HEDGE_CREDIT_MAX) {
+    channel->hedge_credit = HEDGE_CREDIT_MAX;
+  }
+
+  /* Not enough samples yet, or the query would time out first anyway */
+  delay = ares_metrics_server_percentile(server, now, channel->hedge_percentile);
+  if (delay == 0 || delay >= timeplus) {
+    return;
+  }
+
+  tv = *now;
+  timeadd(&tv, delay);
+  ares_twheel_arm(channel->queries_by_hedge, &query->node_queries_by_hedge,
+                  &tv);
+}
+
+/* The query hasn't been answered by the time most answers from its server
+ * arrive, so send the same request to the next best server too.  Failing to
+ * hedge is never fatal, the query simply keeps waiting on its first server. */
+static ares_status_t ares_send_hedge(ares_query_t         *query,
+                                     const ares_timeval_t *now)
+{
+  ares_channel_t *channel = query->channel;
+  ares_server_t  *server;
+  ares_conn_t    *conn;
+  ares_status_t   status;
+
+  if (query->conn == NULL || channel->hedge_credit < HEDGE_COST) {
+    return ARES_SUCCESS;
+  }
+
+  server = ares_hedge_server(channel, query->conn->server);
+  if (server == NULL) {
+    return ARES_SUCCESS;
+  }
+
+  conn = ares_fetch_connection(channel, server, query);
+  if (conn == NULL) {
+    status = ares_open_connection(&conn, channel, server, query->using_tcp);
+    if (status != ARES_SUCCESS) {
+      return (status == ARES_ENOMEM) ? ARES_ENOMEM : ARES_SUCCESS;
+    }
+  }
+
+  /* Writing rewrites the cookie in the request for the new server, responses
+   * must now be validated against each server's own client cookie */
+  query->hedged = ARES_TRUE;
+
+  status = ares_conn_query_write(conn, query, now);
+  switch (status) {
+    case ARES_SUCCESS:
+      break;
+
+    case ARES_ENOMEM:
+      return status;
+
+    case ARES_ECONNREFUSED:
+    case ARES_EBADFAMILY:
+      handle_conn_error(conn, ARES_TRUE, status);
+      return ARES_SUCCESS;
+
+    default:
+      return ARES_SUCCESS;
+  }
+
+  query->node_hedge_to_conn =
+    ares_llist_insert_last(conn->queries_to_conn, query);
+  if (query->node_hedge_to_conn == NULL) {
+    return ARES_ENOMEM; /* LCOV_EXCL_LINE: OutOfMemory */
+  }
+
+  query->hedge_conn  = conn;
+  query->hedge_ts    = *now;
+  conn->total_queries++;
+  channel->hedge_credit -= HEDGE_COST;
+
+  return ARES_SUCCESS;
+}
+
 ares_status_t ares_send_query(ares_server_t *requested_server,
                               ares_query_t *query, const ares_timeval_t *now)
 {
@@ -1276,8 +1751,10 @@ ares_status_t ares_send_query(ares_server_t *requested_server,
   if (requested_server != NULL) {
     server = requested_server;
   } else {
-    /* If rotate is turned on, do a random selection */
-    if (channel->rotate) {
+    if (channel->server_selection == ARES_SERVER_SELECT_LATENCY) {
+      server = ares_latency_server(channel);
+    } else if (channel->rotate) {
+      /* If rotate is turned on, do a random selection */
       server = ares_random_server(channel);
     } else {
       /* First server in list */
@@ -1352,18 +1829,11 @@ ares_status_t ares_send_query(ares_server_t *requested_server,
   /* Keep track of queries bucketed by timeout, so we can process
    * timeout events quickly.
    */
-  ares_slist_node_destroy(query->node_queries_by_timeout);
   query->ts      = *now;
   query->timeout = *now;
   timeadd(&query->timeout, timeplus);
-  query->node_queries_by_timeout =
-    ares_slist_insert(channel->queries_by_timeout, query);
-  if (!query->node_queries_by_timeout) {
-    /* LCOV_EXCL_START: OutOfMemory */
-    end_query(channel, server, query, ARES_ENOMEM, NULL, NULL);
-    return ARES_ENOMEM;
-    /* LCOV_EXCL_STOP */
-  }
+  ares_twheel_arm(channel->queries_by_timeout, &query->node_queries_by_timeout,
+                  &query->timeout);
 
   /* Keep track of queries bucketed by connection, so we can process errors
    * quickly. */
@@ -1378,9 +1848,14 @@ ares_status_t ares_send_query(ares_server_t *requested_server,
     /* LCOV_EXCL_STOP */
   }
 
-  query->conn = conn;
+  query->conn   = conn;
+  query->hedged = ARES_FALSE;
   conn->total_queries++;
 
+  if (requested_server == NULL) {
+    ares_query_arm_hedge(query, server, timeplus, now);
+  }
+
   /* We just successfully enqueud a query, see if we should probe downed
    * servers. */
   if (probe_downed_server) {
@@ -1459,6 +1934,8 @@ static void ares_detach_query(ares_query_t *query)
   /* Remove the query from all the lists in which it is linked */
   ares_query_remove_from_conn(query);
   ares_htable_szvp_remove(query->channel->queries_by_qid, query->qid);
+  ares_twheel_cancel(query->channel->queries_by_deadline,
+                     &query->node_queries_by_deadline);
   ares_llist_node_destroy(query->node_all_queries);
   query->node_all_queries = NULL;
 }
@@ -1502,5 +1979,5 @@ void ares_free_query(ares_query_t *query)
   /* Deallocate the memory associated with the query */
   ares_dns_record_destroy(query->query);
 
-  ares_free(query);
+  ares_pool_put(query->channel->query_pool, query);
 }
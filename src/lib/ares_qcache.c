@@ -24,118 +24,457 @@
  * SPDX-License-Identifier: MIT
  */
 #include "ares_private.h"
+#include "dsa/ares_htable.h"
+
+/* TTL given to stale answers as recommended by RFC 8767 Section 4, and the
+ * minimum number of seconds between refresh attempts of a stale entry when
+ * the upstream servers are failing */
+#define ARES_QCACHE_STALE_ANSWER_TTL 30
+#define ARES_QCACHE_STALE_RETRY      30
+
+/*! Binary cache key.  Format is:
+ *    OPCODE(1) FLAGS(1) [QNAME(wire format, lowercase) QTYPE(2) QCLASS(2)]...
+ */
+typedef struct {
+  const unsigned char *data;
+  size_t               len;
+} ares_qcache_key_t;
+
+/*! Partition of the cache index.  Entries are only inserted and removed with
+ *  the channel lock held, but with ARES_FLAG_MULTICORE hits are also served
+ *  without it, so the index, the per-entry state read on a hit, and the hit
+ *  counters are additionally protected by the shard lock.  The lock is NULL
+ *  when the cache isn't sharded. */
+typedef struct {
+  ares_thread_mutex_t *lock;
+  ares_htable_t       *cache;
+  size_t               hits;
+  size_t               stale_hits;
+} ares_qcache_shard_t;
 
 struct ares_qcache {
-  ares_htable_strvp_t *cache;
+  ares_qcache_shard_t *shards;
+  size_t               nshards;
   ares_slist_t        *expire;
   unsigned int         max_ttl;
+
+  /*! Limits on the cache size, 0 means unlimited */
+  size_t               max_entries;
+  size_t               max_bytes;
+  size_t               bytes;
+
+  /*! CLOCK (second chance) eviction ring of entries and the current position
+   *  of the clock hand, NULL means the start of the ring */
+  ares_llist_t        *clock;
+  ares_llist_node_t   *clock_hand;
+
+  /*! Number of seconds past expiration an entry may be served (RFC 8767),
+   *  and percentage of the TTL remaining at which a hit triggers a background
+   *  refresh.  0 disables either. */
+  unsigned int         stale_ttl;
+  unsigned int         prefetch_pct;
+
+  size_t               misses;
+  size_t               evictions;
+  size_t               refreshes;
 };
 
+/*! Location of a TTL within the cached wire-format response along with the
+ *  TTL as originally received */
+typedef struct {
+  unsigned short offset;
+  unsigned int   ttl;
+} ares_qcache_ttl_t;
+
+/*! Cache entries are stored as a single allocation laid out as:
+ *    [entry][ttl index][response wire bytes][key bytes]
+ *  The response is kept in wire format as received from the server and is
+ *  only materialized into an ares_dns_record_t on first use. */
 typedef struct {
-  char              *key;
-  ares_dns_record_t *dnsrec;
-  time_t             expire_ts;
-  time_t             insert_ts;
+  ares_qcache_key_t        key;
+  ares_qcache_shard_t     *shard;
+  const ares_qcache_ttl_t *ttls;
+  size_t                   ttls_cnt;
+  unsigned char           *wire;
+  size_t                   wire_len;
+  /*! Lazily materialized view of the response, NULL until first fetch */
+  ares_dns_record_t       *dnsrec;
+  /*! Memory held by the view, charged to the cache along with alloc_len */
+  size_t                   view_len;
+  time_t                   view_ts;
+  ares_bool_t              view_stale;
+  time_t                   expire_ts;
+  /*! Time the entry is removed from the cache, past expire_ts when serving
+   *  stale answers is enabled */
+  time_t                   purge_ts;
+  time_t                   insert_ts;
+  ares_slist_node_t       *node;
+  /*! Background refresh state */
+  ares_bool_t              refresh_pending;
+  time_t                   refresh_retry_ts;
+  /*! Size of the entry allocation, used for memory accounting */
+  size_t                   alloc_len;
+  /*! Set on each cache hit, cleared as the clock hand passes */
+  ares_bool_t              referenced;
+  ares_llist_node_t       *clock_node;
 } ares_qcache_entry_t;
 
-static char *ares_qcache_calc_key(const ares_dns_record_t *dnsrec)
+#define ARES_QCACHE_KEY_FLAG_RD (1 << 0)
+#define ARES_QCACHE_KEY_FLAG_CD (1 << 1)
+
+/* Append the name in lowercase DNS wire format.  A trailing '.' is ignored as
+ * on queries it is only used to indicate an explicit name lookup without
+ * performing a search and isn't part of the cached response. */
+static ares_bool_t ares_qcache_key_append_name(unsigned char *buf,
+                                               size_t *pos, const char *name)
 {
-  ares_buf_t      *buf = ares_buf_create();
-  size_t           i;
-  ares_status_t    status;
-  ares_dns_flags_t flags;
+  size_t label_pos = *pos;
+  size_t name_len  = 0;
+  size_t i;
 
-  if (dnsrec == NULL || buf == NULL) {
-    return NULL; /* LCOV_EXCL_LINE: DefensiveCoding */
+  /* Reserve room for the first label length */
+  if (*pos + 1 > ARES_QCACHE_KEY_MAXLEN) {
+    return ARES_FALSE;
   }
+  (*pos)++;
 
-  /* Format is OPCODE|FLAGS[|QTYPE1|QCLASS1|QNAME1]... */
+  for (i = 0; name != NULL && name[i] != 0; i++) {
+    unsigned char c = (unsigned char)name[i];
 
-  status = ares_buf_append_str(
-    buf, ares_dns_opcode_tostr(ares_dns_record_get_opcode(dnsrec)));
-  if (status != ARES_SUCCESS) {
-    goto fail; /* LCOV_EXCL_LINE: OutOfMemory */
+    if (c == '.') {
+      size_t len = *pos - label_pos - 1;
+
+      /* Blank labels are only allowed for the root or trailing '.' */
+      if (len == 0) {
+        if (name[i + 1] == 0 && i == 0) {
+          break;
+        }
+        return ARES_FALSE;
+      }
+
+      buf[label_pos] = (unsigned char)len;
+      label_pos      = *pos;
+      if (*pos + 1 > ARES_QCACHE_KEY_MAXLEN) {
+        return ARES_FALSE;
+      }
+      (*pos)++;
+      continue;
+    }
+
+    if (c == '\\') {
+      i++;
+      c = (unsigned char)name[i];
+      if (c == 0) {
+        return ARES_FALSE;
+      }
+      if (ares_isdigit(c)) {
+        unsigned int val = 0;
+        size_t       j;
+
+        for (j = 0; j < 3; j++) {
+          if (!ares_isdigit(name[i + j])) {
+            return ARES_FALSE;
+          }
+          val = (val * 10) + (unsigned int)(name[i + j] - '0');
+        }
+        if (val > 255) {
+          return ARES_FALSE;
+        }
+        i += 2;
+        c  = (unsigned char)val;
+      }
+    }
+
+    if (*pos + 1 > ARES_QCACHE_KEY_MAXLEN || *pos - label_pos - 1 >= 63 ||
+        ++name_len > 255) {
+      return ARES_FALSE;
+    }
+    buf[(*pos)++] = ares_tolower(c);
   }
 
-  status = ares_buf_append_byte(buf, '|');
-  if (status != ARES_SUCCESS) {
-    goto fail; /* LCOV_EXCL_LINE: OutOfMemory */
+  /* Close out the last label and add the terminator if needed */
+  if (*pos - label_pos - 1 != 0) {
+    buf[label_pos] = (unsigned char)(*pos - label_pos - 1);
+    if (*pos + 1 > ARES_QCACHE_KEY_MAXLEN) {
+      return ARES_FALSE;
+    }
+    (*pos)++;
+  }
+  buf[*pos - 1] = 0;
+
+  return ARES_TRUE;
+}
+
+/* Build the binary key for the request into the provided buffer which must be
+ * at least ARES_QCACHE_KEY_MAXLEN bytes.  No allocations are performed.
+ * Returns ARES_FALSE if the request can't be represented as a key, in which
+ * case it is simply not cacheable. */
+static ares_bool_t ares_qcache_calc_key(const ares_dns_record_t *dnsrec,
+                                        unsigned char           *buf,
+                                        ares_qcache_key_t       *key)
+{
+  size_t           pos = 0;
+  size_t           i;
+  ares_dns_flags_t flags;
+
+  if (dnsrec == NULL) {
+    return ARES_FALSE; /* LCOV_EXCL_LINE: DefensiveCoding */
   }
 
+  buf[pos++] = (unsigned char)ares_dns_record_get_opcode(dnsrec);
+
   flags = ares_dns_record_get_flags(dnsrec);
   /* Only care about RD and CD */
+  buf[pos] = 0;
   if (flags & ARES_FLAG_RD) {
-    status = ares_buf_append_str(buf, "rd");
-    if (status != ARES_SUCCESS) {
-      goto fail; /* LCOV_EXCL_LINE: OutOfMemory */
-    }
+    buf[pos] |= ARES_QCACHE_KEY_FLAG_RD;
   }
   if (flags & ARES_FLAG_CD) {
-    status = ares_buf_append_str(buf, "cd");
-    if (status != ARES_SUCCESS) {
-      goto fail; /* LCOV_EXCL_LINE: OutOfMemory */
-    }
+    buf[pos] |= ARES_QCACHE_KEY_FLAG_CD;
   }
+  pos++;
 
   for (i = 0; i < ares_dns_record_query_cnt(dnsrec); i++) {
     const char         *name;
-    size_t              name_len;
     ares_dns_rec_type_t qtype;
     ares_dns_class_t    qclass;
 
-    status = ares_dns_record_query_get(dnsrec, i, &name, &qtype, &qclass);
-    if (status != ARES_SUCCESS) {
-      goto fail; /* LCOV_EXCL_LINE: DefensiveCoding */
+    if (ares_dns_record_query_get(dnsrec, i, &name, &qtype, &qclass) !=
+        ARES_SUCCESS) {
+      return ARES_FALSE; /* LCOV_EXCL_LINE: DefensiveCoding */
     }
 
-    status = ares_buf_append_byte(buf, '|');
-    if (status != ARES_SUCCESS) {
-      goto fail; /* LCOV_EXCL_LINE: OutOfMemory */
+    if (!ares_qcache_key_append_name(buf, &pos, name) ||
+        pos + 4 > ARES_QCACHE_KEY_MAXLEN) {
+      return ARES_FALSE;
     }
 
-    status = ares_buf_append_str(buf, ares_dns_rec_type_tostr(qtype));
-    if (status != ARES_SUCCESS) {
-      goto fail; /* LCOV_EXCL_LINE: OutOfMemory */
+    buf[pos++] = (unsigned char)(((unsigned int)qtype >> 8) & 0xFF);
+    buf[pos++] = (unsigned char)((unsigned int)qtype & 0xFF);
+    buf[pos++] = (unsigned char)(((unsigned int)qclass >> 8) & 0xFF);
+    buf[pos++] = (unsigned char)((unsigned int)qclass & 0xFF);
+  }
+
+  key->data = buf;
+  key->len  = pos;
+  return ARES_TRUE;
+}
+
+ares_bool_t ares_qcache_key(const ares_dns_record_t *dnsrec,
+                            unsigned char *buf, size_t *len)
+{
+  ares_qcache_key_t key;
+
+  if (!ares_qcache_calc_key(dnsrec, buf, &key)) {
+    return ARES_FALSE;
+  }
+
+  *len = key.len;
+  return ARES_TRUE;
+}
+
+static unsigned int ares_qcache_key_hash(const void *key, unsigned int seed)
+{
+  const ares_qcache_key_t *k = key;
+  return ares_htable_hash_FNV1a(k->data, k->len, seed);
+}
+
+static const void *ares_qcache_key_bucket(const void *bucket)
+{
+  const ares_qcache_entry_t *entry = bucket;
+  return &entry->key;
+}
+
+static ares_bool_t ares_qcache_key_eq(const void *key1, const void *key2)
+{
+  const ares_qcache_key_t *k1 = key1;
+  const ares_qcache_key_t *k2 = key2;
+
+  if (k1->len != k2->len) {
+    return ARES_FALSE;
+  }
+
+  return memcmp(k1->data, k2->data, k1->len) == 0 ? ARES_TRUE : ARES_FALSE;
+}
+
+/* Skip over a possibly compressed name in a wire-format message */
+static ares_bool_t ares_qcache_wire_skip_name(const unsigned char *buf,
+                                              size_t len, size_t *pos)
+{
+  while (*pos < len) {
+    unsigned char c = buf[*pos];
+
+    /* Compression pointer terminates the name */
+    if ((c & 0xC0) == 0xC0) {
+      *pos += 2;
+      return (*pos <= len) ? ARES_TRUE : ARES_FALSE;
     }
 
-    status = ares_buf_append_byte(buf, '|');
-    if (status != ARES_SUCCESS) {
-      goto fail; /* LCOV_EXCL_LINE: OutOfMemory */
+    /* Reserved label types */
+    if (c & 0xC0) {
+      return ARES_FALSE;
     }
 
-    status = ares_buf_append_str(buf, ares_dns_class_tostr(qclass));
-    if (status != ARES_SUCCESS) {
-      goto fail; /* LCOV_EXCL_LINE: OutOfMemory */
+    (*pos)++;
+    if (c == 0) {
+      return ARES_TRUE;
     }
+    *pos += c;
+  }
 
-    status = ares_buf_append_byte(buf, '|');
-    if (status != ARES_SUCCESS) {
-      goto fail; /* LCOV_EXCL_LINE: OutOfMemory */
+  return ARES_FALSE;
+}
+
+static unsigned short ares_qcache_wire_be16(const unsigned char *buf)
+{
+  return (unsigned short)(((unsigned int)buf[0] << 8) | buf[1]);
+}
+
+/* Walk the wire-format response and record the location of every TTL that
+ * needs to be adjusted when returning the response.  If ttls is NULL, only
+ * counts the number of TTLs. */
+static ares_bool_t ares_qcache_wire_index(const unsigned char *buf, size_t len,
+                                          ares_qcache_ttl_t *ttls,
+                                          size_t            *ttls_cnt)
+{
+  size_t pos = 12;
+  size_t qdcount;
+  size_t rrcount;
+  size_t i;
+
+  *ttls_cnt = 0;
+
+  if (len < 12 || len > 65535) {
+    return ARES_FALSE;
+  }
+
+  qdcount = ares_qcache_wire_be16(buf + 4);
+  rrcount = (size_t)ares_qcache_wire_be16(buf + 6) +
+            (size_t)ares_qcache_wire_be16(buf + 8) +
+            (size_t)ares_qcache_wire_be16(buf + 10);
+
+  for (i = 0; i < qdcount; i++) {
+    if (!ares_qcache_wire_skip_name(buf, len, &pos) || pos + 4 > len) {
+      return ARES_FALSE;
     }
+    pos += 4;
+  }
 
-    /* On queries, a '.' may be appended to the name to indicate an explicit
-     * name lookup without performing a search.  Strip this since its not part
-     * of a cached response. */
-    name_len = ares_strlen(name);
-    if (name_len && name[name_len - 1] == '.') {
-      name_len--;
+  for (i = 0; i < rrcount; i++) {
+    unsigned short type;
+
+    if (!ares_qcache_wire_skip_name(buf, len, &pos) || pos + 10 > len) {
+      return ARES_FALSE;
     }
 
-    if (name_len > 0) {
-      status = ares_buf_append(buf, (const unsigned char *)name, name_len);
-      if (status != ARES_SUCCESS) {
-        goto fail; /* LCOV_EXCL_LINE: OutOfMemory */
+    type = ares_qcache_wire_be16(buf + pos);
+    pos += 4; /* Type and class */
+
+    /* The OPT RR overloads the TTL for its own use */
+    if (type != ARES_REC_TYPE_OPT) {
+      if (ttls != NULL) {
+        ttls[*ttls_cnt].offset = (unsigned short)pos;
+        ttls[*ttls_cnt].ttl    = ((unsigned int)buf[pos] << 24) |
+                              ((unsigned int)buf[pos + 1] << 16) |
+                              ((unsigned int)buf[pos + 2] << 8) |
+                              (unsigned int)buf[pos + 3];
       }
+      (*ttls_cnt)++;
+    }
+    pos += 4; /* TTL */
+
+    pos += 2 + (size_t)ares_qcache_wire_be16(buf + pos); /* RDLENGTH + RDATA */
+    if (pos > len) {
+      return ARES_FALSE;
     }
   }
 
-  return ares_buf_finish_str(buf, NULL);
+  return ARES_TRUE;
+}
 
-/* LCOV_EXCL_START: OutOfMemory */
-fail:
-  ares_buf_destroy(buf);
-  return NULL;
-  /* LCOV_EXCL_STOP */
+/* Patch the TTLs in a wire-format response to reflect the amount of time
+ * spent in the cache.  Stale answers get a fixed TTL instead. */
+static void ares_qcache_wire_patch(unsigned char           *wire,
+                                   const ares_qcache_ttl_t *ttls,
+                                   size_t ttls_cnt, unsigned int elapsed,
+                                   ares_bool_t stale)
+{
+  size_t i;
+
+  for (i = 0; i < ttls_cnt; i++) {
+    unsigned char *ptr = wire + ttls[i].offset;
+    unsigned int   ttl = ttls[i].ttl;
+
+    if (stale) {
+      ttl = ARES_QCACHE_STALE_ANSWER_TTL;
+    } else {
+      ttl = (ttl > elapsed) ? ttl - elapsed : 0;
+    }
+    ptr[0] = (unsigned char)((ttl >> 24) & 0xFF);
+    ptr[1] = (unsigned char)((ttl >> 16) & 0xFF);
+    ptr[2] = (unsigned char)((ttl >> 8) & 0xFF);
+    ptr[3] = (unsigned char)(ttl & 0xFF);
+  }
+}
+
+/* Materialize the wire-format response as a record.  Patches the entry's own
+ * copy of the response so the shard lock must be held. */
+static ares_status_t ares_qcache_entry_materialize(ares_qcache_entry_t  *entry,
+                                                   const ares_timeval_t *now,
+                                                   ares_bool_t           stale)
+{
+  ares_qcache_wire_patch(entry->wire, entry->ttls, entry->ttls_cnt,
+                         (unsigned int)(now->sec - entry->insert_ts), stale);
+
+  entry->view_ts    = (time_t)now->sec;
+  entry->view_stale = stale;
+  return ares_dns_parse(entry->wire, entry->wire_len, ARES_DNS_PARSE_ARENA,
+                        &entry->dnsrec);
+}
+
+static void ares_qcache_entry_drop_view(ares_qcache_t       *cache,
+                                        ares_qcache_entry_t *entry)
+{
+  ares_dns_record_destroy(entry->dnsrec);
+  entry->dnsrec  = NULL;
+  cache->bytes  -= entry->view_len;
+  entry->view_len = 0;
+}
+
+static void ares_qcache_bucket_free(void *bucket)
+{
+  /* Entries are owned by the expire list */
+  (void)bucket;
+}
+
+static ares_qcache_shard_t *ares_qcache_shard(const ares_qcache_t     *cache,
+                                              const ares_qcache_key_t *key)
+{
+  size_t idx = 0;
+
+  if (cache->nshards > 1) {
+    idx = ares_htable_hash_FNV1a(key->data, key->len, 0) % cache->nshards;
+  }
+
+  return &cache->shards[idx];
+}
+
+static void ares_qcache_entry_remove(ares_qcache_t       *cache,
+                                     ares_qcache_entry_t *entry)
+{
+  if (cache->clock_hand == entry->clock_node) {
+    cache->clock_hand = ares_llist_node_next(entry->clock_node);
+  }
+  ares_llist_node_destroy(entry->clock_node);
+  cache->bytes -= entry->alloc_len + entry->view_len;
+
+  /* Once out of the index no lockless reader can reach the entry */
+  ares_thread_mutex_lock(entry->shard->lock);
+  ares_htable_remove(entry->shard->cache, &entry->key);
+  ares_thread_mutex_unlock(entry->shard->lock);
+
+  /* Frees the entry */
+  ares_slist_node_destroy(entry->node);
 }
 
 static void ares_qcache_expire(ares_qcache_t *cache, const ares_timeval_t *now)
@@ -147,15 +486,70 @@ static void ares_qcache_expire(ares_qcache_t *cache, const ares_timeval_t *now)
   }
 
   while ((node = ares_slist_node_first(cache->expire)) != NULL) {
-    const ares_qcache_entry_t *entry = ares_slist_node_val(node);
+    ares_qcache_entry_t *entry = ares_slist_node_val(node);
 
     /* If now is NULL, we're flushing everything, so don't break */
-    if (now != NULL && entry->expire_ts > now->sec) {
+    if (now != NULL && entry->purge_ts > now->sec) {
       break;
     }
 
-    ares_htable_strvp_remove(cache->cache, entry->key);
-    ares_slist_node_destroy(node);
+    ares_qcache_entry_remove(cache, entry);
+  }
+}
+
+static ares_bool_t ares_qcache_over_limit(const ares_qcache_t *cache,
+                                          size_t               add_entries,
+                                          size_t               add_bytes)
+{
+  if (cache->max_entries &&
+      ares_llist_len(cache->clock) + add_entries > cache->max_entries) {
+    return ARES_TRUE;
+  }
+
+  if (cache->max_bytes && cache->bytes + add_bytes > cache->max_bytes) {
+    return ARES_TRUE;
+  }
+
+  return ARES_FALSE;
+}
+
+/* Evict entries using the CLOCK algorithm until there is room for a new entry
+ * of the given size, or with keep set, until the cache is back within its byte
+ * limit.  Entries that have been hit since the clock hand last passed get a
+ * second chance.  The entry to keep is never evicted. */
+static void ares_qcache_evict(ares_qcache_t             *cache,
+                              const ares_qcache_entry_t *keep,
+                              size_t                     add_bytes)
+{
+  size_t add_entries = (keep == NULL) ? 1 : 0;
+
+  while (ares_llist_len(cache->clock) > 1 - add_entries &&
+         ares_qcache_over_limit(cache, add_entries, add_bytes)) {
+    ares_qcache_entry_t *entry;
+    ares_bool_t          referenced;
+
+    if (cache->clock_hand == NULL) {
+      cache->clock_hand = ares_llist_node_first(cache->clock);
+    }
+
+    entry = ares_llist_node_val(cache->clock_hand);
+    if (entry == keep) {
+      cache->clock_hand = ares_llist_node_next(cache->clock_hand);
+      continue;
+    }
+
+    ares_thread_mutex_lock(entry->shard->lock);
+    referenced        = entry->referenced;
+    entry->referenced = ARES_FALSE;
+    ares_thread_mutex_unlock(entry->shard->lock);
+
+    if (referenced) {
+      cache->clock_hand = ares_llist_node_next(cache->clock_hand);
+      continue;
+    }
+
+    ares_qcache_entry_remove(cache, entry);
+    cache->evictions++;
   }
 }
 
@@ -166,12 +560,19 @@ void ares_qcache_flush(ares_qcache_t *cache)
 
 void ares_qcache_destroy(ares_qcache_t *cache)
 {
+  size_t i;
+
   if (cache == NULL) {
     return;
   }
 
-  ares_htable_strvp_destroy(cache->cache);
+  for (i = 0; cache->shards != NULL && i < cache->nshards; i++) {
+    ares_htable_destroy(cache->shards[i].cache);
+    ares_thread_mutex_destroy(cache->shards[i].lock);
+  }
+  ares_free(cache->shards);
   ares_slist_destroy(cache->expire);
+  ares_llist_destroy(cache->clock);
   ares_free(cache);
 }
 
@@ -180,11 +581,11 @@ static int ares_qcache_entry_sort_cb(const void *arg1, const void *arg2)
   const ares_qcache_entry_t *entry1 = arg1;
   const ares_qcache_entry_t *entry2 = arg2;
 
-  if (entry1->expire_ts > entry2->expire_ts) {
+  if (entry1->purge_ts > entry2->purge_ts) {
     return 1;
   }
 
-  if (entry1->expire_ts < entry2->expire_ts) {
+  if (entry1->purge_ts < entry2->purge_ts) {
     return -1;
   }
 
@@ -198,17 +599,19 @@ static void ares_qcache_entry_destroy_cb(void *arg)
     return; /* LCOV_EXCL_LINE: DefensiveCoding */
   }
 
-  ares_free(entry->key);
   ares_dns_record_destroy(entry->dnsrec);
   ares_free(entry);
 }
 
 ares_status_t ares_qcache_create(ares_rand_state *rand_state,
-                                 unsigned int     max_ttl,
-                                 ares_qcache_t  **cache_out)
+                                 unsigned int max_ttl, size_t max_entries,
+                                 size_t max_bytes, unsigned int stale_ttl,
+                                 unsigned int prefetch_pct, size_t shards,
+                                 ares_qcache_t **cache_out)
 {
   ares_status_t  status = ARES_SUCCESS;
   ares_qcache_t *cache;
+  size_t         i;
 
   cache = ares_malloc_zero(sizeof(*cache));
   if (cache == NULL) {
@@ -216,11 +619,38 @@ ares_status_t ares_qcache_create(ares_rand_state *rand_state,
     goto done;            /* LCOV_EXCL_LINE: OutOfMemory */
   }
 
-  cache->cache = ares_htable_strvp_create(NULL);
-  if (cache->cache == NULL) {
+  /* Without thread support there is nothing to gain from sharding */
+  if (shards == 0 || !ares_threadsafety()) {
+    shards = 1;
+  }
+
+  cache->shards = ares_malloc_zero(sizeof(*cache->shards) * shards);
+  if (cache->shards == NULL) {
     status = ARES_ENOMEM; /* LCOV_EXCL_LINE: OutOfMemory */
     goto done;            /* LCOV_EXCL_LINE: OutOfMemory */
   }
+  cache->nshards = shards;
+
+  for (i = 0; i < shards; i++) {
+    ares_qcache_shard_t *shard = &cache->shards[i];
+
+    shard->cache =
+      ares_htable_create(ares_qcache_key_hash, ares_qcache_key_bucket,
+                         ares_qcache_bucket_free, ares_qcache_key_eq);
+    if (shard->cache == NULL) {
+      status = ARES_ENOMEM; /* LCOV_EXCL_LINE: OutOfMemory */
+      goto done;            /* LCOV_EXCL_LINE: OutOfMemory */
+    }
+
+    /* A single shard is only ever accessed with the channel lock held */
+    if (shards > 1) {
+      shard->lock = ares_thread_mutex_create();
+      if (shard->lock == NULL) {
+        status = ARES_ENOMEM; /* LCOV_EXCL_LINE: OutOfMemory */
+        goto done;            /* LCOV_EXCL_LINE: OutOfMemory */
+      }
+    }
+  }
 
   cache->expire = ares_slist_create(rand_state, ares_qcache_entry_sort_cb,
                                     ares_qcache_entry_destroy_cb);
@@ -229,7 +659,17 @@ ares_status_t ares_qcache_create(ares_rand_state *rand_state,
     goto done;            /* LCOV_EXCL_LINE: OutOfMemory */
   }
 
-  cache->max_ttl = max_ttl;
+  cache->clock = ares_llist_create(NULL);
+  if (cache->clock == NULL) {
+    status = ARES_ENOMEM; /* LCOV_EXCL_LINE: OutOfMemory */
+    goto done;            /* LCOV_EXCL_LINE: OutOfMemory */
+  }
+
+  cache->max_ttl      = max_ttl;
+  cache->max_entries  = max_entries;
+  cache->max_bytes    = max_bytes;
+  cache->stale_ttl    = stale_ttl;
+  cache->prefetch_pct = prefetch_pct;
 
 done:
   if (status != ARES_SUCCESS) {
@@ -242,7 +682,7 @@ done:
   return status;
 }
 
-static unsigned int ares_qcache_calc_minttl(ares_dns_record_t *dnsrec)
+static unsigned int ares_qcache_calc_minttl(const ares_dns_record_t *dnsrec)
 {
   unsigned int minttl = 0xFFFFFFFF;
   size_t       sect;
@@ -252,7 +692,7 @@ static unsigned int ares_qcache_calc_minttl(ares_dns_record_t *dnsrec)
     for (i = 0; i < ares_dns_record_rr_cnt(dnsrec, (ares_dns_section_t)sect);
          i++) {
       const ares_dns_rr_t *rr =
-        ares_dns_record_rr_get(dnsrec, (ares_dns_section_t)sect, i);
+        ares_dns_record_rr_get_const(dnsrec, (ares_dns_section_t)sect, i);
       ares_dns_rec_type_t type = ares_dns_rr_get_type(rr);
       unsigned int        ttl  = ares_dns_rr_get_ttl(rr);
 
@@ -271,7 +711,7 @@ static unsigned int ares_qcache_calc_minttl(ares_dns_record_t *dnsrec)
   return minttl;
 }
 
-static unsigned int ares_qcache_soa_minimum(ares_dns_record_t *dnsrec)
+static unsigned int ares_qcache_soa_minimum(const ares_dns_record_t *dnsrec)
 {
   size_t i;
 
@@ -279,7 +719,7 @@ static unsigned int ares_qcache_soa_minimum(ares_dns_record_t *dnsrec)
    * record. */
   for (i = 0; i < ares_dns_record_rr_cnt(dnsrec, ARES_SECTION_AUTHORITY); i++) {
     const ares_dns_rr_t *rr =
-      ares_dns_record_rr_get(dnsrec, ARES_SECTION_AUTHORITY, i);
+      ares_dns_record_rr_get_const(dnsrec, ARES_SECTION_AUTHORITY, i);
     ares_dns_rec_type_t type = ares_dns_rr_get_type(rr);
     unsigned int        ttl;
     unsigned int        minimum;
@@ -300,18 +740,27 @@ static unsigned int ares_qcache_soa_minimum(ares_dns_record_t *dnsrec)
   return 0;
 }
 
-/* On success, takes ownership of dnsrec */
 static ares_status_t ares_qcache_insert_int(ares_qcache_t           *qcache,
-                                            ares_dns_record_t       *qresp,
+                                            const ares_dns_record_t *qresp,
+                                            const unsigned char     *abuf,
+                                            size_t                   alen,
                                             const ares_dns_record_t *qreq,
                                             const ares_timeval_t    *now)
 {
   ares_qcache_entry_t *entry;
+  ares_qcache_entry_t *existing;
+  unsigned char        keybuf[ARES_QCACHE_KEY_MAXLEN];
+  ares_qcache_key_t    key;
   unsigned int         ttl;
+  size_t               ttls_cnt = 0;
+  ares_qcache_ttl_t   *ttls;
+  unsigned char       *ptr;
+  size_t               alloc_len;
+  ares_bool_t          inserted;
   ares_dns_rcode_t     rcode = ares_dns_record_get_rcode(qresp);
   ares_dns_flags_t     flags = ares_dns_record_get_flags(qresp);
 
-  if (qcache == NULL || qresp == NULL) {
+  if (qcache == NULL || qresp == NULL || abuf == NULL) {
     return ARES_EFORMERR;
   }
 
@@ -341,53 +790,203 @@ static ares_status_t ares_qcache_insert_int(ares_qcache_t           *qcache,
     return ARES_EREFUSED;
   }
 
-  entry = ares_malloc_zero(sizeof(*entry));
+  /* We can't guarantee the server responded with the same flags as the
+   * request had, so we have to re-parse the request in order to generate the
+   * key for caching, but we'll only do this once we know for sure we really
+   * want to cache it */
+  if (!ares_qcache_calc_key(qreq, keybuf, &key)) {
+    return ARES_ENOTIMP;
+  }
+
+  /* Count the TTLs so we know how much space to allocate for the index */
+  if (!ares_qcache_wire_index(abuf, alen, NULL, &ttls_cnt)) {
+    return ARES_EBADRESP;
+  }
+
+  /* Entry, TTL index, wire response and key are a single allocation */
+  alloc_len =
+    sizeof(*entry) + (sizeof(*ttls) * ttls_cnt) + alen + key.len;
+
+  /* Would never fit */
+  if (qcache->max_bytes && alloc_len > qcache->max_bytes) {
+    return ARES_ENOTIMP;
+  }
+
+  entry = ares_malloc_zero(alloc_len);
   if (entry == NULL) {
-    goto fail; /* LCOV_EXCL_LINE: OutOfMemory */
+    return ARES_ENOMEM; /* LCOV_EXCL_LINE: OutOfMemory */
   }
 
-  entry->dnsrec    = qresp;
+  ttls = (ares_qcache_ttl_t *)((void *)(entry + 1));
+  ptr  = (unsigned char *)(ttls + ttls_cnt);
+  memcpy(ptr, abuf, alen);
+  entry->wire     = ptr;
+  entry->wire_len = alen;
+  ptr            += alen;
+  memcpy(ptr, key.data, key.len);
+  entry->key.data = ptr;
+  entry->key.len  = key.len;
+
+  ares_qcache_wire_index(entry->wire, entry->wire_len, ttls, &ttls_cnt);
+  entry->shard     = ares_qcache_shard(qcache, &entry->key);
+  entry->ttls      = ttls;
+  entry->ttls_cnt  = ttls_cnt;
   entry->expire_ts = (time_t)now->sec + (time_t)ttl;
+  entry->purge_ts  = entry->expire_ts + (time_t)qcache->stale_ttl;
   entry->insert_ts = (time_t)now->sec;
+  entry->alloc_len = alloc_len;
+
+  /* If there's an existing entry (e.g. multiple identical queries were in
+   * flight at the same time), replace it */
+  ares_thread_mutex_lock(entry->shard->lock);
+  existing = ares_htable_get(entry->shard->cache, &entry->key);
+  ares_thread_mutex_unlock(entry->shard->lock);
+  if (existing != NULL) {
+    ares_qcache_entry_remove(qcache, existing);
+  }
 
-  /* We can't guarantee the server responded with the same flags as the
-   * request had, so we have to re-parse the request in order to generate the
-   * key for caching, but we'll only do this once we know for sure we really
-   * want to cache it */
-  entry->key = ares_qcache_calc_key(qreq);
-  if (entry->key == NULL) {
+  /* Make room if we're bounded */
+  ares_qcache_evict(qcache, NULL, alloc_len);
+
+  /* The entry is complete before it becomes visible to lockless readers */
+  ares_thread_mutex_lock(entry->shard->lock);
+  inserted = ares_htable_insert(entry->shard->cache, entry);
+  ares_thread_mutex_unlock(entry->shard->lock);
+  if (!inserted) {
     goto fail; /* LCOV_EXCL_LINE: OutOfMemory */
   }
 
-  if (!ares_htable_strvp_insert(qcache->cache, entry->key, entry)) {
+  /* New entries go just behind the clock hand so they are the last to be
+   * considered for eviction */
+  if (qcache->clock_hand != NULL) {
+    entry->clock_node = ares_llist_insert_before(qcache->clock_hand, entry);
+  } else {
+    entry->clock_node = ares_llist_insert_last(qcache->clock, entry);
+  }
+  if (entry->clock_node == NULL) {
     goto fail; /* LCOV_EXCL_LINE: OutOfMemory */
   }
 
-  if (ares_slist_insert(qcache->expire, entry) == NULL) {
+  entry->node = ares_slist_insert(qcache->expire, entry);
+  if (entry->node == NULL) {
     goto fail; /* LCOV_EXCL_LINE: OutOfMemory */
   }
 
+  qcache->bytes += alloc_len;
   return ARES_SUCCESS;
 
 /* LCOV_EXCL_START: OutOfMemory */
 fail:
-  if (entry != NULL && entry->key != NULL) {
-    ares_htable_strvp_remove(qcache->cache, entry->key);
-    ares_free(entry->key);
-    ares_free(entry);
-  }
+  ares_llist_node_destroy(entry->clock_node);
+  ares_thread_mutex_lock(entry->shard->lock);
+  ares_htable_remove(entry->shard->cache, &entry->key);
+  ares_thread_mutex_unlock(entry->shard->lock);
+  ares_free(entry);
   return ARES_ENOMEM;
   /* LCOV_EXCL_STOP */
 }
 
+typedef struct {
+  ares_channel_t *channel;
+  size_t          key_len;
+  unsigned char   key[ARES_QCACHE_KEY_MAXLEN];
+} ares_qcache_refresh_t;
+
+static void ares_qcache_refresh_cb(void *arg, ares_status_t status,
+                                   size_t                   timeouts,
+                                   const ares_dns_record_t *dnsrec)
+{
+  ares_qcache_refresh_t *refresh = arg;
+  ares_qcache_entry_t   *entry   = NULL;
+  ares_qcache_key_t      key;
+
+  (void)status;
+  (void)timeouts;
+  (void)dnsrec;
+
+  key.data = refresh->key;
+  key.len  = refresh->key_len;
+
+  /* A successful response has already replaced the entry, otherwise the
+   * existing entry continues to be served until the retry time */
+  if (refresh->channel->qcache != NULL) {
+    ares_qcache_shard_t *shard =
+      ares_qcache_shard(refresh->channel->qcache, &key);
+
+    ares_thread_mutex_lock(shard->lock);
+    entry = ares_htable_get(shard->cache, &key);
+    if (entry != NULL) {
+      entry->refresh_pending = ARES_FALSE;
+    }
+    ares_thread_mutex_unlock(shard->lock);
+  }
+
+  ares_free(refresh);
+}
+
+/* Determine if a hit on the entry should trigger a background refresh */
+static ares_bool_t ares_qcache_want_refresh(const ares_qcache_t       *qcache,
+                                            const ares_qcache_entry_t *entry,
+                                            const ares_timeval_t      *now)
+{
+  time_t remaining;
+  time_t total;
+
+  if (entry->refresh_pending || entry->refresh_retry_ts > now->sec) {
+    return ARES_FALSE;
+  }
+
+  /* Stale */
+  if (entry->expire_ts <= now->sec) {
+    return ARES_TRUE;
+  }
+
+  if (qcache->prefetch_pct == 0) {
+    return ARES_FALSE;
+  }
+
+  remaining = entry->expire_ts - (time_t)now->sec;
+  total     = entry->expire_ts - entry->insert_ts;
+
+  return (remaining * 100 <= total * (time_t)qcache->prefetch_pct) ? ARES_TRUE
+                                                                   : ARES_FALSE;
+}
+
+/* Enqueue a query bypassing the cache, its response will replace the entry */
+static void ares_qcache_refresh(ares_channel_t          *channel,
+                                const ares_qcache_key_t *key,
+                                const ares_dns_record_t *dnsrec)
+{
+  ares_qcache_refresh_t *refresh = ares_malloc_zero(sizeof(*refresh));
+
+  if (refresh == NULL) {
+    return; /* LCOV_EXCL_LINE: OutOfMemory */
+  }
+
+  refresh->channel = channel;
+  refresh->key_len = key->len;
+  memcpy(refresh->key, key->data, key->len);
+
+  channel->qcache->refreshes++;
+
+  /* Completion, including failure, is signaled via the callback */
+  ares_send_nolock(channel, NULL, ARES_SEND_FLAG_NOCACHE, dnsrec,
+                   ares_qcache_refresh_cb, refresh, NULL);
+}
+
 ares_status_t ares_qcache_fetch(ares_channel_t           *channel,
                                 const ares_timeval_t     *now,
                                 const ares_dns_record_t  *dnsrec,
                                 const ares_dns_record_t **dnsrec_resp)
 {
-  char                *key = NULL;
+  unsigned char        keybuf[ARES_QCACHE_KEY_MAXLEN];
+  ares_qcache_key_t    key;
+  ares_qcache_shard_t *shard;
   ares_qcache_entry_t *entry;
-  ares_status_t        status = ARES_SUCCESS;
+  ares_bool_t          stale;
+  ares_bool_t          refresh    = ARES_FALSE;
+  ares_bool_t          view_added = ARES_FALSE;
+  ares_status_t        status     = ARES_SUCCESS;
 
   if (channel == NULL || dnsrec == NULL || dnsrec_resp == NULL) {
     return ARES_EFORMERR;
@@ -399,42 +998,207 @@ ares_status_t ares_qcache_fetch(ares_channel_t           *channel,
 
   ares_qcache_expire(channel->qcache, now);
 
-  key = ares_qcache_calc_key(dnsrec);
-  if (key == NULL) {
-    status = ARES_ENOMEM; /* LCOV_EXCL_LINE: OutOfMemory */
-    goto done;            /* LCOV_EXCL_LINE: OutOfMemory */
+  if (!ares_qcache_calc_key(dnsrec, keybuf, &key)) {
+    channel->qcache->misses++;
+    return ARES_ENOTFOUND;
   }
 
-  entry = ares_htable_strvp_get_direct(channel->qcache->cache, key);
+  shard = ares_qcache_shard(channel->qcache, &key);
+  ares_thread_mutex_lock(shard->lock);
+
+  entry = ares_htable_get(shard->cache, &key);
   if (entry == NULL) {
+    channel->qcache->misses++;
     status = ARES_ENOTFOUND;
     goto done;
   }
 
-  ares_dns_record_ttl_decrement(entry->dnsrec,
-                                (unsigned int)(now->sec - entry->insert_ts));
+  stale = (entry->expire_ts <= now->sec) ? ARES_TRUE : ARES_FALSE;
+
+  /* The fresh view can't be reused for a stale answer */
+  if (entry->dnsrec != NULL && entry->view_stale != stale) {
+    ares_qcache_entry_drop_view(channel->qcache, entry);
+  }
+
+  if (entry->dnsrec == NULL) {
+    status = ares_qcache_entry_materialize(entry, now, stale);
+    if (status != ARES_SUCCESS) {
+      /* Can't really happen as the response was already parsed once */
+      if (status != ARES_ENOMEM) {
+        status = ARES_ENOTFOUND;
+      }
+      goto done;
+    }
+    entry->view_len         = ares_dns_record_arena_size(entry->dnsrec);
+    channel->qcache->bytes += entry->view_len;
+    view_added              = ARES_TRUE;
+  }
+
+  if (!stale) {
+    ares_dns_record_ttl_decrement(entry->dnsrec,
+                                  (unsigned int)(now->sec - entry->view_ts));
+  }
+
+  entry->referenced = ARES_TRUE;
+  shard->hits++;
+  if (stale) {
+    shard->stale_hits++;
+  }
+
+  refresh = ares_qcache_want_refresh(channel->qcache, entry, now);
+  if (refresh) {
+    entry->refresh_pending  = ARES_TRUE;
+    entry->refresh_retry_ts = (time_t)now->sec + ARES_QCACHE_STALE_RETRY;
+  }
 
+  /* The view itself is only ever used with the channel lock held, which
+   * also keeps the entry from being removed */
   *dnsrec_resp = entry->dnsrec;
 
 done:
-  ares_free(key);
+  ares_thread_mutex_unlock(shard->lock);
+
+  /* The view counts against the byte limit, make room for it elsewhere */
+  if (view_added) {
+    ares_qcache_evict(channel->qcache, entry, 0);
+  }
+
+  if (status == ARES_SUCCESS && refresh) {
+    ares_qcache_refresh(channel, &key, dnsrec);
+  }
+  return status;
+}
+
+ares_status_t ares_qcache_fetch_copy(ares_qcache_t           *qcache,
+                                     const ares_timeval_t    *now,
+                                     const ares_dns_record_t *dnsrec,
+                                     ares_dns_record_t      **dnsrec_resp)
+{
+  unsigned char        keybuf[ARES_QCACHE_KEY_MAXLEN];
+  ares_qcache_key_t    key;
+  ares_qcache_shard_t *shard;
+  ares_qcache_entry_t *entry;
+  unsigned char       *buf = NULL;
+  size_t               ttls_cnt;
+  size_t               ttls_len;
+  size_t               wire_len;
+  unsigned int         elapsed;
+  ares_bool_t          stale;
+  ares_status_t        status;
+
+  if (dnsrec == NULL || dnsrec_resp == NULL) {
+    return ARES_EFORMERR;
+  }
+
+  /* Misses are accounted for by ares_qcache_fetch() */
+  if (qcache == NULL || !ares_qcache_calc_key(dnsrec, keybuf, &key)) {
+    return ARES_ENOTFOUND;
+  }
+
+  shard = ares_qcache_shard(qcache, &key);
+  ares_thread_mutex_lock(shard->lock);
+
+  /* Entries past their purge time and hits that need to trigger a refresh
+   * require the channel lock */
+  entry = ares_htable_get(shard->cache, &key);
+  if (entry == NULL || entry->purge_ts <= now->sec ||
+      ares_qcache_want_refresh(qcache, entry, now)) {
+    ares_thread_mutex_unlock(shard->lock);
+    return ARES_ENOTFOUND;
+  }
+
+  /* The TTL index is immediately followed by the response, copy both so the
+   * TTLs can be patched after releasing the lock */
+  ttls_cnt = entry->ttls_cnt;
+  ttls_len = sizeof(*entry->ttls) * ttls_cnt;
+  wire_len = entry->wire_len;
+  buf      = ares_malloc(ttls_len + wire_len);
+  if (buf == NULL) {
+    ares_thread_mutex_unlock(shard->lock); /* LCOV_EXCL_LINE: OutOfMemory */
+    return ARES_ENOMEM;                    /* LCOV_EXCL_LINE: OutOfMemory */
+  }
+  memcpy(buf, entry->ttls, ttls_len + wire_len);
+
+  elapsed = (unsigned int)(now->sec - entry->insert_ts);
+  stale   = (entry->expire_ts <= now->sec) ? ARES_TRUE : ARES_FALSE;
+
+  entry->referenced = ARES_TRUE;
+  shard->hits++;
+  if (stale) {
+    shard->stale_hits++;
+  }
+
+  ares_thread_mutex_unlock(shard->lock);
+
+  ares_qcache_wire_patch(buf + ttls_len,
+                         (const ares_qcache_ttl_t *)((void *)buf), ttls_cnt,
+                         elapsed, stale);
+  status = ares_dns_parse(buf + ttls_len, wire_len, ARES_DNS_PARSE_ARENA,
+                          dnsrec_resp);
+  ares_free(buf);
   return status;
 }
 
 ares_status_t ares_qcache_insert(ares_channel_t          *channel,
                                  const ares_timeval_t    *now,
                                  const ares_query_t      *query,
-                                 const ares_dns_record_t *dnsrec)
+                                 const ares_dns_record_t *dnsrec,
+                                 const unsigned char *abuf, size_t alen)
 {
-  ares_dns_record_t *dupdns = ares_dns_record_duplicate(dnsrec);
-  ares_status_t      status;
+  return ares_qcache_insert_int(channel->qcache, dnsrec, abuf, alen,
+                                query->query, now);
+}
+
+size_t ares_qcache_stat(const ares_channel_t *channel, ares_qcache_stat_t stat)
+{
+  const ares_qcache_t *qcache;
+  size_t               val = 0;
+  size_t               i;
 
-  if (dupdns == NULL) {
-    return ARES_ENOMEM;
+  if (channel == NULL) {
+    return 0;
   }
-  status = ares_qcache_insert_int(channel->qcache, dupdns, query->query, now);
-  if (status != ARES_SUCCESS) {
-    ares_dns_record_destroy(dupdns);
+
+  ares_channel_lock(channel);
+
+  qcache = channel->qcache;
+  if (qcache == NULL) {
+    goto done;
   }
-  return status;
+
+  switch (stat) {
+    case ARES_QCACHE_STAT_ENTRIES:
+      val = ares_llist_len(qcache->clock);
+      break;
+    case ARES_QCACHE_STAT_BYTES:
+      val = qcache->bytes;
+      break;
+    case ARES_QCACHE_STAT_HITS:
+      for (i = 0; i < qcache->nshards; i++) {
+        ares_thread_mutex_lock(qcache->shards[i].lock);
+        val += qcache->shards[i].hits;
+        ares_thread_mutex_unlock(qcache->shards[i].lock);
+      }
+      break;
+    case ARES_QCACHE_STAT_MISSES:
+      val = qcache->misses;
+      break;
+    case ARES_QCACHE_STAT_EVICTIONS:
+      val = qcache->evictions;
+      break;
+    case ARES_QCACHE_STAT_STALE_HITS:
+      for (i = 0; i < qcache->nshards; i++) {
+        ares_thread_mutex_lock(qcache->shards[i].lock);
+        val += qcache->shards[i].stale_hits;
+        ares_thread_mutex_unlock(qcache->shards[i].lock);
+      }
+      break;
+    case ARES_QCACHE_STAT_REFRESHES:
+      val = qcache->refreshes;
+      break;
+  }
+
+done:
+  ares_channel_unlock(channel);
+  return val;
 }
@@ -58,6 +58,45 @@ static void ares_query_dnsrec_cb(void *arg, ares_status_t status,
   ares_free(qquery);
 }
 
+ares_bool_t ares_query_callback_match(const ares_query_t  *query,
+                                      ares_callback_dnsrec callback,
+                                      const void          *arg)
+{
+  const ares_query_dnsrec_arg_t *qquery;
+
+  if (query->callback == callback && query->arg == arg) {
+    return ARES_TRUE;
+  }
+
+  /* Look through the rcode conversion of ares_query_nolock() */
+  if (query->callback != ares_query_dnsrec_cb) {
+    return ARES_FALSE;
+  }
+
+  qquery = query->arg;
+  if (qquery->callback == callback && qquery->arg == arg) {
+    return ARES_TRUE;
+  }
+  return ARES_FALSE;
+}
+
+static ares_status_t ares_query_create(const ares_channel_t *channel,
+                                       const char           *name,
+                                       ares_dns_class_t      dnsclass,
+                                       ares_dns_rec_type_t   type,
+                                       ares_dns_record_t   **dnsrec)
+{
+  ares_dns_flags_t flags = 0;
+
+  if (!(channel->flags & ARES_FLAG_NORECURSE)) {
+    flags |= ARES_FLAG_RD;
+  }
+
+  return ares_dns_record_create_query(
+    dnsrec, name, dnsclass, type, 0, flags,
+    (size_t)(channel->flags & ARES_FLAG_EDNS) ? channel->ednspsz : 0);
+}
+
 ares_status_t ares_query_nolock(ares_channel_t *channel, const char *name,
                                 ares_dns_class_t     dnsclass,
                                 ares_dns_rec_type_t  type,
@@ -66,7 +105,6 @@ ares_status_t ares_query_nolock(ares_channel_t *channel, const char *name,
 {
   ares_status_t            status;
   ares_dns_record_t       *dnsrec = NULL;
-  ares_dns_flags_t         flags  = 0;
   ares_query_dnsrec_arg_t *qquery = NULL;
 
   if (channel == NULL || name == NULL || callback == NULL) {
@@ -79,13 +117,7 @@ ares_status_t ares_query_nolock(ares_channel_t *channel, const char *name,
     /* LCOV_EXCL_STOP */
   }
 
-  if (!(channel->flags & ARES_FLAG_NORECURSE)) {
-    flags |= ARES_FLAG_RD;
-  }
-
-  status = ares_dns_record_create_query(
-    &dnsrec, name, dnsclass, type, 0, flags,
-    (size_t)(channel->flags & ARES_FLAG_EDNS) ? channel->ednspsz : 0);
+  status = ares_query_create(channel, name, dnsclass, type, &dnsrec);
   if (status != ARES_SUCCESS) {
     callback(arg, status, 0, NULL); /* LCOV_EXCL_LINE: OutOfMemory */
     return status;                  /* LCOV_EXCL_LINE: OutOfMemory */
@@ -112,6 +144,45 @@ ares_status_t ares_query_nolock(ares_channel_t *channel, const char *name,
   return status;
 }
 
+/* Answer from the query cache, or hand off to the event thread, without
+ * taking the channel lock */
+static ares_bool_t ares_query_unlocked(ares_channel_t *channel, const char *name,
+                                       ares_dns_class_t     dnsclass,
+                                       ares_dns_rec_type_t  type,
+                                       ares_callback_dnsrec callback, void *arg,
+                                       unsigned short *qid)
+{
+  ares_dns_record_t       *dnsrec = NULL;
+  ares_query_dnsrec_arg_t *qquery = NULL;
+  ares_bool_t              rv     = ARES_FALSE;
+
+  if (ares_query_create(channel, name, dnsclass, type, &dnsrec) !=
+      ARES_SUCCESS) {
+    return ARES_FALSE; /* LCOV_EXCL_LINE: OutOfMemory */
+  }
+
+  qquery = ares_malloc(sizeof(*qquery));
+  if (qquery == NULL) {
+    goto done; /* LCOV_EXCL_LINE: OutOfMemory */
+  }
+
+  qquery->callback = callback;
+  qquery->arg      = arg;
+
+  rv = ares_send_cached(channel, dnsrec, ares_query_dnsrec_cb, qquery);
+  if (!rv && channel->submit != NULL && qid == NULL &&
+      ares_submit_enqueue(channel, dnsrec, ares_query_dnsrec_cb, qquery)) {
+    return ARES_TRUE; /* dnsrec is now owned by the submission queue */
+  }
+  if (!rv) {
+    ares_free(qquery);
+  }
+
+done:
+  ares_dns_record_destroy(dnsrec);
+  return rv;
+}
+
 ares_status_t ares_query_dnsrec(ares_channel_t *channel, const char *name,
                                 ares_dns_class_t     dnsclass,
                                 ares_dns_rec_type_t  type,
@@ -124,6 +195,12 @@ ares_status_t ares_query_dnsrec(ares_channel_t *channel, const char *name,
     return ARES_EFORMERR;
   }
 
+  if (channel->flags & ARES_FLAG_MULTICORE && name != NULL &&
+      callback != NULL &&
+      ares_query_unlocked(channel, name, dnsclass, type, callback, arg, qid)) {
+    return ARES_SUCCESS;
+  }
+
   ares_channel_lock(channel);
   status = ares_query_nolock(channel, name, dnsclass, type, callback, arg, qid);
   ares_channel_unlock(channel);
@@ -31,6 +31,18 @@
 #  include <strings.h>
 #endif
 
+struct search_query;
+
+/* State for one name of a search with ARES_FLAG_PARALLEL_SEARCH */
+struct search_name {
+  struct search_query *squery;
+  unsigned short       qid;
+  ares_bool_t          sent;    /* Query has been handed to ares_send_nolock */
+  ares_bool_t          pending; /* Still awaiting the answer */
+  ares_status_t        status;  /* Status of the answer */
+  ares_dns_record_t   *dnsrec;  /* Answer kept until earlier names fail */
+};
+
 struct search_query {
   /* Arguments passed to ares_search_dnsrec() */
   ares_channel_t      *channel;
@@ -48,26 +60,118 @@ struct search_query {
   size_t               next_name_idx; /* next name index being attempted */
   size_t      timeouts;        /* number of timeouts we saw for this request */
   ares_bool_t ever_got_nodata; /* did we ever get ARES_ENODATA along the way? */
+
+  /* With ARES_FLAG_PARALLEL_SEARCH every name is queried at once, and
+   * next_name_idx is the next name whose answer is to be considered */
+  struct search_name *pnames;
+  size_t              refcnt; /* Outstanding queries, plus one while sending */
+  ares_bool_t         done;   /* Callback has been invoked */
 };
 
 static void squery_free(struct search_query *squery)
 {
+  size_t i;
+
   if (squery == NULL) {
     return; /* LCOV_EXCL_LINE: DefensiveCoding */
   }
+  if (squery->pnames != NULL) {
+    for (i = 0; i < squery->names_cnt; i++) {
+      ares_dns_record_destroy(squery->pnames[i].dnsrec);
+    }
+    ares_free(squery->pnames);
+  }
   ares_strsplit_free(squery->names, squery->names_cnt);
   ares_dns_record_destroy(squery->dnsrec);
   ares_free(squery);
 }
 
+static void search_parallel_callback(void *arg, ares_status_t status,
+                                     size_t                   timeouts,
+                                     const ares_dns_record_t *dnsrec);
+
 /* End a search query by invoking the user callback and freeing the
- * search_query structure.
+ * search_query structure.  A parallel search is only freed once the answers
+ * for all of its names are in, any still outstanding are cancelled.
  */
 static void end_squery(struct search_query *squery, ares_status_t status,
                        const ares_dns_record_t *dnsrec)
 {
+  size_t i;
+
   squery->callback(squery->arg, status, squery->timeouts, dnsrec);
-  squery_free(squery);
+
+  if (squery->pnames == NULL) {
+    squery_free(squery);
+    return;
+  }
+
+  squery->done = ARES_TRUE;
+
+  /* The channel is already ending every query */
+  if (status == ARES_ECANCELLED || status == ARES_EDESTRUCTION) {
+    return;
+  }
+
+  for (i = 0; i < squery->names_cnt; i++) {
+    struct search_name *pname = &squery->pnames[i];
+    if (pname->sent && pname->pending) {
+      ares_cancel_query(squery->channel, pname->qid, search_parallel_callback,
+                        pname);
+    }
+  }
+}
+
+/* Status of an answer, as far as the search is concerned */
+static ares_status_t search_answer_status(ares_status_t            status,
+                                          const ares_dns_record_t *dnsrec)
+{
+  if (dnsrec) {
+    ares_dns_rcode_t rcode = ares_dns_record_get_rcode(dnsrec);
+    size_t ancount = ares_dns_record_rr_cnt(dnsrec, ARES_SECTION_ANSWER);
+    return ares_dns_query_reply_tostatus(rcode, ancount);
+  }
+  return status;
+}
+
+/* Whether the answer for the name at idx ends the search, rather than moving
+ * on to the next name */
+static ares_bool_t search_answer_final(struct search_query *squery,
+                                       size_t idx, ares_status_t mystatus)
+{
+  switch (mystatus) {
+    case ARES_ENODATA:
+      /* If we ever get ARES_ENODATA along the way, record that; if the search
+       * should run to the very end and we got at least one ARES_ENODATA,
+       * then callers like ares_gethostbyname() may want to try a T_A search
+       * even if the last domain we queried for T_AAAA resource records
+       * returned ARES_ENOTFOUND.
+       */
+      squery->ever_got_nodata = ARES_TRUE;
+      return ARES_FALSE;
+    case ARES_ENOTFOUND:
+      return ARES_FALSE;
+    case ARES_ESERVFAIL:
+    case ARES_EREFUSED:
+      /* Issue #852, systemd-resolved may return SERVFAIL or REFUSED on a
+       * single label domain name. */
+      return ares_name_label_cnt(squery->names[idx]) != 1 ? ARES_TRUE
+                                                          : ARES_FALSE;
+    default:
+      return ARES_TRUE;
+  }
+}
+
+/* We have no more domains to search, return an appropriate response. */
+static void end_squery_exhausted(struct search_query *squery,
+                                 ares_status_t        mystatus)
+{
+  if (mystatus == ARES_ENOTFOUND && squery->ever_got_nodata) {
+    end_squery(squery, ARES_ENODATA, NULL);
+    return;
+  }
+
+  end_squery(squery, mystatus, NULL);
 }
 
 static void search_callback(void *arg, ares_status_t status, size_t timeouts,
@@ -113,40 +217,10 @@ static void search_callback(void *arg, ares_status_t status, size_t timeouts,
 
   squery->timeouts += timeouts;
 
-  if (dnsrec) {
-    ares_dns_rcode_t rcode = ares_dns_record_get_rcode(dnsrec);
-    size_t ancount = ares_dns_record_rr_cnt(dnsrec, ARES_SECTION_ANSWER);
-    mystatus       = ares_dns_query_reply_tostatus(rcode, ancount);
-  } else {
-    mystatus = status;
-  }
-
-  switch (mystatus) {
-    case ARES_ENODATA:
-    case ARES_ENOTFOUND:
-      break;
-    case ARES_ESERVFAIL:
-    case ARES_EREFUSED:
-      /* Issue #852, systemd-resolved may return SERVFAIL or REFUSED on a
-       * single label domain name. */
-      if (ares_name_label_cnt(squery->names[squery->next_name_idx - 1]) != 1) {
-        end_squery(squery, mystatus, dnsrec);
-        return;
-      }
-      break;
-    default:
-      end_squery(squery, mystatus, dnsrec);
-      return;
-  }
-
-  /* If we ever get ARES_ENODATA along the way, record that; if the search
-   * should run to the very end and we got at least one ARES_ENODATA,
-   * then callers like ares_gethostbyname() may want to try a T_A search
-   * even if the last domain we queried for T_AAAA resource records
-   * returned ARES_ENOTFOUND.
-   */
-  if (mystatus == ARES_ENODATA) {
-    squery->ever_got_nodata = ARES_TRUE;
+  mystatus = search_answer_status(status, dnsrec);
+  if (search_answer_final(squery, squery->next_name_idx - 1, mystatus)) {
+    end_squery(squery, mystatus, dnsrec);
+    return;
   }
 
   if (squery->next_name_idx < squery->names_cnt) {
@@ -157,13 +231,115 @@ static void search_callback(void *arg, ares_status_t status, size_t timeouts,
     return;
   }
 
-  /* We have no more domains to search, return an appropriate response. */
-  if (mystatus == ARES_ENOTFOUND && squery->ever_got_nodata) {
-    end_squery(squery, ARES_ENODATA, NULL);
-    return;
+  end_squery_exhausted(squery, mystatus);
+}
+
+/* Consider the answers of a parallel search in search order, stopping at the
+ * first name that is still pending.  current is the name whose answer just
+ * arrived, which is passed in dnsrec rather than being kept. */
+static void search_parallel_advance(struct search_query     *squery,
+                                    const struct search_name *current,
+                                    const ares_dns_record_t  *dnsrec)
+{
+  ares_status_t mystatus = ARES_ENOTFOUND;
+
+  while (squery->next_name_idx < squery->names_cnt) {
+    const struct search_name *pname = &squery->pnames[squery->next_name_idx];
+
+    if (pname->pending) {
+      return;
+    }
+
+    mystatus = pname->status;
+    if (search_answer_final(squery, squery->next_name_idx, mystatus)) {
+      end_squery(squery, mystatus, (pname == current) ? dnsrec : pname->dnsrec);
+      return;
+    }
+    squery->next_name_idx++;
   }
 
-  end_squery(squery, mystatus, NULL);
+  end_squery_exhausted(squery, mystatus);
+}
+
+static void search_parallel_release(struct search_query *squery)
+{
+  squery->refcnt--;
+  if (squery->refcnt == 0) {
+    squery_free(squery);
+  }
+}
+
+static void search_parallel_callback(void *arg, ares_status_t status,
+                                     size_t                   timeouts,
+                                     const ares_dns_record_t *dnsrec)
+{
+  struct search_name  *pname  = arg;
+  struct search_query *squery = pname->squery;
+
+  squery->timeouts += timeouts;
+  pname->pending    = ARES_FALSE;
+  pname->status     = search_answer_status(status, dnsrec);
+
+  if (!squery->done) {
+    /* An answer for a later name has to wait for the names before it, keep a
+     * copy if it would end the search */
+    if (dnsrec != NULL && pname != &squery->pnames[squery->next_name_idx] &&
+        search_answer_final(squery, (size_t)(pname - squery->pnames),
+                            pname->status)) {
+      pname->dnsrec = ares_dns_record_duplicate(dnsrec);
+      if (pname->dnsrec == NULL) {
+        pname->status = ARES_ENOMEM; /* LCOV_EXCL_LINE: OutOfMemory */
+      }
+    }
+    search_parallel_advance(squery, pname, dnsrec);
+  }
+
+  search_parallel_release(squery);
+}
+
+/* Send the query for every name at once.  The first answer in search order
+ * that ends the search is returned, so the result is the same as searching
+ * one name at a time, but a miss doesn't cost a round trip per name. */
+static ares_status_t ares_search_parallel(ares_channel_t      *channel,
+                                          struct search_query *squery)
+{
+  ares_status_t status = ARES_SUCCESS;
+  size_t        i;
+
+  squery->pnames = ares_malloc_zero(sizeof(*squery->pnames) * squery->names_cnt);
+  if (squery->pnames == NULL) {
+    return ARES_ENOMEM; /* LCOV_EXCL_LINE: OutOfMemory */
+  }
+
+  for (i = 0; i < squery->names_cnt; i++) {
+    squery->pnames[i].squery  = squery;
+    squery->pnames[i].pending = ARES_TRUE;
+  }
+
+  /* Hold a reference so answers delivered while sending (such as from the
+   * cache) can't free the search */
+  squery->refcnt = 1;
+
+  for (i = 0; i < squery->names_cnt && !squery->done; i++) {
+    struct search_name *pname = &squery->pnames[i];
+
+    status = ares_dns_record_query_set_name(squery->dnsrec, 0,
+                                            squery->names[i]);
+    if (status != ARES_SUCCESS) {
+      /* Treat it like an answer so the names before it still count */
+      squery->refcnt++;
+      search_parallel_callback(pname, status, 0, NULL);
+      continue;
+    }
+
+    squery->refcnt++;
+    pname->sent = ARES_TRUE;
+    ares_send_nolock(channel, NULL, 0, squery->dnsrec, search_parallel_callback,
+                     pname, &pname->qid);
+  }
+
+  search_parallel_release(squery);
+  return ARES_SUCCESS;
 }
 
 /* Determine if the domain should be looked up as-is, or if it is eligible
@@ -367,6 +543,14 @@ static ares_status_t ares_search_int(ares_channel_t          *channel,
     goto fail;
   }
 
+  if (channel->flags & ARES_FLAG_PARALLEL_SEARCH && squery->names_cnt > 1) {
+    status = ares_search_parallel(channel, squery);
+    if (status != ARES_SUCCESS) {
+      goto fail; /* LCOV_EXCL_LINE: OutOfMemory */
+    }
+    return status;
+  }
+
   status = ares_search_next(channel, squery, &skip_cleanup);
   if (status != ARES_SUCCESS) {
     goto fail;
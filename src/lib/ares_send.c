@@ -135,13 +135,19 @@ ares_status_t ares_send_nolock(ares_channel_t *channel, ares_server_t *server,
     }
   }
 
+  /* Attach to an identical query already in flight.  Queries targeting a
+   * specific server (e.g. probes) must actually be sent. */
+  if (channel->flags & ARES_FLAG_COALESCE && server == NULL &&
+      ares_coalesce_join(channel, flags, dnsrec, callback, arg, qid)) {
+    return ARES_SUCCESS;
+  }
+
   /* Allocate space for query and allocated fields. */
-  query = ares_malloc(sizeof(ares_query_t));
+  query = ares_pool_get(channel->query_pool);
   if (!query) {
     callback(arg, ARES_ENOMEM, 0, NULL); /* LCOV_EXCL_LINE: OutOfMemory */
     return ARES_ENOMEM;                  /* LCOV_EXCL_LINE: OutOfMemory */
   }
-  memset(query, 0, sizeof(*query));
 
   query->channel      = channel;
   query->qid          = id;
@@ -153,12 +159,7 @@ ares_status_t ares_send_nolock(ares_channel_t *channel, ares_server_t *server,
   /* Duplicate Query */
   status = ares_dns_record_duplicate_ex(&query->query, dnsrec);
   if (status != ARES_SUCCESS) {
-    /* Sometimes we might get a EBADRESP response from duplicate due to
-     * the way it works (write and parse), rewrite it to EBADQUERY. */
-    if (status == ARES_EBADRESP) {
-      status = ARES_EBADQUERY;
-    }
-    ares_free(query);
+    ares_pool_put(channel->query_pool, query);
     callback(arg, status, 0, NULL);
     return status;
   }
@@ -191,8 +192,10 @@ ares_status_t ares_send_nolock(ares_channel_t *channel, ares_server_t *server,
   query->timeouts     = 0;
 
   /* Initialize our list nodes. */
-  query->node_queries_by_timeout = NULL;
-  query->node_queries_to_conn    = NULL;
+  ares_twheel_timer_init(&query->node_queries_by_timeout, query);
+  ares_twheel_timer_init(&query->node_queries_by_hedge, query);
+  ares_twheel_timer_init(&query->node_queries_by_deadline, query);
+  query->node_queries_to_conn = NULL;
 
   /* Chain the query into the list of all queries. */
   query->node_all_queries = ares_llist_insert_last(channel->all_queries, query);
@@ -215,6 +218,10 @@ ares_status_t ares_send_nolock(ares_channel_t *channel, ares_server_t *server,
     /* LCOV_EXCL_STOP */
   }
 
+  if (channel->flags & ARES_FLAG_COALESCE && server == NULL) {
+    ares_coalesce_lead(channel, flags, query);
+  }
+
   /* Perform the first query action. */
 
   status = ares_send_query(server, query, &now);
@@ -224,6 +231,29 @@ ares_status_t ares_send_nolock(ares_channel_t *channel, ares_server_t *server,
   return status;
 }
 
+ares_bool_t ares_send_cached(ares_channel_t          *channel,
+                             const ares_dns_record_t *dnsrec,
+                             ares_callback_dnsrec callback, void *arg)
+{
+  ares_timeval_t     now;
+  ares_dns_record_t *dnsrec_resp = NULL;
+
+  /* The channel flags and cache are fixed for the life of the channel */
+  if (!(channel->flags & ARES_FLAG_MULTICORE)) {
+    return ARES_FALSE;
+  }
+
+  ares_tvnow(&now);
+  if (ares_qcache_fetch_copy(channel->qcache, &now, dnsrec, &dnsrec_resp) !=
+      ARES_SUCCESS) {
+    return ARES_FALSE;
+  }
+
+  callback(arg, ARES_SUCCESS, 0, dnsrec_resp);
+  ares_dns_record_destroy(dnsrec_resp);
+  return ARES_TRUE;
+}
+
 ares_status_t ares_send_dnsrec(ares_channel_t          *channel,
                                const ares_dns_record_t *dnsrec,
                                ares_callback_dnsrec callback, void *arg,
@@ -235,6 +265,20 @@ ares_status_t ares_send_dnsrec(ares_channel_t          *channel,
     return ARES_EFORMERR; /* LCOV_EXCL_LINE: DefensiveCoding */
   }
 
+  if (ares_send_cached(channel, dnsrec, callback, arg)) {
+    return ARES_SUCCESS;
+  }
+
+  /* The query id isn't known until the event thread sends it */
+  if (channel->submit != NULL && qid == NULL) {
+    ares_dns_record_t *dnsrec_copy = ares_dns_record_duplicate(dnsrec);
+    if (dnsrec_copy != NULL &&
+        ares_submit_enqueue(channel, dnsrec_copy, callback, arg)) {
+      return ARES_SUCCESS;
+    }
+    ares_dns_record_destroy(dnsrec_copy);
+  }
+
   ares_channel_lock(channel);
 
   status = ares_send_nolock(channel, NULL, 0, dnsrec, callback, arg, qid);
@@ -261,7 +305,7 @@ void ares_send(ares_channel_t *channel, const unsigned char *qbuf, int qlen,
     return;
   }
 
-  status = ares_dns_parse(qbuf, (size_t)qlen, 0, &dnsrec);
+  status = ares_dns_parse(qbuf, (size_t)qlen, ARES_DNS_PARSE_ARENA, &dnsrec);
   if (status != ARES_SUCCESS) {
     callback(arg, (int)status, 0, NULL, 0);
     return;
@@ -292,7 +336,7 @@ size_t ares_queue_active_queries(const ares_channel_t *channel)
 
   ares_channel_lock(channel);
 
-  len = ares_llist_len(channel->all_queries);
+  len = ares_llist_len(channel->all_queries) + ares_submit_pending(channel);
 
   ares_channel_unlock(channel);
 
@@ -90,7 +90,7 @@ ares_status_t
                                const struct ares_socket_functions_ex *funcs,
                                void                                  *user_data)
 {
-  unsigned int known_versions[] = { 1 };
+  unsigned int known_versions[] = { 1, 2 };
   size_t       i;
 
   if (channel == NULL || funcs == NULL) {
@@ -131,6 +131,11 @@ ares_status_t
     channel->sock_funcs.aif_indextoname = funcs->aif_indextoname;
   }
 
+  if (funcs->version >= 2) {
+    channel->sock_funcs.asendmmsg = funcs->asendmmsg;
+    channel->sock_funcs.arecvmmsg = funcs->arecvmmsg;
+  }
+
   /* Implement newer versions here ...*/
 
 
@@ -401,6 +406,70 @@ static ares_ssize_t default_asendto(ares_socket_t sock, const void *buffer,
                             (SEND_TYPE_ARG3)length, (SEND_TYPE_ARG4)flags);
 }
 
+#ifdef HAVE_SENDMMSG
+static ares_ssize_t default_asendmmsg(ares_socket_t            sock,
+                                      const ares_socket_msg_t *msgs, size_t cnt,
+                                      int flags, void *user_data)
+{
+  struct mmsghdr hdrs[ARES_SOCKET_MSGS_MAX];
+  struct iovec   iovs[ARES_SOCKET_MSGS_MAX];
+  size_t         i;
+
+  (void)user_data;
+
+  if (cnt > ARES_SOCKET_MSGS_MAX) {
+    cnt = ARES_SOCKET_MSGS_MAX;
+  }
+
+  memset(hdrs, 0, sizeof(*hdrs) * cnt);
+  for (i = 0; i < cnt; i++) {
+    iovs[i].iov_base           = msgs[i].buffer;
+    iovs[i].iov_len            = msgs[i].length;
+    hdrs[i].msg_hdr.msg_iov    = &iovs[i];
+    hdrs[i].msg_hdr.msg_iovlen = 1;
+  }
+
+  return (ares_ssize_t)sendmmsg(sock, hdrs, (unsigned int)cnt, flags);
+}
+#endif
+
+#ifdef HAVE_RECVMMSG
+static ares_ssize_t default_arecvmmsg(ares_socket_t      sock,
+                                      ares_socket_msg_t *msgs, size_t cnt,
+                                      int flags, void *user_data)
+{
+  struct mmsghdr hdrs[ARES_SOCKET_MSGS_MAX];
+  struct iovec   iovs[ARES_SOCKET_MSGS_MAX];
+  size_t         i;
+  int            rv;
+
+  (void)user_data;
+
+  if (cnt > ARES_SOCKET_MSGS_MAX) {
+    cnt = ARES_SOCKET_MSGS_MAX;
+  }
+
+  memset(hdrs, 0, sizeof(*hdrs) * cnt);
+  for (i = 0; i < cnt; i++) {
+    iovs[i].iov_base           = msgs[i].buffer;
+    iovs[i].iov_len            = msgs[i].length;
+    hdrs[i].msg_hdr.msg_iov    = &iovs[i];
+    hdrs[i].msg_hdr.msg_iovlen = 1;
+  }
+
+  rv = recvmmsg(sock, hdrs, (unsigned int)cnt, flags, NULL);
+  for (i = 0; rv > 0 && i < (size_t)rv; i++) {
+    msgs[i].length = hdrs[i].msg_len;
+    /* Report truncation as a length larger than the buffer */
+    if (hdrs[i].msg_hdr.msg_flags & MSG_TRUNC) {
+      msgs[i].length = iovs[i].iov_len + 1;
+    }
+  }
+
+  return (ares_ssize_t)rv;
+}
+#endif
+
 static int default_agetsockname(ares_socket_t sock, struct sockaddr *address,
                                 ares_socklen_t *address_len, void *user_data)
 {
@@ -442,7 +511,7 @@ static const char *default_aif_indextoname(unsigned int ifindex,
 }
 
 static const struct ares_socket_functions_ex default_socket_functions = {
-  1,
+  2,
   ARES_SOCKFUNC_FLAG_NONBLOCKING,
   default_asocket,
   default_aclose,
@@ -453,7 +522,17 @@ static const struct ares_socket_functions_ex default_socket_functions = {
   default_agetsockname,
   default_abind,
   default_aif_nametoindex,
-  default_aif_indextoname
+  default_aif_indextoname,
+#ifdef HAVE_SENDMMSG
+  default_asendmmsg,
+#else
+  NULL, /* asendmmsg */
+#endif
+#ifdef HAVE_RECVMMSG
+  default_arecvmmsg
+#else
+  NULL /* arecvmmsg */
+#endif
 };
 
 void ares_set_socket_functions_def(ares_channel_t *channel)
@@ -573,7 +652,9 @@ static const struct ares_socket_functions_ex legacy_socket_functions = {
   NULL, /* agetsockname */
   NULL, /* abind */
   NULL, /* aif_nametoindex */
-  NULL  /* aif_indextoname */
+  NULL, /* aif_indextoname */
+  NULL, /* asendmmsg */
+  NULL  /* arecvmmsg */
 };
 
 void ares_set_socket_functions(ares_channel_t                     *channel,
@@ -90,6 +90,10 @@ static ares_conn_err_t ares_socket_deref_error(int err)
       return ARES_CONN_ERR_AFNOSUPPORT;
     case EADDRNOTAVAIL:
       return ARES_CONN_ERR_BADADDR;
+#if defined(ENOSYS)
+    case ENOSYS:
+      return ARES_CONN_ERR_NOTIMP;
+#endif
     default:
       break;
   }
@@ -150,6 +154,79 @@ ares_conn_err_t ares_socket_write(ares_channel_t *channel, ares_socket_t fd,
   return err;
 }
 
+ares_conn_err_t ares_socket_write_msgs(ares_channel_t          *channel,
+                                       ares_socket_t            fd,
+                                       const ares_socket_msg_t *msgs,
+                                       size_t cnt, size_t *sent)
+{
+  int             flags = 0;
+  ares_ssize_t    rv;
+  ares_conn_err_t err;
+
+  *sent = 0;
+
+  if (channel->sock_funcs.asendmmsg == NULL) {
+    return ARES_CONN_ERR_NOTIMP;
+  }
+
+#ifdef HAVE_MSG_NOSIGNAL
+  flags |= MSG_NOSIGNAL;
+#endif
+
+  rv = channel->sock_funcs.asendmmsg(fd, msgs, cnt, flags,
+                                     channel->sock_func_cb_data);
+  if (rv > 0) {
+    *sent = (size_t)rv;
+    return ARES_CONN_ERR_SUCCESS;
+  }
+
+  if (rv == 0) {
+    return ARES_CONN_ERR_WOULDBLOCK;
+  }
+
+  err = ares_socket_deref_error(SOCKERRNO);
+  if (err == ARES_CONN_ERR_NOTIMP) {
+    /* Not supported by the OS, don't try again */
+    channel->sock_funcs.asendmmsg = NULL;
+  }
+  return err;
+}
+
+ares_conn_err_t ares_socket_recv_msgs(ares_channel_t    *channel,
+                                      ares_socket_t      fd,
+                                      ares_socket_msg_t *msgs, size_t cnt,
+                                      size_t *recvd)
+{
+  ares_ssize_t    rv;
+  ares_conn_err_t err;
+
+  *recvd = 0;
+
+  /* A blocking implementation would wait for the entire array to be filled */
+  if (channel->sock_funcs.arecvmmsg == NULL ||
+      !(channel->sock_funcs.flags & ARES_SOCKFUNC_FLAG_NONBLOCKING)) {
+    return ARES_CONN_ERR_NOTIMP;
+  }
+
+  rv = channel->sock_funcs.arecvmmsg(fd, msgs, cnt, 0,
+                                     channel->sock_func_cb_data);
+  if (rv > 0) {
+    *recvd = (size_t)rv;
+    return ARES_CONN_ERR_SUCCESS;
+  }
+
+  if (rv == 0) {
+    return ARES_CONN_ERR_WOULDBLOCK;
+  }
+
+  err = ares_socket_deref_error(SOCKERRNO);
+  if (err == ARES_CONN_ERR_NOTIMP) {
+    /* Not supported by the OS, don't try again */
+    channel->sock_funcs.arecvmmsg = NULL;
+  }
+  return err;
+}
+
 ares_conn_err_t ares_socket_recv(ares_channel_t *channel, ares_socket_t s,
                                  ares_bool_t is_tcp, void *data,
                                  size_t data_len, size_t *read_bytes)
@@ -160,4 +160,37 @@ ares_conn_err_t ares_socket_write(ares_channel_t *channel, ares_socket_t fd,
                                   const void *data, size_t len, size_t *written,
                                   const struct sockaddr *sa,
                                   ares_socklen_t         salen);
+
+/*! Maximum number of datagrams passed in a single batched socket call */
+#define ARES_SOCKET_MSGS_MAX 64
+
+/*! Send multiple datagrams on a connected UDP socket in a single call.
+ *
+ *  \param[in]  channel Initialized ares channel
+ *  \param[in]  fd      Socket
+ *  \param[in]  msgs    Datagrams to send
+ *  \param[in]  cnt     Number of datagrams
+ *  \param[out] sent    Number of datagrams sent
+ *  \return ARES_CONN_ERR_NOTIMP if batching is not supported, otherwise
+ *          the result of the send.
+ */
+ares_conn_err_t ares_socket_write_msgs(ares_channel_t          *channel,
+                                       ares_socket_t            fd,
+                                       const ares_socket_msg_t *msgs,
+                                       size_t cnt, size_t *sent);
+
+/*! Receive multiple datagrams on a connected UDP socket in a single call.
+ *
+ *  \param[in]     channel Initialized ares channel
+ *  \param[in]     fd      Socket
+ *  \param[in,out] msgs    Buffers to receive into, lengths updated on output
+ *  \param[in]     cnt     Number of buffers
+ *  \param[out]    recvd   Number of datagrams received
+ *  \return ARES_CONN_ERR_NOTIMP if batching is not supported, otherwise
+ *          the result of the receive.
+ */
+ares_conn_err_t ares_socket_recv_msgs(ares_channel_t    *channel,
+                                      ares_socket_t      fd,
+                                      ares_socket_msg_t *msgs, size_t cnt,
+                                      size_t *recvd);
 #endif
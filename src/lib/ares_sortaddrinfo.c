@@ -37,6 +37,7 @@
  */
 
 #include "ares_private.h"
+#include "dsa/ares_htable.h"
 
 #ifdef HAVE_NETINET_IN_H
 #  include <netinet/in.h>
@@ -58,6 +59,32 @@ struct addrinfo_sort_elem {
   size_t                     original_order;
 };
 
+/* Source address selection results are cached per destination as finding them
+ * costs several system calls.  IPv6 global unicast destinations are cached by
+ * /64 since addresses on the same link share a source, all others by address
+ * as their source can differ within a /64 (e.g. v4-mapped or link-local).
+ * The cache is flushed on ares_reinit(), which is also triggered by system
+ * configuration changes. */
+#define ARES_SRCADDR_CACHE_TTL 30 /* seconds */
+#define ARES_SRCADDR_CACHE_MAX 256
+
+typedef struct {
+  int           family;
+  unsigned int  scope_id;
+  unsigned char addr[16];
+} ares_srcaddr_key_t;
+
+typedef struct {
+  ares_srcaddr_key_t key;
+  int                result;
+  ares_sockaddr      src_addr;
+  ares_timeval_t     expire;
+} ares_srcaddr_entry_t;
+
+struct ares_srcaddr_cache {
+  ares_htable_t *entries;
+};
+
 #define ARES_IPV6_ADDR_MC_SCOPE(a) ((a)->s6_addr[1] & 0x0f)
 
 #define ARES_IPV6_ADDR_SCOPE_NODELOCAL    0x01
@@ -385,6 +412,147 @@ static int find_src_addr(ares_channel_t *channel, const struct sockaddr *addr,
   return 1;
 }
 
+static unsigned int ares_srcaddr_key_hash(const void *key, unsigned int seed)
+{
+  return ares_htable_hash_FNV1a(key, sizeof(ares_srcaddr_key_t), seed);
+}
+
+static const void *ares_srcaddr_key_bucket(const void *bucket)
+{
+  const ares_srcaddr_entry_t *entry = bucket;
+  return &entry->key;
+}
+
+static ares_bool_t ares_srcaddr_key_eq(const void *key1, const void *key2)
+{
+  return memcmp(key1, key2, sizeof(ares_srcaddr_key_t)) == 0 ? ARES_TRUE
+                                                             : ARES_FALSE;
+}
+
+void ares_srcaddr_cache_destroy(ares_srcaddr_cache_t *cache)
+{
+  if (cache == NULL) {
+    return;
+  }
+
+  ares_htable_destroy(cache->entries);
+  ares_free(cache);
+}
+
+static ares_srcaddr_cache_t *ares_srcaddr_cache_create(void)
+{
+  ares_srcaddr_cache_t *cache = ares_malloc_zero(sizeof(*cache));
+
+  if (cache == NULL) {
+    return NULL; /* LCOV_EXCL_LINE: OutOfMemory */
+  }
+
+  cache->entries = ares_htable_create(ares_srcaddr_key_hash,
+                                      ares_srcaddr_key_bucket, ares_free,
+                                      ares_srcaddr_key_eq);
+  if (cache->entries == NULL) {
+    ares_free(cache); /* LCOV_EXCL_LINE: OutOfMemory */
+    return NULL;      /* LCOV_EXCL_LINE: OutOfMemory */
+  }
+
+  return cache;
+}
+
+static ares_bool_t ares_srcaddr_key(ares_srcaddr_key_t    *key,
+                                    const struct sockaddr *addr)
+{
+  memset(key, 0, sizeof(*key));
+  key->family = addr->sa_family;
+
+  if (addr->sa_family == AF_INET) {
+    const struct sockaddr_in *sin =
+      (const struct sockaddr_in *)(const void *)addr;
+    memcpy(key->addr, &sin->sin_addr, sizeof(sin->sin_addr));
+    return ARES_TRUE;
+  }
+
+  if (addr->sa_family == AF_INET6) {
+    const struct sockaddr_in6 *sin6 =
+      (const struct sockaddr_in6 *)(const void *)addr;
+    size_t                     len = sizeof(sin6->sin6_addr);
+
+    if (get_scope(addr) == ARES_IPV6_ADDR_SCOPE_GLOBAL &&
+        !IN6_IS_ADDR_MULTICAST(&sin6->sin6_addr) &&
+        !IN6_IS_ADDR_UNSPECIFIED(&sin6->sin6_addr) &&
+        !IN6_IS_ADDR_V4MAPPED(&sin6->sin6_addr) &&
+        !IN6_IS_ADDR_V4COMPAT(&sin6->sin6_addr)) {
+      len = 8;
+    }
+    memcpy(key->addr, &sin6->sin6_addr, len);
+#ifdef HAVE_STRUCT_SOCKADDR_IN6_SIN6_SCOPE_ID
+    key->scope_id = sin6->sin6_scope_id;
+#endif
+    return ARES_TRUE;
+  }
+
+  return ARES_FALSE;
+}
+
+/* Same as find_src_addr(), but consults the channel's cache first */
+static int find_src_addr_cached(ares_channel_t        *channel,
+                                const ares_timeval_t  *now,
+                                const struct sockaddr *addr,
+                                ares_sockaddr         *src_addr)
+{
+  ares_srcaddr_key_t    key;
+  ares_srcaddr_entry_t *entry;
+  int                   result;
+
+  if (!ares_srcaddr_key(&key, addr)) {
+    return find_src_addr(channel, addr, &src_addr->sa);
+  }
+
+  if (channel->srcaddr_cache != NULL) {
+    entry = ares_htable_get(channel->srcaddr_cache->entries, &key);
+    if (entry != NULL && !ares_timedout(now, &entry->expire)) {
+      memcpy(src_addr, &entry->src_addr, sizeof(*src_addr));
+      return entry->result;
+    }
+  }
+
+  result = find_src_addr(channel, addr, &src_addr->sa);
+  if (result == -1) {
+    return result;
+  }
+
+  /* Keep the cache bounded, destinations are rarely this diverse */
+  if (channel->srcaddr_cache != NULL &&
+      ares_htable_num_keys(channel->srcaddr_cache->entries) >=
+        ARES_SRCADDR_CACHE_MAX) {
+    ares_srcaddr_cache_destroy(channel->srcaddr_cache);
+    channel->srcaddr_cache = NULL;
+  }
+
+  if (channel->srcaddr_cache == NULL) {
+    channel->srcaddr_cache = ares_srcaddr_cache_create();
+    if (channel->srcaddr_cache == NULL) {
+      return result; /* LCOV_EXCL_LINE: OutOfMemory */
+    }
+  }
+
+  entry = ares_malloc_zero(sizeof(*entry));
+  if (entry == NULL) {
+    return result; /* LCOV_EXCL_LINE: OutOfMemory */
+  }
+
+  memcpy(&entry->key, &key, sizeof(key));
+  entry->result = result;
+  memcpy(&entry->src_addr, src_addr, sizeof(entry->src_addr));
+  entry->expire      = *now;
+  entry->expire.sec += ARES_SRCADDR_CACHE_TTL;
+
+  if (!ares_htable_insert(channel->srcaddr_cache->entries, entry)) {
+    ares_free(entry); /* LCOV_EXCL_LINE: OutOfMemory */
+  }
+
+  return result;
+}
+
 /*
  * Sort the linked list starting at sentinel->ai_next in RFC6724 order.
  * Will leave the list unchanged if an error occurs.
@@ -397,6 +565,7 @@ ares_status_t ares_sortaddrinfo(ares_channel_t            *channel,
   size_t                     i;
   int                        has_src_addr;
   struct addrinfo_sort_elem *elems;
+  ares_timeval_t             now;
 
   cur = list_sentinel->ai_next;
   while (cur) {
@@ -418,12 +587,14 @@ ares_status_t ares_sortaddrinfo(ares_channel_t            *channel,
    * Convert the linked list to an array that also contains the candidate
    * source address for each destination address.
    */
+  ares_tvnow(&now);
   for (i = 0, cur = list_sentinel->ai_next; i < nelem;
        ++i, cur   = cur->ai_next) {
     assert(cur != NULL);
     elems[i].ai             = cur;
     elems[i].original_order = i;
-    has_src_addr = find_src_addr(channel, cur->ai_addr, &elems[i].src_addr.sa);
+    has_src_addr =
+      find_src_addr_cached(channel, &now, cur->ai_addr, &elems[i].src_addr);
     if (has_src_addr == -1) {
       ares_free(elems);
       return ARES_ENOTFOUND;
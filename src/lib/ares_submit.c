@@ -0,0 +1,221 @@
+/* MIT License
+ *
+ * Copyright (c) The c-ares project and its contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#include "ares_private.h"
+
+/* Submission queue used with ARES_FLAG_MULTICORE and ARES_OPT_EVENT_THREAD.
+ *
+ * Rather than taking the channel lock and performing the send inline, caller
+ * threads append the request to a queue protected by its own lock which is
+ * only ever held long enough to link or unlink list nodes.  The event thread
+ * then drains everything queued in a single pass under one acquisition of the
+ * channel lock.  Only the submission that finds the queue empty wakes the
+ * event thread, so a burst of submissions results in a single wakeup. */
+
+typedef struct {
+  ares_dns_record_t   *dnsrec;
+  ares_callback_dnsrec callback;
+  void                *arg;
+} ares_submit_req_t;
+
+struct ares_submit {
+  ares_thread_mutex_t *lock;
+  /*! Requests waiting for the event thread, protected by lock */
+  ares_llist_t        *queue;
+  /*! Requests being processed, swapped with queue by the event thread and
+   *  only accessed with the channel lock held.  Cancellation moves queued
+   *  requests onto it rather than swapping, as it may be called from a
+   *  callback while the event thread is still walking it */
+  ares_llist_t        *batch;
+};
+
+static void ares_submit_req_destroy(void *arg)
+{
+  ares_submit_req_t *req = arg;
+
+  if (req == NULL) {
+    return; /* LCOV_EXCL_LINE: DefensiveCoding */
+  }
+
+  ares_dns_record_destroy(req->dnsrec);
+  ares_free(req);
+}
+
+ares_submit_t *ares_submit_create(void)
+{
+  ares_submit_t *submit = ares_malloc_zero(sizeof(*submit));
+
+  if (submit == NULL) {
+    return NULL; /* LCOV_EXCL_LINE: OutOfMemory */
+  }
+
+  submit->lock  = ares_thread_mutex_create();
+  submit->queue = ares_llist_create(ares_submit_req_destroy);
+  submit->batch = ares_llist_create(ares_submit_req_destroy);
+  if (submit->lock == NULL || submit->queue == NULL || submit->batch == NULL) {
+    ares_submit_destroy(submit); /* LCOV_EXCL_LINE: OutOfMemory */
+    return NULL;                 /* LCOV_EXCL_LINE: OutOfMemory */
+  }
+
+  return submit;
+}
+
+void ares_submit_destroy(ares_submit_t *submit)
+{
+  if (submit == NULL) {
+    return;
+  }
+
+  ares_llist_destroy(submit->queue);
+  ares_llist_destroy(submit->batch);
+  ares_thread_mutex_destroy(submit->lock);
+  ares_free(submit);
+}
+
+ares_bool_t ares_submit_enqueue(ares_channel_t      *channel,
+                                ares_dns_record_t   *dnsrec,
+                                ares_callback_dnsrec callback, void *arg)
+{
+  ares_submit_t     *submit = channel->submit;
+  ares_submit_req_t *req;
+  ares_bool_t        wake;
+
+  if (submit == NULL) {
+    return ARES_FALSE;
+  }
+
+  req = ares_malloc_zero(sizeof(*req));
+  if (req == NULL) {
+    return ARES_FALSE; /* LCOV_EXCL_LINE: OutOfMemory */
+  }
+
+  req->dnsrec   = dnsrec;
+  req->callback = callback;
+  req->arg      = arg;
+
+  ares_thread_mutex_lock(submit->lock);
+  wake = (ares_llist_len(submit->queue) == 0) ? ARES_TRUE : ARES_FALSE;
+  if (ares_llist_insert_last(submit->queue, req) == NULL) {
+    /* LCOV_EXCL_START: OutOfMemory */
+    ares_thread_mutex_unlock(submit->lock);
+    ares_free(req);
+    return ARES_FALSE;
+    /* LCOV_EXCL_STOP */
+  }
+  ares_thread_mutex_unlock(submit->lock);
+
+  /* The event thread hasn't drained the queue since an earlier submission
+   * woke it, so it will pick this one up as well */
+  if (wake && channel->query_enqueue_cb != NULL) {
+    channel->query_enqueue_cb(channel->query_enqueue_cb_data);
+  }
+
+  return ARES_TRUE;
+}
+
+size_t ares_submit_pending(const ares_channel_t *channel)
+{
+  size_t len;
+
+  if (channel->submit == NULL) {
+    return 0;
+  }
+
+  ares_thread_mutex_lock(channel->submit->lock);
+  len = ares_llist_len(channel->submit->queue);
+  ares_thread_mutex_unlock(channel->submit->lock);
+
+  return len;
+}
+
+/* Swap the queue with the (empty) batch list so the lock is only held for a
+ * constant amount of time.  Channel lock must be held. */
+static ares_llist_t *ares_submit_claim(ares_submit_t *submit)
+{
+  ares_llist_t *batch;
+
+  ares_thread_mutex_lock(submit->lock);
+  batch         = submit->queue;
+  submit->queue = submit->batch;
+  submit->batch = batch;
+  ares_thread_mutex_unlock(submit->lock);
+
+  return batch;
+}
+
+void ares_submit_process(ares_channel_t *channel)
+{
+  ares_llist_t      *batch;
+  ares_submit_req_t *req;
+
+  if (ares_submit_pending(channel) == 0) {
+    return;
+  }
+
+  ares_channel_lock(channel);
+
+  batch = ares_submit_claim(channel->submit);
+  while ((req = ares_llist_first_val(batch)) != NULL) {
+    ares_llist_node_claim(ares_llist_node_first(batch));
+
+    /* NOTE: callbacks invoked here may submit more requests, those are
+     *       picked up on the next wakeup */
+    ares_send_nolock(channel, NULL, 0, req->dnsrec, req->callback, req->arg,
+                     NULL);
+    ares_submit_req_destroy(req);
+  }
+
+  /* Requests may have been answered from the cache or failed outright
+   * without ever becoming queries */
+  ares_queue_notify_empty(channel);
+
+  ares_channel_unlock(channel);
+}
+
+void ares_submit_cancel(ares_channel_t *channel, ares_status_t status)
+{
+  ares_submit_t     *submit = channel->submit;
+  ares_llist_node_t *node;
+  ares_submit_req_t *req;
+
+  if (submit == NULL) {
+    return;
+  }
+
+  /* Requests answered while a batch is being processed may cancel from their
+   * callback, so append to whatever is left of the batch instead of swapping
+   * the list out from under ares_submit_process() */
+  ares_thread_mutex_lock(submit->lock);
+  while ((node = ares_llist_node_first(submit->queue)) != NULL) {
+    ares_llist_node_mvparent_last(node, submit->batch);
+  }
+  ares_thread_mutex_unlock(submit->lock);
+
+  while ((req = ares_llist_first_val(submit->batch)) != NULL) {
+    ares_llist_node_claim(ares_llist_node_first(submit->batch));
+    req->callback(req->arg, status, 0, NULL);
+    ares_submit_req_destroy(req);
+  }
+}
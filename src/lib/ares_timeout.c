@@ -88,25 +88,35 @@ static struct timeval *ares_timeout_int(const ares_channel_t *channel,
                                         struct timeval       *maxtv,
                                         struct timeval       *tvbuf)
 {
-  const ares_query_t *query;
-  ares_slist_node_t  *node;
-  ares_timeval_t      now;
-  ares_timeval_t      atvbuf;
-  ares_timeval_t      amaxtv;
-
-  /* The minimum timeout of all queries is always the first entry in
-   * channel->queries_by_timeout */
-  node = ares_slist_node_first(channel->queries_by_timeout);
-  /* no queries/timeout */
-  if (node == NULL) {
+  ares_timeval_t next;
+  ares_timeval_t other;
+  ares_timeval_t now;
+  ares_timeval_t atvbuf;
+  ares_timeval_t amaxtv;
+
+  /* This may be earlier than the actual minimum timeout of all queries, but
+   * never later, in which case processing will simply find nothing to do */
+  if (!ares_twheel_next(channel->queries_by_timeout, &next)) {
+    /* no queries/timeout */
     return maxtv;
   }
 
-  query = ares_slist_node_val(node);
+  /* A pending hedge or deadline can only be for a query that is also waiting
+   * on a timeout, but it will usually fire sooner */
+  if (ares_twheel_next(channel->queries_by_hedge, &other) &&
+      (other.sec < next.sec ||
+       (other.sec == next.sec && other.usec < next.usec))) {
+    next = other;
+  }
+  if (ares_twheel_next(channel->queries_by_deadline, &other) &&
+      (other.sec < next.sec ||
+       (other.sec == next.sec && other.usec < next.usec))) {
+    next = other;
+  }
 
   ares_tvnow(&now);
 
-  ares_timeval_remaining(&atvbuf, &now, &query->timeout);
+  ares_timeval_remaining(&atvbuf, &now, &next);
 
   ares_timeval_to_struct_timeval(tvbuf, &atvbuf);
 
@@ -1047,6 +1047,45 @@ done:
   return status;
 }
 
+ares_status_t ares_find_server(const ares_channel_t *channel,
+                               const char *addr, const ares_server_t **server)
+{
+  ares_status_t      status = ARES_ENOTFOUND;
+  ares_buf_t        *buf;
+  ares_slist_node_t *node;
+
+  *server = NULL;
+
+  buf = ares_buf_create();
+  if (buf == NULL) {
+    return ARES_ENOMEM; /* LCOV_EXCL_LINE: OutOfMemory */
+  }
+
+  for (node = ares_slist_node_first(channel->servers); node != NULL;
+       node = ares_slist_node_next(node)) {
+    const ares_server_t *s = ares_slist_node_val(node);
+    const unsigned char *ptr;
+    size_t               len;
+
+    ares_buf_set_length(buf, 0);
+    if (ares_get_server_addr(s, buf) != ARES_SUCCESS) {
+      status = ARES_ENOMEM; /* LCOV_EXCL_LINE: OutOfMemory */
+      break;                /* LCOV_EXCL_LINE: OutOfMemory */
+    }
+
+    ptr = ares_buf_peek(buf, &len);
+    if (len == ares_strlen(addr) &&
+        ares_memeq(ptr, (const unsigned char *)addr, len)) {
+      *server = s;
+      status  = ARES_SUCCESS;
+      break;
+    }
+  }
+
+  ares_buf_destroy(buf);
+  return status;
+}
+
 /* Write out the details of a server to a buffer */
 ares_status_t ares_get_server_addr(const ares_server_t *server, ares_buf_t *buf)
 {
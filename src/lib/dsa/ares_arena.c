@@ -0,0 +1,341 @@
+/* MIT License
+ *
+ * Copyright (c) The c-ares project and its contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#include "ares_private.h"
+#include "ares_arena.h"
+
+/* Every allocation is aligned to this, which covers any type we store */
+#define ARES__ARENA_ALIGN         (sizeof(void *) * 2)
+#define ARES__ARENA_ALIGNED(x)    \
+  (((x) + ARES__ARENA_ALIGN - 1) & ~(ARES__ARENA_ALIGN - 1))
+#define ARES__ARENA_DEFAULT_SIZE  1024
+#define ARES__ARENA_MAX_CHUNK     65536
+
+typedef struct ares_arena_chunk {
+  struct ares_arena_chunk *next;
+  size_t                   size; /*!< usable bytes following the header */
+  size_t                   used;
+} ares_arena_chunk_t;
+
+#define ARES__ARENA_CHUNK_HDR ARES__ARENA_ALIGNED(sizeof(ares_arena_chunk_t))
+#define ARES__ARENA_CHUNK_DATA(c) \
+  ((unsigned char *)(c) + ARES__ARENA_CHUNK_HDR)
+#define ARES__ARENA_CHUNK_CDATA(c) \
+  ((const unsigned char *)(c) + ARES__ARENA_CHUNK_HDR)
+
+struct ares_arena {
+  /*! Chunks, the one being allocated from first.  The initial chunk is part
+   *  of the same allocation as the arena itself. */
+  ares_arena_chunk_t *chunks;
+  /*! Most recent allocation, which may be grown in place or rolled back */
+  unsigned char      *last;
+  /*! Size of the next chunk to be added */
+  size_t              next_size;
+};
+
+#define ARES__ARENA_HDR ARES__ARENA_ALIGNED(sizeof(ares_arena_t))
+
+ares_arena_t *ares_arena_create(size_t size_hint)
+{
+  ares_arena_t       *arena;
+  ares_arena_chunk_t *chunk;
+
+  if (size_hint == 0) {
+    size_hint = ARES__ARENA_DEFAULT_SIZE;
+  }
+  size_hint = ARES__ARENA_ALIGNED(size_hint);
+
+  arena = ares_malloc(ARES__ARENA_HDR + ARES__ARENA_CHUNK_HDR + size_hint);
+  if (arena == NULL) {
+    return NULL;
+  }
+
+  chunk           = (ares_arena_chunk_t *)((unsigned char *)arena +
+                                 ARES__ARENA_HDR);
+  chunk->next     = NULL;
+  chunk->size     = size_hint;
+  chunk->used     = 0;
+  arena->chunks   = chunk;
+  arena->last     = NULL;
+  arena->next_size = size_hint * 2;
+  if (arena->next_size > ARES__ARENA_MAX_CHUNK) {
+    arena->next_size = ARES__ARENA_MAX_CHUNK;
+  }
+
+  return arena;
+}
+
+void ares_arena_destroy(ares_arena_t *arena)
+{
+  ares_arena_chunk_t *chunk;
+  ares_arena_chunk_t *first;
+
+  if (arena == NULL) {
+    return;
+  }
+
+  first = (ares_arena_chunk_t *)((unsigned char *)arena + ARES__ARENA_HDR);
+  chunk = arena->chunks;
+  while (chunk != NULL) {
+    ares_arena_chunk_t *next = chunk->next;
+    if (chunk != first) {
+      ares_free(chunk);
+    }
+    chunk = next;
+  }
+
+  ares_free(arena);
+}
+
+static ares_arena_chunk_t *ares_arena_add_chunk(ares_arena_t *arena,
+                                                size_t        size)
+{
+  ares_arena_chunk_t *chunk;
+  size_t              chunk_size = arena->next_size;
+
+  /* Oversized requests get a dedicated chunk placed behind the current one,
+   * so the remaining space in the current chunk isn't abandoned */
+  if (size > chunk_size) {
+    chunk = ares_malloc(ARES__ARENA_CHUNK_HDR + size);
+    if (chunk == NULL) {
+      return NULL;
+    }
+    chunk->size          = size;
+    chunk->used          = 0;
+    chunk->next          = arena->chunks->next;
+    arena->chunks->next  = chunk;
+    return chunk;
+  }
+
+  chunk = ares_malloc(ARES__ARENA_CHUNK_HDR + chunk_size);
+  if (chunk == NULL) {
+    return NULL;
+  }
+  chunk->size   = chunk_size;
+  chunk->used   = 0;
+  chunk->next   = arena->chunks;
+  arena->chunks = chunk;
+
+  if (arena->next_size < ARES__ARENA_MAX_CHUNK) {
+    arena->next_size *= 2;
+  }
+  return chunk;
+}
+
+void *ares_arena_malloc(ares_arena_t *arena, size_t size)
+{
+  ares_arena_chunk_t *chunk;
+  unsigned char      *ptr;
+
+  if (arena == NULL) {
+    return ares_malloc(size);
+  }
+
+  size = ARES__ARENA_ALIGNED(size == 0 ? 1 : size);
+
+  chunk = arena->chunks;
+  if (chunk->size - chunk->used < size) {
+    chunk = ares_arena_add_chunk(arena, size);
+    if (chunk == NULL) {
+      return NULL;
+    }
+  }
+
+  ptr          = ARES__ARENA_CHUNK_DATA(chunk) + chunk->used;
+  chunk->used += size;
+  arena->last  = ptr;
+  return ptr;
+}
+
+void *ares_arena_malloc_zero(ares_arena_t *arena, size_t size)
+{
+  void *ptr = ares_arena_malloc(arena, size);
+  if (ptr != NULL) {
+    memset(ptr, 0, size);
+  }
+  return ptr;
+}
+
+/* Whether ptr is the most recent allocation, and so the last thing in the
+ * chunk being allocated from */
+static ares_bool_t ares_arena_is_last(const ares_arena_t *arena,
+                                      const void         *ptr)
+{
+  const unsigned char *data = ARES__ARENA_CHUNK_DATA(arena->chunks);
+
+  /* Oversized allocations live in a dedicated chunk that isn't the current
+   * one, those are never considered */
+  if (arena->last == NULL || (const unsigned char *)ptr != arena->last ||
+      arena->last < data || arena->last >= data + arena->chunks->used) {
+    return ARES_FALSE;
+  }
+  return ARES_TRUE;
+}
+
+void *ares_arena_realloc_zero(ares_arena_t *arena, void *ptr,
+                              size_t orig_size, size_t new_size)
+{
+  void *newptr;
+
+  if (arena == NULL) {
+    return ares_realloc_zero(ptr, orig_size, new_size);
+  }
+
+  if (ptr == NULL) {
+    return ares_arena_malloc_zero(arena, new_size);
+  }
+
+  if (new_size <= orig_size) {
+    return ptr;
+  }
+
+  /* Grow in place */
+  if (ares_arena_is_last(arena, ptr)) {
+    ares_arena_chunk_t *chunk  = arena->chunks;
+    size_t              offset = (size_t)((unsigned char *)ptr -
+                                          ARES__ARENA_CHUNK_DATA(chunk));
+    size_t              need   = ARES__ARENA_ALIGNED(new_size);
+    if (chunk->size - offset >= need) {
+      chunk->used = offset + need;
+      memset((unsigned char *)ptr + orig_size, 0, new_size - orig_size);
+      return ptr;
+    }
+  }
+
+  newptr = ares_arena_malloc(arena, new_size);
+  if (newptr == NULL) {
+    return NULL;
+  }
+  memcpy(newptr, ptr, orig_size);
+  memset((unsigned char *)newptr + orig_size, 0, new_size - orig_size);
+  return newptr;
+}
+
+char *ares_arena_strdup(ares_arena_t *arena, const char *str)
+{
+  if (str == NULL) {
+    return NULL;
+  }
+
+  if (arena == NULL) {
+    return ares_strdup(str);
+  }
+
+  return ares_arena_memdup(arena, str, ares_strlen(str));
+}
+
+void *ares_arena_memdup(ares_arena_t *arena, const void *data, size_t len)
+{
+  unsigned char *ptr;
+
+  if (data == NULL && len != 0) {
+    return NULL;
+  }
+
+  ptr = ares_arena_malloc(arena, len + 1);
+  if (ptr == NULL) {
+    return NULL;
+  }
+
+  if (len) {
+    memcpy(ptr, data, len);
+  }
+  ptr[len] = 0;
+  return ptr;
+}
+
+void ares_arena_free(ares_arena_t *arena, void *ptr)
+{
+  if (ptr == NULL) {
+    return;
+  }
+
+  if (arena == NULL || !ares_arena_owns(arena, ptr)) {
+    ares_free(ptr);
+    return;
+  }
+
+  /* Roll back the most recent allocation, anything else is left for
+   * ares_arena_destroy() */
+  if (ares_arena_is_last(arena, ptr)) {
+    arena->chunks->used = (size_t)((unsigned char *)ptr -
+                                   ARES__ARENA_CHUNK_DATA(arena->chunks));
+    arena->last         = NULL;
+  }
+}
+
+ares_bool_t ares_arena_owns(const ares_arena_t *arena, const void *ptr)
+{
+  const ares_arena_chunk_t *chunk;
+
+  if (arena == NULL || ptr == NULL) {
+    return ARES_FALSE;
+  }
+
+  for (chunk = arena->chunks; chunk != NULL; chunk = chunk->next) {
+    const unsigned char *data = ARES__ARENA_CHUNK_CDATA(chunk);
+    if ((const unsigned char *)ptr >= data &&
+        (const unsigned char *)ptr < data + chunk->size) {
+      return ARES_TRUE;
+    }
+  }
+
+  return ARES_FALSE;
+}
+
+size_t ares_arena_size(const ares_arena_t *arena)
+{
+  const ares_arena_chunk_t *chunk;
+  size_t                    size;
+
+  if (arena == NULL) {
+    return 0;
+  }
+
+  /* The first chunk shares the arena's allocation */
+  size = ARES__ARENA_HDR;
+  for (chunk = arena->chunks; chunk != NULL; chunk = chunk->next) {
+    size += ARES__ARENA_CHUNK_HDR + chunk->size;
+  }
+
+  return size;
+}
+
+void *ares_arena_adopt(ares_arena_t *arena, void *ptr, size_t len)
+{
+  void *newptr;
+
+  if (arena == NULL || ptr == NULL || ares_arena_owns(arena, ptr)) {
+    return ptr;
+  }
+
+  newptr = ares_arena_memdup(arena, ptr, len);
+  if (newptr == NULL) {
+    return NULL;
+  }
+
+  ares_free(ptr);
+  return newptr;
+}
@@ -29,6 +29,7 @@
 #define ARES__ARRAY_MIN 4
 
 struct ares_array {
+  ares_arena_t           *arena;
   ares_array_destructor_t destruct;
   void                   *arr;
   size_t                  member_size;
@@ -37,8 +38,9 @@ struct ares_array {
   size_t                  alloc_cnt;
 };
 
-ares_array_t *ares_array_create(size_t                  member_size,
-                                ares_array_destructor_t destruct)
+ares_array_t *ares_array_create_arena(ares_arena_t           *arena,
+                                      size_t                  member_size,
+                                      ares_array_destructor_t destruct)
 {
   ares_array_t *arr;
 
@@ -46,16 +48,23 @@ ares_array_t *ares_array_create(size_t                  member_size,
     return NULL;
   }
 
-  arr = ares_malloc_zero(sizeof(*arr));
+  arr = ares_arena_malloc_zero(arena, sizeof(*arr));
   if (arr == NULL) {
     return NULL;
   }
 
+  arr->arena       = arena;
   arr->member_size = member_size;
   arr->destruct    = destruct;
   return arr;
 }
 
+ares_array_t *ares_array_create(size_t                  member_size,
+                                ares_array_destructor_t destruct)
+{
+  return ares_array_create_arena(NULL, member_size, destruct);
+}
+
 size_t ares_array_len(const ares_array_t *arr)
 {
   if (arr == NULL) {
@@ -110,8 +119,8 @@ void ares_array_destroy(ares_array_t *arr)
     }
   }
 
-  ares_free(arr->arr);
-  ares_free(arr);
+  ares_arena_free(arr->arena, arr->arr);
+  ares_arena_free(arr->arena, arr);
 }
 
 /* NOTE: this function operates on actual indexes, NOT indexes using the
@@ -151,7 +160,7 @@ void *ares_array_finish(ares_array_t *arr, size_t *num_members)
 {
   void *ptr;
 
-  if (arr == NULL || num_members == NULL) {
+  if (arr == NULL || num_members == NULL || arr->arena != NULL) {
     return NULL;
   }
 
@@ -189,8 +198,9 @@ ares_status_t ares_array_set_size(ares_array_t *arr, size_t size)
     return ARES_SUCCESS;
   }
 
-  temp = ares_realloc_zero(arr->arr, arr->alloc_cnt * arr->member_size,
-                           size * arr->member_size);
+  temp = ares_arena_realloc_zero(arr->arena, arr->arr,
+                                 arr->alloc_cnt * arr->member_size,
+                                 size * arr->member_size);
   if (temp == NULL) {
     return ARES_ENOMEM;
   }
@@ -36,6 +36,7 @@ struct ares_htable {
   ares_htable_bucket_key_t  bucket_key;
   ares_htable_bucket_free_t bucket_free;
   ares_htable_key_eq_t      key_eq;
+  ares_pool_t              *node_pool;
   unsigned int              seed;
   unsigned int              size;
   size_t                    num_keys;
@@ -138,6 +139,28 @@ fail:
   return NULL;
 }
 
+ares_bool_t ares_htable_set_node_pool(ares_htable_t *htable,
+                                      ares_pool_t   *pool)
+{
+  unsigned int i;
+
+  if (htable == NULL) {
+    return ARES_FALSE;
+  }
+
+  for (i = 0; i < htable->size; i++) {
+    if (htable->buckets[i] == NULL) {
+      continue;
+    }
+    if (!ares_llist_set_node_pool(htable->buckets[i], pool)) {
+      return ARES_FALSE;
+    }
+  }
+
+  htable->node_pool = pool;
+  return ARES_TRUE;
+}
+
 const void **ares_htable_all_buckets(const ares_htable_t *htable, size_t *num)
 {
   const void **out = NULL;
@@ -228,6 +251,7 @@ static ares_bool_t ares_htable_expand(ares_htable_t *htable)
     if (prealloc_llist[i] == NULL) {
       goto done;
     }
+    ares_llist_set_node_pool(prealloc_llist[i], htable->node_pool);
   }
 
   /* Iterate across all buckets and move the entries to the new buckets */
@@ -351,6 +375,7 @@ ares_bool_t ares_htable_insert(ares_htable_t *htable, void *bucket)
     if (htable->buckets[idx] == NULL) {
       return ARES_FALSE;
     }
+    ares_llist_set_node_pool(htable->buckets[idx], htable->node_pool);
   }
 
   node = ares_llist_insert_first(htable->buckets[idx], bucket);
@@ -102,6 +102,16 @@ ares_htable_t *ares_htable_create(ares_htable_hashfunc_t    hash_func,
                                   ares_htable_bucket_free_t bucket_free,
                                   ares_htable_key_eq_t      key_eq);
 
+/*! Allocate the collision list nodes of the hashtable from the given pool,
+ *  see ares_llist_node_pool_create().  The pool must outlive the hashtable.
+ *
+ *  \param[in] htable  Initialized hashtable
+ *  \param[in] pool    Node pool, or NULL to use the system allocator
+ *  \return ARES_FALSE on misuse
+ */
+ares_bool_t    ares_htable_set_node_pool(ares_htable_t *htable,
+                                         ares_pool_t   *pool);
+
 /*! Count of keys from initialized hashtable
  *
  *  \param[in] htable  Initialized hashtable.
@@ -30,6 +30,8 @@
 struct ares_htable_szvp {
   ares_htable_szvp_val_free_t free_val;
   ares_htable_t              *hash;
+  ares_pool_t                *bucket_pool;
+  ares_pool_t                *node_pool;
 };
 
 typedef struct {
@@ -45,6 +47,8 @@ void ares_htable_szvp_destroy(ares_htable_szvp_t *htable)
   }
 
   ares_htable_destroy(htable->hash);
+  ares_pool_destroy(htable->bucket_pool);
+  ares_pool_destroy(htable->node_pool);
   ares_free(htable);
 }
 
@@ -68,7 +72,7 @@ static void bucket_free(void *bucket)
     arg->parent->free_val(arg->val);
   }
 
-  ares_free(arg);
+  ares_pool_put(arg->parent->bucket_pool, arg);
 }
 
 static ares_bool_t key_eq(const void *key1, const void *key2)
@@ -86,7 +90,7 @@ static ares_bool_t key_eq(const void *key1, const void *key2)
 ares_htable_szvp_t *
   ares_htable_szvp_create(ares_htable_szvp_val_free_t val_free)
 {
-  ares_htable_szvp_t *htable = ares_malloc(sizeof(*htable));
+  ares_htable_szvp_t *htable = ares_malloc_zero(sizeof(*htable));
   if (htable == NULL) {
     goto fail;
   }
@@ -108,6 +112,31 @@ fail:
   return NULL;
 }
 
+ares_bool_t ares_htable_szvp_enable_pool(ares_htable_szvp_t *htable,
+                                         size_t              max_cached)
+{
+  if (htable == NULL || htable->bucket_pool != NULL ||
+      ares_htable_num_keys(htable->hash) != 0) {
+    return ARES_FALSE;
+  }
+
+  htable->bucket_pool =
+    ares_pool_create(sizeof(ares_htable_szvp_bucket_t), max_cached);
+  htable->node_pool = ares_llist_node_pool_create(max_cached);
+  if (htable->bucket_pool == NULL || htable->node_pool == NULL ||
+      !ares_htable_set_node_pool(htable->hash, htable->node_pool)) {
+    /* LCOV_EXCL_START: OutOfMemory */
+    ares_pool_destroy(htable->bucket_pool);
+    ares_pool_destroy(htable->node_pool);
+    htable->bucket_pool = NULL;
+    htable->node_pool   = NULL;
+    return ARES_FALSE;
+    /* LCOV_EXCL_STOP */
+  }
+
+  return ARES_TRUE;
+}
+
 ares_bool_t ares_htable_szvp_insert(ares_htable_szvp_t *htable, size_t key,
                                     void *val)
 {
@@ -117,7 +146,11 @@ ares_bool_t ares_htable_szvp_insert(ares_htable_szvp_t *htable, size_t key,
     goto fail;
   }
 
-  bucket = ares_malloc(sizeof(*bucket));
+  if (htable->bucket_pool != NULL) {
+    bucket = ares_pool_get(htable->bucket_pool);
+  } else {
+    bucket = ares_malloc(sizeof(*bucket));
+  }
   if (bucket == NULL) {
     goto fail; /* LCOV_EXCL_LINE: OutOfMemory */
   }
@@ -134,7 +167,9 @@ ares_bool_t ares_htable_szvp_insert(ares_htable_szvp_t *htable, size_t key,
 
 fail:
   if (bucket) {
-    ares_free(bucket); /* LCOV_EXCL_LINE: OutOfMemory */
+    /* LCOV_EXCL_START: OutOfMemory */
+    ares_pool_put(htable->bucket_pool, bucket);
+    /* LCOV_EXCL_STOP */
   }
   return ARES_FALSE;
 }
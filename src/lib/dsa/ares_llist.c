@@ -30,6 +30,7 @@ struct ares_llist {
   ares_llist_node_t      *head;
   ares_llist_node_t      *tail;
   ares_llist_destructor_t destruct;
+  ares_pool_t            *pool;
   size_t                  cnt;
 };
 
@@ -63,6 +64,25 @@ void ares_llist_replace_destructor(ares_llist_t           *list,
   list->destruct = destruct;
 }
 
+ares_pool_t *ares_llist_node_pool_create(size_t max_cached)
+{
+  return ares_pool_create(sizeof(ares_llist_node_t), max_cached);
+}
+
+ares_bool_t ares_llist_set_node_pool(ares_llist_t *list, ares_pool_t *pool)
+{
+  if (list == NULL) {
+    return ARES_FALSE;
+  }
+
+  if (pool != NULL && ares_pool_obj_size(pool) != sizeof(ares_llist_node_t)) {
+    return ARES_FALSE;
+  }
+
+  list->pool = pool;
+  return ARES_TRUE;
+}
+
 typedef enum {
   ARES__LLIST_INSERT_HEAD,
   ARES__LLIST_INSERT_TAIL,
@@ -126,7 +146,11 @@ static ares_llist_node_t *ares_llist_insert_at(ares_llist_t            *list,
     return NULL; /* LCOV_EXCL_LINE: DefensiveCoding */
   }
 
-  node = ares_malloc_zero(sizeof(*node));
+  if (list->pool != NULL) {
+    node = ares_pool_get(list->pool);
+  } else {
+    node = ares_malloc_zero(sizeof(*node));
+  }
 
   if (node == NULL) {
     return NULL;
@@ -291,15 +315,17 @@ static void ares_llist_node_detach(ares_llist_node_t *node)
 
 void *ares_llist_node_claim(ares_llist_node_t *node)
 {
-  void *val;
+  void        *val;
+  ares_pool_t *pool;
 
   if (node == NULL) {
     return NULL;
   }
 
-  val = node->data;
+  val  = node->data;
+  pool = node->parent->pool;
   ares_llist_node_detach(node);
-  ares_free(node);
+  ares_pool_put(pool, node);
 
   return val;
 }
@@ -0,0 +1,138 @@
+/* MIT License
+ *
+ * Copyright (c) The c-ares project and its contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#include "ares_private.h"
+#include "ares_pool.h"
+
+/* Cached objects are chained through their first bytes */
+typedef struct ares_pool_free {
+  struct ares_pool_free *next;
+} ares_pool_free_t;
+
+struct ares_pool {
+  size_t            obj_size;
+  size_t            max_cached;
+  ares_pool_free_t *free_list;
+  ares_pool_stats_t stats;
+};
+
+ares_pool_t *ares_pool_create(size_t obj_size, size_t max_cached)
+{
+  ares_pool_t *pool;
+
+  if (obj_size < sizeof(ares_pool_free_t)) {
+    return NULL;
+  }
+
+  pool = ares_malloc_zero(sizeof(*pool));
+  if (pool == NULL) {
+    return NULL; /* LCOV_EXCL_LINE: OutOfMemory */
+  }
+
+  pool->obj_size   = obj_size;
+  pool->max_cached = max_cached;
+
+  return pool;
+}
+
+void ares_pool_destroy(ares_pool_t *pool)
+{
+  if (pool == NULL) {
+    return;
+  }
+
+  while (pool->free_list != NULL) {
+    ares_pool_free_t *obj = pool->free_list;
+    pool->free_list       = obj->next;
+    ares_free(obj);
+  }
+
+  ares_free(pool);
+}
+
+void *ares_pool_get(ares_pool_t *pool)
+{
+  ares_pool_free_t *obj;
+
+  if (pool == NULL) {
+    return NULL;
+  }
+
+  obj = pool->free_list;
+  if (obj == NULL) {
+    obj = ares_malloc(pool->obj_size);
+    if (obj == NULL) {
+      return NULL; /* LCOV_EXCL_LINE: OutOfMemory */
+    }
+    pool->stats.allocs++;
+  } else {
+    pool->free_list = obj->next;
+    pool->stats.cached--;
+    pool->stats.reuses++;
+  }
+
+  memset(obj, 0, pool->obj_size);
+  return obj;
+}
+
+void ares_pool_put(ares_pool_t *pool, void *obj)
+{
+  ares_pool_free_t *fobj = obj;
+
+  if (obj == NULL) {
+    return;
+  }
+
+  if (pool == NULL || pool->stats.cached >= pool->max_cached) {
+    ares_free(obj);
+    return;
+  }
+
+  fobj->next      = pool->free_list;
+  pool->free_list = fobj;
+  pool->stats.cached++;
+}
+
+size_t ares_pool_obj_size(const ares_pool_t *pool)
+{
+  if (pool == NULL) {
+    return 0;
+  }
+  return pool->obj_size;
+}
+
+void ares_pool_stats(const ares_pool_t *pool, ares_pool_stats_t *stats)
+{
+  if (stats == NULL) {
+    return;
+  }
+
+  if (pool == NULL) {
+    memset(stats, 0, sizeof(*stats));
+    return;
+  }
+
+  *stats = pool->stats;
+}
@@ -0,0 +1,348 @@
+/* MIT License
+ *
+ * Copyright (c) The c-ares project and its contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#include "ares_private.h"
+#include "ares_twheel.h"
+
+/* Hierarchical timing wheel implementation.
+ *
+ * Level L holds timers whose expiration, in units of 64^L milliseconds, is
+ * between 1 and 63 units ahead of the current time.  When the current time
+ * reaches the start of a slot at level L, the timers in that slot are placed
+ * again, which moves them to a lower level, and those in the current level 0
+ * slot are moved to the expired list.  Timers too far out for the top level
+ * sit in an overflow list which is placed again each time the top level
+ * wraps. */
+
+#define ARES_TWHEEL_BITS     6
+#define ARES_TWHEEL_SLOTS    (1 << ARES_TWHEEL_BITS)
+#define ARES_TWHEEL_MASK     (ARES_TWHEEL_SLOTS - 1)
+#define ARES_TWHEEL_LEVELS   4
+#define ARES_TWHEEL_EXPIRED  (ARES_TWHEEL_LEVELS * ARES_TWHEEL_SLOTS)
+#define ARES_TWHEEL_OVERFLOW (ARES_TWHEEL_EXPIRED + 1)
+#define ARES_TWHEEL_LISTS    (ARES_TWHEEL_OVERFLOW + 1)
+
+struct ares_twheel {
+  /*! Current time in milliseconds, all slots up to this point have been
+   *  processed */
+  ares_uint64_t        now;
+  ares_twheel_timer_t *lists[ARES_TWHEEL_LISTS];
+  /*! Bitmap of non-empty slots for each level */
+  ares_uint64_t        occupied[ARES_TWHEEL_LEVELS];
+  size_t               cnt;
+};
+
+static ares_uint64_t ares_twheel_ms(const ares_timeval_t *tv,
+                                    ares_bool_t           round_up)
+{
+  ares_uint64_t ms =
+    ((ares_uint64_t)tv->sec * 1000) + (ares_uint64_t)(tv->usec / 1000);
+
+  if (round_up && tv->usec % 1000 != 0) {
+    ms++;
+  }
+  return ms;
+}
+
+ares_twheel_t *ares_twheel_create(const ares_timeval_t *now)
+{
+  ares_twheel_t *wheel;
+
+  if (now == NULL) {
+    return NULL;
+  }
+
+  wheel = ares_malloc_zero(sizeof(*wheel));
+  if (wheel == NULL) {
+    return NULL; /* LCOV_EXCL_LINE: OutOfMemory */
+  }
+
+  wheel->now = ares_twheel_ms(now, ARES_FALSE);
+  return wheel;
+}
+
+void ares_twheel_destroy(ares_twheel_t *wheel)
+{
+  ares_free(wheel);
+}
+
+void ares_twheel_timer_init(ares_twheel_timer_t *timer, void *data)
+{
+  if (timer == NULL) {
+    return;
+  }
+
+  memset(timer, 0, sizeof(*timer));
+  timer->data = data;
+}
+
+ares_bool_t ares_twheel_timer_armed(const ares_twheel_timer_t *timer)
+{
+  if (timer == NULL || timer->pprev == NULL) {
+    return ARES_FALSE;
+  }
+  return ARES_TRUE;
+}
+
+size_t ares_twheel_len(const ares_twheel_t *wheel)
+{
+  if (wheel == NULL) {
+    return 0;
+  }
+  return wheel->cnt;
+}
+
+static void ares_twheel_link(ares_twheel_t *wheel, ares_twheel_timer_t *timer,
+                             size_t idx)
+{
+  ares_twheel_timer_t **head = &wheel->lists[idx];
+
+  timer->next = *head;
+  if (*head != NULL) {
+    (*head)->pprev = &timer->next;
+  }
+  *head        = timer;
+  timer->pprev = head;
+  timer->slot  = idx;
+
+  if (idx < ARES_TWHEEL_EXPIRED) {
+    wheel->occupied[idx >> ARES_TWHEEL_BITS] |=
+      (ares_uint64_t)1 << (idx & ARES_TWHEEL_MASK);
+  }
+}
+
+static void ares_twheel_unlink(ares_twheel_t *wheel, ares_twheel_timer_t *timer)
+{
+  size_t idx = timer->slot;
+
+  *timer->pprev = timer->next;
+  if (timer->next != NULL) {
+    timer->next->pprev = timer->pprev;
+  }
+  timer->next  = NULL;
+  timer->pprev = NULL;
+
+  if (idx < ARES_TWHEEL_EXPIRED && wheel->lists[idx] == NULL) {
+    wheel->occupied[idx >> ARES_TWHEEL_BITS] &=
+      ~((ares_uint64_t)1 << (idx & ARES_TWHEEL_MASK));
+  }
+}
+
+/* Choose the lowest level the timer fits in relative to the current time.
+ * Never selects the current slot of a level, as that has already been
+ * processed. */
+static void ares_twheel_place(ares_twheel_t *wheel, ares_twheel_timer_t *timer)
+{
+  size_t level;
+
+  if (timer->expire <= wheel->now) {
+    ares_twheel_link(wheel, timer, ARES_TWHEEL_EXPIRED);
+    return;
+  }
+
+  for (level = 0; level < ARES_TWHEEL_LEVELS; level++) {
+    size_t        shift = level * ARES_TWHEEL_BITS;
+    ares_uint64_t units = (timer->expire >> shift) - (wheel->now >> shift);
+
+    if (units < ARES_TWHEEL_SLOTS) {
+      size_t slot = (size_t)((timer->expire >> shift) & ARES_TWHEEL_MASK);
+      ares_twheel_link(wheel, timer, (level << ARES_TWHEEL_BITS) + slot);
+      return;
+    }
+  }
+
+  ares_twheel_link(wheel, timer, ARES_TWHEEL_OVERFLOW);
+}
+
+void ares_twheel_arm(ares_twheel_t *wheel, ares_twheel_timer_t *timer,
+                     const ares_timeval_t *expire)
+{
+  if (wheel == NULL || timer == NULL || expire == NULL) {
+    return;
+  }
+
+  ares_twheel_cancel(wheel, timer);
+
+  /* Rounding up means a timer never fires before its expiration */
+  timer->expire = ares_twheel_ms(expire, ARES_TRUE);
+  ares_twheel_place(wheel, timer);
+  wheel->cnt++;
+}
+
+void ares_twheel_cancel(ares_twheel_t *wheel, ares_twheel_timer_t *timer)
+{
+  if (wheel == NULL || !ares_twheel_timer_armed(timer)) {
+    return;
+  }
+
+  ares_twheel_unlink(wheel, timer);
+  wheel->cnt--;
+}
+
+/* Place every timer in a list again relative to the current time.  The list
+ * is detached first as timers in the overflow list may land there again. */
+static void ares_twheel_cascade(ares_twheel_t *wheel, size_t idx)
+{
+  ares_twheel_timer_t *timer = wheel->lists[idx];
+
+  wheel->lists[idx] = NULL;
+  if (idx < ARES_TWHEEL_EXPIRED) {
+    wheel->occupied[idx >> ARES_TWHEEL_BITS] &=
+      ~((ares_uint64_t)1 << (idx & ARES_TWHEEL_MASK));
+  }
+
+  while (timer != NULL) {
+    ares_twheel_timer_t *next = timer->next;
+    ares_twheel_place(wheel, timer);
+    timer = next;
+  }
+}
+
+/* Earliest start of any non-empty slot, ignoring already expired timers */
+static ares_bool_t ares_twheel_next_ms(const ares_twheel_t *wheel,
+                                       ares_uint64_t       *next)
+{
+  ares_bool_t found = ARES_FALSE;
+  size_t      level;
+
+  for (level = 0; level < ARES_TWHEEL_LEVELS; level++) {
+    size_t        shift = level * ARES_TWHEEL_BITS;
+    ares_uint64_t units = wheel->now >> shift;
+    size_t        k;
+
+    if (wheel->occupied[level] == 0) {
+      continue;
+    }
+
+    for (k = 1; k < ARES_TWHEEL_SLOTS; k++) {
+      size_t slot = (size_t)((units + k) & ARES_TWHEEL_MASK);
+
+      if (wheel->occupied[level] & ((ares_uint64_t)1 << slot)) {
+        ares_uint64_t start = (units + k) << shift;
+        if (!found || start < *next) {
+          *next = start;
+          found = ARES_TRUE;
+        }
+        break;
+      }
+    }
+  }
+
+  if (wheel->lists[ARES_TWHEEL_OVERFLOW] != NULL) {
+    size_t        shift = ARES_TWHEEL_LEVELS * ARES_TWHEEL_BITS;
+    ares_uint64_t start = ((wheel->now >> shift) + 1) << shift;
+    if (!found || start < *next) {
+      *next = start;
+      found = ARES_TRUE;
+    }
+  }
+
+  return found;
+}
+
+static void ares_twheel_tick(ares_twheel_t *wheel)
+{
+  size_t level;
+
+  wheel->now++;
+
+  if ((wheel->now &
+       (((ares_uint64_t)1 << (ARES_TWHEEL_LEVELS * ARES_TWHEEL_BITS)) - 1)) ==
+      0) {
+    ares_twheel_cascade(wheel, ARES_TWHEEL_OVERFLOW);
+  }
+
+  /* Highest level first, so timers moved down are picked up by the lower
+   * levels reaching the same boundary */
+  for (level = ARES_TWHEEL_LEVELS; level-- > 0;) {
+    size_t shift = level * ARES_TWHEEL_BITS;
+
+    if ((wheel->now & (((ares_uint64_t)1 << shift) - 1)) != 0) {
+      continue;
+    }
+
+    ares_twheel_cascade(
+      wheel, (level << ARES_TWHEEL_BITS) +
+               (size_t)((wheel->now >> shift) & ARES_TWHEEL_MASK));
+  }
+}
+
+static void ares_twheel_advance(ares_twheel_t *wheel, ares_uint64_t now)
+{
+  while (wheel->now < now) {
+    ares_uint64_t next;
+
+    if (!ares_twheel_next_ms(wheel, &next)) {
+      wheel->now = now;
+      break;
+    }
+
+    /* Nothing to do until the next occupied slot is reached */
+    if (next > wheel->now + 1) {
+      wheel->now = (next - 1 < now) ? next - 1 : now;
+      continue;
+    }
+
+    ares_twheel_tick(wheel);
+  }
+}
+
+void *ares_twheel_expire(ares_twheel_t *wheel, const ares_timeval_t *now)
+{
+  ares_twheel_timer_t *timer;
+
+  if (wheel == NULL || now == NULL) {
+    return NULL;
+  }
+
+  ares_twheel_advance(wheel, ares_twheel_ms(now, ARES_FALSE));
+
+  timer = wheel->lists[ARES_TWHEEL_EXPIRED];
+  if (timer == NULL) {
+    return NULL;
+  }
+
+  ares_twheel_unlink(wheel, timer);
+  wheel->cnt--;
+  return timer->data;
+}
+
+ares_bool_t ares_twheel_next(const ares_twheel_t *wheel, ares_timeval_t *next)
+{
+  ares_uint64_t ms;
+
+  if (wheel == NULL || next == NULL || wheel->cnt == 0) {
+    return ARES_FALSE;
+  }
+
+  if (wheel->lists[ARES_TWHEEL_EXPIRED] != NULL ||
+      !ares_twheel_next_ms(wheel, &ms)) {
+    ms = wheel->now;
+  }
+
+  next->sec  = (ares_int64_t)(ms / 1000);
+  next->usec = (unsigned int)(ms % 1000) * 1000;
+  return ARES_TRUE;
+}
@@ -0,0 +1,135 @@
+/* MIT License
+ *
+ * Copyright (c) The c-ares project and its contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#ifndef __ARES__TWHEEL_H
+#define __ARES__TWHEEL_H
+
+/*! \addtogroup ares_twheel Hierarchical Timing Wheel Data Structure
+ *
+ * Timers are bucketed by expiration time into a small number of levels of
+ * slots, where each level covers a range 64 times larger than the one below
+ * it at 1/64th the resolution.  As time advances, the slots of the higher
+ * levels are redistributed into the lower levels, until they land in the
+ * millisecond resolution level and expire.
+ *
+ * Timers are embedded in the object they track, so arming a timer never
+ * allocates memory.
+ *
+ * Time complexity:
+ *  - Arm:    O(1)
+ *  - Cancel: O(1)
+ *  - Expire: O(1) amortized per timer
+ *
+ * Unlike a sorted list, only a lower bound for the next expiration is known
+ * for timers more than 64ms out.  Using that to decide how long to sleep may
+ * cause an early wakeup with nothing to do, never a late one.
+ *
+ * @{
+ */
+struct ares_twheel;
+
+/*! Timing Wheel Object, opaque */
+typedef struct ares_twheel ares_twheel_t;
+
+/*! Timer, to be embedded in the object being tracked.  Members are private. */
+typedef struct ares_twheel_timer {
+  struct ares_twheel_timer  *next;
+  struct ares_twheel_timer **pprev;
+  ares_uint64_t              expire;
+  size_t                     slot;
+  void                      *data;
+} ares_twheel_timer_t;
+
+/*! Create Timing Wheel
+ *
+ *  \param[in] now  Current time
+ *  \return Initialized Timing Wheel Object or NULL on misuse or ENOMEM
+ */
+ares_twheel_t *ares_twheel_create(const ares_timeval_t *now);
+
+/*! Destroy Timing Wheel Object.  Any armed timers are simply forgotten.
+ *
+ *  \param[in] wheel  Timing Wheel Object, may be NULL
+ */
+void           ares_twheel_destroy(ares_twheel_t *wheel);
+
+/*! Initialize a timer in the disarmed state
+ *
+ *  \param[in] timer  Timer to initialize
+ *  \param[in] data   Value to associate with the timer
+ */
+void ares_twheel_timer_init(ares_twheel_timer_t *timer, void *data);
+
+/*! Arm a timer, or re-arm it if already armed
+ *
+ *  \param[in] wheel   Initialized Timing Wheel Object
+ *  \param[in] timer   Initialized Timer
+ *  \param[in] expire  Time at which the timer expires
+ */
+void ares_twheel_arm(ares_twheel_t *wheel, ares_twheel_timer_t *timer,
+                     const ares_timeval_t *expire);
+
+/*! Disarm a timer.  Does nothing if not armed.
+ *
+ *  \param[in] wheel  Timing Wheel Object the timer was armed on
+ *  \param[in] timer  Timer
+ */
+void ares_twheel_cancel(ares_twheel_t *wheel, ares_twheel_timer_t *timer);
+
+/*! Whether the timer is armed
+ *
+ *  \param[in] timer  Initialized Timer
+ *  \return ARES_TRUE if armed
+ */
+ares_bool_t ares_twheel_timer_armed(const ares_twheel_timer_t *timer);
+
+/*! Fetch the number of armed timers
+ *
+ *  \param[in] wheel  Timing Wheel Object
+ *  \return number of armed timers
+ */
+size_t      ares_twheel_len(const ares_twheel_t *wheel);
+
+/*! Disarm and return the value of a timer that expired at or before the
+ *  given time.  Timers are not returned in any particular order.
+ *
+ *  \param[in] wheel  Initialized Timing Wheel Object
+ *  \param[in] now    Current time, must not go backwards between calls
+ *  \return value of the expired timer or NULL if none
+ */
+void       *ares_twheel_expire(ares_twheel_t *wheel, const ares_timeval_t *now);
+
+/*! Fetch the earliest time at which a timer may expire.  This is exact for
+ *  timers less than 64ms out, otherwise it is a lower bound.
+ *
+ *  \param[in]  wheel  Initialized Timing Wheel Object
+ *  \param[out] next   Earliest expiration
+ *  \return ARES_FALSE if no timers are armed
+ */
+ares_bool_t ares_twheel_next(const ares_twheel_t *wheel, ares_timeval_t *next);
+
+/*! @} */
+
+#endif /* __ARES__TWHEEL_H */
@@ -114,6 +114,13 @@ struct ares_event_thread {
   ares_event_t           *ev_signal;
   /*! Handle for configuration change monitoring */
   ares_event_configchg_t *configchg;
+  /*! Whether this thread handles timeouts and pending writes.  Other threads
+   *  only service the socket events assigned to them. */
+  ares_bool_t             primary;
+  /*! Additional threads sockets are spread across with
+   *  ARES_OPT_EVENT_THREADS.  Only set on the primary thread. */
+  ares_event_thread_t   **peers;
+  size_t                  npeers;
   /* Event subsystem callbacks */
   const ares_event_sys_t *ev_sys;
   /* Event subsystem private data */
@@ -176,6 +183,10 @@ extern const ares_event_sys_t ares_evsys_kqueue;
 extern const ares_event_sys_t ares_evsys_epoll;
 #  endif
 
+#  ifdef HAVE_IO_URING
+extern const ares_event_sys_t ares_evsys_iouring;
+#  endif
+
 #  ifdef _WIN32
 extern const ares_event_sys_t ares_evsys_win32;
 #  endif
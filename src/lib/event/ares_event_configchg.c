@@ -93,7 +93,8 @@ static void ares_event_configchg_cb(ares_event_thread_t *e, ares_socket_t fd,
     __attribute__((aligned(__alignof__(struct inotify_event))));
   const struct inotify_event *event;
   ssize_t                     len;
-  ares_bool_t                 triggered = ARES_FALSE;
+  ares_bool_t                 triggered     = ARES_FALSE;
+  ares_bool_t                 hosts_changed = ARES_FALSE;
 
   (void)fd;
   (void)flags;
@@ -116,13 +117,23 @@ static void ares_event_configchg_cb(ares_event_thread_t *e, ares_socket_t fd,
         continue;
       }
 
-      if (ares_strcaseeq(event->name, "resolv.conf") ||
-          ares_strcaseeq(event->name, "nsswitch.conf")) {
+      /* Attribute changes are only of interest for the hosts file */
+      if (!(event->mask & IN_ATTRIB) &&
+          (ares_strcaseeq(event->name, "resolv.conf") ||
+           ares_strcaseeq(event->name, "nsswitch.conf"))) {
         triggered = ARES_TRUE;
       }
+
+      if (ares_strcaseeq(event->name, "hosts")) {
+        hosts_changed = ARES_TRUE;
+      }
     }
   }
 
+  if (hosts_changed) {
+    ares_hosts_file_changed(e->channel);
+  }
+
   /* Only process after all events are read.  No need to process more often as
    * we don't want to reload the config back to back */
   if (triggered) {
@@ -153,10 +164,12 @@ ares_status_t ares_event_configchg_init(ares_event_configchg_t **configchg,
     goto done;               /* LCOV_EXCL_LINE: UntestablePath */
   }
 
-  /* We need to monitor /etc/resolv.conf, /etc/nsswitch.conf */
+  /* We need to monitor /etc/resolv.conf, /etc/nsswitch.conf, /etc/hosts.
+   * Deleting the hosts file or changing its permissions changes what can be
+   * loaded from it too. */
   if (inotify_add_watch(c->inotify_fd, "/etc",
-                        IN_CREATE | IN_MODIFY | IN_MOVED_TO | IN_ONLYDIR) ==
-      -1) {
+                        IN_CREATE | IN_MODIFY | IN_MOVED_TO | IN_DELETE |
+                          IN_ATTRIB | IN_ONLYDIR) == -1) {
     status = ARES_ESERVFAIL; /* LCOV_EXCL_LINE: UntestablePath */
     goto done;               /* LCOV_EXCL_LINE: UntestablePath */
   }
@@ -164,6 +177,10 @@ ares_status_t ares_event_configchg_init(ares_event_configchg_t **configchg,
   status =
     ares_event_update(NULL, e, ARES_EVENT_FLAG_READ, ares_event_configchg_cb,
                       c->inotify_fd, c, ares_event_configchg_free, NULL);
+  if (status == ARES_SUCCESS) {
+    /* No need to stat() /etc/hosts on every lookup anymore */
+    e->channel->hosts_watched = ARES_TRUE;
+  }
 
 done:
   if (status != ARES_SUCCESS) {
@@ -0,0 +1,446 @@
+/* MIT License
+ *
+ * Copyright (c) The c-ares project and its contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#include "ares_private.h"
+#include "ares_event.h"
+
+#if defined(HAVE_IO_URING) && defined(CARES_THREADS)
+
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#ifdef HAVE_POLL_H
+#  include <poll.h>
+#endif
+
+/* Linux io_uring, driven through the raw system call interface so there is no
+ * dependency on liburing.  Each socket has a single multishot poll request
+ * armed for it, so unlike epoll there is no per-socket system call when
+ * interest changes, those requests are batched into the same
+ * io_uring_enter() that waits for completions.
+ *
+ * Requests are tagged with the socket and a generation number, since a
+ * socket may be closed and its descriptor reused while completions for the
+ * old poll request are still sitting in the completion queue. */
+
+/* Completions for requests we don't care about, such as poll removals */
+#define ARES_IOURING_UD_NONE 0xFFFFFFFFFFFFFFFFULL
+
+#define ARES_IOURING_ENTRIES 64
+
+typedef struct {
+  unsigned int gen;
+} ares_evsys_iouring_fd_t;
+
+typedef struct {
+  int                  ring_fd;
+  /* Submission queue ring */
+  void                *sq_ring;
+  size_t               sq_ring_sz;
+  unsigned int        *sq_head;
+  unsigned int        *sq_tail;
+  unsigned int        *sq_array;
+  unsigned int         sq_mask;
+  unsigned int         sq_entries;
+  struct io_uring_sqe *sqes;
+  size_t               sqes_sz;
+  /* Completion queue ring, may share the mapping of the submission queue */
+  void                *cq_ring;
+  size_t               cq_ring_sz;
+  unsigned int        *cq_head;
+  unsigned int        *cq_tail;
+  unsigned int         cq_mask;
+  struct io_uring_cqe *cqes;
+  /*! Current poll request generation for each registered socket */
+  ares_htable_asvp_t  *fds;
+  unsigned int         gen;
+} ares_evsys_iouring_t;
+
+static int ares_iouring_setup(unsigned int entries, struct io_uring_params *p)
+{
+  return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int ares_iouring_enter(int fd, unsigned int to_submit,
+                              unsigned int min_complete, unsigned int flags,
+                              const void *arg, size_t argsz)
+{
+  return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags,
+                      arg, argsz);
+}
+
+static void ares_evsys_iouring_destroy(ares_event_thread_t *e)
+{
+  ares_evsys_iouring_t *ur = NULL;
+
+  if (e == NULL) {
+    return; /* LCOV_EXCL_LINE: DefensiveCoding */
+  }
+
+  ur = e->ev_sys_data;
+  if (ur == NULL) {
+    return; /* LCOV_EXCL_LINE: DefensiveCoding */
+  }
+
+  if (ur->sqes != NULL) {
+    munmap(ur->sqes, ur->sqes_sz);
+  }
+  if (ur->cq_ring != NULL && ur->cq_ring != ur->sq_ring) {
+    munmap(ur->cq_ring, ur->cq_ring_sz);
+  }
+  if (ur->sq_ring != NULL) {
+    munmap(ur->sq_ring, ur->sq_ring_sz);
+  }
+  if (ur->ring_fd != -1) {
+    close(ur->ring_fd);
+  }
+
+  ares_htable_asvp_destroy(ur->fds);
+  ares_free(ur);
+  e->ev_sys_data = NULL;
+}
+
+static void *ares_iouring_mmap(int fd, size_t len, off_t offset)
+{
+  void *ptr = mmap(NULL, len, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, fd, offset);
+  return (ptr == MAP_FAILED) ? NULL : ptr;
+}
+
+static ares_bool_t ares_evsys_iouring_init(ares_event_thread_t *e)
+{
+  ares_evsys_iouring_t  *ur = NULL;
+  struct io_uring_params p;
+
+  ur = ares_malloc_zero(sizeof(*ur));
+  if (ur == NULL) {
+    return ARES_FALSE; /* LCOV_EXCL_LINE: OutOfMemory */
+  }
+
+  e->ev_sys_data = ur;
+
+  ur->fds = ares_htable_asvp_create(ares_free);
+  if (ur->fds == NULL) {
+    goto fail; /* LCOV_EXCL_LINE: OutOfMemory */
+  }
+
+  memset(&p, 0, sizeof(p));
+  p.flags     = IORING_SETUP_CLAMP;
+  ur->ring_fd = ares_iouring_setup(ARES_IOURING_ENTRIES, &p);
+  if (ur->ring_fd == -1) {
+    goto fail; /* LCOV_EXCL_LINE: UntestablePath */
+  }
+
+  /* Waiting with a timeout relies on IORING_ENTER_EXT_ARG (5.11), multishot
+   * poll arrived in the following release along with resource tags (5.13) */
+  if (!(p.features & IORING_FEAT_EXT_ARG) ||
+      !(p.features & IORING_FEAT_RSRC_TAGS) ||
+      !(p.features & IORING_FEAT_NODROP)) {
+    goto fail; /* LCOV_EXCL_LINE: UntestablePath */
+  }
+
+  ur->sq_ring_sz = p.sq_off.array + p.sq_entries * sizeof(unsigned int);
+  ur->cq_ring_sz = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+  if (p.features & IORING_FEAT_SINGLE_MMAP) {
+    if (ur->cq_ring_sz > ur->sq_ring_sz) {
+      ur->sq_ring_sz = ur->cq_ring_sz;
+    }
+    ur->cq_ring_sz = ur->sq_ring_sz;
+  }
+
+  ur->sq_ring = ares_iouring_mmap(ur->ring_fd, ur->sq_ring_sz,
+                                  IORING_OFF_SQ_RING);
+  if (ur->sq_ring == NULL) {
+    goto fail; /* LCOV_EXCL_LINE: UntestablePath */
+  }
+
+  if (p.features & IORING_FEAT_SINGLE_MMAP) {
+    ur->cq_ring = ur->sq_ring;
+  } else {
+    ur->cq_ring = ares_iouring_mmap(ur->ring_fd, ur->cq_ring_sz,
+                                    IORING_OFF_CQ_RING);
+    if (ur->cq_ring == NULL) {
+      goto fail; /* LCOV_EXCL_LINE: UntestablePath */
+    }
+  }
+
+  ur->sqes_sz = p.sq_entries * sizeof(struct io_uring_sqe);
+  ur->sqes    = ares_iouring_mmap(ur->ring_fd, ur->sqes_sz, IORING_OFF_SQES);
+  if (ur->sqes == NULL) {
+    goto fail; /* LCOV_EXCL_LINE: UntestablePath */
+  }
+
+  ur->sq_head    = (unsigned int *)((char *)ur->sq_ring + p.sq_off.head);
+  ur->sq_tail    = (unsigned int *)((char *)ur->sq_ring + p.sq_off.tail);
+  ur->sq_array   = (unsigned int *)((char *)ur->sq_ring + p.sq_off.array);
+  ur->sq_mask    = *(unsigned int *)((char *)ur->sq_ring + p.sq_off.ring_mask);
+  ur->sq_entries = p.sq_entries;
+  ur->cq_head    = (unsigned int *)((char *)ur->cq_ring + p.cq_off.head);
+  ur->cq_tail    = (unsigned int *)((char *)ur->cq_ring + p.cq_off.tail);
+  ur->cq_mask    = *(unsigned int *)((char *)ur->cq_ring + p.cq_off.ring_mask);
+  ur->cqes = (struct io_uring_cqe *)((char *)ur->cq_ring + p.cq_off.cqes);
+
+  e->ev_signal = ares_pipeevent_create(e);
+  if (e->ev_signal == NULL) {
+    goto fail; /* LCOV_EXCL_LINE: UntestablePath */
+  }
+
+  return ARES_TRUE;
+
+/* LCOV_EXCL_START: UntestablePath */
+fail:
+  ares_evsys_iouring_destroy(e);
+  return ARES_FALSE;
+  /* LCOV_EXCL_STOP */
+}
+
+/* Number of queued submissions the kernel hasn't consumed yet */
+static unsigned int ares_iouring_sq_pending(const ares_evsys_iouring_t *ur)
+{
+  return *ur->sq_tail - __atomic_load_n(ur->sq_head, __ATOMIC_ACQUIRE);
+}
+
+static struct io_uring_sqe *ares_iouring_get_sqe(ares_evsys_iouring_t *ur)
+{
+  struct io_uring_sqe *sqe;
+  unsigned int         tail = *ur->sq_tail;
+  unsigned int         idx;
+
+  /* Only the event thread itself manipulates the ring, so if it is full just
+   * hand what we have to the kernel without waiting on anything */
+  if (ares_iouring_sq_pending(ur) >= ur->sq_entries) {
+    ares_iouring_enter(ur->ring_fd, ares_iouring_sq_pending(ur), 0, 0, NULL,
+                       0);
+    if (ares_iouring_sq_pending(ur) >= ur->sq_entries) {
+      return NULL; /* LCOV_EXCL_LINE: UntestablePath */
+    }
+  }
+
+  idx = tail & ur->sq_mask;
+  sqe = &ur->sqes[idx];
+  memset(sqe, 0, sizeof(*sqe));
+  ur->sq_array[idx] = idx;
+  return sqe;
+}
+
+static void ares_iouring_commit_sqe(ares_evsys_iouring_t *ur)
+{
+  __atomic_store_n(ur->sq_tail, *ur->sq_tail + 1, __ATOMIC_RELEASE);
+}
+
+static ares_bool_t ares_iouring_poll_add(ares_evsys_iouring_t    *ur,
+                                         ares_evsys_iouring_fd_t *fdst,
+                                         ares_socket_t            fd,
+                                         ares_event_flags_t       flags)
+{
+  struct io_uring_sqe *sqe    = ares_iouring_get_sqe(ur);
+  unsigned int         events = POLLERR | POLLHUP;
+
+  if (sqe == NULL) {
+    return ARES_FALSE; /* LCOV_EXCL_LINE: UntestablePath */
+  }
+
+  if (flags & ARES_EVENT_FLAG_READ) {
+    events |= POLLIN;
+  }
+  if (flags & ARES_EVENT_FLAG_WRITE) {
+    events |= POLLOUT;
+  }
+
+  /* Generation 0 is never handed out so a zeroed state is always stale */
+  if (++ur->gen == 0) {
+    ur->gen = 1; /* LCOV_EXCL_LINE: UntestablePath */
+  }
+  fdst->gen = ur->gen;
+
+  sqe->opcode        = IORING_OP_POLL_ADD;
+  sqe->fd            = (int)fd;
+  sqe->poll32_events = events;
+  sqe->len           = IORING_POLL_ADD_MULTI;
+  sqe->user_data     = ((__u64)fdst->gen << 32) | (__u64)(unsigned int)fd;
+  ares_iouring_commit_sqe(ur);
+  return ARES_TRUE;
+}
+
+static void ares_iouring_poll_remove(ares_evsys_iouring_t          *ur,
+                                     const ares_evsys_iouring_fd_t *fdst,
+                                     ares_socket_t                  fd)
+{
+  struct io_uring_sqe *sqe = ares_iouring_get_sqe(ur);
+
+  if (sqe == NULL) {
+    return; /* LCOV_EXCL_LINE: UntestablePath */
+  }
+
+  sqe->opcode    = IORING_OP_POLL_REMOVE;
+  sqe->addr      = ((__u64)fdst->gen << 32) | (__u64)(unsigned int)fd;
+  sqe->user_data = ARES_IOURING_UD_NONE;
+  ares_iouring_commit_sqe(ur);
+}
+
+static ares_bool_t ares_evsys_iouring_event_add(ares_event_t *event)
+{
+  ares_evsys_iouring_t    *ur = event->e->ev_sys_data;
+  ares_evsys_iouring_fd_t *fdst;
+
+  fdst = ares_malloc_zero(sizeof(*fdst));
+  if (fdst == NULL) {
+    return ARES_FALSE; /* LCOV_EXCL_LINE: OutOfMemory */
+  }
+
+  if (!ares_htable_asvp_insert(ur->fds, event->fd, fdst)) {
+    ares_free(fdst);   /* LCOV_EXCL_LINE: OutOfMemory */
+    return ARES_FALSE; /* LCOV_EXCL_LINE: OutOfMemory */
+  }
+
+  if (!ares_iouring_poll_add(ur, fdst, event->fd, event->flags)) {
+    ares_htable_asvp_remove(ur->fds, event->fd); /* LCOV_EXCL_LINE */
+    return ARES_FALSE;                           /* LCOV_EXCL_LINE */
+  }
+
+  return ARES_TRUE;
+}
+
+static void ares_evsys_iouring_event_del(ares_event_t *event)
+{
+  ares_evsys_iouring_t          *ur = event->e->ev_sys_data;
+  const ares_evsys_iouring_fd_t *fdst;
+
+  fdst = ares_htable_asvp_get_direct(ur->fds, event->fd);
+  if (fdst == NULL) {
+    return; /* LCOV_EXCL_LINE: DefensiveCoding */
+  }
+
+  /* The poll request holds a reference to the socket, so it must be removed
+   * even if the socket has already been closed */
+  ares_iouring_poll_remove(ur, fdst, event->fd);
+  ares_htable_asvp_remove(ur->fds, event->fd);
+}
+
+static void ares_evsys_iouring_event_mod(ares_event_t      *event,
+                                         ares_event_flags_t new_flags)
+{
+  ares_evsys_iouring_t    *ur = event->e->ev_sys_data;
+  ares_evsys_iouring_fd_t *fdst;
+
+  fdst = ares_htable_asvp_get_direct(ur->fds, event->fd);
+  if (fdst == NULL) {
+    return; /* LCOV_EXCL_LINE: DefensiveCoding */
+  }
+
+  /* Replace rather than update in place, the new generation makes any
+   * completions still queued for the old request stale */
+  ares_iouring_poll_remove(ur, fdst, event->fd);
+  ares_iouring_poll_add(ur, fdst, event->fd, new_flags);
+}
+
+static size_t ares_evsys_iouring_wait(ares_event_thread_t *e,
+                                      unsigned long        timeout_ms)
+{
+  ares_evsys_iouring_t         *ur = e->ev_sys_data;
+  struct io_uring_getevents_arg arg;
+  struct __kernel_timespec      ts;
+  unsigned int                  head;
+  size_t                        cnt = 0;
+
+  memset(&arg, 0, sizeof(arg));
+  if (timeout_ms != 0) {
+    ts.tv_sec  = (long long)(timeout_ms / 1000);
+    ts.tv_nsec = (long long)((timeout_ms % 1000) * 1000000);
+    arg.ts     = (__u64)(uintptr_t)&ts;
+  }
+
+  /* Submit any interest changes and wait in a single system call.  A timeout
+   * or interruption is reported as an error, either way there may still be
+   * completions to reap */
+  ares_iouring_enter(ur->ring_fd, ares_iouring_sq_pending(ur), 1,
+                     IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg,
+                     sizeof(arg));
+
+  head = *ur->cq_head;
+  while (head != __atomic_load_n(ur->cq_tail, __ATOMIC_ACQUIRE)) {
+    const struct io_uring_cqe *cqe = &ur->cqes[head & ur->cq_mask];
+    __u64                      user_data = cqe->user_data;
+    __s32                      res       = cqe->res;
+    __u32                      cflags    = cqe->flags;
+    ares_socket_t              fd;
+    ares_evsys_iouring_fd_t   *fdst;
+    ares_event_t              *ev;
+    ares_event_flags_t         flags = 0;
+
+    /* Release the slot before invoking any callbacks */
+    head++;
+    __atomic_store_n(ur->cq_head, head, __ATOMIC_RELEASE);
+
+    if (user_data == ARES_IOURING_UD_NONE) {
+      continue;
+    }
+
+    fd   = (ares_socket_t)(user_data & 0xFFFFFFFF);
+    fdst = ares_htable_asvp_get_direct(ur->fds, fd);
+    if (fdst == NULL || fdst->gen != (unsigned int)(user_data >> 32)) {
+      continue; /* Completion for a request that has since been replaced */
+    }
+
+    ev = ares_htable_asvp_get_direct(e->ev_sock_handles, fd);
+    if (ev == NULL || ev->cb == NULL) {
+      continue; /* LCOV_EXCL_LINE: DefensiveCoding */
+    }
+
+    /* The kernel may terminate a multishot request, such as when the
+     * completion queue overflows or the poll itself fails, so re-arm it */
+    if (!(cflags & IORING_CQE_F_MORE)) {
+      ares_iouring_poll_add(ur, fdst, fd, ev->flags);
+    }
+
+    cnt++;
+
+    /* A failed poll is reported as readable so the owner notices the error
+     * when it reads from the socket, like POLLERR */
+    if (res < 0) {
+      flags |= ARES_EVENT_FLAG_READ; /* LCOV_EXCL_LINE: UntestablePath */
+    } else {
+      if (res & (POLLIN | POLLHUP | POLLERR)) {
+        flags |= ARES_EVENT_FLAG_READ;
+      }
+      if (res & POLLOUT) {
+        flags |= ARES_EVENT_FLAG_WRITE;
+      }
+    }
+
+    ev->cb(e, ev->fd, ev->data, flags);
+  }
+
+  return cnt;
+}
+
+const ares_event_sys_t ares_evsys_iouring = { "io_uring",
+                                              ares_evsys_iouring_init,
+                                              ares_evsys_iouring_destroy,
+                                              ares_evsys_iouring_event_add,
+                                              ares_evsys_iouring_event_del,
+                                              ares_evsys_iouring_event_mod,
+                                              ares_evsys_iouring_wait };
+#endif
@@ -25,6 +25,7 @@
  */
 #include "ares_private.h"
 #include "ares_event.h"
+#include "dsa/ares_htable.h"
 
 #ifdef CARES_THREADS
 static void ares_event_destroy_cb(void *arg)
@@ -204,10 +205,30 @@ static void ares_event_thread_process_fd(ares_event_thread_t *e,
   ares_process_fds(e->channel, &event, 1, ARES_PROCESS_FLAG_SKIP_NON_FD);
 }
 
+/* Sockets are spread across all threads, including the primary, by hash so
+ * that every update for a given socket goes to the same thread */
+static ares_event_thread_t *ares_event_thread_for_fd(ares_event_thread_t *e,
+                                                     ares_socket_t        fd)
+{
+  size_t idx;
+
+  if (e->npeers == 0) {
+    return e;
+  }
+
+  idx = ares_htable_hash_FNV1a((const unsigned char *)&fd, sizeof(fd), 0) %
+        (e->npeers + 1);
+  if (idx == 0) {
+    return e;
+  }
+
+  return e->peers[idx - 1];
+}
+
 static void ares_event_thread_sockstate_cb(void *data, ares_socket_t socket_fd,
                                            int readable, int writable)
 {
-  ares_event_thread_t *e     = data;
+  ares_event_thread_t *e     = ares_event_thread_for_fd(data, socket_fd);
   ares_event_flags_t   flags = ARES_EVENT_FLAG_NONE;
 
   if (readable) {
@@ -344,6 +365,14 @@ static void *ares_event_thread(void *arg)
      * triggered cross-thread */
     ares_thread_mutex_unlock(e->mutex);
 
+    /* Only the primary thread handles timeouts, the others sleep until one of
+     * their sockets has an event */
+    if (!e->primary) {
+      e->ev_sys->wait(e, 0);
+      ares_thread_mutex_lock(e->mutex);
+      continue;
+    }
+
     tvout = ares_timeout(e->channel, NULL, &tv);
     if (tvout != NULL) {
       timeout_ms =
@@ -352,6 +381,9 @@ static void *ares_event_thread(void *arg)
 
     e->ev_sys->wait(e, timeout_ms);
 
+    /* Send anything caller threads queued while we were waiting */
+    ares_submit_process(e->channel);
+
     /* Process pending write operation */
     ares_thread_mutex_lock(e->mutex);
     process_pending_write    = e->process_pending_write;
@@ -383,6 +415,17 @@ static void *ares_event_thread(void *arg)
 
 static void ares_event_thread_destroy_int(ares_event_thread_t *e)
 {
+  size_t i;
+
+  for (i = 0; i < e->npeers; i++) {
+    if (e->peers[i] != NULL) {
+      ares_event_thread_destroy_int(e->peers[i]);
+    }
+  }
+  ares_free(e->peers);
+  e->peers  = NULL;
+  e->npeers = 0;
+
   /* Wake thread and tell it to shutdown if it exists */
   ares_thread_mutex_lock(e->mutex);
   if (e->isup) {
@@ -462,6 +505,13 @@ static const ares_event_sys_t *ares_event_fetch_sys(ares_evsys_t evsys)
       return NULL;
 #endif
 
+    case ARES_EVSYS_IOURING:
+#if defined(HAVE_IO_URING)
+      return &ares_evsys_iouring;
+#else
+      return NULL;
+#endif
+
     /* case ARES_EVSYS_DEFAULT: */
     default:
       break;
@@ -483,10 +533,31 @@ static const ares_event_sys_t *ares_event_fetch_sys(ares_evsys_t evsys)
 #endif
 }
 
-ares_status_t ares_event_thread_init(ares_channel_t *channel)
+static ares_bool_t ares_event_sys_init(ares_event_thread_t *e)
+{
+  if (e->ev_sys->init(e)) {
+    return ARES_TRUE;
+  }
+
+#if defined(HAVE_IO_URING) && defined(HAVE_EPOLL)
+  /* io_uring is frequently disabled by policy, such as by seccomp or the
+   * kernel.io_uring_disabled sysctl, so fall back to epoll */
+  if (e->ev_sys == &ares_evsys_iouring) {
+    e->ev_sys = &ares_evsys_epoll;
+    return e->ev_sys->init(e);
+  }
+#endif
+
+  return ARES_FALSE; /* LCOV_EXCL_LINE: UntestablePath */
+}
+
+static ares_status_t ares_event_thread_create(ares_channel_t       *channel,
+                                              ares_event_thread_t **e_out)
 {
   ares_event_thread_t *e;
 
+  *e_out = NULL;
+
   e = ares_malloc_zero(sizeof(*e));
   if (e == NULL) {
     return ARES_ENOMEM; /* LCOV_EXCL_LINE: OutOfMemory */
@@ -524,19 +595,9 @@ ares_status_t ares_event_thread_init(ares_channel_t *channel)
     return ARES_ENOTIMP;              /* LCOV_EXCL_LINE: UntestablePath */
   }
 
-  channel->sock_state_cb                = ares_event_thread_sockstate_cb;
-  channel->sock_state_cb_data           = e;
-  channel->notify_pending_write_cb      = notifywrite_cb;
-  channel->notify_pending_write_cb_data = e;
-  ares_set_query_enqueue_cb(channel, notifyenqueue_cb, e);
-
-  if (!e->ev_sys->init(e)) {
-    /* LCOV_EXCL_START: UntestablePath */
-    ares_event_thread_destroy_int(e);
-    channel->sock_state_cb      = NULL;
-    channel->sock_state_cb_data = NULL;
-    return ARES_ESERVFAIL;
-    /* LCOV_EXCL_STOP */
+  if (!ares_event_sys_init(e)) {
+    ares_event_thread_destroy_int(e); /* LCOV_EXCL_LINE: UntestablePath */
+    return ARES_ESERVFAIL;            /* LCOV_EXCL_LINE: UntestablePath */
   }
 
   /* Before starting the thread, process any possible events the initialization
@@ -546,17 +607,68 @@ ares_status_t ares_event_thread_init(ares_channel_t *channel)
    * (like the event system wake handle itself). */
   ares_event_process_updates(e);
 
-  /* Start thread */
+  *e_out = e;
+  return ARES_SUCCESS;
+}
+
+ares_status_t ares_event_thread_init(ares_channel_t *channel)
+{
+  ares_event_thread_t *e;
+  ares_status_t        status;
+  size_t               i;
+
+  status = ares_event_thread_create(channel, &e);
+  if (status != ARES_SUCCESS) {
+    return status; /* LCOV_EXCL_LINE: OutOfMemory */
+  }
+  e->primary = ARES_TRUE;
+
+  if (channel->optmask & ARES_OPT_EVENT_THREADS && channel->event_threads > 1) {
+    size_t npeers = channel->event_threads - 1;
+
+    e->peers = ares_malloc_zero(sizeof(*e->peers) * npeers);
+    if (e->peers == NULL) {
+      ares_event_thread_destroy_int(e); /* LCOV_EXCL_LINE: OutOfMemory */
+      return ARES_ENOMEM;               /* LCOV_EXCL_LINE: OutOfMemory */
+    }
+    e->npeers = npeers;
+
+    for (i = 0; i < npeers; i++) {
+      status = ares_event_thread_create(channel, &e->peers[i]);
+      if (status != ARES_SUCCESS) {
+        ares_event_thread_destroy_int(e); /* LCOV_EXCL_LINE: OutOfMemory */
+        return status;                    /* LCOV_EXCL_LINE: OutOfMemory */
+      }
+    }
+  }
+
+  channel->sock_state_cb                = ares_event_thread_sockstate_cb;
+  channel->sock_state_cb_data           = e;
+  channel->notify_pending_write_cb      = notifywrite_cb;
+  channel->notify_pending_write_cb_data = e;
+  ares_set_query_enqueue_cb(channel, notifyenqueue_cb, e);
+
+  /* Start threads */
+  for (i = 0; i < e->npeers; i++) {
+    if (ares_thread_create(&e->peers[i]->thread, ares_event_thread,
+                           e->peers[i]) != ARES_SUCCESS) {
+      goto fail; /* LCOV_EXCL_LINE: UntestablePath */
+    }
+  }
+
   if (ares_thread_create(&e->thread, ares_event_thread, e) != ARES_SUCCESS) {
-    /* LCOV_EXCL_START: UntestablePath */
-    ares_event_thread_destroy_int(e);
-    channel->sock_state_cb      = NULL;
-    channel->sock_state_cb_data = NULL;
-    return ARES_ESERVFAIL;
-    /* LCOV_EXCL_STOP */
+    goto fail; /* LCOV_EXCL_LINE: UntestablePath */
   }
 
   return ARES_SUCCESS;
+
+/* LCOV_EXCL_START: UntestablePath */
+fail:
+  ares_event_thread_destroy_int(e);
+  channel->sock_state_cb      = NULL;
+  channel->sock_state_cb_data = NULL;
+  return ARES_ESERVFAIL;
+  /* LCOV_EXCL_STOP */
 }
 
 #else
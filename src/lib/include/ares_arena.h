@@ -0,0 +1,153 @@
+/* MIT License
+ *
+ * Copyright (c) The c-ares project and its contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#ifndef __ARES__ARENA_H
+#define __ARES__ARENA_H
+
+/*! \addtogroup ares_arena Bump Allocator
+ *
+ * An arena hands out memory by advancing an offset into large chunks, and
+ * releases all of it at once when destroyed.  Individual frees are not
+ * tracked, memory released within the arena is simply not reused (except
+ * for the most recent allocation, which is rolled back).  This suits
+ * objects with many small sub-allocations sharing one lifetime, such as a
+ * parsed DNS message.
+ *
+ * For convenience, every function accepting an arena also accepts NULL, in
+ * which case it behaves like the equivalent ares_malloc() family function.
+ * This allows the same code path to operate on arena-backed and individually
+ * allocated objects.
+ *
+ * The arena is not thread-safe.
+ *
+ * @{
+ */
+
+struct ares_arena;
+
+/*! Opaque data type for an arena */
+typedef struct ares_arena ares_arena_t;
+
+/*! Create an arena
+ *
+ *  \param[in] size_hint  Expected number of bytes to be allocated in total.
+ *                        The first chunk is sized accordingly; further
+ *                        chunks are added as needed.  0 picks a default.
+ *  \return arena or NULL on out of memory
+ */
+CARES_EXTERN ares_arena_t *ares_arena_create(size_t size_hint);
+
+/*! Destroy an arena, releasing every allocation made from it
+ *
+ *  \param[in] arena  Arena, may be NULL
+ */
+CARES_EXTERN void          ares_arena_destroy(ares_arena_t *arena);
+
+/*! Allocate memory from the arena
+ *
+ *  \param[in] arena  Arena, or NULL to use ares_malloc()
+ *  \param[in] size   Number of bytes
+ *  \return pointer suitably aligned for any type, or NULL on out of memory
+ */
+CARES_EXTERN void         *ares_arena_malloc(ares_arena_t *arena, size_t size);
+
+/*! Allocate zero-filled memory from the arena
+ *
+ *  \param[in] arena  Arena, or NULL to use ares_malloc_zero()
+ *  \param[in] size   Number of bytes
+ *  \return pointer or NULL on out of memory
+ */
+CARES_EXTERN void *ares_arena_malloc_zero(ares_arena_t *arena, size_t size);
+
+/*! Grow or shrink an allocation, zero-filling any newly added space.  The
+ *  most recent allocation is grown in place when there is room.
+ *
+ *  \param[in] arena      Arena, or NULL to use ares_realloc_zero()
+ *  \param[in] ptr        Allocation from the same arena, or NULL
+ *  \param[in] orig_size  Current size of the allocation
+ *  \param[in] new_size   Requested size
+ *  \return pointer or NULL on out of memory, in which case ptr is unchanged
+ */
+CARES_EXTERN void *ares_arena_realloc_zero(ares_arena_t *arena, void *ptr,
+                                           size_t orig_size, size_t new_size);
+
+/*! Duplicate a string into the arena
+ *
+ *  \param[in] arena  Arena, or NULL to use ares_strdup()
+ *  \param[in] str    NULL-terminated string
+ *  \return copy or NULL on out of memory or misuse
+ */
+CARES_EXTERN char *ares_arena_strdup(ares_arena_t *arena, const char *str);
+
+/*! Duplicate a buffer into the arena, appending a NULL terminator
+ *
+ *  \param[in] arena  Arena, or NULL to use ares_malloc()
+ *  \param[in] data   Data to copy, may be NULL if len is 0
+ *  \param[in] len    Length of data
+ *  \return copy of len + 1 bytes or NULL on out of memory or misuse
+ */
+CARES_EXTERN void *ares_arena_memdup(ares_arena_t *arena, const void *data,
+                                     size_t len);
+
+/*! Release memory.  Memory belonging to the arena is only reclaimed when
+ *  the arena is destroyed, memory that doesn't is passed to ares_free().
+ *
+ *  \param[in] arena  Arena, or NULL to use ares_free()
+ *  \param[in] ptr    Memory to release, may be NULL
+ */
+CARES_EXTERN void  ares_arena_free(ares_arena_t *arena, void *ptr);
+
+/*! Whether memory was allocated from the arena
+ *
+ *  \param[in] arena  Arena
+ *  \param[in] ptr    Memory to check
+ *  \return ARES_TRUE if ptr belongs to the arena
+ */
+CARES_EXTERN ares_bool_t ares_arena_owns(const ares_arena_t *arena,
+                                         const void         *ptr);
+
+/*! Total memory held by the arena, including space not yet handed out
+ *
+ *  \param[in] arena  Arena, may be NULL
+ *  \return number of bytes allocated for the arena and its chunks
+ */
+CARES_EXTERN size_t      ares_arena_size(const ares_arena_t *arena);
+
+/*! Move memory allocated with ares_malloc() into the arena.  The original
+ *  is freed on success.  Memory already belonging to the arena, or any
+ *  memory when arena is NULL, is returned as is.
+ *
+ *  \param[in] arena  Arena, may be NULL
+ *  \param[in] ptr    Memory to adopt
+ *  \param[in] len    Number of bytes to copy from ptr
+ *  \return pointer to use in place of ptr, or NULL on out of memory in which
+ *          case ptr is unchanged
+ */
+CARES_EXTERN void *ares_arena_adopt(ares_arena_t *arena, void *ptr,
+                                    size_t len);
+
+/*! @} */
+
+#endif /* __ARES__ARENA_H */
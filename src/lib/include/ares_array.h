@@ -27,6 +27,7 @@
 #define __ARES__ARRAY_H
 
 #include "ares.h"
+#include "ares_arena.h"
 
 /*! \addtogroup ares_array Array Data Structure
  *
@@ -77,6 +78,22 @@ typedef int (*ares_array_cmp_t)(const void *data1, const void *data2);
 CARES_EXTERN ares_array_t *ares_array_create(size_t member_size,
                                              ares_array_destructor_t destruct);
 
+/*! Create an array object whose container and storage are allocated from
+ *  an arena, see ares_array_create().  The arena must outlive the array.
+ *  Storage abandoned when the array grows is only reclaimed with the arena,
+ *  and ares_array_finish() is not supported.
+ *
+ *  \param[in] arena        Arena to allocate from, NULL behaves like
+ *                          ares_array_create()
+ *  \param[in] member_size  Size of array member
+ *  \param[in] destruct     Optional. Destructor to call on a removed member
+ *
+ *  \return array object or NULL on out of memory
+ */
+CARES_EXTERN ares_array_t *
+  ares_array_create_arena(ares_arena_t *arena, size_t member_size,
+                          ares_array_destructor_t destruct);
+
 
 /*! Request the array be at least the requested size.  Useful if the desired
  *  array size is known prior to populating the array to prevent reallocations.
@@ -106,7 +123,8 @@ CARES_EXTERN void          ares_array_destroy(ares_array_t *arr);
 
 /*! Retrieve the array in the native format.  This will also destroy the
  *  container.  It is the responsibility of the caller to free the returned
- *  pointer and also any data within each array element.
+ *  pointer and also any data within each array element.  Not supported
+ *  for arrays created with ares_array_create_arena().
  *
  *  \param[in] arr  Initialized array object
  *  \param[out] num_members the number of members in the returned array
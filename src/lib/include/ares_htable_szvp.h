@@ -66,6 +66,17 @@ CARES_EXTERN void ares_htable_szvp_destroy(ares_htable_szvp_t *htable);
 CARES_EXTERN ares_htable_szvp_t *
   ares_htable_szvp_create(ares_htable_szvp_val_free_t val_free);
 
+/*! Keep released buckets and collision list nodes for reuse instead of
+ *  returning them to the system allocator, so that a table whose size stays
+ *  roughly constant performs no allocations once warmed up.
+ *
+ *  \param[in] htable      Initialized hash table, must be empty
+ *  \param[in] max_cached  Maximum number of released entries to retain
+ *  \return ARES_TRUE on success, ARES_FALSE on misuse or out of memory
+ */
+CARES_EXTERN ares_bool_t
+  ares_htable_szvp_enable_pool(ares_htable_szvp_t *htable, size_t max_cached);
+
 /*! Insert key/value into hash table
  *
  *  \param[in] htable Initialized hash table
@@ -26,6 +26,8 @@
 #ifndef __ARES__LLIST_H
 #define __ARES__LLIST_H
 
+#include "ares_pool.h"
+
 /*! \addtogroup ares_llist LinkedList Data Structure
  *
  * This is a doubly-linked list data structure.
@@ -71,6 +73,27 @@ CARES_EXTERN void
   ares_llist_replace_destructor(ares_llist_t           *list,
                                 ares_llist_destructor_t destruct);
 
+/*! Create an object pool suitable for linked list nodes.  A single pool
+ *  may be shared by any number of lists that are accessed under the same
+ *  lock.
+ *
+ *  \param[in] max_cached  Maximum number of released nodes to retain
+ *  \return pool object or NULL on out of memory
+ */
+CARES_EXTERN ares_pool_t *ares_llist_node_pool_create(size_t max_cached);
+
+/*! Allocate nodes for the list from a pool created with
+ *  ares_llist_node_pool_create(), and return them to it on removal.  Nodes
+ *  may safely be moved between lists using different pools, or none.  The
+ *  pool must outlive the list.
+ *
+ *  \param[in] list  Initialized linked list object
+ *  \param[in] pool  Node pool, or NULL to use the system allocator
+ *  \return ARES_FALSE if the pool was not created for linked list nodes
+ */
+CARES_EXTERN ares_bool_t  ares_llist_set_node_pool(ares_llist_t *list,
+                                                   ares_pool_t  *pool);
+
 /*! Insert value as the first node in the linked list
  *
  *  \param[in] list   Initialized linked list object
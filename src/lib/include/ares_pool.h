@@ -0,0 +1,109 @@
+/* MIT License
+ *
+ * Copyright (c) The c-ares project and its contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#ifndef __ARES__POOL_H
+#define __ARES__POOL_H
+
+/*! \addtogroup ares_pool Fixed-Size Object Pool
+ *
+ * A free list of fixed-size objects.  Objects returned to the pool are kept
+ * for reuse, up to a configured limit, rather than being released back to
+ * the system allocator, so that steady-state allocation of short-lived
+ * objects of a known size costs neither a malloc() nor a free().
+ *
+ * Each object is allocated individually with ares_malloc(), so an object
+ * obtained from a pool may be released with ares_free(), and an object
+ * allocated with ares_malloc() of the pool's object size may be returned to
+ * the pool.
+ *
+ * The pool is not thread-safe, callers must provide their own locking.
+ *
+ * @{
+ */
+
+struct ares_pool;
+
+/*! Opaque data type for a fixed-size object pool */
+typedef struct ares_pool ares_pool_t;
+
+/*! Pool statistics */
+typedef struct {
+  size_t allocs; /*!< Objects that had to be allocated from the system */
+  size_t reuses; /*!< Objects handed out from the free list */
+  size_t cached; /*!< Objects currently held on the free list */
+} ares_pool_stats_t;
+
+/*! Create an object pool
+ *
+ *  \param[in] obj_size    Size of each object, must be at least the size of
+ *                         a pointer.
+ *  \param[in] max_cached  Maximum number of released objects to retain for
+ *                         reuse.
+ *  \return pool object or NULL on misuse or out of memory
+ */
+CARES_EXTERN ares_pool_t *ares_pool_create(size_t obj_size, size_t max_cached);
+
+/*! Destroy an object pool, releasing any cached objects.  Objects still
+ *  checked out of the pool are unaffected and must be released with
+ *  ares_free().
+ *
+ *  \param[in] pool  Pool object, may be NULL
+ */
+CARES_EXTERN void         ares_pool_destroy(ares_pool_t *pool);
+
+/*! Retrieve a zero-filled object from the pool, allocating if the free list
+ *  is empty.
+ *
+ *  \param[in] pool  Pool object
+ *  \return object of the pool's object size, or NULL on out of memory
+ */
+CARES_EXTERN void        *ares_pool_get(ares_pool_t *pool);
+
+/*! Return an object to the pool.  If the pool already holds its maximum
+ *  number of cached objects, or pool is NULL, the object is freed.
+ *
+ *  \param[in] pool  Pool object the object belongs to, may be NULL
+ *  \param[in] obj   Object to return, may be NULL
+ */
+CARES_EXTERN void         ares_pool_put(ares_pool_t *pool, void *obj);
+
+/*! Size of objects handed out by the pool
+ *
+ *  \param[in] pool  Pool object
+ *  \return object size, or 0 if pool is NULL
+ */
+CARES_EXTERN size_t       ares_pool_obj_size(const ares_pool_t *pool);
+
+/*! Retrieve pool statistics
+ *
+ *  \param[in]  pool   Pool object
+ *  \param[out] stats  Statistics to fill in
+ */
+CARES_EXTERN void         ares_pool_stats(const ares_pool_t *pool,
+                                          ares_pool_stats_t *stats);
+
+/*! @} */
+
+#endif /* __ARES__POOL_H */
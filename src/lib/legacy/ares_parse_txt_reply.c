@@ -39,7 +39,7 @@ static int ares_parse_txt_reply_int(const unsigned char *abuf, size_t alen,
 
   *txt_out = NULL;
 
-  status = ares_dns_parse(abuf, alen, 0, &dnsrec);
+  status = ares_dns_parse(abuf, alen, ARES_DNS_PARSE_ARENA, &dnsrec);
   if (status != ARES_SUCCESS) {
     goto done;
   }
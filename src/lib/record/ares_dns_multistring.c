@@ -32,6 +32,8 @@ typedef struct {
 } multistring_data_t;
 
 struct ares_dns_multistring {
+  /*! arena the object and its data are allocated from, if any */
+  ares_arena_t  *arena;
   /*! whether or not cached concatenated string is valid */
   ares_bool_t    cache_invalidated;
   /*! combined/concatenated string cache */
@@ -51,23 +53,31 @@ static void ares_dns_multistring_free_cb(void *arg)
   ares_free(data->data);
 }
 
-ares_dns_multistring_t *ares_dns_multistring_create(void)
+ares_dns_multistring_t *ares_dns_multistring_create_arena(ares_arena_t *arena)
 {
-  ares_dns_multistring_t *strs = ares_malloc_zero(sizeof(*strs));
+  ares_dns_multistring_t *strs = ares_arena_malloc_zero(arena, sizeof(*strs));
   if (strs == NULL) {
     return NULL;
   }
 
-  strs->strs =
-    ares_array_create(sizeof(multistring_data_t), ares_dns_multistring_free_cb);
+  strs->arena = arena;
+  /* Everything belonging to an arena is released with it */
+  strs->strs  = ares_array_create_arena(
+    arena, sizeof(multistring_data_t),
+    arena == NULL ? ares_dns_multistring_free_cb : NULL);
   if (strs->strs == NULL) {
-    ares_free(strs);
+    ares_arena_free(arena, strs);
     return NULL;
   }
 
   return strs;
 }
 
+ares_dns_multistring_t *ares_dns_multistring_create(void)
+{
+  return ares_dns_multistring_create_arena(NULL);
+}
+
 void ares_dns_multistring_clear(ares_dns_multistring_t *strs)
 {
   if (strs == NULL) {
@@ -86,8 +96,8 @@ void ares_dns_multistring_destroy(ares_dns_multistring_t *strs)
   }
   ares_dns_multistring_clear(strs);
   ares_array_destroy(strs->strs);
-  ares_free(strs->cache_str);
-  ares_free(strs);
+  ares_arena_free(strs->arena, strs->cache_str);
+  ares_arena_free(strs->arena, strs);
 }
 
 ares_status_t ares_dns_multistring_swap_own(ares_dns_multistring_t *strs,
@@ -107,7 +117,12 @@ ares_status_t ares_dns_multistring_swap_own(ares_dns_multistring_t *strs,
     return ARES_EFORMERR;
   }
 
-  ares_free(data->data);
+  str = ares_arena_adopt(strs->arena, str, len);
+  if (str == NULL) {
+    return ARES_ENOMEM; /* LCOV_EXCL_LINE: OutOfMemory */
+  }
+
+  ares_arena_free(strs->arena, data->data);
   data->data = str;
   data->len  = len;
   return ARES_SUCCESS;
@@ -146,12 +161,23 @@ ares_status_t ares_dns_multistring_add_own(ares_dns_multistring_t *strs,
     return status;
   }
 
+  if (str != NULL) {
+    unsigned char *adopted = ares_arena_adopt(strs->arena, str, len);
+    if (adopted == NULL) {
+      /* LCOV_EXCL_START: OutOfMemory */
+      ares_array_remove_last(strs->strs);
+      return ARES_ENOMEM;
+      /* LCOV_EXCL_STOP */
+    }
+    str = adopted;
+  }
+
   /* Issue #921, ares_dns_multistring_get() doesn't have a way to indicate
    * success or fail on a zero-length string which is actually valid.  So we
    * are going to allocate a 1-byte buffer to use as a placeholder in this
    * case */
   if (str == NULL) {
-    str = ares_malloc_zero(1);
+    str = ares_arena_malloc_zero(strs->arena, 1);
     if (str == NULL) {
       ares_array_remove_last(strs->strs);
       return ARES_ENOMEM;
@@ -210,7 +236,7 @@ const unsigned char *ares_dns_multistring_combined(ares_dns_multistring_t *strs,
   }
 
   /* Clear cache */
-  ares_free(strs->cache_str);
+  ares_arena_free(strs->arena, strs->cache_str);
   strs->cache_str     = NULL;
   strs->cache_str_len = 0;
 
@@ -227,6 +253,19 @@ const unsigned char *ares_dns_multistring_combined(ares_dns_multistring_t *strs,
 
   strs->cache_str =
     (unsigned char *)ares_buf_finish_str(buf, &strs->cache_str_len);
+  if (strs->cache_str != NULL) {
+    unsigned char *adopted =
+      ares_arena_adopt(strs->arena, strs->cache_str, strs->cache_str_len);
+    if (adopted == NULL) {
+      /* LCOV_EXCL_START: OutOfMemory */
+      ares_free(strs->cache_str);
+      strs->cache_str     = NULL;
+      strs->cache_str_len = 0;
+      return NULL;
+      /* LCOV_EXCL_STOP */
+    }
+    strs->cache_str = adopted;
+  }
   if (strs->cache_str != NULL) {
     strs->cache_invalidated = ARES_FALSE;
   }
@@ -234,8 +273,9 @@ const unsigned char *ares_dns_multistring_combined(ares_dns_multistring_t *strs,
   return strs->cache_str;
 }
 
-ares_status_t ares_dns_multistring_parse_buf(ares_buf_t *buf,
-                                             size_t      remaining_len,
+ares_status_t ares_dns_multistring_parse_buf(ares_buf_t   *buf,
+                                             size_t        remaining_len,
+                                             ares_arena_t *arena,
                                              ares_dns_multistring_t **strs,
                                              ares_bool_t validate_printable)
 {
@@ -252,7 +292,7 @@ ares_status_t ares_dns_multistring_parse_buf(ares_buf_t *buf,
   }
 
   if (strs != NULL) {
-    *strs = ares_dns_multistring_create();
+    *strs = ares_dns_multistring_create_arena(arena);
     if (*strs == NULL) {
       return ARES_ENOMEM;
     }
@@ -279,14 +319,22 @@ ares_status_t ares_dns_multistring_parse_buf(ares_buf_t *buf,
     if (strs != NULL) {
       unsigned char *data = NULL;
       if (len) {
-        status = ares_buf_fetch_bytes_dup(buf, len, ARES_TRUE, &data);
-        if (status != ARES_SUCCESS) {
+        size_t               mylen;
+        const unsigned char *ptr = ares_buf_peek(buf, &mylen);
+        if (mylen < len) {
+          status = ARES_EBADRESP;
           break;
         }
+        data = ares_arena_memdup(arena, ptr, len);
+        if (data == NULL) {
+          status = ARES_ENOMEM; /* LCOV_EXCL_LINE: OutOfMemory */
+          break;                /* LCOV_EXCL_LINE: OutOfMemory */
+        }
+        ares_buf_consume(buf, len);
       }
       status = ares_dns_multistring_add_own(*strs, data, len);
       if (status != ARES_SUCCESS) {
-        ares_free(data);
+        ares_arena_free(arena, data);
         break;
       }
     } else {
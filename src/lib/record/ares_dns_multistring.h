@@ -32,6 +32,8 @@ struct ares_dns_multistring;
 typedef struct ares_dns_multistring ares_dns_multistring_t;
 
 ares_dns_multistring_t             *ares_dns_multistring_create(void);
+ares_dns_multistring_t *
+  ares_dns_multistring_create_arena(ares_arena_t *arena);
 void          ares_dns_multistring_clear(ares_dns_multistring_t *strs);
 void          ares_dns_multistring_destroy(ares_dns_multistring_t *strs);
 ares_status_t ares_dns_multistring_swap_own(ares_dns_multistring_t *strs,
@@ -57,6 +59,7 @@ const unsigned char *ares_dns_multistring_combined(ares_dns_multistring_t *strs,
  *                                 parsing the string, this is often less than
  *                                 the remaining buffer and is based on the RR
  *                                 record length.
+ *  \param[in]  arena              Optional. Arena to allocate the values from.
  *  \param[out] strs               Pointer passed by reference to be filled in
  *                                 with
  *                                 the array of values.
@@ -66,6 +69,7 @@ const unsigned char *ares_dns_multistring_combined(ares_dns_multistring_t *strs,
  */
 ares_status_t        ares_dns_multistring_parse_buf(ares_buf_t *buf,
                                                     size_t      remaining_len,
+                                                    ares_arena_t *arena,
                                                     ares_dns_multistring_t **strs,
                                                     ares_bool_t validate_printable);
 
@@ -24,111 +24,188 @@
  * SPDX-License-Identifier: MIT
  */
 #include "ares_private.h"
+#include "dsa/ares_htable.h"
 
+/* Name compression table.  Every label boundary of every name written is
+ * indexed by the text of the remaining suffix so the longest previously written
+ * suffix of a name can be found with one lookup per label. */
 typedef struct {
-  char  *name;
-  size_t name_len;
-  size_t idx;
+  const char *name; /*!< Suffix of a written name, not NULL terminated */
+  size_t      name_len;
+  size_t      idx; /*!< Offset of the first label of the suffix */
 } ares_nameoffset_t;
 
-static void ares_nameoffset_free(void *arg)
+struct ares_dns_nametable {
+  ares_htable_t *offsets; /*!< ares_nameoffset_t keyed on suffix */
+  ares_llist_t  *names;   /*!< Allocations backing the offsets */
+};
+
+static unsigned int ares_nameoffset_hash(const void *key, unsigned int seed)
 {
-  ares_nameoffset_t *off = arg;
-  if (off == NULL) {
-    return; /* LCOV_EXCL_LINE: DefensiveCoding */
-  }
-  ares_free(off->name);
-  ares_free(off);
+  const ares_nameoffset_t *off = key;
+  /* Due to DNS 0x20, lets not inadvertently mangle things, use case-sensitive
+   * matching instead of case-insensitive.  This may result in slightly
+   * larger DNS queries overall. */
+  return ares_htable_hash_FNV1a((const unsigned char *)off->name,
+                                off->name_len, seed);
 }
 
-static ares_status_t ares_nameoffset_create(ares_llist_t **list,
-                                            const char *name, size_t idx)
+static const void *ares_nameoffset_bucket_key(const void *bucket)
 {
-  ares_status_t      status;
-  ares_nameoffset_t *off = NULL;
+  return bucket;
+}
 
-  if (list == NULL || name == NULL || ares_strlen(name) == 0 ||
-      ares_strlen(name) > 255) {
-    return ARES_EFORMERR; /* LCOV_EXCL_LINE: DefensiveCoding */
+static void ares_nameoffset_bucket_free(void *bucket)
+{
+  /* Owned by the names list */
+  (void)bucket;
+}
+
+static ares_bool_t ares_nameoffset_key_eq(const void *key1, const void *key2)
+{
+  const ares_nameoffset_t *off1 = key1;
+  const ares_nameoffset_t *off2 = key2;
+
+  if (off1->name_len != off2->name_len) {
+    return ARES_FALSE;
   }
 
-  if (*list == NULL) {
-    *list = ares_llist_create(ares_nameoffset_free);
+  return memcmp(off1->name, off2->name, off1->name_len) == 0 ? ARES_TRUE
+                                                             : ARES_FALSE;
+}
+
+void ares_dns_nametable_destroy(ares_dns_nametable_t *tbl)
+{
+  if (tbl == NULL) {
+    return;
   }
-  if (*list == NULL) {
-    status = ARES_ENOMEM; /* LCOV_EXCL_LINE: OutOfMemory */
-    goto fail;            /* LCOV_EXCL_LINE: OutOfMemory */
+
+  ares_htable_destroy(tbl->offsets);
+  ares_llist_destroy(tbl->names);
+  ares_free(tbl);
+}
+
+static ares_dns_nametable_t *ares_dns_nametable_create(void)
+{
+  ares_dns_nametable_t *tbl = ares_malloc_zero(sizeof(*tbl));
+
+  if (tbl == NULL) {
+    return NULL; /* LCOV_EXCL_LINE: OutOfMemory */
   }
 
-  off = ares_malloc_zero(sizeof(*off));
-  if (off == NULL) {
-    return ARES_ENOMEM; /* LCOV_EXCL_LINE: OutOfMemory */
+  tbl->offsets =
+    ares_htable_create(ares_nameoffset_hash, ares_nameoffset_bucket_key,
+                       ares_nameoffset_bucket_free, ares_nameoffset_key_eq);
+  tbl->names = ares_llist_create(ares_free);
+  if (tbl->offsets == NULL || tbl->names == NULL) {
+    ares_dns_nametable_destroy(tbl); /* LCOV_EXCL_LINE: OutOfMemory */
+    return NULL;                     /* LCOV_EXCL_LINE: OutOfMemory */
   }
 
-  off->name     = ares_strdup(name);
-  off->name_len = ares_strlen(off->name);
-  off->idx      = idx;
+  return tbl;
+}
 
-  if (ares_llist_insert_last(*list, off) == NULL) {
-    status = ARES_ENOMEM; /* LCOV_EXCL_LINE: OutOfMemory */
-    goto fail;            /* LCOV_EXCL_LINE: OutOfMemory */
+/* Returns the position of the label following the one at pos, taking escape
+ * sequences into account, or name_len if there are no more labels */
+static size_t ares_dns_name_next_label(const char *name, size_t name_len,
+                                       size_t pos)
+{
+  while (pos < name_len) {
+    if (name[pos] == '\\') {
+      /* Either \DDD or \X */
+      pos += (pos + 1 < name_len && ares_isdigit(name[pos + 1])) ? 4 : 2;
+      continue;
+    }
+    if (name[pos] == '.') {
+      return pos + 1;
+    }
+    pos++;
   }
 
-  return ARES_SUCCESS;
-
-/* LCOV_EXCL_START: OutOfMemory */
-fail:
-  ares_nameoffset_free(off);
-  return status;
-  /* LCOV_EXCL_STOP */
+  return name_len;
 }
 
-static const ares_nameoffset_t *ares_nameoffset_find(ares_llist_t *list,
-                                                     const char   *name)
+static const ares_nameoffset_t *
+  ares_nameoffset_find(const ares_dns_nametable_t *tbl, const char *name,
+                       size_t name_len)
 {
-  size_t                   name_len = ares_strlen(name);
-  ares_llist_node_t       *node;
-  const ares_nameoffset_t *longest_match = NULL;
+  size_t pos;
 
-  if (list == NULL || name == NULL || name_len == 0) {
+  if (tbl == NULL || name_len == 0) {
     return NULL;
   }
 
-  for (node = ares_llist_node_first(list); node != NULL;
-       node = ares_llist_node_next(node)) {
-    const ares_nameoffset_t *val = ares_llist_node_val(node);
-    size_t                   prefix_len;
+  /* Try each suffix from longest to shortest, first hit is the longest
+   * match */
+  for (pos = 0; pos < name_len;
+       pos = ares_dns_name_next_label(name, name_len, pos)) {
+    const ares_nameoffset_t *off;
+    ares_nameoffset_t        key;
 
-    /* Can't be a match if the stored name is longer */
-    if (val->name_len > name_len) {
-      continue;
+    key.name     = name + pos;
+    key.name_len = name_len - pos;
+    off          = ares_htable_get(tbl->offsets, &key);
+    if (off != NULL) {
+      return off;
     }
+  }
 
-    /* Can't be the longest match if our existing longest match is longer */
-    if (longest_match != NULL && longest_match->name_len > val->name_len) {
-      continue;
+  return NULL;
+}
+
+/* Index each suffix of name up to (not including) the portion that was
+ * compressed.  label_idx holds the offset of each label written. */
+static ares_status_t ares_nameoffset_add(ares_dns_nametable_t **tbl,
+                                         const char *name, size_t name_len,
+                                         const size_t *label_idx,
+                                         size_t        num_labels)
+{
+  ares_nameoffset_t *offs;
+  char              *name_copy;
+  size_t             pos = 0;
+  size_t             i;
+
+  if (num_labels == 0) {
+    return ARES_SUCCESS;
+  }
+
+  if (*tbl == NULL) {
+    *tbl = ares_dns_nametable_create();
+    if (*tbl == NULL) {
+      return ARES_ENOMEM; /* LCOV_EXCL_LINE: OutOfMemory */
     }
+  }
+
+  /* Single allocation for the offsets followed by the name they reference */
+  offs = ares_malloc((sizeof(*offs) * num_labels) + name_len + 1);
+  if (offs == NULL) {
+    return ARES_ENOMEM; /* LCOV_EXCL_LINE: OutOfMemory */
+  }
+  name_copy = (char *)(offs + num_labels);
+  memcpy(name_copy, name, name_len + 1);
 
-    prefix_len = name_len - val->name_len;
+  if (ares_llist_insert_last((*tbl)->names, offs) == NULL) {
+    ares_free(offs);    /* LCOV_EXCL_LINE: OutOfMemory */
+    return ARES_ENOMEM; /* LCOV_EXCL_LINE: OutOfMemory */
+  }
 
-    /* Due to DNS 0x20, lets not inadvertently mangle things, use case-sensitive
-     * matching instead of case-insensitive.  This may result in slightly
-     * larger DNS queries overall. */
-    if (!ares_streq(val->name, name + prefix_len)) {
-      continue;
+  for (i = 0; i < num_labels && pos < name_len; i++) {
+    /* Compression pointers can only reference the first 16k of a message */
+    if (label_idx[i] > 0x3FFF) {
+      break;
     }
 
-    /* We need to make sure if `val->name` is "example.com" that name is
-     * is separated by a label, e.g. "myexample.com" is not ok, however
-     * "my.example.com" is, so we look for the preceding "." */
-    if (prefix_len != 0 && name[prefix_len - 1] != '.') {
-      continue;
+    offs[i].name     = name_copy + pos;
+    offs[i].name_len = name_len - pos;
+    offs[i].idx      = label_idx[i];
+    if (!ares_htable_insert((*tbl)->offsets, &offs[i])) {
+      return ARES_ENOMEM; /* LCOV_EXCL_LINE: OutOfMemory */
     }
 
-    longest_match = val;
+    pos = ares_dns_name_next_label(name, name_len, pos);
   }
 
-  return longest_match;
+  return ARES_SUCCESS;
 }
 
 static void ares_dns_labels_free_cb(void *arg)
@@ -347,16 +424,99 @@ done:
   return status;
 }
 
-ares_status_t ares_dns_name_write(ares_buf_t *buf, ares_llist_t **list,
+ares_status_t ares_dns_name_validate(const char *name,
+                                     ares_bool_t validate_hostname)
+{
+  size_t      len;
+  size_t      i;
+  size_t      label_len   = 0;
+  size_t      total_len   = 0;
+  size_t      num_labels  = 0;
+  size_t      num_empties = 0;
+
+  if (name == NULL) {
+    return ARES_EFORMERR; /* LCOV_EXCL_LINE: DefensiveCoding */
+  }
+
+  /* Same rules as ares_split_dns_name(), without building the labels */
+  len = ares_strlen(name);
+  for (i = 0; i < len; i++) {
+    unsigned char c = (unsigned char)name[i];
+
+    if (c == '.') {
+      if (label_len == 0) {
+        num_empties++;
+      }
+      total_len += label_len;
+      num_labels++;
+      label_len = 0;
+      continue;
+    }
+
+    if (c == '\\') {
+      if (++i >= len) {
+        return ARES_EBADNAME;
+      }
+      c = (unsigned char)name[i];
+
+      if (ares_isdigit(c)) {
+        unsigned int val;
+
+        if (i + 2 >= len || !ares_isdigit(name[i + 1]) ||
+            !ares_isdigit(name[i + 2])) {
+          return ARES_EBADNAME;
+        }
+        val = (unsigned int)(c - '0') * 100 +
+              (unsigned int)(name[i + 1] - '0') * 10 +
+              (unsigned int)(name[i + 2] - '0');
+        if (val > 255) {
+          return ARES_EBADNAME;
+        }
+        c  = (unsigned char)val;
+        i += 2;
+      }
+    }
+
+    if (validate_hostname && !ares_is_hostnamech(c)) {
+      return ARES_EBADNAME;
+    }
+
+    if (++label_len > 63) {
+      return ARES_EBADQUERY;
+    }
+  }
+
+  /* A trailing blank label is dropped, as is the lone one left by "." */
+  if (label_len > 0) {
+    total_len += label_len;
+    num_labels++;
+  } else if (num_labels == 1 && num_empties == 1) {
+    return ARES_SUCCESS;
+  }
+
+  if (num_empties > 0) {
+    return ARES_EBADNAME;
+  }
+
+  if (num_labels && total_len + num_labels - 1 > 255) {
+    return ARES_EBADQUERY;
+  }
+
+  return ARES_SUCCESS;
+}
+
+ares_status_t ares_dns_name_write(ares_buf_t *buf, ares_dns_nametable_t **list,
                                   ares_bool_t validate_hostname,
                                   const char *name)
 {
   const ares_nameoffset_t *off = NULL;
   size_t                   name_len;
   size_t                   orig_name_len;
-  size_t                   pos    = ares_buf_len(buf);
   ares_array_t            *labels = NULL;
   char                     name_copy[512];
+  /* A name is at most 255 bytes on the wire, so at most 127 labels */
+  size_t                   label_idx[128];
+  size_t                   num_labels = 0;
   ares_status_t            status;
 
   if (buf == NULL || name == NULL) {
@@ -375,7 +535,7 @@ ares_status_t ares_dns_name_write(ares_buf_t *buf, ares_llist_t **list,
 
   /* Find longest match */
   if (list != NULL) {
-    off = ares_nameoffset_find(*list, name_copy);
+    off = ares_nameoffset_find(*list, name_copy, name_len);
     if (off != NULL && off->name_len != name_len) {
       /* truncate */
       name_len            -= (off->name_len + 1);
@@ -397,6 +557,11 @@ ares_status_t ares_dns_name_write(ares_buf_t *buf, ares_llist_t **list,
       const ares_buf_t    *lbuf = ares_dns_labels_get_at(labels, i);
       const unsigned char *ptr  = ares_buf_peek(lbuf, &len);
 
+      /* Record where each label starts for future jumps */
+      if (num_labels < sizeof(label_idx) / sizeof(*label_idx)) {
+        label_idx[num_labels++] = ares_buf_len(buf);
+      }
+
       status = ares_buf_append_byte(buf, (unsigned char)(len & 0xFF));
       if (status != ARES_SUCCESS) {
         goto done; /* LCOV_EXCL_LINE: OutOfMemory */
@@ -427,11 +592,12 @@ ares_status_t ares_dns_name_write(ares_buf_t *buf, ares_llist_t **list,
     }
   }
 
-  /* Store pointer for future jumps as long as its not an exact match for
-   * a prior entry */
+  /* Store pointers for future jumps to each label written as long as its not
+   * an exact match for a prior entry */
   if (list != NULL && (off == NULL || off->name_len != orig_name_len) &&
       name_len > 0) {
-    status = ares_nameoffset_create(list, name /* not truncated copy! */, pos);
+    status = ares_nameoffset_add(list, name /* not truncated copy! */,
+                                 orig_name_len, label_idx, num_labels);
     if (status != ARES_SUCCESS) {
       goto done; /* LCOV_EXCL_LINE: OutOfMemory */
     }
@@ -530,27 +696,19 @@ fail:
   return status;
 }
 
-ares_status_t ares_dns_name_parse(ares_buf_t *buf, char **name,
-                                  ares_bool_t is_hostname)
+ares_status_t ares_dns_name_parse_buf(ares_buf_t *buf, ares_buf_t *namebuf,
+                                      ares_bool_t is_hostname)
 {
   size_t        save_offset = 0;
   unsigned char c;
   ares_status_t status;
-  ares_buf_t   *namebuf     = NULL;
   size_t        label_start = ares_buf_get_position(buf);
+  size_t        name_start  = ares_buf_len(namebuf);
 
   if (buf == NULL) {
     return ARES_EFORMERR;
   }
 
-  if (name != NULL) {
-    namebuf = ares_buf_create();
-    if (namebuf == NULL) {
-      status = ARES_ENOMEM;
-      goto fail;
-    }
-  }
-
   /* The compression scheme allows a domain name in a message to be
    * represented as either:
    *
@@ -633,7 +791,7 @@ ares_status_t ares_dns_name_parse(ares_buf_t *buf, char **name,
     /* New label */
 
     /* Labels are separated by periods */
-    if (ares_buf_len(namebuf) != 0 && name != NULL) {
+    if (namebuf != NULL && ares_buf_len(namebuf) != name_start) {
       status = ares_buf_append_byte(namebuf, '.');
       if (status != ARES_SUCCESS) {
         goto fail; /* LCOV_EXCL_LINE: OutOfMemory */
@@ -652,22 +810,49 @@ ares_status_t ares_dns_name_parse(ares_buf_t *buf, char **name,
     ares_buf_set_position(buf, save_offset);
   }
 
+  return ARES_SUCCESS;
+
+fail:
+  /* We want badname response if we couldn't parse */
+  if (status == ARES_EBADRESP) {
+    status = ARES_EBADNAME;
+  }
+
+  return status;
+}
+
+ares_status_t ares_dns_name_parse(ares_buf_t *buf, char **name,
+                                  ares_bool_t is_hostname)
+{
+  ares_status_t status;
+  ares_buf_t   *namebuf = NULL;
+
+  if (buf == NULL) {
+    return ARES_EFORMERR;
+  }
+
+  if (name != NULL) {
+    namebuf = ares_buf_create();
+    if (namebuf == NULL) {
+      return ARES_ENOMEM; /* LCOV_EXCL_LINE: OutOfMemory */
+    }
+  }
+
+  status = ares_dns_name_parse_buf(buf, namebuf, is_hostname);
+  if (status != ARES_SUCCESS) {
+    goto fail;
+  }
+
   if (name != NULL) {
     *name = ares_buf_finish_str(namebuf, NULL);
     if (*name == NULL) {
-      status = ARES_ENOMEM; /* LCOV_EXCL_LINE: OutOfMemory */
-      goto fail;            /* LCOV_EXCL_LINE: OutOfMemory */
+      return ARES_ENOMEM; /* LCOV_EXCL_LINE: OutOfMemory */
     }
   }
 
   return ARES_SUCCESS;
 
 fail:
-  /* We want badname response if we couldn't parse */
-  if (status == ARES_EBADRESP) {
-    status = ARES_EBADNAME;
-  }
-
   ares_buf_destroy(namebuf);
   return status;
 }
@@ -39,6 +39,95 @@ static size_t ares_dns_rr_remaining_len(const ares_buf_t *buf, size_t orig_len,
   return rdlength - used_len;
 }
 
+/* Parse a DNS name.  When parsing into an arena-backed record, the name is
+ * decoded into the record's reusable scratch buffer and then copied into the
+ * arena, so the result must be released with ares_arena_free(). */
+static ares_status_t ares_dns_parse_name(ares_buf_t        *buf,
+                                         ares_dns_record_t *dnsrec, char **name,
+                                         ares_bool_t is_hostname)
+{
+  ares_status_t        status;
+  const unsigned char *ptr;
+  size_t               len;
+
+  if (dnsrec->namebuf == NULL) {
+    return ares_dns_name_parse(buf, name, is_hostname);
+  }
+
+  if (ares_buf_len(dnsrec->namebuf)) {
+    ares_buf_set_length(dnsrec->namebuf, 0);
+  }
+
+  status = ares_dns_name_parse_buf(buf, dnsrec->namebuf, is_hostname);
+  if (status != ARES_SUCCESS) {
+    return status;
+  }
+
+  ptr   = ares_buf_peek(dnsrec->namebuf, &len);
+  *name = (char *)ares_arena_memdup(dnsrec->arena, ptr, len);
+  if (*name == NULL) {
+    return ARES_ENOMEM; /* LCOV_EXCL_LINE: OutOfMemory */
+  }
+  return ARES_SUCCESS;
+}
+
+/* Parse an owner name that is only needed until it is copied into the record.
+ * For arena-backed records the name is left in the scratch buffer so nothing
+ * is allocated; otherwise *name_alloc receives the string to ares_free(). */
+static ares_status_t ares_dns_parse_owner_name(ares_buf_t        *buf,
+                                               ares_dns_record_t *dnsrec,
+                                               char             **name_alloc,
+                                               const char       **name)
+{
+  ares_status_t status;
+  size_t        len;
+
+  if (dnsrec->namebuf == NULL) {
+    status = ares_dns_name_parse(buf, name_alloc, ARES_FALSE);
+    *name  = *name_alloc;
+    return status;
+  }
+
+  if (ares_buf_len(dnsrec->namebuf)) {
+    ares_buf_set_length(dnsrec->namebuf, 0);
+  }
+
+  status = ares_dns_name_parse_buf(buf, dnsrec->namebuf, ARES_FALSE);
+  if (status != ARES_SUCCESS) {
+    return status;
+  }
+
+  status = ares_buf_append_byte(dnsrec->namebuf, 0);
+  if (status != ARES_SUCCESS) {
+    return status; /* LCOV_EXCL_LINE: OutOfMemory */
+  }
+
+  *name = (const char *)ares_buf_peek(dnsrec->namebuf, &len);
+  return ARES_SUCCESS;
+}
+
+/* Same as ares_buf_fetch_bytes_dup() with null termination, but allocates
+ * from the record's arena when there is one. */
+static ares_status_t ares_dns_parse_fetch_bytes_dup(ares_buf_t          *buf,
+                                                    const ares_dns_rr_t *rr,
+                                                    size_t               len,
+                                                    unsigned char      **bytes)
+{
+  size_t               remaining_len;
+  const unsigned char *ptr = ares_buf_peek(buf, &remaining_len);
+
+  if (len == 0 || remaining_len < len) {
+    return ARES_EBADRESP;
+  }
+
+  *bytes = ares_arena_memdup(rr->parent->arena, ptr, len);
+  if (*bytes == NULL) {
+    return ARES_ENOMEM; /* LCOV_EXCL_LINE: OutOfMemory */
+  }
+
+  return ares_buf_consume(buf, len);
+}
+
 static ares_status_t ares_dns_parse_and_set_dns_name(ares_buf_t    *buf,
                                                      ares_bool_t    is_hostname,
                                                      ares_dns_rr_t *rr,
@@ -47,14 +136,14 @@ static ares_status_t ares_dns_parse_and_set_dns_name(ares_buf_t    *buf,
   ares_status_t status;
   char         *name = NULL;
 
-  status = ares_dns_name_parse(buf, &name, is_hostname);
+  status = ares_dns_parse_name(buf, rr->parent, &name, is_hostname);
   if (status != ARES_SUCCESS) {
     return status;
   }
 
   status = ares_dns_rr_set_str_own(rr, key, name);
   if (status != ARES_SUCCESS) {
-    ares_free(name);
+    ares_arena_free(rr->parent->arena, name);
     return status;
   }
   return ARES_SUCCESS;
@@ -95,8 +184,8 @@ static ares_status_t
   ares_status_t           status;
   ares_dns_multistring_t *strs = NULL;
 
-  status =
-    ares_dns_multistring_parse_buf(buf, max_len, &strs, validate_printable);
+  status = ares_dns_multistring_parse_buf(buf, max_len, rr->parent->arena,
+                                          &strs, validate_printable);
   if (status != ARES_SUCCESS) {
     return status;
   }
@@ -349,14 +438,14 @@ static ares_status_t ares_dns_parse_rr_sig(ares_buf_t *buf, ares_dns_rr_t *rr,
     return ARES_EBADRESP;
   }
 
-  status = ares_buf_fetch_bytes_dup(buf, len, ARES_FALSE, &data);
+  status = ares_dns_parse_fetch_bytes_dup(buf, rr, len, &data);
   if (status != ARES_SUCCESS) {
     return status;
   }
 
   status = ares_dns_rr_set_bin_own(rr, ARES_RR_SIG_SIGNATURE, data, len);
   if (status != ARES_SUCCESS) {
-    ares_free(data);
+    ares_arena_free(rr->parent->arena, data);
     return status;
   }
 
@@ -506,7 +595,7 @@ static ares_status_t ares_dns_parse_rr_opt(ares_buf_t *buf, ares_dns_rr_t *rr,
     }
 
     if (len) {
-      status = ares_buf_fetch_bytes_dup(buf, len, ARES_TRUE, &val);
+      status = ares_dns_parse_fetch_bytes_dup(buf, rr, len, &val);
       if (status != ARES_SUCCESS) {
         return status;
       }
@@ -549,14 +638,14 @@ static ares_status_t ares_dns_parse_rr_tlsa(ares_buf_t *buf, ares_dns_rr_t *rr,
     return ARES_EBADRESP;
   }
 
-  status = ares_buf_fetch_bytes_dup(buf, len, ARES_FALSE, &data);
+  status = ares_dns_parse_fetch_bytes_dup(buf, rr, len, &data);
   if (status != ARES_SUCCESS) {
     return status;
   }
 
   status = ares_dns_rr_set_bin_own(rr, ARES_RR_TLSA_DATA, data, len);
   if (status != ARES_SUCCESS) {
-    ares_free(data);
+    ares_arena_free(rr->parent->arena, data);
     return status;
   }
 
@@ -599,7 +688,7 @@ static ares_status_t ares_dns_parse_rr_svcb(ares_buf_t *buf, ares_dns_rr_t *rr,
     }
 
     if (len) {
-      status = ares_buf_fetch_bytes_dup(buf, len, ARES_TRUE, &val);
+      status = ares_dns_parse_fetch_bytes_dup(buf, rr, len, &val);
       if (status != ARES_SUCCESS) {
         return status;
       }
@@ -650,7 +739,7 @@ static ares_status_t ares_dns_parse_rr_https(ares_buf_t *buf, ares_dns_rr_t *rr,
     }
 
     if (len) {
-      status = ares_buf_fetch_bytes_dup(buf, len, ARES_TRUE, &val);
+      status = ares_dns_parse_fetch_bytes_dup(buf, rr, len, &val);
       if (status != ARES_SUCCESS) {
         return status;
       }
@@ -742,14 +831,14 @@ static ares_status_t ares_dns_parse_rr_caa(ares_buf_t *buf, ares_dns_rr_t *rr,
     status = ARES_EBADRESP;
     return status;
   }
-  status = ares_buf_fetch_bytes_dup(buf, data_len, ARES_TRUE, &data);
+  status = ares_dns_parse_fetch_bytes_dup(buf, rr, data_len, &data);
   if (status != ARES_SUCCESS) {
     return status;
   }
 
   status = ares_dns_rr_set_bin_own(rr, ARES_RR_CAA_VALUE, data, data_len);
   if (status != ARES_SUCCESS) {
-    ares_free(data);
+    ares_arena_free(rr->parent->arena, data);
     return status;
   }
   data = NULL;
@@ -769,7 +858,7 @@ static ares_status_t ares_dns_parse_rr_raw_rr(ares_buf_t    *buf,
     return ARES_SUCCESS;
   }
 
-  status = ares_buf_fetch_bytes_dup(buf, rdlength, ARES_FALSE, &bytes);
+  status = ares_dns_parse_fetch_bytes_dup(buf, rr, rdlength, &bytes);
   if (status != ARES_SUCCESS) {
     return status;
   }
@@ -777,13 +866,13 @@ static ares_status_t ares_dns_parse_rr_raw_rr(ares_buf_t    *buf,
   /* Can't fail */
   status = ares_dns_rr_set_u16(rr, ARES_RR_RAW_RR_TYPE, raw_type);
   if (status != ARES_SUCCESS) {
-    ares_free(bytes);
+    ares_arena_free(rr->parent->arena, bytes);
     return status;
   }
 
   status = ares_dns_rr_set_bin_own(rr, ARES_RR_RAW_RR_DATA, bytes, rdlength);
   if (status != ARES_SUCCESS) {
-    ares_free(bytes);
+    ares_arena_free(rr->parent->arena, bytes);
     return status;
   }
 
@@ -804,8 +893,6 @@ static ares_status_t ares_dns_parse_header(ares_buf_t *buf, unsigned int flags,
   ares_dns_opcode_t opcode;
   unsigned short    rcode;
 
-  (void)flags; /* currently unused */
-
   if (buf == NULL || dnsrec == NULL || qdcount == NULL || ancount == NULL ||
       nscount == NULL || arcount == NULL) {
     return ARES_EFORMERR;
@@ -912,10 +999,33 @@ static ares_status_t ares_dns_parse_header(ares_buf_t *buf, unsigned int flags,
     goto fail;
   }
 
-  status = ares_dns_record_create(dnsrec, id, dns_flags, opcode,
-                                  ARES_RCODE_NOERROR /* Temporary */);
-  if (status != ARES_SUCCESS) {
-    goto fail;
+  if (flags & ARES_DNS_PARSE_ARENA) {
+    /* Size the arena so a typical message fits in the first chunk: the
+     * decoded names and data are at most about twice the wire size, plus
+     * the fixed size structures for each entry. */
+    size_t size_hint = sizeof(ares_dns_record_t) + (ares_buf_len(buf) * 2) +
+                       (*qdcount * sizeof(ares_dns_qd_t)) +
+                       (((size_t)*ancount + *nscount + *arcount) *
+                        (sizeof(ares_dns_rr_t) + 16));
+
+    status = ares_dns_record_create_arena(dnsrec, id, dns_flags, opcode,
+                                          ARES_RCODE_NOERROR /* Temporary */,
+                                          size_hint);
+    if (status != ARES_SUCCESS) {
+      goto fail;
+    }
+
+    (*dnsrec)->namebuf = ares_buf_create();
+    if ((*dnsrec)->namebuf == NULL) {
+      status = ARES_ENOMEM; /* LCOV_EXCL_LINE: OutOfMemory */
+      goto fail;            /* LCOV_EXCL_LINE: OutOfMemory */
+    }
+  } else {
+    status = ares_dns_record_create(dnsrec, id, dns_flags, opcode,
+                                    ARES_RCODE_NOERROR /* Temporary */);
+    if (status != ARES_SUCCESS) {
+      goto fail;
+    }
   }
 
   (*dnsrec)->raw_rcode = rcode;
@@ -1010,7 +1120,8 @@ static ares_status_t
 static ares_status_t ares_dns_parse_qd(ares_buf_t        *buf,
                                        ares_dns_record_t *dnsrec)
 {
-  char               *name = NULL;
+  char               *name_alloc = NULL;
+  const char         *name       = NULL;
   unsigned short      u16;
   ares_status_t       status;
   ares_dns_rec_type_t type;
@@ -1032,7 +1143,7 @@ static ares_status_t ares_dns_parse_qd(ares_buf_t        *buf,
    */
 
   /* Name */
-  status = ares_dns_name_parse(buf, &name, ARES_FALSE);
+  status = ares_dns_parse_owner_name(buf, dnsrec, &name_alloc, &name);
   if (status != ARES_SUCCESS) {
     goto done;
   }
@@ -1058,7 +1169,7 @@ static ares_status_t ares_dns_parse_qd(ares_buf_t        *buf,
   }
 
 done:
-  ares_free(name);
+  ares_free(name_alloc);
   return status;
 }
 
@@ -1066,7 +1177,8 @@ static ares_status_t ares_dns_parse_rr(ares_buf_t *buf, unsigned int flags,
                                        ares_dns_section_t sect,
                                        ares_dns_record_t *dnsrec)
 {
-  char               *name = NULL;
+  char               *name_alloc = NULL;
+  const char         *name       = NULL;
   unsigned short      u16;
   unsigned short      raw_type;
   ares_status_t       status;
@@ -1103,7 +1215,7 @@ static ares_status_t ares_dns_parse_rr(ares_buf_t *buf, unsigned int flags,
    */
 
   /* Name */
-  status = ares_dns_name_parse(buf, &name, ARES_FALSE);
+  status = ares_dns_parse_owner_name(buf, dnsrec, &name_alloc, &name);
   if (status != ARES_SUCCESS) {
     goto done;
   }
@@ -1200,7 +1312,7 @@ static ares_status_t ares_dns_parse_rr(ares_buf_t *buf, unsigned int flags,
 
 
 done:
-  ares_free(name);
+  ares_free(name_alloc);
   return status;
 }
 
@@ -1299,6 +1411,10 @@ static ares_status_t ares_dns_parse_buf(ares_buf_t *buf, unsigned int flags,
     (*dnsrec)->rcode = (ares_dns_rcode_t)(*dnsrec)->raw_rcode;
   }
 
+  /* The name scratch buffer is only needed while parsing */
+  ares_buf_destroy((*dnsrec)->namebuf);
+  (*dnsrec)->namebuf = NULL;
+
   return ARES_SUCCESS;
 
 fail:
@@ -82,6 +82,32 @@ ares_status_t
                                ares_dns_rec_type_t type, unsigned short id,
                                ares_dns_flags_t flags, size_t max_udp_size);
 
+/*! Create a DNS record whose memory is all allocated from a single arena,
+ *  released at once by ares_dns_record_destroy().  Memory released while
+ *  modifying such a record is only reclaimed when it is destroyed.
+ *
+ *  \param[out] dnsrec     Newly created record
+ *  \param[in]  id         DNS message id
+ *  \param[in]  flags      DNS flags
+ *  \param[in]  opcode     DNS opcode
+ *  \param[in]  rcode      DNS rcode
+ *  \param[in]  size_hint  Expected total size of the record's allocations
+ *  \return ARES_SUCCESS on success
+ */
+ares_status_t ares_dns_record_create_arena(ares_dns_record_t **dnsrec,
+                                           unsigned short      id,
+                                           unsigned short      flags,
+                                           ares_dns_opcode_t   opcode,
+                                           ares_dns_rcode_t    rcode,
+                                           size_t              size_hint);
+
+/*! Memory held by a record created in an arena.
+ *
+ *  \param[in] dnsrec  DNS record
+ *  \return size of the record's arena, or 0 if it wasn't created in one
+ */
+size_t ares_dns_record_arena_size(const ares_dns_record_t *dnsrec);
+
 /*! Convert the RCODE and ANCOUNT from a DNS query reply into a status code.
  *
  *  \param[in] rcode   The RCODE from the reply.
@@ -268,6 +294,12 @@ struct ares_dns_record {
   ares_array_t     *an;            /*!< Type is ares_dns_rr_t */
   ares_array_t     *ns;            /*!< Type is ares_dns_rr_t */
   ares_array_t     *ar;            /*!< Type is ares_dns_rr_t */
+
+  ares_arena_t     *arena;         /*!< If set, the record and everything it
+                                    *   owns is allocated from this arena,
+                                    *   which also holds the record itself */
+  ares_buf_t       *namebuf;       /*!< Scratch space for decoding names
+                                    *   while parsing into an arena */
 };
 
 #endif
@@ -49,12 +49,18 @@ static void ares_dns_rr_free_cb(void *arg)
   ares_dns_rr_free(rr);
 }
 
-ares_status_t ares_dns_record_create(ares_dns_record_t **dnsrec,
-                                     unsigned short id, unsigned short flags,
-                                     ares_dns_opcode_t opcode,
-                                     ares_dns_rcode_t  rcode)
+static ares_status_t ares_dns_record_create_int(ares_dns_record_t **dnsrec,
+                                                unsigned short      id,
+                                                unsigned short      flags,
+                                                ares_dns_opcode_t   opcode,
+                                                ares_dns_rcode_t    rcode,
+                                                ares_arena_t       *arena)
 {
+  ares_array_destructor_t qd_free = ares_dns_qd_free_cb;
+  ares_array_destructor_t rr_free = ares_dns_rr_free_cb;
+
   if (dnsrec == NULL) {
+    ares_arena_destroy(arena);
     return ARES_EFORMERR;
   }
 
@@ -62,22 +68,36 @@ ares_status_t ares_dns_record_create(ares_dns_record_t **dnsrec,
 
   if (!ares_dns_opcode_isvalid(opcode) || !ares_dns_rcode_isvalid(rcode) ||
       !ares_dns_flags_arevalid(flags)) {
+    ares_arena_destroy(arena);
     return ARES_EFORMERR;
   }
 
-  *dnsrec = ares_malloc_zero(sizeof(**dnsrec));
+  *dnsrec = ares_arena_malloc_zero(arena, sizeof(**dnsrec));
   if (*dnsrec == NULL) {
+    ares_arena_destroy(arena);
     return ARES_ENOMEM;
   }
 
+  /* Everything belonging to an arena is released with it, nothing to
+   * destruct */
+  if (arena != NULL) {
+    qd_free = NULL;
+    rr_free = NULL;
+  }
+
+  (*dnsrec)->arena  = arena;
   (*dnsrec)->id     = id;
   (*dnsrec)->flags  = flags;
   (*dnsrec)->opcode = opcode;
   (*dnsrec)->rcode  = rcode;
-  (*dnsrec)->qd = ares_array_create(sizeof(ares_dns_qd_t), ares_dns_qd_free_cb);
-  (*dnsrec)->an = ares_array_create(sizeof(ares_dns_rr_t), ares_dns_rr_free_cb);
-  (*dnsrec)->ns = ares_array_create(sizeof(ares_dns_rr_t), ares_dns_rr_free_cb);
-  (*dnsrec)->ar = ares_array_create(sizeof(ares_dns_rr_t), ares_dns_rr_free_cb);
+  (*dnsrec)->qd =
+    ares_array_create_arena(arena, sizeof(ares_dns_qd_t), qd_free);
+  (*dnsrec)->an =
+    ares_array_create_arena(arena, sizeof(ares_dns_rr_t), rr_free);
+  (*dnsrec)->ns =
+    ares_array_create_arena(arena, sizeof(ares_dns_rr_t), rr_free);
+  (*dnsrec)->ar =
+    ares_array_create_arena(arena, sizeof(ares_dns_rr_t), rr_free);
 
   if ((*dnsrec)->qd == NULL || (*dnsrec)->an == NULL || (*dnsrec)->ns == NULL ||
       (*dnsrec)->ar == NULL) {
@@ -89,6 +109,38 @@ ares_status_t ares_dns_record_create(ares_dns_record_t **dnsrec,
   return ARES_SUCCESS;
 }
 
+ares_status_t ares_dns_record_create(ares_dns_record_t **dnsrec,
+                                     unsigned short id, unsigned short flags,
+                                     ares_dns_opcode_t opcode,
+                                     ares_dns_rcode_t  rcode)
+{
+  return ares_dns_record_create_int(dnsrec, id, flags, opcode, rcode, NULL);
+}
+
+ares_status_t ares_dns_record_create_arena(ares_dns_record_t **dnsrec,
+                                           unsigned short      id,
+                                           unsigned short      flags,
+                                           ares_dns_opcode_t   opcode,
+                                           ares_dns_rcode_t    rcode,
+                                           size_t              size_hint)
+{
+  ares_arena_t *arena = ares_arena_create(size_hint);
+
+  if (arena == NULL) {
+    return ARES_ENOMEM;
+  }
+
+  return ares_dns_record_create_int(dnsrec, id, flags, opcode, rcode, arena);
+}
+
+size_t ares_dns_record_arena_size(const ares_dns_record_t *dnsrec)
+{
+  if (dnsrec == NULL) {
+    return 0;
+  }
+  return ares_arena_size(dnsrec->arena);
+}
+
 unsigned short ares_dns_record_get_id(const ares_dns_record_t *dnsrec)
 {
   if (dnsrec == NULL) {
@@ -226,6 +278,14 @@ void ares_dns_record_destroy(ares_dns_record_t *dnsrec)
     return;
   }
 
+  ares_buf_destroy(dnsrec->namebuf);
+
+  /* The record itself lives in the arena */
+  if (dnsrec->arena != NULL) {
+    ares_arena_destroy(dnsrec->arena);
+    return;
+  }
+
   /* Free questions */
   ares_array_destroy(dnsrec->qd);
 
@@ -270,7 +330,7 @@ ares_status_t ares_dns_record_query_add(ares_dns_record_t  *dnsrec,
     return status;
   }
 
-  qd->name = ares_strdup(name);
+  qd->name = ares_arena_strdup(dnsrec->arena, name);
   if (qd->name == NULL) {
     ares_array_remove_at(dnsrec->qd, idx);
     return ARES_ENOMEM;
@@ -293,13 +353,13 @@ ares_status_t ares_dns_record_query_set_name(ares_dns_record_t *dnsrec,
   qd = ares_array_at(dnsrec->qd, idx);
 
   orig_name = qd->name;
-  qd->name  = ares_strdup(name);
+  qd->name  = ares_arena_strdup(dnsrec->arena, name);
   if (qd->name == NULL) {
     qd->name = orig_name; /* LCOV_EXCL_LINE: OutOfMemory */
     return ARES_ENOMEM;   /* LCOV_EXCL_LINE: OutOfMemory */
   }
 
-  ares_free(orig_name);
+  ares_arena_free(dnsrec->arena, orig_name);
   return ARES_SUCCESS;
 }
 
@@ -431,7 +491,7 @@ ares_status_t ares_dns_record_rr_add(ares_dns_rr_t    **rr_out,
     return status; /* LCOV_EXCL_LINE: OutOfMemory */
   }
 
-  rr->name = ares_strdup(name);
+  rr->name = ares_arena_strdup(dnsrec->arena, name);
   if (rr->name == NULL) {
     ares_array_remove_at(arr, idx);
     return ARES_ENOMEM;
@@ -952,13 +1012,13 @@ ares_status_t ares_dns_rr_add_abin(ares_dns_rr_t *dns_rr, ares_dns_rr_key_t key,
   }
 
   if (*strs == NULL) {
-    *strs = ares_dns_multistring_create();
+    *strs = ares_dns_multistring_create_arena(dns_rr->parent->arena);
     if (*strs == NULL) {
       return ARES_ENOMEM;
     }
   }
 
-  temp = ares_malloc(alloclen);
+  temp = ares_arena_malloc(dns_rr->parent->arena, alloclen);
   if (temp == NULL) {
     return ARES_ENOMEM;
   }
@@ -972,7 +1032,7 @@ ares_status_t ares_dns_rr_add_abin(ares_dns_rr_t *dns_rr, ares_dns_rr_key_t key,
 
   status = ares_dns_multistring_add_own(*strs, temp, len);
   if (status != ARES_SUCCESS) {
-    ares_free(temp);
+    ares_arena_free(dns_rr->parent->arena, temp);
   }
 
   return status;
@@ -1211,7 +1271,7 @@ ares_status_t ares_dns_rr_set_bin_own(ares_dns_rr_t    *dns_rr,
     }
 
     if (*strs == NULL) {
-      *strs = ares_dns_multistring_create();
+      *strs = ares_dns_multistring_create_arena(dns_rr->parent->arena);
       if (*strs == NULL) {
         return ARES_ENOMEM;
       }
@@ -1228,8 +1288,16 @@ ares_status_t ares_dns_rr_set_bin_own(ares_dns_rr_t    *dns_rr,
     return ARES_EFORMERR;
   }
 
+  if (val != NULL) {
+    unsigned char *adopted = ares_arena_adopt(dns_rr->parent->arena, val, len);
+    if (adopted == NULL) {
+      return ARES_ENOMEM; /* LCOV_EXCL_LINE: OutOfMemory */
+    }
+    val = adopted;
+  }
+
   if (*bin) {
-    ares_free(*bin);
+    ares_arena_free(dns_rr->parent->arena, *bin);
   }
   *bin     = val;
   *bin_len = len;
@@ -1247,8 +1315,13 @@ ares_status_t ares_dns_rr_set_bin(ares_dns_rr_t *dns_rr, ares_dns_rr_key_t key,
               ? ARES_TRUE
               : ARES_FALSE;
   size_t         alloclen = is_nullterm ? len + 1 : len;
-  unsigned char *temp     = ares_malloc(alloclen);
+  unsigned char *temp;
 
+  if (dns_rr == NULL) {
+    return ARES_EFORMERR;
+  }
+
+  temp = ares_arena_malloc(dns_rr->parent->arena, alloclen);
   if (temp == NULL) {
     return ARES_ENOMEM;
   }
@@ -1262,7 +1335,7 @@ ares_status_t ares_dns_rr_set_bin(ares_dns_rr_t *dns_rr, ares_dns_rr_key_t key,
 
   status = ares_dns_rr_set_bin_own(dns_rr, key, temp, len);
   if (status != ARES_SUCCESS) {
-    ares_free(temp);
+    ares_arena_free(dns_rr->parent->arena, temp);
   }
 
   return status;
@@ -1283,8 +1356,17 @@ ares_status_t ares_dns_rr_set_str_own(ares_dns_rr_t    *dns_rr,
     return ARES_EFORMERR;
   }
 
+  if (val != NULL) {
+    char *adopted =
+      ares_arena_adopt(dns_rr->parent->arena, val, ares_strlen(val));
+    if (adopted == NULL) {
+      return ARES_ENOMEM; /* LCOV_EXCL_LINE: OutOfMemory */
+    }
+    val = adopted;
+  }
+
   if (*str) {
-    ares_free(*str);
+    ares_arena_free(dns_rr->parent->arena, *str);
   }
   *str = val;
 
@@ -1297,8 +1379,12 @@ ares_status_t ares_dns_rr_set_str(ares_dns_rr_t *dns_rr, ares_dns_rr_key_t key,
   ares_status_t status;
   char         *temp = NULL;
 
+  if (dns_rr == NULL) {
+    return ARES_EFORMERR;
+  }
+
   if (val != NULL) {
-    temp = ares_strdup(val);
+    temp = ares_arena_strdup(dns_rr->parent->arena, val);
     if (temp == NULL) {
       return ARES_ENOMEM;
     }
@@ -1306,7 +1392,7 @@ ares_status_t ares_dns_rr_set_str(ares_dns_rr_t *dns_rr, ares_dns_rr_key_t key,
 
   status = ares_dns_rr_set_str_own(dns_rr, key, temp);
   if (status != ARES_SUCCESS) {
-    ares_free(temp);
+    ares_arena_free(dns_rr->parent->arena, temp);
   }
 
   return status;
@@ -1327,6 +1413,7 @@ ares_status_t ares_dns_rr_set_abin_own(ares_dns_rr_t          *dns_rr,
     return ARES_EFORMERR;
   }
 
+  /* NOTE: for arena-backed records, strs must be from the same arena */
   if (*strs_ptr != NULL) {
     ares_dns_multistring_destroy(*strs_ptr);
   }
@@ -1364,13 +1451,16 @@ ares_status_t ares_dns_rr_set_opt_own(ares_dns_rr_t    *dns_rr,
   }
 
   if (*options == NULL) {
-    *options =
-      ares_array_create(sizeof(ares_dns_optval_t), ares_dns_opt_free_cb);
+    ares_arena_t *arena = dns_rr->parent->arena;
+    *options            = ares_array_create_arena(
+      arena, sizeof(ares_dns_optval_t),
+      arena == NULL ? ares_dns_opt_free_cb : NULL);
   }
   if (*options == NULL) {
     return ARES_ENOMEM;
   }
 
+
   cnt = ares_array_len(*options);
   for (idx = 0; idx < cnt; idx++) {
     optptr = ares_array_at(*options, idx);
@@ -1393,7 +1483,21 @@ ares_status_t ares_dns_rr_set_opt_own(ares_dns_rr_t    *dns_rr,
   }
 
 done:
-  ares_free(optptr->val);
+  if (val != NULL) {
+    unsigned char *adopted =
+      ares_arena_adopt(dns_rr->parent->arena, val, val_len);
+    if (adopted == NULL) {
+      /* LCOV_EXCL_START: OutOfMemory */
+      if (idx == cnt) {
+        ares_array_remove_last(*options);
+      }
+      return ARES_ENOMEM;
+      /* LCOV_EXCL_STOP */
+    }
+    val = adopted;
+  }
+
+  ares_arena_free(dns_rr->parent->arena, optptr->val);
   optptr->opt     = opt;
   optptr->val     = val;
   optptr->val_len = val_len;
@@ -1408,18 +1512,20 @@ ares_status_t ares_dns_rr_set_opt(ares_dns_rr_t *dns_rr, ares_dns_rr_key_t key,
   unsigned char *temp = NULL;
   ares_status_t  status;
 
+  if (dns_rr == NULL) {
+    return ARES_EFORMERR;
+  }
+
   if (val != NULL) {
-    temp = ares_malloc(val_len + 1);
+    temp = ares_arena_memdup(dns_rr->parent->arena, val, val_len);
     if (temp == NULL) {
       return ARES_ENOMEM;
     }
-    memcpy(temp, val, val_len);
-    temp[val_len] = 0;
   }
 
   status = ares_dns_rr_set_opt_own(dns_rr, key, opt, temp, val_len);
   if (status != ARES_SUCCESS) {
-    ares_free(temp);
+    ares_arena_free(dns_rr->parent->arena, temp);
   }
 
   return status;
@@ -1637,12 +1743,167 @@ done:
   return status;
 }
 
+/* Writing and re-parsing a name drops the trailing period of a fully
+ * qualified name.  Do the same when copying so a duplicate compares equal to
+ * names read off the wire. */
+static void ares_dns_name_strip_root(char *name)
+{
+  size_t len = ares_strlen(name);
+  size_t escapes;
+
+  if (len == 0 || name[len - 1] != '.') {
+    return;
+  }
+
+  /* An escaped period belongs to the last label */
+  escapes = 0;
+  while (escapes < len - 1 && name[len - 2 - escapes] == '\\') {
+    escapes++;
+  }
+  if (escapes % 2) {
+    return;
+  }
+
+  name[len - 1] = 0;
+}
+
+static ares_status_t ares_dns_rr_copy_key(ares_dns_rr_t       *dest,
+                                          const ares_dns_rr_t *src,
+                                          ares_dns_rr_key_t    key)
+{
+  ares_status_t        status = ARES_SUCCESS;
+  const unsigned char *bin;
+  const char          *str;
+  size_t               len;
+  size_t               cnt;
+  size_t               i;
+
+  switch (ares_dns_rr_key_datatype(key)) {
+    case ARES_DATATYPE_INADDR:
+      return ares_dns_rr_set_addr(dest, key, ares_dns_rr_get_addr(src, key));
+
+    case ARES_DATATYPE_INADDR6:
+      return ares_dns_rr_set_addr6(dest, key, ares_dns_rr_get_addr6(src, key));
+
+    case ARES_DATATYPE_U8:
+      return ares_dns_rr_set_u8(dest, key, ares_dns_rr_get_u8(src, key));
+
+    case ARES_DATATYPE_U16:
+      return ares_dns_rr_set_u16(dest, key, ares_dns_rr_get_u16(src, key));
+
+    case ARES_DATATYPE_U32:
+      return ares_dns_rr_set_u32(dest, key, ares_dns_rr_get_u32(src, key));
+
+    case ARES_DATATYPE_NAME:
+    case ARES_DATATYPE_STR:
+      str = ares_dns_rr_get_str(src, key);
+      if (str == NULL) {
+        return ARES_SUCCESS;
+      }
+      if (ares_dns_rr_key_datatype(key) == ARES_DATATYPE_NAME) {
+        status = ares_dns_name_validate(str, ARES_FALSE);
+        if (status != ARES_SUCCESS) {
+          return status;
+        }
+      }
+      status = ares_dns_rr_set_str(dest, key, str);
+      if (status == ARES_SUCCESS &&
+          ares_dns_rr_key_datatype(key) == ARES_DATATYPE_NAME) {
+        char **name = ares_dns_rr_data_ptr(dest, key, NULL);
+        ares_dns_name_strip_root(*name);
+      }
+      return status;
+
+    case ARES_DATATYPE_BIN:
+    case ARES_DATATYPE_BINP:
+      bin = ares_dns_rr_get_bin(src, key, &len);
+      if (bin == NULL) {
+        return ARES_SUCCESS;
+      }
+      return ares_dns_rr_set_bin(dest, key, bin, len);
+
+    case ARES_DATATYPE_ABINP:
+      cnt = ares_dns_rr_get_abin_cnt(src, key);
+      for (i = 0; i < cnt && status == ARES_SUCCESS; i++) {
+        bin    = ares_dns_rr_get_abin(src, key, i, &len);
+        status = ares_dns_rr_add_abin(dest, key, bin, len);
+      }
+      return status;
+
+    case ARES_DATATYPE_OPT:
+      cnt = ares_dns_rr_get_opt_cnt(src, key);
+      for (i = 0; i < cnt && status == ARES_SUCCESS; i++) {
+        unsigned short opt = ares_dns_rr_get_opt(src, key, i, &bin, &len);
+        status             = ares_dns_rr_set_opt(dest, key, opt, bin, len);
+      }
+      return status;
+  }
+
+  return ARES_EFORMERR; /* LCOV_EXCL_LINE: DefensiveCoding */
+}
+
+static ares_status_t ares_dns_record_copy_section(ares_dns_record_t       *dest,
+                                                 const ares_dns_record_t *src,
+                                                 ares_dns_section_t       sect)
+{
+  size_t        cnt = ares_dns_record_rr_cnt(src, sect);
+  size_t        i;
+  ares_status_t status;
+
+  if (cnt == 0) {
+    return ARES_SUCCESS;
+  }
+
+  status = ares_dns_record_rr_prealloc(dest, sect, cnt);
+  if (status != ARES_SUCCESS) {
+    return status; /* LCOV_EXCL_LINE: OutOfMemory */
+  }
+
+  for (i = 0; i < cnt; i++) {
+    const ares_dns_rr_t     *rr = ares_dns_record_rr_get_const(src, sect, i);
+    ares_dns_rr_t           *newrr = NULL;
+    const ares_dns_rr_key_t *keys;
+    size_t                   keys_cnt = 0;
+    unsigned int             ttl      = rr->ttl;
+    size_t                   j;
+
+    /* Bake in any pending decrement, the same as writing the record would */
+    if (src->ttl_decrement > ttl) {
+      ttl = 0;
+    } else {
+      ttl -= src->ttl_decrement;
+    }
+
+    status = ares_dns_name_validate(rr->name, ARES_TRUE);
+    if (status != ARES_SUCCESS) {
+      return status;
+    }
+
+    status = ares_dns_record_rr_add(&newrr, dest, sect, rr->name, rr->type,
+                                    rr->rclass, ttl);
+    if (status != ARES_SUCCESS) {
+      return status;
+    }
+    ares_dns_name_strip_root(newrr->name);
+
+    keys = ares_dns_rr_get_keys(rr->type, &keys_cnt);
+    for (j = 0; j < keys_cnt; j++) {
+      status = ares_dns_rr_copy_key(newrr, rr, keys[j]);
+      if (status != ARES_SUCCESS) {
+        return status;
+      }
+    }
+  }
+
+  return ARES_SUCCESS;
+}
+
 ares_status_t ares_dns_record_duplicate_ex(ares_dns_record_t      **dest,
                                            const ares_dns_record_t *src)
 {
-  unsigned char *data     = NULL;
-  size_t         data_len = 0;
-  ares_status_t  status;
+  ares_status_t status;
+  size_t        rr_cnt;
+  size_t        i;
 
   if (dest == NULL || src == NULL) {
     return ARES_EFORMERR;
@@ -1650,14 +1911,61 @@ ares_status_t ares_dns_record_duplicate_ex(ares_dns_record_t      **dest,
 
   *dest = NULL;
 
-  status = ares_dns_write(src, &data, &data_len);
+  /* Copy field by field rather than writing and re-parsing the message.  The
+   * copy goes into a single arena, which a few hundred bytes per record is
+   * enough to hold in most cases. */
+  rr_cnt = ares_dns_record_rr_cnt(src, ARES_SECTION_ANSWER) +
+           ares_dns_record_rr_cnt(src, ARES_SECTION_AUTHORITY) +
+           ares_dns_record_rr_cnt(src, ARES_SECTION_ADDITIONAL);
+  status = ares_dns_record_create_arena(
+    dest, src->id, src->flags, src->opcode, src->rcode,
+    sizeof(*src) +
+      (ares_array_len(src->qd) * (sizeof(ares_dns_qd_t) + 64)) +
+      (rr_cnt * (sizeof(ares_dns_rr_t) + 64)));
   if (status != ARES_SUCCESS) {
     return status;
   }
 
-  status = ares_dns_parse(data, data_len, 0, dest);
-  ares_free(data);
+  (*dest)->raw_rcode = src->raw_rcode;
+
+  for (i = 0; i < ares_array_len(src->qd); i++) {
+    const ares_dns_qd_t *qd = ares_array_at_const(src->qd, i);
+    ares_dns_qd_t       *newqd;
+
+    /* Writing the record used to catch bad names, so check them here */
+    status = ares_dns_name_validate(qd->name, ARES_TRUE);
+    if (status != ARES_SUCCESS) {
+      goto fail;
+    }
+
+    status = ares_dns_record_query_add(*dest, qd->name, qd->qtype, qd->qclass);
+    if (status != ARES_SUCCESS) {
+      goto fail;
+    }
+    newqd = ares_array_last((*dest)->qd);
+    ares_dns_name_strip_root(newqd->name);
+  }
+
+  status = ares_dns_record_copy_section(*dest, src, ARES_SECTION_ANSWER);
+  if (status != ARES_SUCCESS) {
+    goto fail;
+  }
+
+  status = ares_dns_record_copy_section(*dest, src, ARES_SECTION_AUTHORITY);
+  if (status != ARES_SUCCESS) {
+    goto fail;
+  }
 
+  status = ares_dns_record_copy_section(*dest, src, ARES_SECTION_ADDITIONAL);
+  if (status != ARES_SUCCESS) {
+    goto fail;
+  }
+
+  return ARES_SUCCESS;
+
+fail:
+  ares_dns_record_destroy(*dest);
+  *dest = NULL;
   return status;
 }
 
@@ -136,7 +136,7 @@ static ares_status_t ares_dns_write_header(const ares_dns_record_t *dnsrec,
 }
 
 static ares_status_t ares_dns_write_questions(const ares_dns_record_t *dnsrec,
-                                              ares_llist_t           **namelist,
+                                              ares_dns_nametable_t   **namelist,
                                               ares_buf_t              *buf)
 {
   size_t i;
@@ -174,9 +174,9 @@ static ares_status_t ares_dns_write_questions(const ares_dns_record_t *dnsrec,
   return ARES_SUCCESS;
 }
 
-static ares_status_t ares_dns_write_rr_name(ares_buf_t          *buf,
-                                            const ares_dns_rr_t *rr,
-                                            ares_llist_t       **namelist,
+static ares_status_t ares_dns_write_rr_name(ares_buf_t            *buf,
+                                            const ares_dns_rr_t   *rr,
+                                            ares_dns_nametable_t **namelist,
                                             ares_bool_t       validate_hostname,
                                             ares_dns_rr_key_t key)
 {
@@ -317,9 +317,9 @@ static ares_status_t ares_dns_write_rr_u8(ares_buf_t          *buf,
   return ares_buf_append_byte(buf, ares_dns_rr_get_u8(rr, key));
 }
 
-static ares_status_t ares_dns_write_rr_a(ares_buf_t          *buf,
-                                         const ares_dns_rr_t *rr,
-                                         ares_llist_t       **namelist)
+static ares_status_t ares_dns_write_rr_a(ares_buf_t            *buf,
+                                         const ares_dns_rr_t   *rr,
+                                         ares_dns_nametable_t **namelist)
 {
   const struct in_addr *addr;
   (void)namelist;
@@ -332,25 +332,25 @@ static ares_status_t ares_dns_write_rr_a(ares_buf_t          *buf,
   return ares_buf_append(buf, (const unsigned char *)addr, sizeof(*addr));
 }
 
-static ares_status_t ares_dns_write_rr_ns(ares_buf_t          *buf,
-                                          const ares_dns_rr_t *rr,
-                                          ares_llist_t       **namelist)
+static ares_status_t ares_dns_write_rr_ns(ares_buf_t            *buf,
+                                          const ares_dns_rr_t   *rr,
+                                          ares_dns_nametable_t **namelist)
 {
   return ares_dns_write_rr_name(buf, rr, namelist, ARES_FALSE,
                                 ARES_RR_NS_NSDNAME);
 }
 
-static ares_status_t ares_dns_write_rr_cname(ares_buf_t          *buf,
-                                             const ares_dns_rr_t *rr,
-                                             ares_llist_t       **namelist)
+static ares_status_t ares_dns_write_rr_cname(ares_buf_t            *buf,
+                                             const ares_dns_rr_t   *rr,
+                                             ares_dns_nametable_t **namelist)
 {
   return ares_dns_write_rr_name(buf, rr, namelist, ARES_FALSE,
                                 ARES_RR_CNAME_CNAME);
 }
 
-static ares_status_t ares_dns_write_rr_soa(ares_buf_t          *buf,
-                                           const ares_dns_rr_t *rr,
-                                           ares_llist_t       **namelist)
+static ares_status_t ares_dns_write_rr_soa(ares_buf_t            *buf,
+                                           const ares_dns_rr_t   *rr,
+                                           ares_dns_nametable_t **namelist)
 {
   ares_status_t status;
 
@@ -396,17 +396,17 @@ static ares_status_t ares_dns_write_rr_soa(ares_buf_t          *buf,
   return ares_dns_write_rr_be32(buf, rr, ARES_RR_SOA_MINIMUM);
 }
 
-static ares_status_t ares_dns_write_rr_ptr(ares_buf_t          *buf,
-                                           const ares_dns_rr_t *rr,
-                                           ares_llist_t       **namelist)
+static ares_status_t ares_dns_write_rr_ptr(ares_buf_t            *buf,
+                                           const ares_dns_rr_t   *rr,
+                                           ares_dns_nametable_t **namelist)
 {
   return ares_dns_write_rr_name(buf, rr, namelist, ARES_FALSE,
                                 ARES_RR_PTR_DNAME);
 }
 
-static ares_status_t ares_dns_write_rr_hinfo(ares_buf_t          *buf,
-                                             const ares_dns_rr_t *rr,
-                                             ares_llist_t       **namelist)
+static ares_status_t ares_dns_write_rr_hinfo(ares_buf_t            *buf,
+                                             const ares_dns_rr_t   *rr,
+                                             ares_dns_nametable_t **namelist)
 {
   ares_status_t status;
 
@@ -422,9 +422,9 @@ static ares_status_t ares_dns_write_rr_hinfo(ares_buf_t          *buf,
   return ares_dns_write_rr_str(buf, rr, ARES_RR_HINFO_OS);
 }
 
-static ares_status_t ares_dns_write_rr_mx(ares_buf_t          *buf,
-                                          const ares_dns_rr_t *rr,
-                                          ares_llist_t       **namelist)
+static ares_status_t ares_dns_write_rr_mx(ares_buf_t            *buf,
+                                          const ares_dns_rr_t   *rr,
+                                          ares_dns_nametable_t **namelist)
 {
   ares_status_t status;
 
@@ -439,17 +439,17 @@ static ares_status_t ares_dns_write_rr_mx(ares_buf_t          *buf,
                                 ARES_RR_MX_EXCHANGE);
 }
 
-static ares_status_t ares_dns_write_rr_txt(ares_buf_t          *buf,
-                                           const ares_dns_rr_t *rr,
-                                           ares_llist_t       **namelist)
+static ares_status_t ares_dns_write_rr_txt(ares_buf_t            *buf,
+                                           const ares_dns_rr_t   *rr,
+                                           ares_dns_nametable_t **namelist)
 {
   (void)namelist;
   return ares_dns_write_rr_abin(buf, rr, ARES_RR_TXT_DATA);
 }
 
-static ares_status_t ares_dns_write_rr_sig(ares_buf_t          *buf,
-                                           const ares_dns_rr_t *rr,
-                                           ares_llist_t       **namelist)
+static ares_status_t ares_dns_write_rr_sig(ares_buf_t            *buf,
+                                           const ares_dns_rr_t   *rr,
+                                           ares_dns_nametable_t **namelist)
 {
   ares_status_t        status;
   const unsigned char *data;
@@ -515,9 +515,9 @@ static ares_status_t ares_dns_write_rr_sig(ares_buf_t          *buf,
   return ares_buf_append(buf, data, len);
 }
 
-static ares_status_t ares_dns_write_rr_aaaa(ares_buf_t          *buf,
-                                            const ares_dns_rr_t *rr,
-                                            ares_llist_t       **namelist)
+static ares_status_t ares_dns_write_rr_aaaa(ares_buf_t            *buf,
+                                            const ares_dns_rr_t   *rr,
+                                            ares_dns_nametable_t **namelist)
 {
   const struct ares_in6_addr *addr;
   (void)namelist;
@@ -530,9 +530,9 @@ static ares_status_t ares_dns_write_rr_aaaa(ares_buf_t          *buf,
   return ares_buf_append(buf, (const unsigned char *)addr, sizeof(*addr));
 }
 
-static ares_status_t ares_dns_write_rr_srv(ares_buf_t          *buf,
-                                           const ares_dns_rr_t *rr,
-                                           ares_llist_t       **namelist)
+static ares_status_t ares_dns_write_rr_srv(ares_buf_t            *buf,
+                                           const ares_dns_rr_t   *rr,
+                                           ares_dns_nametable_t **namelist)
 {
   ares_status_t status;
 
@@ -559,9 +559,9 @@ static ares_status_t ares_dns_write_rr_srv(ares_buf_t          *buf,
                                 ARES_RR_SRV_TARGET);
 }
 
-static ares_status_t ares_dns_write_rr_naptr(ares_buf_t          *buf,
-                                             const ares_dns_rr_t *rr,
-                                             ares_llist_t       **namelist)
+static ares_status_t ares_dns_write_rr_naptr(ares_buf_t            *buf,
+                                             const ares_dns_rr_t   *rr,
+                                             ares_dns_nametable_t **namelist)
 {
   ares_status_t status;
 
@@ -600,9 +600,9 @@ static ares_status_t ares_dns_write_rr_naptr(ares_buf_t          *buf,
                                 ARES_RR_NAPTR_REPLACEMENT);
 }
 
-static ares_status_t ares_dns_write_rr_opt(ares_buf_t          *buf,
-                                           const ares_dns_rr_t *rr,
-                                           ares_llist_t       **namelist)
+static ares_status_t ares_dns_write_rr_opt(ares_buf_t            *buf,
+                                           const ares_dns_rr_t   *rr,
+                                           ares_dns_nametable_t **namelist)
 {
   size_t         len = ares_buf_len(buf);
   ares_status_t  status;
@@ -681,9 +681,9 @@ static ares_status_t ares_dns_write_rr_opt(ares_buf_t          *buf,
   return ARES_SUCCESS;
 }
 
-static ares_status_t ares_dns_write_rr_tlsa(ares_buf_t          *buf,
-                                            const ares_dns_rr_t *rr,
-                                            ares_llist_t       **namelist)
+static ares_status_t ares_dns_write_rr_tlsa(ares_buf_t            *buf,
+                                            const ares_dns_rr_t   *rr,
+                                            ares_dns_nametable_t **namelist)
 {
   ares_status_t        status;
   const unsigned char *data;
@@ -718,9 +718,9 @@ static ares_status_t ares_dns_write_rr_tlsa(ares_buf_t          *buf,
   return ares_buf_append(buf, data, len);
 }
 
-static ares_status_t ares_dns_write_rr_svcb(ares_buf_t          *buf,
-                                            const ares_dns_rr_t *rr,
-                                            ares_llist_t       **namelist)
+static ares_status_t ares_dns_write_rr_svcb(ares_buf_t            *buf,
+                                            const ares_dns_rr_t   *rr,
+                                            ares_dns_nametable_t **namelist)
 {
   ares_status_t status;
   size_t        i;
@@ -769,9 +769,9 @@ static ares_status_t ares_dns_write_rr_svcb(ares_buf_t          *buf,
   return ARES_SUCCESS;
 }
 
-static ares_status_t ares_dns_write_rr_https(ares_buf_t          *buf,
-                                             const ares_dns_rr_t *rr,
-                                             ares_llist_t       **namelist)
+static ares_status_t ares_dns_write_rr_https(ares_buf_t            *buf,
+                                             const ares_dns_rr_t   *rr,
+                                             ares_dns_nametable_t **namelist)
 {
   ares_status_t status;
   size_t        i;
@@ -820,9 +820,9 @@ static ares_status_t ares_dns_write_rr_https(ares_buf_t          *buf,
   return ARES_SUCCESS;
 }
 
-static ares_status_t ares_dns_write_rr_uri(ares_buf_t          *buf,
-                                           const ares_dns_rr_t *rr,
-                                           ares_llist_t       **namelist)
+static ares_status_t ares_dns_write_rr_uri(ares_buf_t            *buf,
+                                           const ares_dns_rr_t   *rr,
+                                           ares_dns_nametable_t **namelist)
 {
   ares_status_t status;
   const char   *target;
@@ -852,9 +852,9 @@ static ares_status_t ares_dns_write_rr_uri(ares_buf_t          *buf,
                          ares_strlen(target));
 }
 
-static ares_status_t ares_dns_write_rr_caa(ares_buf_t          *buf,
-                                           const ares_dns_rr_t *rr,
-                                           ares_llist_t       **namelist)
+static ares_status_t ares_dns_write_rr_caa(ares_buf_t            *buf,
+                                           const ares_dns_rr_t   *rr,
+                                           ares_dns_nametable_t **namelist)
 {
   const unsigned char *data     = NULL;
   size_t               data_len = 0;
@@ -883,9 +883,9 @@ static ares_status_t ares_dns_write_rr_caa(ares_buf_t          *buf,
   return ares_buf_append(buf, data, data_len);
 }
 
-static ares_status_t ares_dns_write_rr_raw_rr(ares_buf_t          *buf,
-                                              const ares_dns_rr_t *rr,
-                                              ares_llist_t       **namelist)
+static ares_status_t ares_dns_write_rr_raw_rr(ares_buf_t            *buf,
+                                              const ares_dns_rr_t   *rr,
+                                              ares_dns_nametable_t **namelist)
 {
   size_t               len = ares_buf_len(buf);
   ares_status_t        status;
@@ -935,7 +935,7 @@ static ares_status_t ares_dns_write_rr_raw_rr(ares_buf_t          *buf,
 }
 
 static ares_status_t ares_dns_write_rr(const ares_dns_record_t *dnsrec,
-                                       ares_llist_t           **namelist,
+                                       ares_dns_nametable_t   **namelist,
                                        ares_dns_section_t       section,
                                        ares_buf_t              *buf)
 {
@@ -945,7 +945,7 @@ static ares_status_t ares_dns_write_rr(const ares_dns_record_t *dnsrec,
     const ares_dns_rr_t *rr;
     ares_dns_rec_type_t  type;
     ares_bool_t          allow_compress;
-    ares_llist_t       **namelistptr = NULL;
+    ares_dns_nametable_t **namelistptr = NULL;
     size_t               pos_len;
     ares_status_t        status;
     size_t               rdlength;
@@ -1097,7 +1097,7 @@ static ares_status_t ares_dns_write_rr(const ares_dns_record_t *dnsrec,
 ares_status_t ares_dns_write_buf(const ares_dns_record_t *dnsrec,
                                  ares_buf_t              *buf)
 {
-  ares_llist_t *namelist = NULL;
+  ares_dns_nametable_t *namelist = NULL;
   size_t        orig_len;
   ares_status_t status;
 
@@ -1133,7 +1133,7 @@ ares_status_t ares_dns_write_buf(const ares_dns_record_t *dnsrec,
   }
 
 done:
-  ares_llist_destroy(namelist);
+  ares_dns_nametable_destroy(namelist);
   if (status != ARES_SUCCESS) {
     ares_buf_set_length(buf, orig_len);
   }
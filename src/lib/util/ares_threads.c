@@ -785,7 +785,8 @@ ares_status_t ares_queue_wait_empty(ares_channel_t *channel, int timeout_ms)
   }
 
   ares_thread_mutex_lock(channel->lock);
-  while (ares_llist_len(channel->all_queries)) {
+  while (ares_llist_len(channel->all_queries) ||
+         ares_submit_pending(channel)) {
     if (timeout_ms < 0) {
       ares_thread_cond_wait(channel->cond_empty, channel->lock);
     } else {
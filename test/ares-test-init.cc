@@ -115,6 +115,13 @@ TEST_F(LibraryTest, OptionsChannelInit) {
   optmask |= ARES_OPT_RESOLVCONF;
   opts.hosts_path = strdup("/etc/hosts");
   optmask |= ARES_OPT_HOSTS_FILE;
+  opts.timeout_percentile = 99;
+  optmask |= ARES_OPT_TIMEOUT_PERCENTILE;
+  opts.server_selection = ARES_SERVER_SELECT_LATENCY;
+  optmask |= ARES_OPT_SERVER_SELECTION;
+  opts.hedge_percentile = 95;
+  opts.hedge_max_pct = 5;
+  optmask |= ARES_OPT_HEDGE;
 
   ares_channel_t *channel = nullptr;
   EXPECT_EQ(ARES_SUCCESS, ares_init_options(&channel, &opts, optmask));
@@ -146,6 +153,13 @@ TEST_F(LibraryTest, OptionsChannelInit) {
   EXPECT_EQ(std::string(opts.lookups), std::string(opts2.lookups));
   EXPECT_EQ(std::string(opts.resolvconf_path), std::string(opts2.resolvconf_path));
   EXPECT_EQ(std::string(opts.hosts_path), std::string(opts2.hosts_path));
+  EXPECT_TRUE(optmask2 & ARES_OPT_TIMEOUT_PERCENTILE);
+  EXPECT_EQ(opts.timeout_percentile, opts2.timeout_percentile);
+  EXPECT_TRUE(optmask2 & ARES_OPT_SERVER_SELECTION);
+  EXPECT_EQ(opts.server_selection, opts2.server_selection);
+  EXPECT_TRUE(optmask2 & ARES_OPT_HEDGE);
+  EXPECT_EQ(opts.hedge_percentile, opts2.hedge_percentile);
+  EXPECT_EQ(opts.hedge_max_pct, opts2.hedge_max_pct);
 
   ares_destroy_options(&opts);
   ares_destroy_options(&opts2);
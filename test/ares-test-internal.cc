@@ -288,6 +288,48 @@ TEST_F(LibraryTest, CatDomain) {
   ares_free(s);
 }
 
+TEST_F(LibraryTest, MetricsHistogram) {
+  unsigned int hist[ARES_METRICS_HIST_LEN];
+
+  memset(hist, 0, sizeof(hist));
+  EXPECT_EQ(0u, ares_metrics_hist_percentile(hist, 50));
+
+  /* Values below 8ms are exact */
+  ares_metrics_hist_add(hist, 5);
+  EXPECT_EQ(5u, ares_metrics_hist_percentile(hist, 50));
+  EXPECT_EQ(5u, ares_metrics_hist_percentile(hist, 100));
+  EXPECT_EQ(0u, ares_metrics_hist_percentile(hist, 0));
+  EXPECT_EQ(0u, ares_metrics_hist_percentile(hist, 101));
+
+  /* 100ms lands in [96,103], 1000ms lands in [960,1023] */
+  memset(hist, 0, sizeof(hist));
+  for (unsigned int i = 0; i < 90; i++) {
+    ares_metrics_hist_add(hist, 100);
+  }
+  for (unsigned int i = 0; i < 10; i++) {
+    ares_metrics_hist_add(hist, 1000);
+  }
+  EXPECT_EQ(103u, ares_metrics_hist_percentile(hist, 50));
+  EXPECT_EQ(103u, ares_metrics_hist_percentile(hist, 90));
+  EXPECT_EQ(1023u, ares_metrics_hist_percentile(hist, 91));
+  EXPECT_EQ(1023u, ares_metrics_hist_percentile(hist, 99));
+
+  /* Reported values are never below the sample and within 12.5% of it */
+  for (unsigned int ms = 1; ms < 30000; ms += 7) {
+    unsigned int val;
+    memset(hist, 0, sizeof(hist));
+    ares_metrics_hist_add(hist, ms);
+    val = ares_metrics_hist_percentile(hist, 50);
+    EXPECT_LE(ms, val);
+    EXPECT_LE(val - ms, ms / 8);
+  }
+
+  /* Huge values saturate into the last slot */
+  memset(hist, 0, sizeof(hist));
+  ares_metrics_hist_add(hist, 0xFFFFFFFF);
+  EXPECT_EQ(32767u, ares_metrics_hist_percentile(hist, 50));
+}
+
 TEST_F(LibraryTest, SlistMisuse) {
   EXPECT_EQ(NULL, ares_slist_create(NULL, NULL, NULL));
   ares_slist_replace_destructor(NULL, NULL);
@@ -305,6 +347,354 @@ TEST_F(LibraryTest, SlistMisuse) {
   EXPECT_EQ(NULL, ares_slist_node_claim(NULL));
 }
 
+static void TimingWheelAdd(ares_timeval_t *tv, ares_uint64_t ms) {
+  ares_uint64_t usec = (ares_uint64_t)tv->usec + (ms % 1000) * 1000;
+  tv->sec  += (ares_int64_t)(ms / 1000) + (ares_int64_t)(usec / 1000000);
+  tv->usec  = (unsigned int)(usec % 1000000);
+}
+
+static bool TimingWheelBefore(const ares_timeval_t *a, const ares_timeval_t *b) {
+  return a->sec < b->sec || (a->sec == b->sec && a->usec < b->usec);
+}
+
+TEST_F(LibraryTest, TimingWheel) {
+  EXPECT_EQ(NULL, ares_twheel_create(NULL));
+  EXPECT_EQ((size_t)0, ares_twheel_len(NULL));
+  EXPECT_EQ(NULL, ares_twheel_expire(NULL, NULL));
+  EXPECT_FALSE(ares_twheel_timer_armed(NULL));
+
+  ares_timeval_t start = { 1000, 250000 };
+  ares_timeval_t now   = start;
+  ares_timeval_t next;
+  ares_twheel_t *wheel = ares_twheel_create(&now);
+  EXPECT_NE(nullptr, wheel);
+  EXPECT_FALSE(ares_twheel_next(wheel, &next));
+
+  // Spread across every level, including beyond the top level
+  const ares_uint64_t offsets[] = { 0, 1, 2, 63, 64, 65, 100, 4095, 4096, 5000,
+                                    262143, 262144, 300000, 16777215,
+                                    16777216, 20000000, 36000000 };
+  const size_t  ntimers = sizeof(offsets) / sizeof(*offsets);
+  struct {
+    ares_twheel_timer_t timer;
+    ares_timeval_t      expire;
+    bool                fired;
+  } timers[sizeof(offsets) / sizeof(*offsets)];
+
+  for (size_t i = 0; i < ntimers; i++) {
+    timers[i].expire = start;
+    /* Sub-millisecond expirations are rounded up */
+    TimingWheelAdd(&timers[i].expire, offsets[i]);
+    timers[i].expire.usec += (i % 2) ? 500 : 0;
+    timers[i].fired = false;
+    ares_twheel_timer_init(&timers[i].timer, &timers[i]);
+    ares_twheel_arm(wheel, &timers[i].timer, &timers[i].expire);
+    EXPECT_TRUE(ares_twheel_timer_armed(&timers[i].timer));
+  }
+  EXPECT_EQ(ntimers, ares_twheel_len(wheel));
+
+  // Cancel one and re-arm another somewhere else
+  ares_twheel_cancel(wheel, &timers[5].timer);
+  EXPECT_FALSE(ares_twheel_timer_armed(&timers[5].timer));
+  timers[5].fired = true;
+  timers[6].expire = start;
+  TimingWheelAdd(&timers[6].expire, 7);
+  ares_twheel_arm(wheel, &timers[6].timer, &timers[6].expire);
+  EXPECT_EQ(ntimers - 1, ares_twheel_len(wheel));
+
+  // Step through time in uneven increments, nothing may fire early and
+  // the next expiration may never be later than an armed timer
+  const ares_uint64_t steps[] = { 0, 1, 3, 50, 977, 12345, 1000000 };
+  size_t              step    = 0;
+  while (ares_twheel_len(wheel) > 0) {
+    ASSERT_TRUE(ares_twheel_next(wheel, &next));
+    for (size_t i = 0; i < ntimers; i++) {
+      if (!timers[i].fired) {
+        // Millisecond resolution
+        ares_timeval_t bound = timers[i].expire;
+        TimingWheelAdd(&bound, 1);
+        EXPECT_FALSE(TimingWheelBefore(&bound, &next)) << i;
+      }
+    }
+
+    void *data;
+    while ((data = ares_twheel_expire(wheel, &now)) != NULL) {
+      auto *t = (decltype(&timers[0]))data;
+      EXPECT_FALSE(t->fired);
+      EXPECT_FALSE(TimingWheelBefore(&now, &t->expire));
+      EXPECT_FALSE(ares_twheel_timer_armed(&t->timer));
+      t->fired = true;
+    }
+
+    // Anything that expired before the previous step must have fired
+    for (size_t i = 0; i < ntimers; i++) {
+      EXPECT_TRUE(timers[i].fired || TimingWheelBefore(&now, &timers[i].expire))
+        << i;
+    }
+
+    TimingWheelAdd(&now, steps[step]);
+    if (step < sizeof(steps) / sizeof(*steps) - 1) {
+      step++;
+    }
+  }
+
+  for (size_t i = 0; i < ntimers; i++) {
+    EXPECT_TRUE(timers[i].fired) << i;
+  }
+  EXPECT_FALSE(ares_twheel_next(wheel, &next));
+
+  ares_twheel_destroy(wheel);
+}
+
+TEST_F(LibraryTest, Pool) {
+  ares_pool_stats_t stats;
+
+  EXPECT_EQ(NULL, ares_pool_create(1, 10));
+  EXPECT_EQ(NULL, ares_pool_get(NULL));
+  EXPECT_EQ((size_t)0, ares_pool_obj_size(NULL));
+  ares_pool_put(NULL, NULL);
+  ares_pool_stats(NULL, &stats);
+  EXPECT_EQ((size_t)0, stats.allocs);
+
+  ares_pool_t *pool = ares_pool_create(64, 2);
+  EXPECT_NE(nullptr, pool);
+  EXPECT_EQ((size_t)64, ares_pool_obj_size(pool));
+
+  unsigned char *objs[3];
+  for (size_t i = 0; i < 3; i++) {
+    objs[i] = (unsigned char *)ares_pool_get(pool);
+    EXPECT_NE(nullptr, objs[i]);
+    memset(objs[i], 0xA5, 64);
+  }
+  for (size_t i = 0; i < 3; i++) {
+    ares_pool_put(pool, objs[i]);
+  }
+  ares_pool_stats(pool, &stats);
+  EXPECT_EQ((size_t)3, stats.allocs);
+  EXPECT_EQ((size_t)0, stats.reuses);
+  EXPECT_EQ((size_t)2, stats.cached);
+
+  // Reused objects come back zeroed
+  for (size_t i = 0; i < 2; i++) {
+    objs[i] = (unsigned char *)ares_pool_get(pool);
+    for (size_t j = 0; j < 64; j++) {
+      EXPECT_EQ(0, objs[i][j]);
+    }
+  }
+  ares_pool_stats(pool, &stats);
+  EXPECT_EQ((size_t)3, stats.allocs);
+  EXPECT_EQ((size_t)2, stats.reuses);
+  EXPECT_EQ((size_t)0, stats.cached);
+
+  // Objects may be released directly as well
+  ares_free(objs[0]);
+  ares_pool_put(pool, objs[1]);
+  ares_pool_destroy(pool);
+
+  // Linked lists sharing a node pool, nodes moving between lists
+  ares_pool_t  *npool = ares_llist_node_pool_create(100);
+  ares_llist_t *list1 = ares_llist_create(NULL);
+  ares_llist_t *list2 = ares_llist_create(NULL);
+  EXPECT_FALSE(ares_llist_set_node_pool(NULL, npool));
+  pool = ares_pool_create(ares_pool_obj_size(npool) + 1, 1);
+  EXPECT_FALSE(ares_llist_set_node_pool(list1, pool));
+  ares_pool_destroy(pool);
+  EXPECT_TRUE(ares_llist_set_node_pool(list1, npool));
+  EXPECT_TRUE(ares_llist_set_node_pool(list2, npool));
+
+  int vals[50];
+  for (size_t round = 0; round < 10; round++) {
+    for (size_t i = 0; i < 50; i++) {
+      ares_llist_node_t *node = ares_llist_insert_last(list1, &vals[i]);
+      EXPECT_NE(nullptr, node);
+      if (i % 2) {
+        ares_llist_node_mvparent_last(node, list2);
+      }
+    }
+    EXPECT_EQ((size_t)25, ares_llist_len(list1));
+    EXPECT_EQ((size_t)25, ares_llist_len(list2));
+    ares_llist_clear(list1);
+    ares_llist_clear(list2);
+  }
+  ares_pool_stats(npool, &stats);
+  EXPECT_EQ((size_t)50, stats.allocs);
+  EXPECT_EQ((size_t)450, stats.reuses);
+  EXPECT_EQ((size_t)50, stats.cached);
+  ares_llist_destroy(list1);
+  ares_llist_destroy(list2);
+  ares_pool_destroy(npool);
+
+  // Hashtable with pooled entries, including across rehashes
+  ares_htable_szvp_t *ht = ares_htable_szvp_create(NULL);
+  EXPECT_TRUE(ares_htable_szvp_insert(ht, 1, &vals[0]));
+  EXPECT_FALSE(ares_htable_szvp_enable_pool(ht, 10));
+  EXPECT_TRUE(ares_htable_szvp_remove(ht, 1));
+  EXPECT_TRUE(ares_htable_szvp_enable_pool(ht, 10));
+  EXPECT_FALSE(ares_htable_szvp_enable_pool(ht, 10));
+  for (size_t round = 0; round < 3; round++) {
+    for (size_t i = 0; i < 50; i++) {
+      EXPECT_TRUE(ares_htable_szvp_insert(ht, i * 16, &vals[i]));
+    }
+    for (size_t i = 0; i < 50; i++) {
+      EXPECT_EQ(&vals[i], ares_htable_szvp_get_direct(ht, i * 16));
+      EXPECT_TRUE(ares_htable_szvp_remove(ht, i * 16));
+    }
+    EXPECT_EQ((size_t)0, ares_htable_szvp_num_keys(ht));
+  }
+  ares_htable_szvp_destroy(ht);
+}
+
+TEST_F(LibraryTest, Arena) {
+  // A NULL arena falls back to the heap
+  char *heap = ares_arena_strdup(NULL, "heap");
+  EXPECT_STREQ("heap", heap);
+  EXPECT_FALSE(ares_arena_owns(NULL, heap));
+  EXPECT_EQ(heap, ares_arena_adopt(NULL, heap, 4));
+  ares_arena_free(NULL, heap);
+
+  ares_arena_t *arena = ares_arena_create(64);
+  EXPECT_NE(nullptr, arena);
+
+  // Allocations are aligned, zeroed on request, and spill into new chunks
+  unsigned char *ptrs[100];
+  for (size_t i = 0; i < 100; i++) {
+    ptrs[i] = (unsigned char *)ares_arena_malloc_zero(arena, i + 1);
+    EXPECT_NE(nullptr, ptrs[i]);
+    EXPECT_EQ((size_t)0, ((size_t)ptrs[i]) % sizeof(void *));
+    EXPECT_TRUE(ares_arena_owns(arena, ptrs[i]));
+    for (size_t j = 0; j <= i; j++) {
+      EXPECT_EQ(0, ptrs[i][j]);
+    }
+    memset(ptrs[i], (int)i, i + 1);
+  }
+  for (size_t i = 0; i < 100; i++) {
+    EXPECT_EQ((unsigned char)i, ptrs[i][i]);
+  }
+
+  // Oversized allocation
+  unsigned char *big = (unsigned char *)ares_arena_malloc(arena, 200000);
+  EXPECT_NE(nullptr, big);
+  memset(big, 0xA5, 200000);
+  EXPECT_TRUE(ares_arena_owns(arena, big));
+
+  // Growing keeps the contents and zeroes the rest
+  unsigned char *grow = (unsigned char *)ares_arena_memdup(arena, "abc", 3);
+  EXPECT_NE(nullptr, grow);
+  unsigned char *grown =
+    (unsigned char *)ares_arena_realloc_zero(arena, grow, 4, 64);
+  EXPECT_EQ(0, memcmp(grown, "abc", 4));
+  for (size_t i = 4; i < 64; i++) {
+    EXPECT_EQ(0, grown[i]);
+  }
+  grown = (unsigned char *)ares_arena_realloc_zero(arena, grown, 64, 5000);
+  EXPECT_EQ(0, memcmp(grown, "abc", 4));
+  ares_arena_free(arena, grown);
+
+  // Heap memory is copied in and the original released
+  char *adopted = (char *)ares_arena_adopt(arena, ares_strdup("adopt"), 5);
+  EXPECT_STREQ("adopt", adopted);
+  EXPECT_TRUE(ares_arena_owns(arena, adopted));
+  EXPECT_EQ(adopted, ares_arena_adopt(arena, adopted, 5));
+  heap = ares_strdup("foreign");
+  EXPECT_FALSE(ares_arena_owns(arena, heap));
+  ares_arena_free(arena, heap);
+  ares_arena_destroy(arena);
+
+  // Parse into an arena, then modify, write and duplicate the record
+  ares_dns_record_t *dnsrec = NULL;
+  ares_dns_rr_t     *rr     = NULL;
+  EXPECT_EQ(ARES_SUCCESS,
+            ares_dns_record_create(&dnsrec, 0x1234,
+                                   ARES_FLAG_QR | ARES_FLAG_RD | ARES_FLAG_RA,
+                                   ARES_OPCODE_QUERY, ARES_RCODE_NOERROR));
+  EXPECT_EQ(ARES_SUCCESS, ares_dns_record_query_add(dnsrec, "example.com",
+                                                    ARES_REC_TYPE_ANY,
+                                                    ARES_CLASS_IN));
+  EXPECT_EQ(ARES_SUCCESS,
+            ares_dns_record_rr_add(&rr, dnsrec, ARES_SECTION_ANSWER,
+                                   "example.com", ARES_REC_TYPE_MX,
+                                   ARES_CLASS_IN, 300));
+  EXPECT_EQ(ARES_SUCCESS, ares_dns_rr_set_u16(rr, ARES_RR_MX_PREFERENCE, 10));
+  EXPECT_EQ(ARES_SUCCESS,
+            ares_dns_rr_set_str(rr, ARES_RR_MX_EXCHANGE, "mx.example.com"));
+  EXPECT_EQ(ARES_SUCCESS,
+            ares_dns_record_rr_add(&rr, dnsrec, ARES_SECTION_ANSWER,
+                                   "example.com", ARES_REC_TYPE_TXT,
+                                   ARES_CLASS_IN, 300));
+  EXPECT_EQ(ARES_SUCCESS, ares_dns_rr_add_abin(rr, ARES_RR_TXT_DATA,
+                                               (const unsigned char *)"one",
+                                               3));
+  EXPECT_EQ(ARES_SUCCESS, ares_dns_rr_add_abin(rr, ARES_RR_TXT_DATA,
+                                               (const unsigned char *)"two",
+                                               3));
+  EXPECT_EQ(ARES_SUCCESS,
+            ares_dns_record_rr_add(&rr, dnsrec, ARES_SECTION_ADDITIONAL, "",
+                                   ARES_REC_TYPE_OPT, ARES_CLASS_IN, 0));
+  EXPECT_EQ(ARES_SUCCESS,
+            ares_dns_rr_set_u16(rr, ARES_RR_OPT_UDP_SIZE, 1232));
+  EXPECT_EQ(ARES_SUCCESS,
+            ares_dns_rr_set_opt(rr, ARES_RR_OPT_OPTIONS, 10,
+                                (const unsigned char *)"cookie12", 8));
+
+  unsigned char *msg     = NULL;
+  size_t         msg_len = 0;
+  EXPECT_EQ(ARES_SUCCESS, ares_dns_write(dnsrec, &msg, &msg_len));
+  ares_dns_record_destroy(dnsrec);
+  dnsrec = NULL;
+
+  EXPECT_EQ(ARES_SUCCESS,
+            ares_dns_parse(msg, msg_len, ARES_DNS_PARSE_ARENA, &dnsrec));
+  EXPECT_NE(nullptr, dnsrec->arena);
+  EXPECT_EQ(nullptr, dnsrec->namebuf);
+  const char *name = NULL;
+  EXPECT_EQ(ARES_SUCCESS,
+            ares_dns_record_query_get(dnsrec, 0, &name, NULL, NULL));
+  EXPECT_STREQ("example.com", name);
+  rr = ares_dns_record_rr_get(dnsrec, ARES_SECTION_ANSWER, 0);
+  EXPECT_STREQ("example.com", ares_dns_rr_get_name(rr));
+  EXPECT_STREQ("mx.example.com",
+               ares_dns_rr_get_str(rr, ARES_RR_MX_EXCHANGE));
+  EXPECT_EQ(ARES_SUCCESS,
+            ares_dns_rr_set_str(rr, ARES_RR_MX_EXCHANGE, "mx2.example.com"));
+  char *own = ares_strdup("mx3.example.com");
+  EXPECT_EQ(ARES_SUCCESS, ares_dns_rr_set_str_own(rr, ARES_RR_MX_EXCHANGE, own));
+  EXPECT_STREQ("mx3.example.com",
+               ares_dns_rr_get_str(rr, ARES_RR_MX_EXCHANGE));
+  EXPECT_EQ(ARES_SUCCESS, ares_dns_record_query_set_name(dnsrec, 0,
+                                                         "example.net"));
+  rr = ares_dns_record_rr_get(dnsrec, ARES_SECTION_ANSWER, 1);
+  EXPECT_EQ((size_t)2, ares_dns_rr_get_abin_cnt(rr, ARES_RR_TXT_DATA));
+  EXPECT_EQ(ARES_SUCCESS, ares_dns_rr_add_abin(rr, ARES_RR_TXT_DATA,
+                                               (const unsigned char *)"three",
+                                               5));
+  size_t               len = 0;
+  const unsigned char *bin =
+    ares_dns_rr_get_abin(rr, ARES_RR_TXT_DATA, 2, &len);
+  EXPECT_EQ((size_t)5, len);
+  EXPECT_EQ(0, memcmp(bin, "three", 5));
+  rr = ares_dns_record_rr_get(dnsrec, ARES_SECTION_ADDITIONAL, 0);
+  EXPECT_EQ(ARES_SUCCESS,
+            ares_dns_rr_set_opt(rr, ARES_RR_OPT_OPTIONS, 10,
+                                (const unsigned char *)"cookie34", 8));
+  EXPECT_EQ((size_t)1, ares_dns_rr_get_opt_cnt(rr, ARES_RR_OPT_OPTIONS));
+  EXPECT_EQ(ARES_SUCCESS,
+            ares_dns_rr_del_opt_byid(rr, ARES_RR_OPT_OPTIONS, 10));
+  EXPECT_EQ(ARES_SUCCESS,
+            ares_dns_record_rr_del(dnsrec, ARES_SECTION_ADDITIONAL, 0));
+
+  ares_dns_record_t *dup = ares_dns_record_duplicate(dnsrec);
+  EXPECT_NE(nullptr, dup);
+  ares_dns_record_destroy(dnsrec);
+  rr = ares_dns_record_rr_get(dup, ARES_SECTION_ANSWER, 0);
+  EXPECT_STREQ("mx3.example.com",
+               ares_dns_rr_get_str(rr, ARES_RR_MX_EXCHANGE));
+  rr = ares_dns_record_rr_get(dup, ARES_SECTION_ANSWER, 1);
+  EXPECT_EQ((size_t)3, ares_dns_rr_get_abin_cnt(rr, ARES_RR_TXT_DATA));
+  EXPECT_EQ((size_t)0, ares_dns_record_rr_cnt(dup, ARES_SECTION_ADDITIONAL));
+  ares_dns_record_destroy(dup);
+  ares_free(msg);
+}
+
 #if !defined(_WIN32) || _WIN32_WINNT >= 0x0600
 TEST_F(LibraryTest, IfaceIPs) {
   ares_status_t      status;
@@ -600,6 +990,41 @@ TEST_F(FileChannelTest, GetAddrInfoHostsIPV6) {
   EXPECT_EQ("{ipv6.com addr=[[0000:0000:0000:0000:0000:0000:0000:0001]]}", ss.str());
 }
 
+TEST_F(FileChannelTest, GetAddrInfoHostsMerged) {
+  TempFile hostsfile("127.0.0.1    localhost.localdomain localhost\n"
+                     "::1          localhost.localdomain localhost\n"
+                     "192.168.1.1  host.example.com host host\n"
+                     "192.168.1.5  HOST.example.com host\n"
+                     "2620:1234::1 host.example.com host6.example.com host6 host\n"
+                     "192.168.1.1  alias.example.com\n");
+  EnvValue with_env("CARES_HOSTS", hostsfile.filename());
+  struct ares_addrinfo_hints hints = {0, 0, 0, 0};
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_flags = ARES_AI_CANONNAME | ARES_AI_ENVHOSTS | ARES_AI_NOSORT;
+
+  AddrInfoResult result = {};
+  ares_getaddrinfo(channel_, "Host6", NULL, &hints, AddrInfoCallback, &result);
+  Process();
+  EXPECT_TRUE(result.done_);
+  std::stringstream ss;
+  ss << result.ai_;
+  EXPECT_EQ("{host->host.example.com, host6.example.com->host.example.com, "
+            "host6->host.example.com, alias.example.com->host.example.com "
+            "addr=[192.168.1.1], addr=[192.168.1.5], "
+            "addr=[[2620:1234:0000:0000:0000:0000:0000:0001]]}", ss.str());
+
+  AddrInfoResult result2 = {};
+  hints.ai_family = AF_INET6;
+  ares_getaddrinfo(channel_, "localhost", NULL, &hints, AddrInfoCallback,
+                   &result2);
+  Process();
+  EXPECT_TRUE(result2.done_);
+  std::stringstream ss2;
+  ss2 << result2.ai_;
+  EXPECT_EQ("{localhost->localhost.localdomain "
+            "addr=[[0000:0000:0000:0000:0000:0000:0000:0001]]}", ss2.str());
+}
+
 TEST_F(FileChannelTest, GetAddrInfoInvalidService) {
   TempFile hostsfile("1.2.3.4 example.com");
   EnvValue with_env("CARES_HOSTS", hostsfile.filename());
@@ -924,6 +1349,17 @@ TEST_F(LibraryTest, DNSRecord) {
   //printf("HEXDUMP\n%s", hexdata);
   ares_free(hexdata);
 
+  /* A duplicate is copied field by field but must write the same message */
+  ares_dns_record_t *dup = ares_dns_record_duplicate(dnsrec);
+  EXPECT_NE(nullptr, dup);
+  unsigned char *dupmsg    = NULL;
+  size_t         dupmsglen = 0;
+  EXPECT_EQ(ARES_SUCCESS, ares_dns_write(dup, &dupmsg, &dupmsglen));
+  EXPECT_EQ(msglen, dupmsglen);
+  EXPECT_EQ(0, memcmp(msg, dupmsg, msglen));
+  ares_free_string(dupmsg);
+  ares_dns_record_destroy(dup);
+
   ares_dns_record_destroy(dnsrec); dnsrec = NULL;
 
   /* Parse */
@@ -1813,6 +2249,465 @@ TEST_F(DefaultChannelTest, SaveInvalidChannel) {
   channel_->servers = saved;
 }
 
+#ifndef CARES_SYMBOL_HIDING
+TEST_F(DefaultChannelTest, QueryCacheWireTTL) {
+  ares_dns_record_t       *req    = NULL;
+  ares_dns_record_t       *resp   = NULL;
+  ares_dns_rr_t           *rr     = NULL;
+  const ares_dns_record_t *cached = NULL;
+  unsigned char           *abuf   = NULL;
+  size_t                   alen   = 0;
+  ares_query_t             query;
+  ares_timeval_t           now;
+  ares_timeval_t           later;
+  struct in_addr           addr;
+
+  ASSERT_NE(nullptr, channel_->qcache);
+
+  addr.s_addr = htonl(0x01020304);
+  EXPECT_EQ(ARES_SUCCESS, ares_dns_record_create(&req, 0, ARES_FLAG_RD,
+    ARES_OPCODE_QUERY, ARES_RCODE_NOERROR));
+  EXPECT_EQ(ARES_SUCCESS, ares_dns_record_query_add(req, "www.example.com",
+    ARES_REC_TYPE_A, ARES_CLASS_IN));
+  EXPECT_EQ(ARES_SUCCESS, ares_dns_record_create(&resp, 0,
+    ARES_FLAG_QR | ARES_FLAG_RD, ARES_OPCODE_QUERY, ARES_RCODE_NOERROR));
+  EXPECT_EQ(ARES_SUCCESS, ares_dns_record_query_add(resp, "www.example.com",
+    ARES_REC_TYPE_A, ARES_CLASS_IN));
+  EXPECT_EQ(ARES_SUCCESS, ares_dns_record_rr_add(&rr, resp,
+    ARES_SECTION_ANSWER, "www.example.com", ARES_REC_TYPE_A, ARES_CLASS_IN,
+    100));
+  EXPECT_EQ(ARES_SUCCESS, ares_dns_rr_set_addr(rr, ARES_RR_A_ADDR, &addr));
+  EXPECT_EQ(ARES_SUCCESS, ares_dns_record_rr_add(&rr, resp,
+    ARES_SECTION_ADDITIONAL, "", ARES_REC_TYPE_OPT, ARES_CLASS_IN, 0));
+  EXPECT_EQ(ARES_SUCCESS, ares_dns_rr_set_u16(rr, ARES_RR_OPT_UDP_SIZE, 1232));
+  EXPECT_EQ(ARES_SUCCESS, ares_dns_write(resp, &abuf, &alen));
+
+  memset(&query, 0, sizeof(query));
+  query.query = req;
+  ares_tvnow(&now);
+  EXPECT_EQ(ARES_SUCCESS, ares_qcache_insert(channel_, &now, &query, resp,
+                                             abuf, alen));
+
+  /* First fetch materializes the response with TTLs reflecting the time
+   * spent in the cache */
+  later      = now;
+  later.sec += 10;
+  EXPECT_EQ(ARES_SUCCESS, ares_qcache_fetch(channel_, &later, req, &cached));
+  ASSERT_NE(nullptr, cached);
+  EXPECT_EQ(1, ares_dns_record_rr_cnt(cached, ARES_SECTION_ANSWER));
+  EXPECT_EQ(90, ares_dns_rr_get_ttl(
+    ares_dns_record_rr_get_const(cached, ARES_SECTION_ANSWER, 0)));
+  EXPECT_NE(nullptr, ares_dns_get_opt_rr_const(cached));
+  EXPECT_EQ(1232, ares_dns_rr_get_u16(ares_dns_get_opt_rr_const(cached),
+                                      ARES_RR_OPT_UDP_SIZE));
+
+  /* Expired */
+  later.sec = now.sec + 100;
+  EXPECT_EQ(ARES_ENOTFOUND, ares_qcache_fetch(channel_, &later, req, &cached));
+
+  ares_free(abuf);
+  ares_dns_record_destroy(resp);
+  ares_dns_record_destroy(req);
+}
+
+static void QueryCacheInsertName(ares_channel_t *channel,
+                                 const ares_timeval_t *now, const char *name,
+                                 ares_dns_record_t **req_out) {
+  ares_dns_record_t *resp = NULL;
+  ares_dns_rr_t     *rr   = NULL;
+  unsigned char     *abuf = NULL;
+  size_t             alen = 0;
+  ares_query_t       query;
+  struct in_addr     addr;
+
+  addr.s_addr = htonl(0x01020304);
+  EXPECT_EQ(ARES_SUCCESS, ares_dns_record_create(req_out, 0, ARES_FLAG_RD,
+    ARES_OPCODE_QUERY, ARES_RCODE_NOERROR));
+  EXPECT_EQ(ARES_SUCCESS, ares_dns_record_query_add(*req_out, name,
+    ARES_REC_TYPE_A, ARES_CLASS_IN));
+  EXPECT_EQ(ARES_SUCCESS, ares_dns_record_create(&resp, 0,
+    ARES_FLAG_QR | ARES_FLAG_RD, ARES_OPCODE_QUERY, ARES_RCODE_NOERROR));
+  EXPECT_EQ(ARES_SUCCESS, ares_dns_record_query_add(resp, name,
+    ARES_REC_TYPE_A, ARES_CLASS_IN));
+  EXPECT_EQ(ARES_SUCCESS, ares_dns_record_rr_add(&rr, resp,
+    ARES_SECTION_ANSWER, name, ARES_REC_TYPE_A, ARES_CLASS_IN, 100));
+  EXPECT_EQ(ARES_SUCCESS, ares_dns_rr_set_addr(rr, ARES_RR_A_ADDR, &addr));
+  EXPECT_EQ(ARES_SUCCESS, ares_dns_write(resp, &abuf, &alen));
+
+  memset(&query, 0, sizeof(query));
+  query.query = *req_out;
+  EXPECT_EQ(ARES_SUCCESS, ares_qcache_insert(channel, now, &query, resp,
+                                             abuf, alen));
+  ares_free(abuf);
+  ares_dns_record_destroy(resp);
+}
+
+TEST_F(DefaultChannelTest, QueryCacheEviction) {
+  ares_dns_record_t       *req1   = NULL;
+  ares_dns_record_t       *req2   = NULL;
+  ares_dns_record_t       *req3   = NULL;
+  const ares_dns_record_t *cached = NULL;
+  ares_timeval_t           now;
+
+  /* Replace the default cache with one bounded to 2 entries */
+  ares_qcache_destroy(channel_->qcache);
+  channel_->qcache = NULL;
+  ASSERT_EQ(ARES_SUCCESS, ares_qcache_create(channel_->rand_state, 3600, 2, 0, 0,
+                                             0, 1, &channel_->qcache));
+
+  ares_tvnow(&now);
+  QueryCacheInsertName(channel_, &now, "one.example.com", &req1);
+  QueryCacheInsertName(channel_, &now, "two.example.com", &req2);
+  EXPECT_EQ(2, ares_qcache_stat(channel_, ARES_QCACHE_STAT_ENTRIES));
+  EXPECT_LT(0, ares_qcache_stat(channel_, ARES_QCACHE_STAT_BYTES));
+  size_t entry_bytes = ares_qcache_stat(channel_, ARES_QCACHE_STAT_BYTES) / 2;
+
+  /* Reference the first entry so it gets a second chance */
+  EXPECT_EQ(ARES_SUCCESS, ares_qcache_fetch(channel_, &now, req1, &cached));
+
+  QueryCacheInsertName(channel_, &now, "three.example.com", &req3);
+  EXPECT_EQ(2, ares_qcache_stat(channel_, ARES_QCACHE_STAT_ENTRIES));
+  EXPECT_EQ(1, ares_qcache_stat(channel_, ARES_QCACHE_STAT_EVICTIONS));
+
+  EXPECT_EQ(ARES_SUCCESS, ares_qcache_fetch(channel_, &now, req1, &cached));
+  EXPECT_EQ(ARES_ENOTFOUND, ares_qcache_fetch(channel_, &now, req2, &cached));
+  EXPECT_EQ(ARES_SUCCESS, ares_qcache_fetch(channel_, &now, req3, &cached));
+
+  EXPECT_EQ(3, ares_qcache_stat(channel_, ARES_QCACHE_STAT_HITS));
+  EXPECT_EQ(1, ares_qcache_stat(channel_, ARES_QCACHE_STAT_MISSES));
+
+  ares_dns_record_destroy(req1);
+  ares_dns_record_destroy(req2);
+  ares_dns_record_destroy(req3);
+
+  /* Byte budget that only fits a single entry */
+  ares_qcache_destroy(channel_->qcache);
+  channel_->qcache = NULL;
+  ASSERT_EQ(ARES_SUCCESS, ares_qcache_create(channel_->rand_state, 3600, 0,
+                                             entry_bytes + (entry_bytes / 2), 0,
+                                             0, 1,
+                                             &channel_->qcache));
+  QueryCacheInsertName(channel_, &now, "one.example.com", &req1);
+  QueryCacheInsertName(channel_, &now, "two.example.com", &req2);
+  EXPECT_EQ(1, ares_qcache_stat(channel_, ARES_QCACHE_STAT_ENTRIES));
+  EXPECT_EQ(1, ares_qcache_stat(channel_, ARES_QCACHE_STAT_EVICTIONS));
+  EXPECT_EQ(ARES_ENOTFOUND, ares_qcache_fetch(channel_, &now, req1, &cached));
+  EXPECT_EQ(ARES_SUCCESS, ares_qcache_fetch(channel_, &now, req2, &cached));
+
+  ares_dns_record_destroy(req1);
+  ares_dns_record_destroy(req2);
+}
+
+TEST_F(DefaultChannelTest, QueryCacheViewBytes) {
+  ares_dns_record_t       *req1   = NULL;
+  ares_dns_record_t       *req2   = NULL;
+  const ares_dns_record_t *cached = NULL;
+  ares_timeval_t           now;
+
+  /* Fetching materializes a view of the response, which is charged to the
+   * cache once */
+  ares_tvnow(&now);
+  QueryCacheInsertName(channel_, &now, "one.example.com", &req1);
+  size_t entry_bytes = ares_qcache_stat(channel_, ARES_QCACHE_STAT_BYTES);
+  EXPECT_EQ(ARES_SUCCESS, ares_qcache_fetch(channel_, &now, req1, &cached));
+  size_t view_bytes =
+    ares_qcache_stat(channel_, ARES_QCACHE_STAT_BYTES) - entry_bytes;
+  EXPECT_LT(0u, view_bytes);
+  EXPECT_EQ(ARES_SUCCESS, ares_qcache_fetch(channel_, &now, req1, &cached));
+  EXPECT_EQ(entry_bytes + view_bytes,
+            ares_qcache_stat(channel_, ARES_QCACHE_STAT_BYTES));
+  ares_dns_record_destroy(req1);
+
+  /* Room for two entries but only one view */
+  size_t max_bytes = (2 * entry_bytes) + view_bytes;
+  ares_qcache_destroy(channel_->qcache);
+  channel_->qcache = NULL;
+  ASSERT_EQ(ARES_SUCCESS, ares_qcache_create(channel_->rand_state, 3600, 0,
+                                             max_bytes, 0, 0, 1,
+                                             &channel_->qcache));
+  QueryCacheInsertName(channel_, &now, "one.example.com", &req1);
+  QueryCacheInsertName(channel_, &now, "two.example.com", &req2);
+  EXPECT_EQ(ARES_SUCCESS, ares_qcache_fetch(channel_, &now, req1, &cached));
+  EXPECT_EQ(2, ares_qcache_stat(channel_, ARES_QCACHE_STAT_ENTRIES));
+  EXPECT_GE(max_bytes, ares_qcache_stat(channel_, ARES_QCACHE_STAT_BYTES));
+
+  /* The second view doesn't fit, the entry being fetched must stay */
+  EXPECT_EQ(ARES_SUCCESS, ares_qcache_fetch(channel_, &now, req2, &cached));
+  EXPECT_NE(nullptr, cached);
+  EXPECT_EQ(1, ares_qcache_stat(channel_, ARES_QCACHE_STAT_ENTRIES));
+  EXPECT_EQ(1, ares_qcache_stat(channel_, ARES_QCACHE_STAT_EVICTIONS));
+  EXPECT_GE(max_bytes, ares_qcache_stat(channel_, ARES_QCACHE_STAT_BYTES));
+  EXPECT_EQ(ARES_SUCCESS, ares_qcache_fetch(channel_, &now, req2, &cached));
+  EXPECT_EQ(ARES_ENOTFOUND, ares_qcache_fetch(channel_, &now, req1, &cached));
+
+  ares_dns_record_destroy(req1);
+  ares_dns_record_destroy(req2);
+}
+
+TEST_F(DefaultChannelTest, CoalesceSendFlags) {
+  ares_dns_record_t *req    = NULL;
+  unsigned short     qid[4] = {0, 0, 0, 0};
+  QueryResult        result[4];
+
+  /* Queries are sent to a server that is never processed, so never answers */
+  MockServer  server(AF_INET, 0);
+  std::string csv = "127.0.0.1:" + std::to_string(server.udpport());
+  EXPECT_EQ(ARES_SUCCESS, ares_set_servers_csv(channel_, csv.c_str()));
+  channel_->flags |= ARES_FLAG_COALESCE;
+
+  EXPECT_EQ(ARES_SUCCESS, ares_dns_record_create(&req, 0, ARES_FLAG_RD,
+    ARES_OPCODE_QUERY, ARES_RCODE_NOERROR));
+  EXPECT_EQ(ARES_SUCCESS, ares_dns_record_query_add(req, "www.example.com",
+    ARES_REC_TYPE_A, ARES_CLASS_IN));
+
+  /* Only queries sent with the same flags share a single query */
+  EXPECT_EQ(ARES_SUCCESS, ares_send_nolock(channel_, NULL,
+    (ares_send_flags_t)0, req, QueryCallback, &result[0], &qid[0]));
+  EXPECT_EQ(ARES_SUCCESS, ares_send_nolock(channel_, NULL,
+    ARES_SEND_FLAG_NORETRY, req, QueryCallback, &result[1], &qid[1]));
+  EXPECT_EQ(ARES_SUCCESS, ares_send_nolock(channel_, NULL,
+    ARES_SEND_FLAG_NOCACHE, req, QueryCallback, &result[2], &qid[2]));
+  EXPECT_EQ(ARES_SUCCESS, ares_send_nolock(channel_, NULL,
+    (ares_send_flags_t)0, req, QueryCallback, &result[3], &qid[3]));
+  EXPECT_EQ(3, ares_queue_active_queries(channel_));
+  EXPECT_NE(qid[0], qid[1]);
+  EXPECT_NE(qid[0], qid[2]);
+  EXPECT_NE(qid[1], qid[2]);
+  EXPECT_EQ(qid[0], qid[3]);
+
+  ares_cancel(channel_);
+  for (size_t i = 0; i < 4; i++) {
+    EXPECT_TRUE(result[i].done_);
+    EXPECT_EQ(ARES_ECANCELLED, result[i].status_);
+  }
+
+  ares_dns_record_destroy(req);
+}
+
+TEST_F(DefaultChannelTest, QueryCacheStale) {
+  ares_dns_record_t       *req    = NULL;
+  const ares_dns_record_t *cached = NULL;
+  ares_timeval_t           now;
+  ares_timeval_t           later;
+
+  /* Refreshes are sent to a server that will never answer */
+  EXPECT_EQ(ARES_SUCCESS, ares_set_servers_csv(channel_, "127.0.0.1:1"));
+
+  /* Serve stale for 60s, refresh when 10% of the TTL remains */
+  ares_qcache_destroy(channel_->qcache);
+  channel_->qcache = NULL;
+  ASSERT_EQ(ARES_SUCCESS, ares_qcache_create(channel_->rand_state, 3600, 0, 0,
+                                             60, 10, 1, &channel_->qcache));
+
+  ares_tvnow(&now);
+  QueryCacheInsertName(channel_, &now, "www.example.com", &req);
+
+  /* Not yet within the prefetch window */
+  later      = now;
+  later.sec += 50;
+  EXPECT_EQ(ARES_SUCCESS, ares_qcache_fetch(channel_, &later, req, &cached));
+  EXPECT_EQ(0, ares_qcache_stat(channel_, ARES_QCACHE_STAT_REFRESHES));
+
+  /* Within the prefetch window, only a single refresh is issued */
+  later.sec = now.sec + 95;
+  EXPECT_EQ(ARES_SUCCESS, ares_qcache_fetch(channel_, &later, req, &cached));
+  EXPECT_EQ(ARES_SUCCESS, ares_qcache_fetch(channel_, &later, req, &cached));
+  EXPECT_EQ(1, ares_qcache_stat(channel_, ARES_QCACHE_STAT_REFRESHES));
+
+  /* Expired, served stale with a fixed TTL.  The refresh is still pending so
+   * no new one is issued. */
+  later.sec = now.sec + 130;
+  EXPECT_EQ(ARES_SUCCESS, ares_qcache_fetch(channel_, &later, req, &cached));
+  EXPECT_EQ(30, ares_dns_rr_get_ttl(
+    ares_dns_record_rr_get_const(cached, ARES_SECTION_ANSWER, 0)));
+  EXPECT_EQ(1, ares_qcache_stat(channel_, ARES_QCACHE_STAT_STALE_HITS));
+  EXPECT_EQ(1, ares_qcache_stat(channel_, ARES_QCACHE_STAT_REFRESHES));
+
+  /* Past the stale window */
+  later.sec = now.sec + 160;
+  EXPECT_EQ(ARES_ENOTFOUND, ares_qcache_fetch(channel_, &later, req, &cached));
+
+  ares_dns_record_destroy(req);
+}
+
+TEST_F(DefaultChannelTest, QueryCacheSharded) {
+  std::vector<ares_dns_record_t *> reqs;
+  ares_dns_record_t              *resp = NULL;
+  ares_timeval_t                  now;
+  ares_timeval_t                  later;
+
+  EXPECT_EQ(ARES_SUCCESS, ares_set_servers_csv(channel_, "127.0.0.1:1"));
+
+  ares_qcache_destroy(channel_->qcache);
+  channel_->qcache = NULL;
+  ASSERT_EQ(ARES_SUCCESS, ares_qcache_create(channel_->rand_state, 3600, 0, 0,
+                                             60, 10, ARES_QCACHE_SHARDS,
+                                             &channel_->qcache));
+
+  ares_tvnow(&now);
+  for (size_t i = 0; i < 32; i++) {
+    ares_dns_record_t *req = NULL;
+    std::string        name = "host" + std::to_string(i) + ".example.com";
+    QueryCacheInsertName(channel_, &now, name.c_str(), &req);
+    reqs.push_back(req);
+  }
+  EXPECT_EQ(32, ares_qcache_stat(channel_, ARES_QCACHE_STAT_ENTRIES));
+
+  /* Lockless copies have TTLs reflecting the time spent in the cache */
+  later      = now;
+  later.sec += 10;
+  for (auto req : reqs) {
+    ASSERT_EQ(ARES_SUCCESS, ares_qcache_fetch_copy(channel_->qcache, &later,
+                                                   req, &resp));
+    EXPECT_EQ(90, ares_dns_rr_get_ttl(
+      ares_dns_record_rr_get_const(resp, ARES_SECTION_ANSWER, 0)));
+    ares_dns_record_destroy(resp);
+    resp = NULL;
+  }
+  EXPECT_EQ(32, ares_qcache_stat(channel_, ARES_QCACHE_STAT_HITS));
+
+  /* A hit that would trigger a refresh needs the channel lock, once the
+   * refresh is pending copies are served again */
+  later.sec = now.sec + 95;
+  EXPECT_EQ(ARES_ENOTFOUND, ares_qcache_fetch_copy(channel_->qcache, &later,
+                                                   reqs[0], &resp));
+  const ares_dns_record_t *cached = NULL;
+  EXPECT_EQ(ARES_SUCCESS, ares_qcache_fetch(channel_, &later, reqs[0],
+                                            &cached));
+  EXPECT_EQ(1, ares_qcache_stat(channel_, ARES_QCACHE_STAT_REFRESHES));
+  EXPECT_EQ(ARES_SUCCESS, ares_qcache_fetch_copy(channel_->qcache, &later,
+                                                 reqs[0], &resp));
+  ares_dns_record_destroy(resp);
+  resp = NULL;
+
+  /* Stale while the refresh is pending */
+  later.sec = now.sec + 130;
+  EXPECT_EQ(ARES_SUCCESS, ares_qcache_fetch_copy(channel_->qcache, &later,
+                                                 reqs[0], &resp));
+  EXPECT_EQ(30, ares_dns_rr_get_ttl(
+    ares_dns_record_rr_get_const(resp, ARES_SECTION_ANSWER, 0)));
+  EXPECT_EQ(1, ares_qcache_stat(channel_, ARES_QCACHE_STAT_STALE_HITS));
+  ares_dns_record_destroy(resp);
+  resp = NULL;
+
+  /* Past the stale window entries are left for ares_qcache_fetch() to purge */
+  later.sec = now.sec + 160;
+  EXPECT_EQ(ARES_ENOTFOUND, ares_qcache_fetch_copy(channel_->qcache, &later,
+                                                   reqs[1], &resp));
+  EXPECT_EQ(ARES_ENOTFOUND, ares_qcache_fetch(channel_, &later, reqs[1],
+                                              &cached));
+  EXPECT_EQ(0, ares_qcache_stat(channel_, ARES_QCACHE_STAT_ENTRIES));
+
+  for (auto req : reqs) {
+    ares_dns_record_destroy(req);
+  }
+}
+
+typedef struct {
+  struct ares_socket_functions_ex funcs;
+  size_t                          sockets;
+} SrcAddrSocketCount;
+
+TEST_F(DefaultChannelTest, SortAddrInfoSrcAddrCache) {
+  SrcAddrSocketCount              count;
+  struct ares_socket_functions_ex funcs;
+  struct sockaddr_in              sin[3];
+  struct ares_addrinfo_node       nodes[3];
+  struct ares_addrinfo_node       sentinel;
+  size_t                          i;
+
+  /* Count sockets opened to look up source addresses */
+  memcpy(&count.funcs, &channel_->sock_funcs, sizeof(count.funcs));
+  count.sockets = 0;
+  memcpy(&funcs, &count.funcs, sizeof(funcs));
+  funcs.asocket = [](int af, int type, int protocol,
+                     void *p) -> ares_socket_t {
+    SrcAddrSocketCount *c = reinterpret_cast<SrcAddrSocketCount *>(p);
+    c->sockets++;
+    return c->funcs.asocket(af, type, protocol, NULL);
+  };
+  EXPECT_EQ(ARES_SUCCESS, ares_set_socket_functions_ex(channel_, &funcs, &count));
+
+  memset(sin, 0, sizeof(sin));
+  memset(nodes, 0, sizeof(nodes));
+  for (i = 0; i < 3; i++) {
+    sin[i].sin_family      = AF_INET;
+    sin[i].sin_addr.s_addr = htonl(0x7F000001 + (unsigned int)i);
+    nodes[i].ai_family     = AF_INET;
+    nodes[i].ai_addrlen    = sizeof(sin[i]);
+    nodes[i].ai_addr       = (struct sockaddr *)&sin[i];
+  }
+
+  /* Every destination is looked up */
+  for (i = 0; i < 3; i++) {
+    nodes[i].ai_next = (i == 2) ? NULL : &nodes[i + 1];
+  }
+  sentinel.ai_next = &nodes[0];
+  EXPECT_EQ(ARES_SUCCESS, ares_sortaddrinfo(channel_, &sentinel));
+  EXPECT_EQ((size_t)3, count.sockets);
+
+  /* Then served from cache */
+  count.sockets = 0;
+  for (i = 0; i < 3; i++) {
+    nodes[i].ai_next = (i == 2) ? NULL : &nodes[i + 1];
+  }
+  sentinel.ai_next = &nodes[0];
+  EXPECT_EQ(ARES_SUCCESS, ares_sortaddrinfo(channel_, &sentinel));
+  EXPECT_EQ((size_t)0, count.sockets);
+
+  /* Until the configuration is reloaded */
+  EXPECT_EQ(ARES_SUCCESS, ares_reinit(channel_));
+  for (i = 0; i < 3; i++) {
+    nodes[i].ai_next = (i == 2) ? NULL : &nodes[i + 1];
+  }
+  sentinel.ai_next = &nodes[0];
+  EXPECT_EQ(ARES_SUCCESS, ares_sortaddrinfo(channel_, &sentinel));
+  EXPECT_EQ((size_t)3, count.sockets);
+}
+
+TEST_F(DefaultChannelTest, SortAddrInfoSrcAddrCacheV6) {
+  static const char *const addrs[] = {
+    "::ffff:127.0.0.1", "::ffff:127.0.0.2", "fe80::1", "fe80::2",
+    "2001:db8::1",      "2001:db8::2"
+  };
+  const size_t                    naddrs = sizeof(addrs) / sizeof(*addrs);
+  SrcAddrSocketCount              count;
+  struct ares_socket_functions_ex funcs;
+  struct sockaddr_in6             sin6[naddrs];
+  struct ares_addrinfo_node       nodes[naddrs];
+  struct ares_addrinfo_node       sentinel;
+  size_t                          i;
+
+  /* Count sockets opened to look up source addresses */
+  memcpy(&count.funcs, &channel_->sock_funcs, sizeof(count.funcs));
+  count.sockets = 0;
+  memcpy(&funcs, &count.funcs, sizeof(funcs));
+  funcs.asocket = [](int af, int type, int protocol,
+                     void *p) -> ares_socket_t {
+    SrcAddrSocketCount *c = reinterpret_cast<SrcAddrSocketCount *>(p);
+    c->sockets++;
+    return c->funcs.asocket(af, type, protocol, NULL);
+  };
+  EXPECT_EQ(ARES_SUCCESS, ares_set_socket_functions_ex(channel_, &funcs, &count));
+
+  memset(sin6, 0, sizeof(sin6));
+  memset(nodes, 0, sizeof(nodes));
+  for (i = 0; i < naddrs; i++) {
+    sin6[i].sin6_family = AF_INET6;
+    EXPECT_EQ(1, ares_inet_pton(AF_INET6, addrs[i], &sin6[i].sin6_addr));
+    nodes[i].ai_family  = AF_INET6;
+    nodes[i].ai_addrlen = sizeof(sin6[i]);
+    nodes[i].ai_addr    = (struct sockaddr *)&sin6[i];
+    nodes[i].ai_next    = (i == naddrs - 1) ? NULL : &nodes[i + 1];
+  }
+
+  /* Only global unicast destinations share a lookup per /64 */
+  sentinel.ai_next = &nodes[0];
+  EXPECT_EQ(ARES_SUCCESS, ares_sortaddrinfo(channel_, &sentinel));
+  EXPECT_EQ(naddrs - 1, count.sockets);
+}
+#endif
+
 // Need to put this in own function due to nested lambda bug
 // in VS2013. (C2888)
 static int configure_socket(ares_socket_t s) {
@@ -338,6 +338,56 @@ TEST_F(DefaultChannelTest, HostByNameFileOnionDomain) {
             ares_gethostbyname_file(channel_, "dontleak.onion", AF_INET, &h));
 }
 
+static void RewriteFile(const char *filename, const char *contents) {
+  FILE *fp = fopen(filename, "w");
+  ASSERT_NE(nullptr, fp);
+  fputs(contents, fp);
+  fclose(fp);
+}
+
+TEST_F(LibraryTest, HostsCheckInterval) {
+  TempFile        hosts("10.0.12.26     foobar\n");
+  struct hostent *h = nullptr;
+
+  for (int interval = 0; interval <= 1; interval++) {
+    struct ares_options opts;
+    int                 optmask = ARES_OPT_HOSTS_FILE;
+    ares_channel_t     *channel = nullptr;
+
+    memset(&opts, 0, sizeof(opts));
+    opts.hosts_path = (char *)hosts.filename();
+    if (interval) {
+      opts.hosts_check_ms = 3600000;
+      optmask |= ARES_OPT_HOSTS_CHECK_INTERVAL;
+    }
+    EXPECT_EQ(ARES_SUCCESS, ares_init_options(&channel, &opts, optmask));
+
+    RewriteFile(hosts.filename(), "10.0.12.26     foobar\n");
+    EXPECT_EQ(ARES_SUCCESS,
+              ares_gethostbyname_file(channel, "foobar", AF_INET, &h));
+    ares_free_hostent(h);
+
+    // Without an interval every lookup checks the file for changes, with
+    // one the already loaded copy is used until the interval passes.
+    RewriteFile(hosts.filename(), "10.0.12.27     other\n");
+    if (interval) {
+      EXPECT_EQ(ARES_SUCCESS,
+                ares_gethostbyname_file(channel, "foobar", AF_INET, &h));
+      ares_free_hostent(h);
+      EXPECT_EQ(ARES_ENOTFOUND,
+                ares_gethostbyname_file(channel, "other", AF_INET, &h));
+    } else {
+      EXPECT_EQ(ARES_ENOTFOUND,
+                ares_gethostbyname_file(channel, "foobar", AF_INET, &h));
+      EXPECT_EQ(ARES_SUCCESS,
+                ares_gethostbyname_file(channel, "other", AF_INET, &h));
+      ares_free_hostent(h);
+    }
+
+    ares_destroy(channel);
+  }
+}
+
 TEST_F(DefaultChannelTest, GetAddrinfoOnionDomain) {
   AddrInfoResult result;
   struct ares_addrinfo_hints hints = {0, 0, 0, 0};
@@ -714,6 +714,105 @@ TEST_P(MockChannelTestAI, FamilyUnspecified) {
 }
 
 
+struct IncrementalResult {
+  IncrementalResult() : early_calls_(0) {}
+  // Results delivered with is_final set to ARES_FALSE and ARES_TRUE
+  AddrInfoResult early_;
+  AddrInfoResult final_;
+  int            early_calls_;
+};
+
+static void IncrementalCallback(void *data, int status, int timeouts,
+                                struct ares_addrinfo *ai, ares_bool_t is_final) {
+  IncrementalResult *result = reinterpret_cast<IncrementalResult*>(data);
+  EXPECT_FALSE(result->final_.done_);
+  if (is_final) {
+    AddrInfoCallback(&result->final_, status, timeouts, ai);
+  } else {
+    result->early_calls_++;
+    AddrInfoCallback(&result->early_, status, timeouts, ai);
+  }
+}
+
+TEST_P(MockChannelTestAI, IncrementalBothFamilies) {
+  DNSPacket rsp6;
+  rsp6.set_response().set_aa()
+    .add_question(new DNSQuestion("example.com", T_AAAA))
+    .add_answer(new DNSAaaaRR("example.com", 100,
+                              {0x21, 0x21, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+                               0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x03, 0x03}));
+  ON_CALL(server_, OnRequest("example.com", T_AAAA))
+    .WillByDefault(SetReply(&server_, &rsp6));
+  DNSPacket rsp4;
+  rsp4.set_response().set_aa()
+    .add_question(new DNSQuestion("example.com", T_A))
+    .add_answer(new DNSARR("example.com", 100, {2, 3, 4, 5}));
+  ON_CALL(server_, OnRequest("example.com", T_A))
+    .WillByDefault(SetReply(&server_, &rsp4));
+  IncrementalResult result;
+  struct ares_addrinfo_hints hints = {0, 0, 0, 0};
+  hints.ai_family = AF_UNSPEC;
+  ares_getaddrinfo_incremental(channel_, "example.com.", NULL, &hints, 0,
+                               IncrementalCallback, &result);
+  Process();
+  // The first family to answer is delivered on its own
+  EXPECT_EQ(1, result.early_calls_);
+  EXPECT_EQ(ARES_SUCCESS, result.early_.status_);
+  EXPECT_THAT(result.early_.ai_, IncludesNumAddresses(1));
+  EXPECT_TRUE(result.final_.done_);
+  EXPECT_EQ(ARES_SUCCESS, result.final_.status_);
+  EXPECT_THAT(result.final_.ai_, IncludesNumAddresses(2));
+  EXPECT_THAT(result.final_.ai_, IncludesV4Address("2.3.4.5"));
+  EXPECT_THAT(result.final_.ai_, IncludesV6Address("2121:0000:0000:0000:0000:0000:0000:0303"));
+}
+
+TEST_P(MockChannelTestAI, IncrementalV6Lost) {
+  std::vector<byte> nothing;
+  DNSPacket rsp4;
+  rsp4.set_response().set_aa()
+    .add_question(new DNSQuestion("example.com", T_A))
+    .add_answer(new DNSARR("example.com", 100, {2, 3, 4, 5}));
+  EXPECT_CALL(server_, OnRequest("example.com", T_A))
+    .WillOnce(SetReply(&server_, &rsp4));
+  // Given up on after the resolution delay rather than timed out and retried
+  EXPECT_CALL(server_, OnRequest("example.com", T_AAAA))
+    .Times(testing::AtMost(1))
+    .WillRepeatedly(SetReplyData(&server_, nothing));
+  IncrementalResult result;
+  struct ares_addrinfo_hints hints = {0, 0, 0, 0};
+  hints.ai_family = AF_UNSPEC;
+  ares_getaddrinfo_incremental(channel_, "example.com.", NULL, &hints, 10,
+                               IncrementalCallback, &result);
+  Process();
+  EXPECT_EQ(1, result.early_calls_);
+  EXPECT_THAT(result.early_.ai_, IncludesNumAddresses(1));
+  EXPECT_THAT(result.early_.ai_, IncludesV4Address("2.3.4.5"));
+  EXPECT_TRUE(result.final_.done_);
+  EXPECT_EQ(ARES_SUCCESS, result.final_.status_);
+  EXPECT_EQ(0, result.final_.timeouts_);
+  EXPECT_THAT(result.final_.ai_, IncludesNumAddresses(1));
+  EXPECT_THAT(result.final_.ai_, IncludesV4Address("2.3.4.5"));
+}
+
+TEST_P(MockChannelTestAI, IncrementalSingleFamily) {
+  DNSPacket rsp4;
+  rsp4.set_response().set_aa()
+    .add_question(new DNSQuestion("example.com", T_A))
+    .add_answer(new DNSARR("example.com", 100, {2, 3, 4, 5}));
+  ON_CALL(server_, OnRequest("example.com", T_A))
+    .WillByDefault(SetReply(&server_, &rsp4));
+  IncrementalResult result;
+  struct ares_addrinfo_hints hints = {0, 0, 0, 0};
+  hints.ai_family = AF_INET;
+  ares_getaddrinfo_incremental(channel_, "example.com.", NULL, &hints, 0,
+                               IncrementalCallback, &result);
+  Process();
+  EXPECT_EQ(0, result.early_calls_);
+  EXPECT_TRUE(result.final_.done_);
+  EXPECT_EQ(ARES_SUCCESS, result.final_.status_);
+  EXPECT_THAT(result.final_.ai_, IncludesV4Address("2.3.4.5"));
+}
+
 TEST_P(MockChannelTestAI, TriggerResendThenConnFailSERVFAIL) {
   // Set up the server response. The server always returns SERVFAIL.
   DNSPacket badrsp4;
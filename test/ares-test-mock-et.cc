@@ -33,7 +33,12 @@
 #include <sys/stat.h>
 #endif
 
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <set>
 #include <sstream>
+#include <thread>
 #include <vector>
 
 using testing::InvokeWithoutArgs;
@@ -461,6 +466,271 @@ TEST_P(CacheQueriesEventThreadTest, GetHostByNameCache) {
   EXPECT_EQ(1, sock_cb_count);
 }
 
+class MulticoreCacheEventThreadTest
+    : public MockEventThreadOptsTest,
+      public ::testing::WithParamInterface<std::tuple<ares_evsys_t,int>> {
+ public:
+  MulticoreCacheEventThreadTest()
+    : MockEventThreadOptsTest(1, std::get<0>(GetParam()), std::get<1>(GetParam()), false,
+                          FillOptions(&opts_),
+                          ARES_OPT_QUERY_CACHE|ARES_OPT_FLAGS) {}
+  static struct ares_options* FillOptions(struct ares_options * opts) {
+    memset(opts, 0, sizeof(struct ares_options));
+    opts->qcache_max_ttl = 3600;
+    opts->flags          = ARES_FLAG_MULTICORE;
+    return opts;
+  }
+ private:
+  struct ares_options opts_;
+};
+
+static void MulticoreCacheCallback(void *data, ares_status_t status,
+                                   size_t timeouts,
+                                   const ares_dns_record_t *dnsrec) {
+  std::atomic<size_t> *hits = (std::atomic<size_t> *)data;
+  (void)timeouts;
+  if (status == ARES_SUCCESS &&
+      ares_dns_record_rr_cnt(dnsrec, ARES_SECTION_ANSWER) == 1) {
+    (*hits)++;
+  }
+}
+
+#define MULTICORETHREADS 8
+#define MULTICORELOOKUPS 500
+TEST_P(MulticoreCacheEventThreadTest, ConcurrentCacheHits) {
+  DNSPacket rsp;
+  rsp.set_response().set_aa()
+    .add_question(new DNSQuestion("www.google.com", T_A))
+    .add_answer(new DNSARR("www.google.com", 100, {2, 3, 4, 5}));
+  EXPECT_CALL(server_, OnRequest("www.google.com", T_A))
+    .WillOnce(SetReply(&server_, &rsp));
+
+  QueryResult result;
+  ares_query_dnsrec(channel_, "www.google.com", ARES_CLASS_IN, ARES_REC_TYPE_A,
+                    QueryCallback, &result, NULL);
+  Process();
+  EXPECT_TRUE(result.done_);
+  EXPECT_EQ(ARES_SUCCESS, result.status_);
+
+  // Hits are answered synchronously from the calling thread
+  std::atomic<size_t>      hits(0);
+  std::vector<std::thread> threads;
+  for (size_t i = 0; i < MULTICORETHREADS; i++) {
+    threads.push_back(std::thread([this, &hits]() {
+      for (size_t j = 0; j < MULTICORELOOKUPS; j++) {
+        ares_query_dnsrec(channel_, "www.google.com", ARES_CLASS_IN,
+                          ARES_REC_TYPE_A, MulticoreCacheCallback, &hits,
+                          NULL);
+      }
+    }));
+  }
+  for (auto &t : threads) {
+    t.join();
+  }
+
+  EXPECT_EQ(MULTICORETHREADS * MULTICORELOOKUPS, hits.load());
+  EXPECT_EQ(MULTICORETHREADS * MULTICORELOOKUPS,
+            ares_qcache_stat(channel_, ARES_QCACHE_STAT_HITS));
+}
+
+#define MULTICORESUBMITS 50
+TEST_P(MulticoreCacheEventThreadTest, ConcurrentSubmissions) {
+  DNSPacket rsp;
+  rsp.set_response().set_aa()
+    .add_question(new DNSQuestion("www.google.com", T_A))
+    .add_answer(new DNSARR("www.google.com", 100, {2, 3, 4, 5}));
+  ON_CALL(server_, OnRequest("www.google.com", T_A))
+    .WillByDefault(SetReply(&server_, &rsp));
+
+  // Misses are queued for the event thread rather than sent inline, hits
+  // once the first response is cached are answered from the calling thread
+  std::atomic<size_t>      answers(0);
+  std::vector<std::thread> threads;
+  for (size_t i = 0; i < MULTICORETHREADS; i++) {
+    threads.push_back(std::thread([this, &answers]() {
+      for (size_t j = 0; j < MULTICORESUBMITS; j++) {
+        ares_query_dnsrec(channel_, "www.google.com", ARES_CLASS_IN,
+                          ARES_REC_TYPE_A, MulticoreCacheCallback, &answers,
+                          NULL);
+      }
+    }));
+  }
+  for (auto &t : threads) {
+    t.join();
+  }
+  Process();
+
+  EXPECT_EQ(MULTICORETHREADS * MULTICORESUBMITS, answers.load());
+  EXPECT_EQ(0, ares_queue_active_queries(channel_));
+}
+
+typedef struct {
+  ares_channel_t      *channel;
+  std::atomic<size_t>  completed;
+  std::atomic<size_t>  batch_hits;
+} MulticoreCancelState;
+
+static thread_local bool multicore_hit = false;
+static thread_local bool multicore_submitter = false;
+
+static void MulticoreCancelCallback(void *data, ares_status_t status,
+                                    size_t timeouts,
+                                    const ares_dns_record_t *dnsrec) {
+  MulticoreCancelState *state = (MulticoreCancelState *)data;
+  (void)timeouts;
+  (void)dnsrec;
+  state->completed++;
+  if (status != ARES_SUCCESS) {
+    return;
+  }
+  if (multicore_submitter) {
+    multicore_hit = true;
+    return;
+  }
+  // Only the first query is ever answered by the server, so a success on the
+  // event thread is a queued request answered from the cache in a batch
+  state->batch_hits++;
+  ares_cancel(state->channel);
+}
+
+TEST_P(MulticoreCacheEventThreadTest, CancelFromBatchCallback) {
+  DNSPacket rsp;
+  rsp.set_response().set_aa()
+    .add_question(new DNSQuestion("www.google.com", T_A))
+    .add_answer(new DNSARR("www.google.com", 100, {2, 3, 4, 5}));
+  std::vector<byte> nothing;
+  EXPECT_CALL(server_, OnRequest("www.google.com", T_A))
+    .WillOnce(SetReply(&server_, &rsp))
+    .WillRepeatedly(SetReplyData(&server_, nothing));
+
+  ares_dns_record_t *req = NULL;
+  EXPECT_EQ(ARES_SUCCESS, ares_dns_record_create(&req, 0, ARES_FLAG_RD,
+    ARES_OPCODE_QUERY, ARES_RCODE_NOERROR));
+  EXPECT_EQ(ARES_SUCCESS, ares_dns_record_query_add(req, "www.google.com",
+    ARES_REC_TYPE_A, ARES_CLASS_IN));
+
+  QueryResult result;
+  ares_send_dnsrec(channel_, req, QueryCallback, &result, NULL);
+
+  // Keep submitting until the response is cached, requests queued just
+  // before then are answered from the cache by the event thread and cancel
+  // the channel while the other threads are still submitting
+  MulticoreCancelState     state;
+  std::atomic<size_t>      running(MULTICORETHREADS);
+  std::atomic<size_t>      sent(0);
+  std::vector<std::thread> threads;
+  state.channel    = channel_;
+  state.completed  = 0;
+  state.batch_hits = 0;
+  for (size_t i = 0; i < MULTICORETHREADS; i++) {
+    threads.push_back(std::thread([this, req, &state, &running, &sent]() {
+      multicore_submitter = true;
+      for (size_t j = 0; j < MULTICORESUBMITS && !multicore_hit; j++) {
+        EXPECT_EQ(ARES_SUCCESS, ares_send_dnsrec(channel_, req,
+          MulticoreCancelCallback, &state, NULL));
+        sent++;
+      }
+      running--;
+    }));
+  }
+  while (running.load() != 0 || !result.done_) {
+    Process();
+  }
+  for (auto &t : threads) {
+    t.join();
+  }
+
+  // Anything left was sent before the response arrived and is never answered
+  ares_cancel(channel_);
+  Process();
+
+  EXPECT_TRUE(result.done_);
+  EXPECT_EQ(sent.load(), state.completed.load());
+  EXPECT_EQ(0, ares_queue_active_queries(channel_));
+  if (verbose) {
+    std::cerr << "batch hits: " << state.batch_hits.load() << std::endl;
+  }
+  ares_dns_record_destroy(req);
+}
+
+class MockMultiEventThreadTest
+    : public MockEventThreadOptsTest,
+      public ::testing::WithParamInterface< std::tuple<ares_evsys_t, int, bool> > {
+ public:
+  MockMultiEventThreadTest()
+    : MockEventThreadOptsTest(3, std::get<0>(GetParam()), std::get<1>(GetParam()), std::get<2>(GetParam()),
+                          FillOptions(&opts_),
+                          ARES_OPT_EVENT_THREADS|ARES_OPT_ROTATE) {}
+  static struct ares_options* FillOptions(struct ares_options * opts) {
+    memset(opts, 0, sizeof(struct ares_options));
+    opts->event_threads = 4;
+    return opts;
+  }
+ private:
+  struct ares_options opts_;
+};
+
+#define MULTIEVENTLOOKUPS 32
+
+// Callbacks run on the event thread that read the answer from the socket
+struct MultiEventResult {
+  HostResult                 result;
+  std::mutex                *lock;
+  std::set<std::thread::id> *threads;
+};
+
+static void MultiEventHostCallback(void *data, int status, int timeouts,
+                                   const struct hostent *hostent) {
+  MultiEventResult *r = reinterpret_cast<MultiEventResult *>(data);
+  {
+    std::lock_guard<std::mutex> guard(*r->lock);
+    r->threads->insert(std::this_thread::get_id());
+  }
+  HostCallback(&r->result, status, timeouts, hostent);
+}
+TEST_P(MockMultiEventThreadTest, ParallelLookups) {
+  DNSPacket rsp;
+  rsp.set_response().set_aa()
+    .add_question(new DNSQuestion("www.google.com", T_A))
+    .add_answer(new DNSARR("www.google.com", 100, {2, 3, 4, 5}));
+  for (auto &server : servers_) {
+    ON_CALL(*server, OnRequest("www.google.com", T_A))
+      .WillByDefault(SetReply(server.get(), &rsp));
+  }
+
+  struct ares_options opts;
+  int                 optmask = 0;
+  memset(&opts, 0, sizeof(opts));
+  EXPECT_EQ(ARES_SUCCESS, ares_save_options(channel_, &opts, &optmask));
+  EXPECT_EQ(ARES_OPT_EVENT_THREADS, optmask & ARES_OPT_EVENT_THREADS);
+  EXPECT_EQ(4, opts.event_threads);
+  ares_destroy_options(&opts);
+
+  // Rotation spreads the queries across the connections to each server,
+  // which are in turn spread across the event threads
+  std::mutex                lock;
+  std::set<std::thread::id> threads;
+  MultiEventResult          result[MULTIEVENTLOOKUPS];
+  for (size_t i = 0; i < MULTIEVENTLOOKUPS; i++) {
+    result[i].lock    = &lock;
+    result[i].threads = &threads;
+    ares_gethostbyname(channel_, "www.google.com.", AF_INET,
+                       MultiEventHostCallback, &result[i]);
+  }
+  Process();
+
+  for (size_t i = 0; i < MULTIEVENTLOOKUPS; i++) {
+    std::stringstream ss;
+    EXPECT_TRUE(result[i].result.done_);
+    ss << result[i].result.host_;
+    EXPECT_EQ("{'www.google.com' aliases=[] addrs=[2.3.4.5]}", ss.str());
+  }
+
+  std::lock_guard<std::mutex> guard(lock);
+  EXPECT_LT((size_t)1, threads.size());
+  EXPECT_EQ((size_t)0, threads.count(std::this_thread::get_id()));
+}
+
 #define TCPPARALLELLOOKUPS 32
 
 class MockTCPEventThreadStayOpenTest
@@ -1532,6 +1802,140 @@ TEST_P(NoRotateMultiMockEventThreadTest, ServerNoResponseFailover) {
 #endif
 
 
+class HedgeMultiMockEventThreadTest : public MockMultiServerEventThreadTest {
+ public:
+  HedgeMultiMockEventThreadTest()
+    : MockMultiServerEventThreadTest(FillOptions(&opts_),
+                                     ARES_OPT_HEDGE | ARES_OPT_NOROTATE) {}
+  static struct ares_options* FillOptions(struct ares_options *opts) {
+    memset(opts, 0, sizeof(struct ares_options));
+    opts->hedge_percentile = 50;
+    opts->hedge_max_pct = 100;
+    return opts;
+  }
+ private:
+  struct ares_options opts_;
+};
+
+TEST_P(HedgeMultiMockEventThreadTest, HedgeAnswersAfterPrimaryTimeout) {
+  std::vector<byte> nothing;
+  DNSPacket okrsp;
+  okrsp.set_response().set_aa()
+    .add_question(new DNSQuestion("www.example.com", T_A))
+    .add_answer(new DNSARR("www.example.com", 100, {2,3,4,5}));
+
+  /* Server #1 answers in about 100ms, which gives it a timeout of about 500ms
+   * and hedges its queries after about 100ms.  It then doesn't answer, and
+   * server #2 answers the hedge after server #1's timeout but well within the
+   * time the hedge itself is given.  The timeout must only blame server #1
+   * and keep waiting on the hedge rather than requeue the query. */
+  EXPECT_CALL(*servers_[0], OnRequest("www.example.com", T_A))
+    .WillOnce(DoAll(InvokeWithoutArgs([]() { ares_sleep_time(100); }),
+                    SetReply(servers_[0].get(), &okrsp)))
+    .WillOnce(DoAll(InvokeWithoutArgs([]() { ares_sleep_time(100); }),
+                    SetReply(servers_[0].get(), &okrsp)))
+    .WillOnce(DoAll(InvokeWithoutArgs([]() { ares_sleep_time(100); }),
+                    SetReply(servers_[0].get(), &okrsp)))
+    .WillOnce(SetReplyData(servers_[0].get(), nothing));
+  EXPECT_CALL(*servers_[1], OnRequest("www.example.com", T_A))
+    .WillOnce(DoAll(InvokeWithoutArgs([]() { ares_sleep_time(450); }),
+                    SetReply(servers_[1].get(), &okrsp)));
+  EXPECT_CALL(*servers_[2], OnRequest("www.example.com", T_A)).Times(0);
+
+  for (size_t i = 0; i < 3; i++) {
+    CheckExample();
+  }
+
+  HostResult result;
+  ares_gethostbyname(channel_, "www.example.com.", AF_INET, HostCallback, &result);
+  Process();
+  EXPECT_TRUE(result.done_);
+  EXPECT_EQ(1, result.timeouts_);
+  std::stringstream ss;
+  ss << result.host_;
+  EXPECT_EQ("{'www.example.com' aliases=[] addrs=[2.3.4.5]}", ss.str());
+}
+
+TEST_P(HedgeMultiMockEventThreadTest, PrimaryAnswersAfterHedgeServFail) {
+  DNSPacket okrsp;
+  okrsp.set_response().set_aa()
+    .add_question(new DNSQuestion("www.example.com", T_A))
+    .add_answer(new DNSARR("www.example.com", 100, {2,3,4,5}));
+  DNSPacket servfailrsp;
+  servfailrsp.set_response().set_aa().set_rcode(SERVFAIL)
+    .add_question(new DNSQuestion("www.example.com", T_A));
+
+  /* Server #1 answers in about 100ms so queries to it are hedged after about
+   * 100ms.  After that, the hedge is answered with SERVFAIL while server #1 is
+   * still working on its answer, which arrives about 300ms after it was sent.
+   * Its latency must be timed from its own send rather than from the hedge's.
+   * This happens twice, with hedges to servers #2 and #3 until both have
+   * failed, and is followed by a plain query so the latency reported covers
+   * one of them even if the metrics roll over to a new period in between. */
+  size_t hedges = 0;
+  auto answer_hedge = [this, &hedges]() {
+    size_t prev = hedges;
+    ares_sleep_time(200);
+    for (int i = 0; i < 10 && hedges == prev; i++) {
+      std::map<ares_socket_t, MockServer *> fds;
+      fd_set                                readers;
+      int                                   nfds = 0;
+      struct timeval                        tv   = { 0, 50000 };
+      FD_ZERO(&readers);
+      for (size_t j = 1; j < servers_.size(); j++) {
+        for (ares_socket_t fd : servers_[j]->fds()) {
+          fds[fd] = servers_[j].get();
+          FD_SET(fd, &readers);
+          if (fd >= (ares_socket_t)nfds) {
+            nfds = (int)fd + 1;
+          }
+        }
+      }
+      if (select(nfds, &readers, nullptr, nullptr, &tv) <= 0) {
+        continue;
+      }
+      for (auto &fd : fds) {
+        if (FD_ISSET(fd.first, &readers)) {
+          fd.second->ProcessFD(fd.first);
+        }
+      }
+    }
+    ares_sleep_time(100);
+  };
+  EXPECT_CALL(*servers_[0], OnRequest("www.example.com", T_A))
+    .WillOnce(DoAll(InvokeWithoutArgs([]() { ares_sleep_time(100); }),
+                    SetReply(servers_[0].get(), &okrsp)))
+    .WillOnce(DoAll(InvokeWithoutArgs([]() { ares_sleep_time(100); }),
+                    SetReply(servers_[0].get(), &okrsp)))
+    .WillOnce(DoAll(InvokeWithoutArgs([]() { ares_sleep_time(100); }),
+                    SetReply(servers_[0].get(), &okrsp)))
+    .WillOnce(DoAll(InvokeWithoutArgs(answer_hedge),
+                    SetReply(servers_[0].get(), &okrsp)))
+    .WillOnce(DoAll(InvokeWithoutArgs(answer_hedge),
+                    SetReply(servers_[0].get(), &okrsp)))
+    .WillOnce(DoAll(InvokeWithoutArgs([]() { ares_sleep_time(100); }),
+                    SetReply(servers_[0].get(), &okrsp)));
+  for (size_t i = 1; i < servers_.size(); i++) {
+    ON_CALL(*servers_[i], OnRequest("www.example.com", T_A))
+      .WillByDefault(DoAll(InvokeWithoutArgs([&hedges]() { hedges++; }),
+                           SetReply(servers_[i].get(), &servfailrsp)));
+  }
+
+  for (size_t i = 0; i < 6; i++) {
+    CheckExample();
+  }
+  EXPECT_EQ(2u, hedges);
+
+  char        *servers = ares_get_servers_csv(channel_);
+  std::string  server(servers);
+  unsigned int latency = 0;
+  server = server.substr(0, server.find(','));
+  EXPECT_EQ(ARES_SUCCESS,
+            ares_get_server_latency(channel_, server.c_str(), 100, &latency));
+  EXPECT_LE(300u, latency);
+  ares_free_string(servers);
+}
+
 class ServerFailoverOptsMockEventThreadTest
   : public MockEventThreadOptsTest,
     public ::testing::WithParamInterface<std::tuple<ares_evsys_t, int, bool> > {
@@ -1723,6 +2127,8 @@ static const char *evsys_tostr(ares_evsys_t evsys)
       return "POLL";
     case ARES_EVSYS_SELECT:
       return "SELECT";
+    case ARES_EVSYS_IOURING:
+      return "IOURING";
     case ARES_EVSYS_DEFAULT:
       return "DEFAULT";
   }
@@ -1760,6 +2166,8 @@ INSTANTIATE_TEST_SUITE_P(AddressFamilies, MockUDPEventThreadMaxQueriesTest, ::te
 
 INSTANTIATE_TEST_SUITE_P(AddressFamilies, CacheQueriesEventThreadTest, ::testing::ValuesIn(ares::test::evsys_families), ares::test::PrintEvsysFamily);
 
+INSTANTIATE_TEST_SUITE_P(AddressFamilies, MulticoreCacheEventThreadTest, ::testing::ValuesIn(ares::test::evsys_families), ares::test::PrintEvsysFamily);
+
 INSTANTIATE_TEST_SUITE_P(AddressFamilies, MockTCPEventThreadTest, ::testing::ValuesIn(ares::test::evsys_families), ares::test::PrintEvsysFamily);
 
 INSTANTIATE_TEST_SUITE_P(AddressFamilies, MockTCPEventThreadStayOpenTest, ::testing::ValuesIn(ares::test::evsys_families), ares::test::PrintEvsysFamily);
@@ -1770,8 +2178,12 @@ INSTANTIATE_TEST_SUITE_P(AddressFamilies, MockNoCheckRespEventThreadTest, ::test
 
 INSTANTIATE_TEST_SUITE_P(AddressFamilies, MockEDNSEventThreadTest, ::testing::ValuesIn(ares::test::evsys_families_modes), ares::test::PrintEvsysFamilyMode);
 
+INSTANTIATE_TEST_SUITE_P(AddressFamilies, MockMultiEventThreadTest, ::testing::ValuesIn(ares::test::evsys_families_modes), ares::test::PrintEvsysFamilyMode);
+
 INSTANTIATE_TEST_SUITE_P(TransportModes, NoRotateMultiMockEventThreadTest, ::testing::ValuesIn(ares::test::evsys_families_modes), ares::test::PrintEvsysFamilyMode);
 
+INSTANTIATE_TEST_SUITE_P(TransportModes, HedgeMultiMockEventThreadTest, ::testing::ValuesIn(ares::test::evsys_families_modes), ares::test::PrintEvsysFamilyMode);
+
 INSTANTIATE_TEST_SUITE_P(TransportModes, ServerFailoverOptsMockEventThreadTest, ::testing::ValuesIn(ares::test::evsys_families_modes), ares::test::PrintEvsysFamilyMode);
 
 #if 0
@@ -36,6 +36,7 @@
 
 using testing::InvokeWithoutArgs;
 using testing::DoAll;
+using testing::AtMost;
 
 namespace ares {
 namespace test {
@@ -176,6 +177,187 @@ TEST_P(MockUDPChannelTest, GetHostByNameParallelLookups) {
   EXPECT_EQ("{'www.google.com' aliases=[] addrs=[2.3.4.5]}", ss3.str());
 }
 
+// UDP only, queries to the server are spread across several sockets
+TEST_P(MockUDPChannelTest, MultipleUDPSockets) {
+  EXPECT_EQ(ARES_EFORMERR,
+            ares_set_udp_sockets(channel_, 0, ARES_UDP_BALANCE_ROUND_ROBIN));
+  EXPECT_EQ(ARES_SUCCESS,
+            ares_set_udp_sockets(channel_, 3, ARES_UDP_BALANCE_ROUND_ROBIN));
+
+  DNSPacket rsp;
+  rsp.set_response().set_aa()
+    .add_question(new DNSQuestion("www.google.com", T_A))
+    .add_answer(new DNSARR("www.google.com", 100, {2, 3, 4, 5}));
+  ON_CALL(server_, OnRequest("www.google.com", T_A))
+    .WillByDefault(SetReply(&server_, &rsp));
+
+  HostResult results[6];
+  for (size_t i = 0; i < 6; i++) {
+    ares_gethostbyname(channel_, "www.google.com.", AF_INET, HostCallback,
+                       &results[i]);
+  }
+
+  char            *server = ares_get_servers_csv(channel_);
+  ares_udp_stats_t stats[4];
+  size_t           num_stats = 4;
+  EXPECT_EQ(ARES_SUCCESS,
+            ares_get_server_udp_stats(channel_, server, stats, &num_stats));
+  EXPECT_EQ((size_t)3, num_stats);
+  for (size_t i = 0; i < num_stats; i++) {
+    EXPECT_EQ((size_t)2, stats[i].queries_sent);
+    EXPECT_EQ((size_t)2, stats[i].outstanding);
+    EXPECT_EQ((size_t)0, stats[i].answers);
+    EXPECT_NE(0, stats[i].local_port);
+  }
+  EXPECT_NE(stats[0].local_port, stats[1].local_port);
+  EXPECT_NE(stats[1].local_port, stats[2].local_port);
+
+  num_stats = 4;
+  EXPECT_EQ(ARES_ENOTFOUND, ares_get_server_udp_stats(channel_, "192.0.2.1:53",
+                                                      stats, &num_stats));
+  EXPECT_EQ((size_t)0, num_stats);
+  ares_free_string(server);
+
+  Process();
+  for (size_t i = 0; i < 6; i++) {
+    EXPECT_TRUE(results[i].done_);
+    std::stringstream ss;
+    ss << results[i].host_;
+    EXPECT_EQ("{'www.google.com' aliases=[] addrs=[2.3.4.5]}", ss.str());
+  }
+}
+
+#ifndef WIN32
+typedef struct {
+  size_t send_calls;
+  size_t send_msgs;
+  size_t recv_calls;
+  size_t recv_msgs;
+} BatchCount;
+
+static void PendingWriteCallback(void *data) {
+  *reinterpret_cast<bool *>(data) = true;
+}
+
+// UDP only, verifies deferred queries are sent as a single batch and answers
+// are read in batches
+TEST_P(MockUDPChannelTest, BatchedSendRecv) {
+  struct ares_socket_functions_ex sock_funcs;
+  memset(&sock_funcs, 0, sizeof(sock_funcs));
+
+  sock_funcs.version = 2;
+  sock_funcs.flags   = ARES_SOCKFUNC_FLAG_NONBLOCKING;
+  sock_funcs.asocket = [](int af, int type, int protocol,
+                          void *) -> ares_socket_t {
+    return ::socket(af, type, protocol);
+  };
+  sock_funcs.aclose = [](ares_socket_t sock, void *) -> int {
+    return sclose(sock);
+  };
+  sock_funcs.asetsockopt = [](ares_socket_t, ares_socket_opt_t, const void *,
+                              ares_socklen_t, void *) -> int {
+    return 0;
+  };
+  sock_funcs.aconnect = [](ares_socket_t sock, const struct sockaddr *address,
+                           ares_socklen_t address_len, unsigned int,
+                           void *) -> int {
+    return ::connect(sock, address, address_len);
+  };
+  sock_funcs.arecvfrom = [](ares_socket_t sock, void *buffer, size_t length,
+                            int flags, struct sockaddr *address,
+                            ares_socklen_t *address_len,
+                            void *) -> ares_ssize_t {
+    return ::recvfrom(sock, buffer, length, flags | MSG_DONTWAIT, address,
+                      address_len);
+  };
+  sock_funcs.asendto = [](ares_socket_t sock, const void *buffer, size_t length,
+                          int flags, const struct sockaddr *address,
+                          ares_socklen_t address_len, void *) -> ares_ssize_t {
+    return ::sendto(sock, buffer, length, flags, address, address_len);
+  };
+  sock_funcs.asendmmsg = [](ares_socket_t sock, const ares_socket_msg_t *msgs,
+                            size_t cnt, int flags,
+                            void *p) -> ares_ssize_t {
+    BatchCount *count = reinterpret_cast<BatchCount *>(p);
+    size_t      i;
+    count->send_calls++;
+    for (i = 0; i < cnt; i++) {
+      if (::send(sock, msgs[i].buffer, msgs[i].length, flags) < 0) {
+        break;
+      }
+      count->send_msgs++;
+    }
+    return (i == 0) ? -1 : (ares_ssize_t)i;
+  };
+  sock_funcs.arecvmmsg = [](ares_socket_t sock, ares_socket_msg_t *msgs,
+                            size_t cnt, int flags, void *p) -> ares_ssize_t {
+    BatchCount *count = reinterpret_cast<BatchCount *>(p);
+    size_t      i;
+    count->recv_calls++;
+    for (i = 0; i < cnt; i++) {
+      ssize_t rv = ::recv(sock, msgs[i].buffer, msgs[i].length,
+                          flags | MSG_DONTWAIT);
+      if (rv < 0) {
+        break;
+      }
+      msgs[i].length = (size_t)rv;
+      count->recv_msgs++;
+    }
+    return (i == 0) ? -1 : (ares_ssize_t)i;
+  };
+
+  BatchCount count = { 0, 0, 0, 0 };
+  EXPECT_EQ(ARES_SUCCESS,
+            ares_set_socket_functions_ex(channel_, &sock_funcs, &count));
+
+  bool pending = false;
+  ares_set_pending_write_cb(channel_, PendingWriteCallback, &pending);
+
+  DNSPacket rsp1;
+  rsp1.set_response().set_aa()
+    .add_question(new DNSQuestion("www.google.com", T_A))
+    .add_answer(new DNSARR("www.google.com", 100, {2, 3, 4, 5}));
+  ON_CALL(server_, OnRequest("www.google.com", T_A))
+    .WillByDefault(SetReply(&server_, &rsp1));
+  DNSPacket rsp2;
+  rsp2.set_response().set_aa()
+    .add_question(new DNSQuestion("www.example.com", T_A))
+    .add_answer(new DNSARR("www.example.com", 100, {1, 2, 3, 4}));
+  ON_CALL(server_, OnRequest("www.example.com", T_A))
+    .WillByDefault(SetReply(&server_, &rsp2));
+
+  HostResult result1;
+  ares_gethostbyname(channel_, "www.google.com.", AF_INET, HostCallback, &result1);
+  HostResult result2;
+  ares_gethostbyname(channel_, "www.example.com.", AF_INET, HostCallback, &result2);
+  HostResult result3;
+  ares_gethostbyname(channel_, "www.google.com.", AF_INET, HostCallback, &result3);
+
+  // Nothing is written until the pending write is processed
+  EXPECT_TRUE(pending);
+  EXPECT_EQ((size_t)0, count.send_calls);
+  ares_process_pending_write(channel_);
+  EXPECT_EQ((size_t)1, count.send_calls);
+  EXPECT_EQ((size_t)3, count.send_msgs);
+
+  Process();
+  EXPECT_NE((size_t)0, count.recv_calls);
+  EXPECT_EQ((size_t)3, count.recv_msgs);
+  EXPECT_TRUE(result1.done_);
+  EXPECT_TRUE(result2.done_);
+  EXPECT_TRUE(result3.done_);
+  std::stringstream ss1;
+  ss1 << result1.host_;
+  EXPECT_EQ("{'www.google.com' aliases=[] addrs=[2.3.4.5]}", ss1.str());
+  std::stringstream ss2;
+  ss2 << result2.host_;
+  EXPECT_EQ("{'www.example.com' aliases=[] addrs=[1.2.3.4]}", ss2.str());
+  std::stringstream ss3;
+  ss3 << result3.host_;
+  EXPECT_EQ("{'www.google.com' aliases=[] addrs=[2.3.4.5]}", ss3.str());
+}
+#endif
+
 // UDP to TCP specific test
 TEST_P(MockUDPChannelTest, TruncationRetry) {
   DNSPacket rsptruncated;
@@ -197,6 +379,37 @@ TEST_P(MockUDPChannelTest, TruncationRetry) {
   EXPECT_EQ("{'www.google.com' aliases=[] addrs=[1.2.3.4]}", ss.str());
 }
 
+// Server ignores the advertised EDNS payload size, the oversized answer is
+// retried over TCP and later answers on the same socket are read in full
+TEST_P(MockUDPChannelTest, OversizedUDPAnswer) {
+  DNSPacket rsp;
+  rsp.set_response().set_aa()
+    .add_question(new DNSQuestion("www.google.com", T_A));
+  for (byte i = 0; i < 50; i++) {
+    rsp.add_answer(new DNSARR("www.google.com", 100, {10, 0, 0, i}));
+  }
+  EXPECT_LT((size_t)1400, rsp.data().size());
+  EXPECT_CALL(server_, OnRequest("www.google.com", T_A))
+    .Times(3)
+    .WillRepeatedly(SetReply(&server_, &rsp));
+
+  HostResult result1;
+  ares_gethostbyname(channel_, "www.google.com.", AF_INET, HostCallback,
+                     &result1);
+  Process();
+  EXPECT_TRUE(result1.done_);
+  EXPECT_EQ(ARES_SUCCESS, result1.status_);
+  EXPECT_EQ((size_t)50, result1.host_.addrs_.size());
+
+  HostResult result2;
+  ares_gethostbyname(channel_, "www.google.com.", AF_INET, HostCallback,
+                     &result2);
+  Process();
+  EXPECT_TRUE(result2.done_);
+  EXPECT_EQ(ARES_SUCCESS, result2.status_);
+  EXPECT_EQ((size_t)50, result2.host_.addrs_.size());
+}
+
 TEST_P(MockUDPChannelTest, UTF8BadName) {
   DNSPacket reply;
   reply.set_response().set_aa()
@@ -362,6 +575,44 @@ TEST_P(MockChannelTest, ServStateCallbackSuccess) {
   ares_free_string(exp_server_string);
 }
 
+TEST_P(MockChannelTest, ServerLatency) {
+  char        *server = ares_get_servers_csv(channel_);
+  unsigned int p50    = 0;
+  unsigned int p99    = 0;
+
+  EXPECT_EQ(ARES_ENODATA, ares_get_server_latency(channel_, server, 50, &p50));
+  EXPECT_EQ(ARES_EFORMERR, ares_get_server_latency(channel_, server, 0, &p50));
+  EXPECT_EQ(ARES_EFORMERR,
+            ares_get_server_latency(channel_, server, 101, &p50));
+  EXPECT_EQ(ARES_EFORMERR, ares_get_server_latency(channel_, NULL, 50, &p50));
+  EXPECT_EQ(ARES_ENOTFOUND,
+            ares_get_server_latency(channel_, "192.0.2.1:53", 50, &p50));
+
+  for (int i = 0; i < 4; i++) {
+    std::string name = "www" + std::to_string(i) + ".google.com";
+    DNSPacket   rsp;
+    rsp.set_response().set_aa()
+      .add_question(new DNSQuestion(name.c_str(), T_A))
+      .add_answer(new DNSARR(name.c_str(), 100, {2, 3, 4, 5}));
+    EXPECT_CALL(server_, OnRequest(name, T_A))
+      .WillOnce(SetReply(&server_, &rsp));
+
+    HostResult result;
+    ares_gethostbyname(channel_, name.c_str(), AF_INET, HostCallback,
+                       &result);
+    Process();
+    EXPECT_TRUE(result.done_);
+    EXPECT_EQ(ARES_SUCCESS, result.status_);
+  }
+
+  EXPECT_EQ(ARES_SUCCESS, ares_get_server_latency(channel_, server, 50, &p50));
+  EXPECT_EQ(ARES_SUCCESS, ares_get_server_latency(channel_, server, 99, &p99));
+  EXPECT_LT(0u, p50);
+  EXPECT_LE(p50, p99);
+
+  ares_free_string(server);
+}
+
 TEST_P(MockChannelTest, ServStateCallbackFailure) {
   // Set up the server response. The server always returns SERVFAIL.
   DNSPacket rsp;
@@ -393,6 +644,39 @@ TEST_P(MockChannelTest, ServStateCallbackFailure) {
   ares_free_string(exp_server_string);
 }
 
+TEST_P(MockChannelTest, SendOverlongLabel) {
+  // A label over 63 bytes can't be encoded, so the query must be rejected
+  // before it reaches a server, and no server may be blamed for it.
+  EXPECT_CALL(server_, OnRequest(testing::_, testing::_)).Times(0);
+
+  char *exp_server_string = ares_get_servers_csv(channel_);
+  ares_set_server_state_callback(channel_, ServerStateCallback,
+                                 &exp_server_string);
+  server_state_cb_success_count = 0;
+  server_state_cb_failure_count = 0;
+
+  std::string        name = std::string(64, 'a') + ".example.com";
+  ares_dns_record_t *dnsrec = NULL;
+  EXPECT_EQ(ARES_SUCCESS,
+    ares_dns_record_create(&dnsrec, 0, ARES_FLAG_RD, ARES_OPCODE_QUERY,
+      ARES_RCODE_NOERROR));
+  EXPECT_EQ(ARES_SUCCESS,
+    ares_dns_record_query_add(dnsrec, name.c_str(), ARES_REC_TYPE_A,
+      ARES_CLASS_IN));
+
+  QueryResult result;
+  EXPECT_EQ(ARES_EBADQUERY,
+            ares_send_dnsrec(channel_, dnsrec, QueryCallback, &result, NULL));
+  ares_dns_record_destroy(dnsrec);
+  Process();
+  EXPECT_TRUE(result.done_);
+  EXPECT_EQ(ARES_EBADQUERY, result.status_);
+  EXPECT_EQ(0, server_state_cb_success_count);
+  EXPECT_EQ(0, server_state_cb_failure_count);
+
+  ares_free_string(exp_server_string);
+}
+
 TEST_P(MockChannelTest, ServStateCallbackRecover) {
   // Set up the server response. The server initially times out, but then
   // returns successfully (with NXDOMAIN) on the first retry.
@@ -547,6 +831,30 @@ TEST_P(CacheQueriesTest, GetHostByNameCache) {
   EXPECT_EQ(1, sock_cb_count);
 }
 
+TEST_P(CacheQueriesTest, GetHostByNameCacheCaseInsensitive) {
+  DNSPacket rsp;
+  rsp.set_response().set_aa()
+    .add_question(new DNSQuestion("www.google.com", T_A))
+    .add_answer(new DNSARR("www.google.com", 100, {2, 3, 4, 5}));
+  EXPECT_CALL(server_, OnRequest("www.google.com", T_A))
+    .WillOnce(SetReply(&server_, &rsp));
+
+  HostResult result1;
+  ares_gethostbyname(channel_, "www.google.com.", AF_INET, HostCallback, &result1);
+  Process();
+  EXPECT_TRUE(result1.done_);
+
+  /* Differing case and lack of trailing dot must be served from cache */
+  HostResult result2;
+  ares_gethostbyname(channel_, "WWW.Google.COM", AF_INET, HostCallback, &result2);
+  Process();
+
+  std::stringstream ss;
+  EXPECT_TRUE(result2.done_);
+  ss << result2.host_;
+  EXPECT_EQ("{'www.google.com' aliases=[] addrs=[2.3.4.5]}", ss.str());
+}
+
 #define TCPPARALLELLOOKUPS 32
 TEST_P(MockTCPChannelTest, GetHostByNameParallelLookups) {
   DNSPacket rsp;
@@ -765,6 +1073,181 @@ TEST_P(MockNoCheckRespChannelTest, RefusedResponse) {
   EXPECT_EQ(ARES_EREFUSED, result.status_);
 }
 
+class MockCoalesceChannelTest : public MockFlagsChannelOptsTest {
+ public:
+  MockCoalesceChannelTest() : MockFlagsChannelOptsTest(ARES_FLAG_COALESCE) {}
+};
+
+#define COALESCELOOKUPS 16
+TEST_P(MockCoalesceChannelTest, IdenticalQueriesShareResponse) {
+  DNSPacket rsp;
+  rsp.set_response().set_aa()
+    .add_question(new DNSQuestion("www.google.com", T_A))
+    .add_answer(new DNSARR("www.google.com", 100, {2, 3, 4, 5}));
+  DNSPacket rsp6;
+  rsp6.set_response().set_aa()
+    .add_question(new DNSQuestion("www.google.com", T_AAAA))
+    .add_answer(new DNSAaaaRR("www.google.com", 100,
+                              {0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08,
+                               0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f, 0x10}));
+  // Only a single request per question should reach the server
+  EXPECT_CALL(server_, OnRequest("www.google.com", T_A))
+    .WillOnce(SetReply(&server_, &rsp));
+  EXPECT_CALL(server_, OnRequest("www.google.com", T_AAAA))
+    .WillOnce(SetReply(&server_, &rsp6));
+
+  HostResult result[COALESCELOOKUPS];
+  for (size_t i=0; i<COALESCELOOKUPS; i++) {
+    ares_gethostbyname(channel_, (i % 2) ? "www.google.com." : "WWW.Google.com.",
+                       AF_INET, HostCallback, &result[i]);
+  }
+  HostResult result6;
+  ares_gethostbyname(channel_, "www.google.com.", AF_INET6, HostCallback, &result6);
+  EXPECT_EQ(2, ares_queue_active_queries(channel_));
+
+  Process();
+
+  for (size_t i=0; i<COALESCELOOKUPS; i++) {
+    std::stringstream ss;
+    EXPECT_TRUE(result[i].done_);
+    ss << result[i].host_;
+    EXPECT_EQ("{'www.google.com' aliases=[] addrs=[2.3.4.5]}", ss.str());
+  }
+  EXPECT_TRUE(result6.done_);
+  EXPECT_EQ(ARES_SUCCESS, result6.status_);
+}
+
+TEST_P(MockCoalesceChannelTest, CancelCoalesced) {
+  DNSPacket rsp;
+  rsp.set_response().set_aa()
+    .add_question(new DNSQuestion("www.google.com", T_A))
+    .add_answer(new DNSARR("www.google.com", 100, {2, 3, 4, 5}));
+  ON_CALL(server_, OnRequest("www.google.com", T_A))
+    .WillByDefault(SetReply(&server_, &rsp));
+
+  HostResult result1;
+  ares_gethostbyname(channel_, "www.google.com.", AF_INET, HostCallback, &result1);
+  HostResult result2;
+  ares_gethostbyname(channel_, "www.google.com.", AF_INET, HostCallback, &result2);
+  ares_cancel(channel_);
+
+  EXPECT_TRUE(result1.done_);
+  EXPECT_EQ(ARES_ECANCELLED, result1.status_);
+  EXPECT_TRUE(result2.done_);
+  EXPECT_EQ(ARES_ECANCELLED, result2.status_);
+}
+
+class MockParallelSearchChannelTest : public MockFlagsChannelOptsTest {
+ public:
+  MockParallelSearchChannelTest()
+    : MockFlagsChannelOptsTest(ARES_FLAG_PARALLEL_SEARCH) {}
+};
+
+TEST_P(MockParallelSearchChannelTest, SearchDomainsInOrder) {
+  std::vector<byte> nothing;
+  DNSPacket nofirst;
+  nofirst.set_response().set_aa().set_rcode(NXDOMAIN)
+    .add_question(new DNSQuestion("www.first.com", T_A));
+  DNSPacket yessecond;
+  yessecond.set_response().set_aa()
+    .add_question(new DNSQuestion("www.second.org", T_A))
+    .add_answer(new DNSARR("www.second.org", 0x0200, {2, 3, 4, 5}));
+  DNSPacket yesthird;
+  yesthird.set_response().set_aa()
+    .add_question(new DNSQuestion("www.third.gov", T_A))
+    .add_answer(new DNSARR("www.third.gov", 0x0200, {6, 7, 8, 9}));
+  DNSPacket nobare;
+  nobare.set_response().set_aa().set_rcode(NXDOMAIN)
+    .add_question(new DNSQuestion("www", T_A));
+  // The first name only answers after a timeout, so the answers of later
+  // names must wait on it.  Every name is sent up front.
+  EXPECT_CALL(server_, OnRequest("www.first.com", T_A))
+    .WillOnce(SetReplyData(&server_, nothing))
+    .WillOnce(SetReply(&server_, &nofirst));
+  EXPECT_CALL(server_, OnRequest("www.second.org", T_A))
+    .WillOnce(SetReply(&server_, &yessecond));
+  EXPECT_CALL(server_, OnRequest("www.third.gov", T_A))
+    .WillOnce(SetReply(&server_, &yesthird));
+  EXPECT_CALL(server_, OnRequest("www", T_A))
+    .WillOnce(SetReply(&server_, &nobare));
+
+  HostResult result;
+  ares_gethostbyname(channel_, "www", AF_INET, HostCallback, &result);
+  EXPECT_EQ(4, ares_queue_active_queries(channel_));
+  Process();
+  EXPECT_TRUE(result.done_);
+  std::stringstream ss;
+  ss << result.host_;
+  EXPECT_EQ("{'www.second.org' aliases=[] addrs=[2.3.4.5]}", ss.str());
+}
+
+TEST_P(MockParallelSearchChannelTest, SearchCancelsRemaining) {
+  std::vector<byte> nothing;
+  DNSPacket yesfirst;
+  yesfirst.set_response().set_aa()
+    .add_question(new DNSQuestion("www.first.com", T_A))
+    .add_answer(new DNSARR("www.first.com", 0x0200, {2, 3, 4, 5}));
+  EXPECT_CALL(server_, OnRequest("www.first.com", T_A))
+    .WillOnce(SetReply(&server_, &yesfirst));
+  // Never answered, but cancelled before they could be retried
+  EXPECT_CALL(server_, OnRequest("www.second.org", T_A))
+    .Times(AtMost(1))
+    .WillRepeatedly(SetReplyData(&server_, nothing));
+  EXPECT_CALL(server_, OnRequest("www.third.gov", T_A))
+    .Times(AtMost(1))
+    .WillRepeatedly(SetReplyData(&server_, nothing));
+  EXPECT_CALL(server_, OnRequest("www", T_A))
+    .Times(AtMost(1))
+    .WillRepeatedly(SetReplyData(&server_, nothing));
+
+  SearchResult result;
+  ares_search(channel_, "www", C_IN, T_A, SearchCallback, &result);
+  Process();
+  EXPECT_TRUE(result.done_);
+  EXPECT_EQ(ARES_SUCCESS, result.status_);
+  EXPECT_EQ(0, result.timeouts_);
+  std::stringstream ss;
+  ss << PacketToString(result.data_);
+  EXPECT_EQ("RSP QRY AA NOERROR Q:{'www.first.com' IN A} "
+            "A:{'www.first.com' IN A TTL=512 2.3.4.5}",
+            ss.str());
+}
+
+TEST_P(MockParallelSearchChannelTest, SearchExhausted) {
+  DNSPacket nodata;
+  nodata.set_response().set_aa()
+    .add_question(new DNSQuestion("www.first.com", T_A));
+  ON_CALL(server_, OnRequest("www.first.com", T_A))
+    .WillByDefault(SetReply(&server_, &nodata));
+  DNSPacket nosecond;
+  nosecond.set_response().set_aa().set_rcode(NXDOMAIN)
+    .add_question(new DNSQuestion("www.second.org", T_A));
+  ON_CALL(server_, OnRequest("www.second.org", T_A))
+    .WillByDefault(SetReply(&server_, &nosecond));
+  DNSPacket nothird;
+  nothird.set_response().set_aa().set_rcode(NXDOMAIN)
+    .add_question(new DNSQuestion("www.third.gov", T_A));
+  ON_CALL(server_, OnRequest("www.third.gov", T_A))
+    .WillByDefault(SetReply(&server_, &nothird));
+  DNSPacket nobare;
+  nobare.set_response().set_aa().set_rcode(NXDOMAIN)
+    .add_question(new DNSQuestion("www", T_A));
+  ON_CALL(server_, OnRequest("www", T_A))
+    .WillByDefault(SetReply(&server_, &nobare));
+
+  SearchResult result;
+  ares_search(channel_, "www", C_IN, T_A, SearchCallback, &result);
+  Process();
+  EXPECT_TRUE(result.done_);
+  EXPECT_EQ(ARES_ENODATA, result.status_);
+
+  HostResult hresult;
+  ares_gethostbyname(channel_, "www", AF_INET, HostCallback, &hresult);
+  Process();
+  EXPECT_TRUE(hresult.done_);
+  EXPECT_EQ(ARES_ENODATA, hresult.status_);
+}
+
 class MockEDNSChannelTest : public MockFlagsChannelOptsTest {
  public:
   MockEDNSChannelTest() : MockFlagsChannelOptsTest(ARES_FLAG_EDNS) {}
@@ -964,6 +1447,54 @@ TEST_P(CacheQueriesTest, SearchDomainsCache) {
   EXPECT_EQ("{'www.third.gov' aliases=[] addrs=[2.3.4.5]}", sscache.str());
 }
 
+class CachePrefetchTest
+    : public MockChannelOptsTest,
+      public ::testing::WithParamInterface<int> {
+ public:
+  CachePrefetchTest()
+    : MockChannelOptsTest(1, GetParam(), false, false,
+                          FillOptions(&opts_),
+                          ARES_OPT_QUERY_CACHE|ARES_OPT_QCACHE_STALE) {}
+  static struct ares_options* FillOptions(struct ares_options * opts) {
+    memset(opts, 0, sizeof(struct ares_options));
+    opts->qcache_max_ttl      = 3600;
+    opts->qcache_stale_ttl    = 60;
+    opts->qcache_prefetch_pct = 100;
+    return opts;
+  }
+ private:
+  struct ares_options opts_;
+};
+
+TEST_P(CachePrefetchTest, RefreshOnHit) {
+  DNSPacket rsp;
+  rsp.set_response().set_aa()
+    .add_question(new DNSQuestion("www.google.com", T_A))
+    .add_answer(new DNSARR("www.google.com", 100, {2, 3, 4, 5}));
+  // Initial lookup plus the background refresh
+  EXPECT_CALL(server_, OnRequest("www.google.com", T_A))
+    .Times(2)
+    .WillRepeatedly(SetReply(&server_, &rsp));
+
+  HostResult result1;
+  ares_gethostbyname(channel_, "www.google.com.", AF_INET, HostCallback, &result1);
+  Process();
+  EXPECT_TRUE(result1.done_);
+
+  /* Served from cache immediately, with a refresh issued in the background */
+  HostResult result2;
+  ares_gethostbyname(channel_, "www.google.com.", AF_INET, HostCallback, &result2);
+  EXPECT_TRUE(result2.done_);
+  std::stringstream ss;
+  ss << result2.host_;
+  EXPECT_EQ("{'www.google.com' aliases=[] addrs=[2.3.4.5]}", ss.str());
+  Process();
+
+  EXPECT_EQ(1, ares_qcache_stat(channel_, ARES_QCACHE_STAT_REFRESHES));
+  EXPECT_EQ(1, ares_qcache_stat(channel_, ARES_QCACHE_STAT_HITS));
+  EXPECT_EQ(1, ares_qcache_stat(channel_, ARES_QCACHE_STAT_ENTRIES));
+}
+
 // Relies on retries so is UDP-only
 TEST_P(MockUDPChannelTest, SearchDomainsWithResentReply) {
   DNSPacket nofirst;
@@ -2350,6 +2881,103 @@ TEST_P(NoRotateMultiMockTest, ServerNoResponseFailover) {
 #  define SERVER_FAILOVER_RETRY_DELAY 330
 #endif
 
+class LatencySelectMultiMockTest : public MockMultiServerChannelTest {
+ public:
+  LatencySelectMultiMockTest()
+    : MockMultiServerChannelTest(FillOptions(&opts_),
+                                 ARES_OPT_SERVER_SELECTION) {}
+  static struct ares_options* FillOptions(struct ares_options *opts) {
+    memset(opts, 0, sizeof(struct ares_options));
+    opts->server_selection = ARES_SERVER_SELECT_LATENCY;
+    return opts;
+  }
+ private:
+  struct ares_options opts_;
+};
+
+#define LATENCYLOOKUPS 20
+
+TEST_P(LatencySelectMultiMockTest, AvoidSlowServer) {
+  DNSPacket okrsp;
+  okrsp.set_response().set_aa()
+    .add_question(new DNSQuestion("www.example.com", T_A))
+    .add_answer(new DNSARR("www.example.com", 100, {2,3,4,5}));
+
+  // Only keep servers #0 and #1 so every selection compares both of them
+  // rather than a random pair
+  char       *servers = ares_get_servers_csv(channel_);
+  std::string csv(servers);
+  ares_free_string(servers);
+  csv = csv.substr(0, csv.rfind(','));
+  EXPECT_EQ(ARES_SUCCESS, ares_set_servers_csv(channel_, csv.c_str()));
+
+  // Server #0 takes 50ms to answer, server #1 answers immediately.  Whichever
+  // is tried first, the other isn't measured yet so it's tried next.  From
+  // then on server #0 loses every comparison.
+  EXPECT_CALL(*servers_[0], OnRequest("www.example.com", T_A))
+    .WillOnce(DoAll(InvokeWithoutArgs([]() { ares_sleep_time(50); }),
+                    SetReply(servers_[0].get(), &okrsp)));
+  EXPECT_CALL(*servers_[1], OnRequest("www.example.com", T_A))
+    .Times(LATENCYLOOKUPS - 1)
+    .WillRepeatedly(SetReply(servers_[1].get(), &okrsp));
+  EXPECT_CALL(*servers_[2], OnRequest("www.example.com", T_A)).Times(0);
+
+  for (size_t i = 0; i < LATENCYLOOKUPS; i++) {
+    CheckExample();
+  }
+}
+
+class HedgeMultiMockTest : public MockMultiServerChannelTest {
+ public:
+  HedgeMultiMockTest()
+    : MockMultiServerChannelTest(FillOptions(&opts_),
+                                 ARES_OPT_HEDGE | ARES_OPT_NOROTATE) {}
+  static struct ares_options* FillOptions(struct ares_options *opts) {
+    memset(opts, 0, sizeof(struct ares_options));
+    opts->hedge_percentile = 50;
+    opts->hedge_max_pct = 100;
+    return opts;
+  }
+ private:
+  struct ares_options opts_;
+};
+
+TEST_P(HedgeMultiMockTest, SlowServerHedged) {
+  std::vector<byte> nothing;
+  DNSPacket okrsp;
+  okrsp.set_response().set_aa()
+    .add_question(new DNSQuestion("www.example.com", T_A))
+    .add_answer(new DNSARR("www.example.com", 100, {2,3,4,5}));
+
+  /* Server #1 answers enough queries to know its latency, then doesn't answer
+   * one, which must be hedged to server #2 rather than time out.  Not
+   * answering a hedged query doesn't count as a failure, so server #1 is still
+   * used afterwards. */
+  EXPECT_CALL(*servers_[0], OnRequest("www.example.com", T_A))
+    .WillOnce(SetReply(servers_[0].get(), &okrsp))
+    .WillOnce(SetReply(servers_[0].get(), &okrsp))
+    .WillOnce(SetReply(servers_[0].get(), &okrsp))
+    .WillOnce(SetReplyData(servers_[0].get(), nothing))
+    .WillOnce(SetReply(servers_[0].get(), &okrsp));
+  EXPECT_CALL(*servers_[1], OnRequest("www.example.com", T_A))
+    .WillOnce(SetReply(servers_[1].get(), &okrsp));
+
+  for (size_t i = 0; i < 3; i++) {
+    CheckExample();
+  }
+
+  HostResult result;
+  ares_gethostbyname(channel_, "www.example.com.", AF_INET, HostCallback, &result);
+  Process();
+  EXPECT_TRUE(result.done_);
+  EXPECT_EQ(0, result.timeouts_);
+  std::stringstream ss;
+  ss << result.host_;
+  EXPECT_EQ("{'www.example.com' aliases=[] addrs=[2.3.4.5]}", ss.str());
+
+  CheckExample();
+}
+
 class ServerFailoverOptsMultiMockTest
   : public MockChannelOptsTest,
     public ::testing::WithParamInterface< std::pair<int, bool> > {
@@ -2577,6 +3205,8 @@ INSTANTIATE_TEST_SUITE_P(AddressFamilies, MockUDPMaxQueriesTest, ::testing::Valu
 
 INSTANTIATE_TEST_SUITE_P(AddressFamilies, CacheQueriesTest, ::testing::ValuesIn(ares::test::families), PrintFamily);
 
+INSTANTIATE_TEST_SUITE_P(AddressFamilies, CachePrefetchTest, ::testing::ValuesIn(ares::test::families), PrintFamily);
+
 INSTANTIATE_TEST_SUITE_P(AddressFamilies, MockTCPChannelTest, ::testing::ValuesIn(ares::test::families), PrintFamily);
 
 INSTANTIATE_TEST_SUITE_P(AddressFamilies, MockExtraOptsTest, ::testing::ValuesIn(ares::test::families_modes), PrintFamilyMode);
@@ -2585,8 +3215,15 @@ INSTANTIATE_TEST_SUITE_P(AddressFamilies, MockNoCheckRespChannelTest, ::testing:
 
 INSTANTIATE_TEST_SUITE_P(AddressFamilies, MockEDNSChannelTest, ::testing::ValuesIn(ares::test::families_modes), PrintFamilyMode);
 
+INSTANTIATE_TEST_SUITE_P(AddressFamilies, MockCoalesceChannelTest, ::testing::ValuesIn(ares::test::families_modes), PrintFamilyMode);
+INSTANTIATE_TEST_SUITE_P(AddressFamilies, MockParallelSearchChannelTest, ::testing::ValuesIn(ares::test::families_modes), PrintFamilyMode);
+
 INSTANTIATE_TEST_SUITE_P(TransportModes, NoRotateMultiMockTest, ::testing::ValuesIn(ares::test::families_modes), PrintFamilyMode);
 
+INSTANTIATE_TEST_SUITE_P(TransportModes, LatencySelectMultiMockTest, ::testing::ValuesIn(ares::test::families_modes), PrintFamilyMode);
+
+INSTANTIATE_TEST_SUITE_P(TransportModes, HedgeMultiMockTest, ::testing::ValuesIn(ares::test::families_modes), PrintFamilyMode);
+
 INSTANTIATE_TEST_SUITE_P(TransportModes, ServerFailoverOptsMultiMockTest, ::testing::ValuesIn(ares::test::families_modes), PrintFamilyMode);
 
 }  // namespace test
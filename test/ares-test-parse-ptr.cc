@@ -241,7 +241,7 @@ TEST_F(LibraryTest, ParsePtrReplyAllocFailSome) {
   std::vector<byte> data = pkt.data();
   struct hostent *host = nullptr;
 
-  for (int ii = 1; ii <= 18; ii++) {
+  for (int ii = 1; ii <= 14; ii++) {
     ClearFails();
     SetAllocFail(ii);
     EXPECT_EQ(ARES_ENOMEM, ares_parse_ptr_reply(data.data(), (int)data.size(),
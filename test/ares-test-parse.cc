@@ -208,5 +208,151 @@ TEST_F(LibraryTest, ParseFullyCompressedName) {
 }
 
 
+TEST_F(LibraryTest, WriteCompressedNames) {
+  ares_dns_record_t *dnsrec = NULL;
+  ares_dns_rr_t     *rr     = NULL;
+  struct in_addr     addr;
+  unsigned char     *msg    = NULL;
+  size_t             msglen = 0;
+  const char        *names[] = { "www.example.com", "mail.example.com",
+                                 "WWW.example.com", "example.com" };
+  size_t             i;
+
+  addr.s_addr = htonl(0x01020304);
+
+  EXPECT_EQ(ARES_SUCCESS,
+            ares_dns_record_create(&dnsrec, 0x1234, ARES_FLAG_QR|ARES_FLAG_AA,
+                                   ARES_OPCODE_QUERY, ARES_RCODE_NOERROR));
+  EXPECT_EQ(ARES_SUCCESS,
+            ares_dns_record_query_add(dnsrec, "www.example.com",
+                                      ARES_REC_TYPE_A, ARES_CLASS_IN));
+  for (i = 0; i < sizeof(names) / sizeof(*names); i++) {
+    EXPECT_EQ(ARES_SUCCESS,
+              ares_dns_record_rr_add(&rr, dnsrec, ARES_SECTION_ANSWER,
+                                     names[i], ARES_REC_TYPE_A, ARES_CLASS_IN,
+                                     100));
+    EXPECT_EQ(ARES_SUCCESS, ares_dns_rr_set_addr(rr, ARES_RR_A_ADDR, &addr));
+  }
+
+  EXPECT_EQ(ARES_SUCCESS, ares_dns_write(dnsrec, &msg, &msglen));
+  ares_dns_record_destroy(dnsrec);
+
+  std::vector<byte> expected = {
+    0x12, 0x34,  // qid
+    0x84, // response + query + AA + not-TC + not-RD
+    0x00, // not-RA + not-Z + not-AD + not-CD + rc=NoError
+    0x00, 0x01,  // num questions
+    0x00, 0x04,  // num answer RRs
+    0x00, 0x00,  // num authority RRs
+    0x00, 0x00,  // num additional RRs
+    // Question
+    0x03, 'w', 'w', 'w',
+    0x07, 'e', 'x', 'a', 'm', 'p', 'l', 'e',
+    0x03, 'c', 'o', 'm',
+    0x00,
+    0x00, 0x01,  // type A
+    0x00, 0x01,  // class IN
+    // Answer 1
+    0xc0, 0x0c,  // offset 12
+    0x00, 0x01,  // RR type
+    0x00, 0x01,  // class IN
+    0x00, 0x00, 0x00, 0x64, // TTL
+    0x00, 0x04,  // rdata length
+    0x01, 0x02, 0x03, 0x04,
+    // Answer 2
+    0x04, 'm', 'a', 'i', 'l',
+    0xc0, 0x10,  // offset 16
+    0x00, 0x01,  // RR type
+    0x00, 0x01,  // class IN
+    0x00, 0x00, 0x00, 0x64, // TTL
+    0x00, 0x04,  // rdata length
+    0x01, 0x02, 0x03, 0x04,
+    // Answer 3, case preserved for DNS 0x20
+    0x03, 'W', 'W', 'W',
+    0xc0, 0x10,  // offset 16
+    0x00, 0x01,  // RR type
+    0x00, 0x01,  // class IN
+    0x00, 0x00, 0x00, 0x64, // TTL
+    0x00, 0x04,  // rdata length
+    0x01, 0x02, 0x03, 0x04,
+    // Answer 4
+    0xc0, 0x10,  // offset 16
+    0x00, 0x01,  // RR type
+    0x00, 0x01,  // class IN
+    0x00, 0x00, 0x00, 0x64, // TTL
+    0x00, 0x04,  // rdata length
+    0x01, 0x02, 0x03, 0x04,
+  };
+  std::vector<byte> actual(msg, msg + msglen);
+  EXPECT_EQ(expected, actual);
+  ares_free_string(msg);
+}
+
+TEST_F(LibraryTest, WriteCompressedNamesLarge) {
+  ares_dns_record_t *dnsrec = NULL;
+  ares_dns_record_t *parsed = NULL;
+  unsigned char     *msg    = NULL;
+  size_t             msglen = 0;
+  size_t             i;
+
+  EXPECT_EQ(ARES_SUCCESS,
+            ares_dns_record_create(&dnsrec, 0x1234, ARES_FLAG_QR|ARES_FLAG_AA,
+                                   ARES_OPCODE_QUERY, ARES_RCODE_NOERROR));
+  EXPECT_EQ(ARES_SUCCESS,
+            ares_dns_record_query_add(dnsrec, "example.com", ARES_REC_TYPE_TXT,
+                                      ARES_CLASS_IN));
+
+  // Push the message past the 16k reachable by compression pointers
+  for (i = 0; i < 200; i++) {
+    ares_dns_rr_t *rr = NULL;
+    std::string    name  = "host" + std::to_string(i) + ".example.com";
+    std::string    value(100, 'x');
+
+    EXPECT_EQ(ARES_SUCCESS,
+              ares_dns_record_rr_add(&rr, dnsrec, ARES_SECTION_ANSWER,
+                                     name.c_str(), ARES_REC_TYPE_TXT,
+                                     ARES_CLASS_IN, 100));
+    EXPECT_EQ(ARES_SUCCESS,
+              ares_dns_rr_add_abin(rr, ARES_RR_TXT_DATA,
+                                   (const unsigned char *)value.data(),
+                                   value.size()));
+  }
+
+  // Names first written beyond 16k can't be the target of a later jump
+  const char *late[] = { "late.example.net", "www.late.example.net" };
+  for (i = 0; i < sizeof(late) / sizeof(*late); i++) {
+    ares_dns_rr_t *rr = NULL;
+    EXPECT_EQ(ARES_SUCCESS,
+              ares_dns_record_rr_add(&rr, dnsrec, ARES_SECTION_ANSWER, late[i],
+                                     ARES_REC_TYPE_CNAME, ARES_CLASS_IN, 100));
+    EXPECT_EQ(ARES_SUCCESS,
+              ares_dns_rr_set_str(rr, ARES_RR_CNAME_CNAME, "late.example.net"));
+  }
+
+  EXPECT_EQ(ARES_SUCCESS, ares_dns_write(dnsrec, &msg, &msglen));
+  EXPECT_LT((size_t)0x3FFF, msglen);
+
+  EXPECT_EQ(ARES_SUCCESS, ares_dns_parse(msg, msglen, 0, &parsed));
+  ares_free_string(msg);
+  ASSERT_NE(nullptr, parsed);
+  EXPECT_EQ((size_t)202, ares_dns_record_rr_cnt(parsed, ARES_SECTION_ANSWER));
+  for (i = 0; i < 200; i++) {
+    std::string name = "host" + std::to_string(i) + ".example.com";
+    EXPECT_EQ(name, std::string(ares_dns_rr_get_name(
+                      ares_dns_record_rr_get(parsed, ARES_SECTION_ANSWER, i))));
+  }
+  for (i = 0; i < sizeof(late) / sizeof(*late); i++) {
+    const ares_dns_rr_t *rr =
+      ares_dns_record_rr_get(parsed, ARES_SECTION_ANSWER, 200 + i);
+    EXPECT_EQ(std::string(late[i]), std::string(ares_dns_rr_get_name(rr)));
+    EXPECT_EQ(std::string("late.example.net"),
+              std::string(ares_dns_rr_get_str(rr, ARES_RR_CNAME_CNAME)));
+  }
+
+  ares_dns_record_destroy(parsed);
+  ares_dns_record_destroy(dnsrec);
+}
+
+
 }  // namespace test
 }  // namespace ares
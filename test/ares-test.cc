@@ -109,6 +109,10 @@ const std::vector<std::tuple<ares_evsys_t, int, bool>> all_evsys_ipv4_family_bot
   std::make_tuple<ares_evsys_t, int, bool>(ARES_EVSYS_EPOLL, AF_INET, false),
   std::make_tuple<ares_evsys_t, int, bool>(ARES_EVSYS_EPOLL, AF_INET, true),
 #endif
+#ifdef HAVE_IO_URING
+  std::make_tuple<ares_evsys_t, int, bool>(ARES_EVSYS_IOURING, AF_INET, false),
+  std::make_tuple<ares_evsys_t, int, bool>(ARES_EVSYS_IOURING, AF_INET, true),
+#endif
 #ifdef HAVE_POLL
   std::make_tuple<ares_evsys_t, int, bool>(ARES_EVSYS_POLL, AF_INET, false),
   std::make_tuple<ares_evsys_t, int, bool>(ARES_EVSYS_POLL, AF_INET, true),
@@ -132,6 +136,10 @@ const std::vector<std::tuple<ares_evsys_t, int, bool>> all_evsys_ipv6_family_bot
   std::make_tuple<ares_evsys_t, int, bool>(ARES_EVSYS_EPOLL, AF_INET6, false),
   std::make_tuple<ares_evsys_t, int, bool>(ARES_EVSYS_EPOLL, AF_INET6, true),
 #endif
+#ifdef HAVE_IO_URING
+  std::make_tuple<ares_evsys_t, int, bool>(ARES_EVSYS_IOURING, AF_INET6, false),
+  std::make_tuple<ares_evsys_t, int, bool>(ARES_EVSYS_IOURING, AF_INET6, true),
+#endif
 #ifdef HAVE_POLL
   std::make_tuple<ares_evsys_t, int, bool>(ARES_EVSYS_POLL, AF_INET6, false),
   std::make_tuple<ares_evsys_t, int, bool>(ARES_EVSYS_POLL, AF_INET6, true),
@@ -161,6 +169,12 @@ const std::vector<std::tuple<ares_evsys_t, int, bool>> all_evsys_both_families_b
   std::make_tuple<ares_evsys_t, int, bool>(ARES_EVSYS_EPOLL, AF_INET6, false),
   std::make_tuple<ares_evsys_t, int, bool>(ARES_EVSYS_EPOLL, AF_INET6, true),
 #endif
+#ifdef HAVE_IO_URING
+  std::make_tuple<ares_evsys_t, int, bool>(ARES_EVSYS_IOURING, AF_INET, false),
+  std::make_tuple<ares_evsys_t, int, bool>(ARES_EVSYS_IOURING, AF_INET, true),
+  std::make_tuple<ares_evsys_t, int, bool>(ARES_EVSYS_IOURING, AF_INET6, false),
+  std::make_tuple<ares_evsys_t, int, bool>(ARES_EVSYS_IOURING, AF_INET6, true),
+#endif
 #ifdef HAVE_POLL
   std::make_tuple<ares_evsys_t, int, bool>(ARES_EVSYS_POLL, AF_INET, false),
   std::make_tuple<ares_evsys_t, int, bool>(ARES_EVSYS_POLL, AF_INET, true),
@@ -189,6 +203,9 @@ const std::vector<std::tuple<ares_evsys_t, int>> all_evsys_ipv4_family = {
 #ifdef HAVE_EPOLL
   std::make_tuple<ares_evsys_t, int>(ARES_EVSYS_EPOLL, AF_INET),
 #endif
+#ifdef HAVE_IO_URING
+  std::make_tuple<ares_evsys_t, int>(ARES_EVSYS_IOURING, AF_INET),
+#endif
 #ifdef HAVE_POLL
   std::make_tuple<ares_evsys_t, int>(ARES_EVSYS_POLL, AF_INET),
 #endif
@@ -207,6 +224,9 @@ const std::vector<std::tuple<ares_evsys_t, int>> all_evsys_ipv6_family = {
 #ifdef HAVE_EPOLL
   std::make_tuple<ares_evsys_t, int>(ARES_EVSYS_EPOLL, AF_INET6),
 #endif
+#ifdef HAVE_IO_URING
+  std::make_tuple<ares_evsys_t, int>(ARES_EVSYS_IOURING, AF_INET6),
+#endif
 #ifdef HAVE_POLL
   std::make_tuple<ares_evsys_t, int>(ARES_EVSYS_POLL, AF_INET6),
 #endif
@@ -228,6 +248,10 @@ const std::vector<std::tuple<ares_evsys_t, int>> all_evsys_both_families = {
   std::make_tuple<ares_evsys_t, int>(ARES_EVSYS_EPOLL, AF_INET),
   std::make_tuple<ares_evsys_t, int>(ARES_EVSYS_EPOLL, AF_INET6),
 #endif
+#ifdef HAVE_IO_URING
+  std::make_tuple<ares_evsys_t, int>(ARES_EVSYS_IOURING, AF_INET),
+  std::make_tuple<ares_evsys_t, int>(ARES_EVSYS_IOURING, AF_INET6),
+#endif
 #ifdef HAVE_POLL
   std::make_tuple<ares_evsys_t, int>(ARES_EVSYS_POLL, AF_INET),
   std::make_tuple<ares_evsys_t, int>(ARES_EVSYS_POLL, AF_INET6),
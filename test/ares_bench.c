@@ -0,0 +1,936 @@
+/* MIT License
+ *
+ * Copyright (c) The c-ares project and its contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+/* This program contains micro-benchmarks for internal data structures and
+ * hot paths.  It is not run as part of the test suite as results are only
+ * meaningful on a quiet machine.  Run without arguments to execute all
+ * benchmarks, or pass the names of the benchmarks to run. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ares_private.h"
+
+#ifndef CARES_SYMBOL_HIDING
+
+#  define BENCH_NAMES      10000
+#  define BENCH_ITERATIONS 1000000
+#  define BENCH_UDP_BURST  32
+#  define BENCH_UDP_ROUNDS 1000
+#  define BENCH_HOSTS      200000
+#  define BENCH_TIMERS     100000
+#  define BENCH_TIMER_MS   5000
+
+/* Allocator wrappers tracking the number of bytes currently allocated and
+ * the number of allocator calls made */
+static size_t bench_mem_live   = 0;
+static size_t bench_mem_allocs = 0;
+
+#  define BENCH_MEM_HDR 16
+
+static void *bench_malloc(size_t size)
+{
+  unsigned char *ptr = malloc(size + BENCH_MEM_HDR);
+  if (ptr == NULL) {
+    return NULL;
+  }
+  memcpy(ptr, &size, sizeof(size));
+  bench_mem_live += size;
+  bench_mem_allocs++;
+  return ptr + BENCH_MEM_HDR;
+}
+
+static void bench_free(void *ptr)
+{
+  size_t size;
+
+  if (ptr == NULL) {
+    return;
+  }
+  memcpy(&size, (unsigned char *)ptr - BENCH_MEM_HDR, sizeof(size));
+  bench_mem_live -= size;
+  free((unsigned char *)ptr - BENCH_MEM_HDR);
+}
+
+static void *bench_realloc(void *ptr, size_t size)
+{
+  unsigned char *newptr;
+  size_t         oldsize = 0;
+
+  if (ptr == NULL) {
+    return bench_malloc(size);
+  }
+
+  memcpy(&oldsize, (unsigned char *)ptr - BENCH_MEM_HDR, sizeof(oldsize));
+  newptr = realloc((unsigned char *)ptr - BENCH_MEM_HDR, size + BENCH_MEM_HDR);
+  if (newptr == NULL) {
+    return NULL;
+  }
+  memcpy(newptr, &size, sizeof(size));
+  bench_mem_live = bench_mem_live - oldsize + size;
+  bench_mem_allocs++;
+  return newptr + BENCH_MEM_HDR;
+}
+
+static double bench_elapsed_ns(const ares_timeval_t *start, size_t count)
+{
+  ares_timeval_t end;
+  ares_timeval_t diff;
+
+  ares_tvnow(&end);
+  ares_timeval_diff(&diff, start, &end);
+
+  return (((double)diff.sec * 1000000000.0) + ((double)diff.usec * 1000.0)) /
+         (double)count;
+}
+
+static ares_dns_record_t *bench_qcache_request(size_t idx)
+{
+  ares_dns_record_t *dnsrec = NULL;
+  char               name[64];
+
+  snprintf(name, sizeof(name), "host%u.example.com", (unsigned int)idx);
+
+  if (ares_dns_record_create(&dnsrec, 0, ARES_FLAG_RD, ARES_OPCODE_QUERY,
+                             ARES_RCODE_NOERROR) != ARES_SUCCESS ||
+      ares_dns_record_query_add(dnsrec, name, ARES_REC_TYPE_A,
+                                ARES_CLASS_IN) != ARES_SUCCESS) {
+    ares_dns_record_destroy(dnsrec);
+    return NULL;
+  }
+
+  return dnsrec;
+}
+
+static ares_dns_record_t *bench_qcache_response(const ares_dns_record_t *req)
+{
+  ares_dns_record_t *dnsrec = NULL;
+  ares_dns_rr_t     *rr     = NULL;
+  const char        *name   = NULL;
+  struct in_addr     addr;
+
+  addr.s_addr = htonl(0x7F000001);
+
+  if (ares_dns_record_query_get(req, 0, &name, NULL, NULL) != ARES_SUCCESS ||
+      ares_dns_record_create(&dnsrec, 0, ARES_FLAG_QR | ARES_FLAG_RD,
+                             ARES_OPCODE_QUERY,
+                             ARES_RCODE_NOERROR) != ARES_SUCCESS ||
+      ares_dns_record_query_add(dnsrec, name, ARES_REC_TYPE_A,
+                                ARES_CLASS_IN) != ARES_SUCCESS ||
+      ares_dns_record_rr_add(&rr, dnsrec, ARES_SECTION_ANSWER, name,
+                             ARES_REC_TYPE_A, ARES_CLASS_IN,
+                             3600) != ARES_SUCCESS ||
+      ares_dns_rr_set_addr(rr, ARES_RR_A_ADDR, &addr) != ARES_SUCCESS) {
+    ares_dns_record_destroy(dnsrec);
+    return NULL;
+  }
+
+  return dnsrec;
+}
+
+/* Reference implementation of the original pipe-delimited string key used by
+ * the query cache, used for comparison purposes */
+static char *bench_qcache_strkey(const ares_dns_record_t *dnsrec)
+{
+  ares_buf_t         *buf = ares_buf_create();
+  const char         *name;
+  size_t              name_len;
+  ares_dns_rec_type_t qtype;
+  ares_dns_class_t    qclass;
+  ares_dns_flags_t    flags = ares_dns_record_get_flags(dnsrec);
+
+  if (buf == NULL ||
+      ares_dns_record_query_get(dnsrec, 0, &name, &qtype, &qclass) !=
+        ARES_SUCCESS) {
+    ares_buf_destroy(buf);
+    return NULL;
+  }
+
+  name_len = ares_strlen(name);
+  if (name_len && name[name_len - 1] == '.') {
+    name_len--;
+  }
+
+  if (ares_buf_append_str(
+        buf, ares_dns_opcode_tostr(ares_dns_record_get_opcode(dnsrec))) !=
+        ARES_SUCCESS ||
+      ares_buf_append_byte(buf, '|') != ARES_SUCCESS ||
+      ((flags & ARES_FLAG_RD) && ares_buf_append_str(buf, "rd")) ||
+      ((flags & ARES_FLAG_CD) && ares_buf_append_str(buf, "cd")) ||
+      ares_buf_append_byte(buf, '|') != ARES_SUCCESS ||
+      ares_buf_append_str(buf, ares_dns_rec_type_tostr(qtype)) !=
+        ARES_SUCCESS ||
+      ares_buf_append_byte(buf, '|') != ARES_SUCCESS ||
+      ares_buf_append_str(buf, ares_dns_class_tostr(qclass)) != ARES_SUCCESS ||
+      ares_buf_append_byte(buf, '|') != ARES_SUCCESS ||
+      ares_buf_append(buf, (const unsigned char *)name, name_len) !=
+        ARES_SUCCESS) {
+    ares_buf_destroy(buf);
+    return NULL;
+  }
+
+  return ares_buf_finish_str(buf, NULL);
+}
+
+static ares_status_t bench_qcache(void)
+{
+  struct ares_options   options;
+  ares_channel_t       *channel = NULL;
+  ares_dns_record_t   **reqs    = NULL;
+  ares_htable_strvp_t  *strvp   = NULL;
+  ares_status_t         status  = ARES_ENOMEM;
+  ares_timeval_t        now;
+  ares_timeval_t        start;
+  size_t                i;
+  size_t                hits = 0;
+
+  memset(&options, 0, sizeof(options));
+  options.qcache_max_ttl = 3600;
+  if (ares_init_options(&channel, &options, ARES_OPT_QUERY_CACHE) !=
+        ARES_SUCCESS ||
+      ares_set_servers_csv(channel, "127.0.0.1") != ARES_SUCCESS) {
+    goto done;
+  }
+
+  reqs  = ares_malloc_zero(sizeof(*reqs) * BENCH_NAMES);
+  strvp = ares_htable_strvp_create(NULL);
+  if (reqs == NULL || strvp == NULL) {
+    goto done;
+  }
+
+  ares_tvnow(&now);
+  for (i = 0; i < BENCH_NAMES; i++) {
+    ares_query_t       query;
+    ares_dns_record_t *resp;
+    unsigned char     *abuf = NULL;
+    size_t             alen = 0;
+    char              *key;
+
+    reqs[i] = bench_qcache_request(i);
+    resp    = reqs[i] == NULL ? NULL : bench_qcache_response(reqs[i]);
+    if (resp == NULL) {
+      goto done;
+    }
+
+    if (ares_dns_write(resp, &abuf, &alen) != ARES_SUCCESS) {
+      ares_dns_record_destroy(resp);
+      goto done;
+    }
+
+    memset(&query, 0, sizeof(query));
+    query.query = reqs[i];
+    ares_qcache_insert(channel, &now, &query, resp, abuf, alen);
+    ares_free(abuf);
+
+    key = bench_qcache_strkey(reqs[i]);
+    if (key == NULL || !ares_htable_strvp_insert(strvp, key, resp)) {
+      ares_free(key);
+      ares_dns_record_destroy(resp);
+      goto done;
+    }
+    ares_free(key);
+    ares_dns_record_destroy(resp);
+  }
+
+  ares_tvnow(&start);
+  for (i = 0; i < BENCH_ITERATIONS; i++) {
+    char *key = bench_qcache_strkey(reqs[i % BENCH_NAMES]);
+    if (ares_htable_strvp_get_direct(strvp, key) != NULL) {
+      hits++;
+    }
+    ares_free(key);
+  }
+  printf("qcache: string key hit:  %8.1f ns/op (%u hits)\n",
+         bench_elapsed_ns(&start, BENCH_ITERATIONS), (unsigned int)hits);
+
+  hits = 0;
+  ares_tvnow(&start);
+  for (i = 0; i < BENCH_ITERATIONS; i++) {
+    const ares_dns_record_t *resp = NULL;
+    if (ares_qcache_fetch(channel, &now, reqs[i % BENCH_NAMES], &resp) ==
+        ARES_SUCCESS) {
+      hits++;
+    }
+  }
+  printf("qcache: binary key hit:  %8.1f ns/op (%u hits)\n",
+         bench_elapsed_ns(&start, BENCH_ITERATIONS), (unsigned int)hits);
+
+  status = ARES_SUCCESS;
+
+done:
+  if (reqs != NULL) {
+    for (i = 0; i < BENCH_NAMES; i++) {
+      ares_dns_record_destroy(reqs[i]);
+    }
+  }
+  ares_free(reqs);
+  ares_htable_strvp_destroy(strvp);
+  ares_destroy(channel);
+  return status;
+}
+
+static ares_status_t bench_dnswrite(void)
+{
+  ares_dns_record_t *dnsrec = NULL;
+  ares_status_t      status;
+  ares_timeval_t     start;
+  struct in_addr     addr;
+  size_t             i;
+
+  addr.s_addr = htonl(0x7F000001);
+
+  /* Large synthesized answer, every name shares a suffix with the question */
+  status = ares_dns_record_create(&dnsrec, 0, ARES_FLAG_QR | ARES_FLAG_RD,
+                                  ARES_OPCODE_QUERY, ARES_RCODE_NOERROR);
+  if (status == ARES_SUCCESS) {
+    status = ares_dns_record_query_add(dnsrec, "example.com", ARES_REC_TYPE_A,
+                                       ARES_CLASS_IN);
+  }
+  for (i = 0; status == ARES_SUCCESS && i < 1000; i++) {
+    ares_dns_rr_t *rr = NULL;
+    char           name[64];
+
+    snprintf(name, sizeof(name), "host%u.sub%u.example.com", (unsigned int)i,
+             (unsigned int)(i % 10));
+    status = ares_dns_record_rr_add(&rr, dnsrec, ARES_SECTION_ANSWER, name,
+                                    ARES_REC_TYPE_A, ARES_CLASS_IN, 3600);
+    if (status == ARES_SUCCESS) {
+      status = ares_dns_rr_set_addr(rr, ARES_RR_A_ADDR, &addr);
+    }
+  }
+  if (status != ARES_SUCCESS) {
+    goto done;
+  }
+
+  ares_tvnow(&start);
+  for (i = 0; i < 1000; i++) {
+    unsigned char *msg = NULL;
+    size_t         len = 0;
+
+    status = ares_dns_write(dnsrec, &msg, &len);
+    ares_free(msg);
+    if (status != ARES_SUCCESS) {
+      goto done;
+    }
+  }
+  printf("dnswrite: 1000 names:    %8.1f ns/op\n",
+         bench_elapsed_ns(&start, 1000));
+
+done:
+  ares_dns_record_destroy(dnsrec);
+  return status;
+}
+
+static ares_status_t bench_dnsparse_run(const unsigned char *msg, size_t len,
+                                        unsigned int flags, const char *label)
+{
+  ares_timeval_t start;
+  size_t         allocs = bench_mem_allocs;
+  size_t         i;
+
+  ares_tvnow(&start);
+  for (i = 0; i < 10000; i++) {
+    ares_dns_record_t *dnsrec = NULL;
+    ares_status_t      status = ares_dns_parse(msg, len, flags, &dnsrec);
+
+    ares_dns_record_destroy(dnsrec);
+    if (status != ARES_SUCCESS) {
+      return status;
+    }
+  }
+  printf("dnsparse: %-14s %8.1f ns/op  %5.1f allocs/op\n", label,
+         bench_elapsed_ns(&start, 10000),
+         (double)(bench_mem_allocs - allocs) / 10000.0);
+  return ARES_SUCCESS;
+}
+
+static ares_status_t bench_dnsparse(void)
+{
+  ares_dns_record_t *dnsrec = NULL;
+  ares_dns_rr_t     *rr     = NULL;
+  unsigned char     *msg    = NULL;
+  size_t             len    = 0;
+  ares_status_t      status;
+  struct in_addr     addr;
+  size_t             i;
+
+  addr.s_addr = htonl(0x7F000001);
+
+  /* Typical recursive answer: a CNAME chain, addresses and an OPT RR */
+  status = ares_dns_record_create(&dnsrec, 0, ARES_FLAG_QR | ARES_FLAG_RD,
+                                  ARES_OPCODE_QUERY, ARES_RCODE_NOERROR);
+  if (status == ARES_SUCCESS) {
+    status = ares_dns_record_query_add(dnsrec, "www.example.com",
+                                       ARES_REC_TYPE_A, ARES_CLASS_IN);
+  }
+  if (status == ARES_SUCCESS) {
+    status = ares_dns_record_rr_add(&rr, dnsrec, ARES_SECTION_ANSWER,
+                                    "www.example.com", ARES_REC_TYPE_CNAME,
+                                    ARES_CLASS_IN, 300);
+  }
+  if (status == ARES_SUCCESS) {
+    status =
+      ares_dns_rr_set_str(rr, ARES_RR_CNAME_CNAME, "edge.cdn.example.net");
+  }
+  for (i = 0; status == ARES_SUCCESS && i < 8; i++) {
+    status = ares_dns_record_rr_add(&rr, dnsrec, ARES_SECTION_ANSWER,
+                                    "edge.cdn.example.net", ARES_REC_TYPE_A,
+                                    ARES_CLASS_IN, 60);
+    if (status == ARES_SUCCESS) {
+      status = ares_dns_rr_set_addr(rr, ARES_RR_A_ADDR, &addr);
+    }
+  }
+  if (status == ARES_SUCCESS) {
+    status = ares_dns_record_rr_add(&rr, dnsrec, ARES_SECTION_ADDITIONAL, "",
+                                    ARES_REC_TYPE_OPT, ARES_CLASS_IN, 0);
+  }
+  if (status == ARES_SUCCESS) {
+    status = ares_dns_rr_set_u16(rr, ARES_RR_OPT_UDP_SIZE, 1232);
+  }
+  if (status == ARES_SUCCESS) {
+    status = ares_dns_write(dnsrec, &msg, &len);
+  }
+  if (status != ARES_SUCCESS) {
+    goto done;
+  }
+
+  status = bench_dnsparse_run(msg, len, 0, "heap:");
+  if (status != ARES_SUCCESS) {
+    goto done;
+  }
+  status = bench_dnsparse_run(msg, len, ARES_DNS_PARSE_ARENA, "arena:");
+
+done:
+  ares_free(msg);
+  ares_dns_record_destroy(dnsrec);
+  return status;
+}
+
+/* Wraps the default socket functions to count the system calls used to
+ * exchange datagrams with the loopback responder */
+typedef struct {
+  struct ares_socket_functions_ex funcs;
+  ares_socket_t                   fd;
+  size_t                          send_calls;
+  size_t                          recv_calls;
+} bench_udp_t;
+
+static ares_socket_t bench_udp_asocket(int domain, int type, int protocol,
+                                       void *user_data)
+{
+  bench_udp_t *bench = user_data;
+  bench->fd = bench->funcs.asocket(domain, type, protocol, NULL);
+  return bench->fd;
+}
+
+static ares_ssize_t bench_udp_arecvfrom(ares_socket_t sock, void *buffer,
+                                        size_t length, int flags,
+                                        struct sockaddr *address,
+                                        ares_socklen_t  *address_len,
+                                        void            *user_data)
+{
+  bench_udp_t *bench = user_data;
+  bench->recv_calls++;
+  return bench->funcs.arecvfrom(sock, buffer, length, flags, address,
+                                address_len, NULL);
+}
+
+static ares_ssize_t bench_udp_asendto(ares_socket_t sock, const void *buffer,
+                                      size_t length, int flags,
+                                      const struct sockaddr *address,
+                                      ares_socklen_t address_len,
+                                      void          *user_data)
+{
+  bench_udp_t *bench = user_data;
+  bench->send_calls++;
+  return bench->funcs.asendto(sock, buffer, length, flags, address,
+                              address_len, NULL);
+}
+
+static ares_ssize_t bench_udp_asendmmsg(ares_socket_t            sock,
+                                        const ares_socket_msg_t *msgs,
+                                        size_t cnt, int flags, void *user_data)
+{
+  bench_udp_t *bench = user_data;
+  bench->send_calls++;
+  return bench->funcs.asendmmsg(sock, msgs, cnt, flags, NULL);
+}
+
+static ares_ssize_t bench_udp_arecvmmsg(ares_socket_t      sock,
+                                        ares_socket_msg_t *msgs, size_t cnt,
+                                        int flags, void *user_data)
+{
+  bench_udp_t *bench = user_data;
+  bench->recv_calls++;
+  return bench->funcs.arecvmmsg(sock, msgs, cnt, flags, NULL);
+}
+
+static void bench_udp_pending_write(void *data)
+{
+  (void)data;
+}
+
+static void bench_udp_cb(void *arg, ares_status_t status, size_t timeouts,
+                         const ares_dns_record_t *dnsrec)
+{
+  size_t *answers = arg;
+  (void)timeouts;
+  if (status == ARES_SUCCESS && dnsrec != NULL) {
+    (*answers)++;
+  }
+}
+
+/* Answer every pending query with an empty response by echoing the header
+ * and question back with the QR bit set */
+static void bench_udp_respond(const bench_udp_t *bench, ares_socket_t fd)
+{
+  unsigned char           buf[512];
+  struct sockaddr_storage from;
+
+  while (1) {
+    ares_socklen_t from_len = sizeof(from);
+    ares_ssize_t   len =
+      bench->funcs.arecvfrom(fd, buf, sizeof(buf), 0, (struct sockaddr *)&from,
+                             &from_len, NULL);
+    size_t pos = 12;
+
+    if (len <= 12) {
+      return;
+    }
+
+    while (pos < (size_t)len && buf[pos] != 0) {
+      pos += (size_t)buf[pos] + 1;
+    }
+    pos += 1 + 4;
+    if (pos > (size_t)len) {
+      continue;
+    }
+
+    buf[2] |= 0x80;
+    memset(buf + 6, 0, 6);
+    bench->funcs.asendto(fd, buf, pos, 0, (struct sockaddr *)&from, from_len,
+                         NULL);
+  }
+}
+
+static ares_status_t bench_udp_run(ares_bool_t batch)
+{
+  struct ares_options             options;
+  struct ares_socket_functions_ex funcs;
+  struct sockaddr_in              sin;
+  ares_socklen_t                  sin_len = sizeof(sin);
+  ares_channel_t                 *channel = NULL;
+  ares_socket_t                   server  = ARES_SOCKET_BAD;
+  bench_udp_t                     bench;
+  ares_status_t                   status = ARES_ENOMEM;
+  char                            csv[64];
+  size_t                          answers = 0;
+  size_t                          allocs  = 0;
+  size_t                          before;
+  size_t                          i;
+  size_t                          j;
+
+  memset(&bench, 0, sizeof(bench));
+  bench.fd = ARES_SOCKET_BAD;
+
+  /* Disable the cache so every query hits the wire */
+  memset(&options, 0, sizeof(options));
+  options.qcache_max_ttl = 0;
+  if (ares_init_options(&channel, &options, ARES_OPT_QUERY_CACHE) !=
+      ARES_SUCCESS) {
+    goto done;
+  }
+
+  memcpy(&bench.funcs, &channel->sock_funcs, sizeof(bench.funcs));
+  memcpy(&funcs, &channel->sock_funcs, sizeof(funcs));
+  funcs.asocket   = bench_udp_asocket;
+  funcs.arecvfrom = bench_udp_arecvfrom;
+  funcs.asendto   = bench_udp_asendto;
+  funcs.asendmmsg = NULL;
+  funcs.arecvmmsg = NULL;
+  if (batch) {
+    if (bench.funcs.asendmmsg == NULL || bench.funcs.arecvmmsg == NULL) {
+      printf("udp: batched:    not supported\n");
+      status = ARES_SUCCESS;
+      goto done;
+    }
+    funcs.asendmmsg = bench_udp_asendmmsg;
+    funcs.arecvmmsg = bench_udp_arecvmmsg;
+  }
+  ares_set_socket_functions_ex(channel, &funcs, &bench);
+  ares_set_pending_write_cb(channel, bench_udp_pending_write, NULL);
+
+  memset(&sin, 0, sizeof(sin));
+  sin.sin_family      = AF_INET;
+  sin.sin_addr.s_addr = htonl(0x7F000001);
+  server              = bench.funcs.asocket(AF_INET, SOCK_DGRAM, 0, NULL);
+  if (server == ARES_SOCKET_BAD ||
+      bench.funcs.abind(server, 0, (struct sockaddr *)&sin, sizeof(sin),
+                        NULL) != 0 ||
+      bench.funcs.agetsockname(server, (struct sockaddr *)&sin, &sin_len,
+                               NULL) != 0) {
+    status = ARES_ECONNREFUSED;
+    goto done;
+  }
+
+  snprintf(csv, sizeof(csv), "127.0.0.1:%u", (unsigned int)ntohs(sin.sin_port));
+  if (ares_set_servers_ports_csv(channel, csv) != ARES_SUCCESS) {
+    goto done;
+  }
+
+  for (i = 0; i < BENCH_UDP_ROUNDS; i++) {
+    for (j = 0; j < BENCH_UDP_BURST; j++) {
+      ares_dns_record_t *req = bench_qcache_request((i * BENCH_UDP_BURST) + j);
+      if (req == NULL) {
+        goto done;
+      }
+      before = bench_mem_allocs;
+      status = ares_send_dnsrec(channel, req, bench_udp_cb, &answers, NULL);
+      allocs += bench_mem_allocs - before;
+      ares_dns_record_destroy(req);
+      if (status != ARES_SUCCESS) {
+        goto done;
+      }
+    }
+
+    before = bench_mem_allocs;
+    ares_process_pending_write(channel);
+    allocs += bench_mem_allocs - before;
+    bench_udp_respond(&bench, server);
+    before = bench_mem_allocs;
+    ares_process_fd(channel, bench.fd, ARES_SOCKET_BAD);
+    allocs += bench_mem_allocs - before;
+  }
+
+  printf("udp: %s %5.2f send, %5.2f recv syscalls/answer (%u answers)\n",
+         batch ? "batched:   " : "per-packet:",
+         (double)bench.send_calls / (double)answers,
+         (double)bench.recv_calls / (double)answers, (unsigned int)answers);
+  printf("udp: %s %5.2f allocations/answer\n",
+         batch ? "batched:   " : "per-packet:",
+         (double)allocs / (double)answers);
+  status = ARES_SUCCESS;
+
+done:
+  ares_destroy(channel);
+  if (server != ARES_SOCKET_BAD) {
+    bench.funcs.aclose(server, NULL);
+  }
+  return status;
+}
+
+static ares_status_t bench_udp(void)
+{
+  ares_status_t status = bench_udp_run(ARES_FALSE);
+  if (status != ARES_SUCCESS) {
+    return status;
+  }
+  return bench_udp_run(ARES_TRUE);
+}
+
+/* Large hosts file in the style of ad blocking lists, where most names map
+ * to the same unroutable address, mixed with pinned addresses */
+static ares_status_t bench_hosts(void)
+{
+  const char         *path    = "ares_bench_hosts";
+  ares_channel_t     *channel = NULL;
+  struct ares_options opts;
+  struct hostent     *host = NULL;
+  ares_status_t       status;
+  ares_timeval_t      start;
+  size_t              mem_before;
+  FILE               *fp;
+  char                name[64];
+  size_t              i;
+
+  fp = fopen(path, "w");
+  if (fp == NULL) {
+    return ARES_EFILE;
+  }
+  for (i = 0; i < BENCH_HOSTS; i++) {
+    if (i % 4 == 0) {
+      fprintf(fp, "10.%u.%u.%u\tpin%u.example.com pin%u\n",
+              (unsigned int)((i >> 16) & 0xFF), (unsigned int)((i >> 8) & 0xFF),
+              (unsigned int)(i & 0xFF), (unsigned int)i, (unsigned int)i);
+    } else {
+      fprintf(fp, "0.0.0.0 ad%u.tracker%u.example.net\n", (unsigned int)i,
+              (unsigned int)(i % 100));
+    }
+  }
+  fclose(fp);
+
+  memset(&opts, 0, sizeof(opts));
+  opts.hosts_path     = (char *)((size_t)path);
+  opts.hosts_check_ms = 3600000;
+  status              = (ares_status_t)ares_init_options(
+    &channel, &opts, ARES_OPT_HOSTS_FILE | ARES_OPT_HOSTS_CHECK_INTERVAL);
+  if (status != ARES_SUCCESS) {
+    goto done;
+  }
+
+  /* First lookup loads the file */
+  mem_before = bench_mem_live;
+  ares_tvnow(&start);
+  status = (ares_status_t)ares_gethostbyname_file(channel, "pin0", AF_INET,
+                                                  &host);
+  if (status != ARES_SUCCESS) {
+    goto done;
+  }
+  ares_free_hostent(host);
+  printf("hosts: load %u lines:    %8.1f ms, %8.1f MB\n",
+         (unsigned int)BENCH_HOSTS, bench_elapsed_ns(&start, 1) / 1000000.0,
+         (double)(bench_mem_live - mem_before) / (1024.0 * 1024.0));
+
+  ares_tvnow(&start);
+  for (i = 0; i < BENCH_HOSTS; i += 4) {
+    snprintf(name, sizeof(name), "pin%u.example.com", (unsigned int)i);
+    status = (ares_status_t)ares_gethostbyname_file(channel, name, AF_INET,
+                                                    &host);
+    if (status != ARES_SUCCESS) {
+      goto done;
+    }
+    ares_free_hostent(host);
+  }
+  printf("hosts: lookup:            %8.1f ns/op\n",
+         bench_elapsed_ns(&start, BENCH_HOSTS / 4));
+
+done:
+  ares_destroy(channel);
+  remove(path);
+  return status;
+}
+
+/* Outstanding queries with timeouts, tracked by both the skip list previously
+ * used for channel->queries_by_timeout and the timing wheel replacing it */
+typedef struct {
+  ares_timeval_t      timeout;
+  ares_slist_node_t  *node;
+  ares_twheel_timer_t timer;
+} bench_timer_t;
+
+static int bench_timer_cmp(const void *arg1, const void *arg2)
+{
+  const bench_timer_t *t1 = arg1;
+  const bench_timer_t *t2 = arg2;
+
+  if (t1->timeout.sec != t2->timeout.sec) {
+    return t1->timeout.sec < t2->timeout.sec ? -1 : 1;
+  }
+  if (t1->timeout.usec != t2->timeout.usec) {
+    return t1->timeout.usec < t2->timeout.usec ? -1 : 1;
+  }
+  return 0;
+}
+
+/* Spread timeouts across the configured range, varying per round */
+static void bench_timer_set(bench_timer_t *timer, const ares_timeval_t *now,
+                            size_t idx, size_t round)
+{
+  unsigned int ms =
+    (unsigned int)(((idx + round) * 2654435761UL) % BENCH_TIMER_MS) + 1;
+
+  timer->timeout       = *now;
+  timer->timeout.sec  += ms / 1000;
+  timer->timeout.usec += (ms % 1000) * 1000;
+  if (timer->timeout.usec >= 1000000) {
+    timer->timeout.sec++;
+    timer->timeout.usec -= 1000000;
+  }
+}
+
+static ares_status_t bench_timeouts(void)
+{
+  ares_rand_state *rand_state = NULL;
+  bench_timer_t   *timers     = NULL;
+  ares_slist_t    *slist      = NULL;
+  ares_twheel_t   *wheel      = NULL;
+  ares_status_t    status     = ARES_ENOMEM;
+  ares_timeval_t   now;
+  ares_timeval_t   start;
+  size_t           expired;
+  size_t           i;
+
+  ares_tvnow(&now);
+  rand_state = ares_init_rand_state();
+  timers     = ares_malloc_zero(sizeof(*timers) * BENCH_TIMERS);
+  if (rand_state == NULL || timers == NULL) {
+    goto done;
+  }
+  slist = ares_slist_create(rand_state, bench_timer_cmp, NULL);
+  wheel = ares_twheel_create(&now);
+  if (slist == NULL || wheel == NULL) {
+    goto done;
+  }
+
+  /* Every query is armed, then answered and a new one sent in its place */
+  ares_tvnow(&start);
+  for (i = 0; i < BENCH_TIMERS; i++) {
+    bench_timer_set(&timers[i], &now, i, 0);
+    timers[i].node = ares_slist_insert(slist, &timers[i]);
+    if (timers[i].node == NULL) {
+      goto done;
+    }
+  }
+  for (i = 0; i < BENCH_TIMERS; i++) {
+    ares_slist_node_destroy(timers[i].node);
+    bench_timer_set(&timers[i], &now, i, 1);
+    timers[i].node = ares_slist_insert(slist, &timers[i]);
+    if (timers[i].node == NULL) {
+      goto done;
+    }
+  }
+  printf("timeouts: slist churn:    %8.1f ns/op\n",
+         bench_elapsed_ns(&start, BENCH_TIMERS * 2));
+
+  ares_tvnow(&start);
+  for (i = 0; i < BENCH_TIMERS; i++) {
+    bench_timer_set(&timers[i], &now, i, 0);
+    ares_twheel_timer_init(&timers[i].timer, &timers[i]);
+    ares_twheel_arm(wheel, &timers[i].timer, &timers[i].timeout);
+  }
+  for (i = 0; i < BENCH_TIMERS; i++) {
+    ares_twheel_cancel(wheel, &timers[i].timer);
+    bench_timer_set(&timers[i], &now, i, 1);
+    ares_twheel_arm(wheel, &timers[i].timer, &timers[i].timeout);
+  }
+  printf("timeouts: twheel churn:   %8.1f ns/op\n",
+         bench_elapsed_ns(&start, BENCH_TIMERS * 2));
+
+  /* Let everything time out, processing once per millisecond */
+  ares_tvnow(&start);
+  expired = 0;
+  for (i = 0; i <= BENCH_TIMER_MS + 1; i++) {
+    ares_timeval_t     tv = now;
+    ares_slist_node_t *node;
+
+    tv.sec  += (ares_int64_t)(i / 1000);
+    tv.usec += (unsigned int)(i % 1000) * 1000;
+    if (tv.usec >= 1000000) {
+      tv.sec++;
+      tv.usec -= 1000000;
+    }
+    while ((node = ares_slist_node_first(slist)) != NULL &&
+           ares_timedout(&tv, &((bench_timer_t *)ares_slist_node_val(node))
+                                  ->timeout)) {
+      ares_slist_node_destroy(node);
+      expired++;
+    }
+  }
+  printf("timeouts: slist expire:   %8.1f ns/op\n",
+         bench_elapsed_ns(&start, expired));
+
+  ares_tvnow(&start);
+  expired = 0;
+  for (i = 0; i <= BENCH_TIMER_MS + 1; i++) {
+    ares_timeval_t tv = now;
+
+    tv.sec  += (ares_int64_t)(i / 1000);
+    tv.usec += (unsigned int)(i % 1000) * 1000;
+    if (tv.usec >= 1000000) {
+      tv.sec++;
+      tv.usec -= 1000000;
+    }
+    while (ares_twheel_expire(wheel, &tv) != NULL) {
+      expired++;
+    }
+  }
+  printf("timeouts: twheel expire:  %8.1f ns/op\n",
+         bench_elapsed_ns(&start, expired));
+
+  status = (expired == BENCH_TIMERS && ares_slist_len(slist) == 0)
+             ? ARES_SUCCESS
+             : ARES_EBADRESP;
+
+done:
+  ares_slist_destroy(slist);
+  ares_twheel_destroy(wheel);
+  ares_free(timers);
+  ares_destroy_rand_state(rand_state);
+  return status;
+}
+
+typedef struct {
+  const char *name;
+  ares_status_t (*func)(void);
+} bench_t;
+
+static const bench_t benchmarks[] = {
+  { "qcache",   bench_qcache   },
+  { "dnswrite", bench_dnswrite },
+  { "dnsparse", bench_dnsparse },
+  { "udp",      bench_udp      },
+  { "hosts",    bench_hosts    },
+  { "timeouts", bench_timeouts },
+  { NULL,       NULL           }
+};
+
+int main(int argc, char *argv[])
+{
+  size_t i;
+  int    rv = 0;
+
+  if (ares_library_init_mem(ARES_LIB_INIT_ALL, bench_malloc, bench_free,
+                            bench_realloc) != ARES_SUCCESS) {
+    fprintf(stderr, "ares_library_init failed\n");
+    return 1;
+  }
+
+  for (i = 0; benchmarks[i].name != NULL; i++) {
+    ares_status_t status;
+    int           j;
+    ares_bool_t   run = (argc <= 1) ? ARES_TRUE : ARES_FALSE;
+
+    for (j = 1; j < argc; j++) {
+      if (ares_streq(argv[j], benchmarks[i].name)) {
+        run = ARES_TRUE;
+      }
+    }
+
+    if (!run) {
+      continue;
+    }
+
+    status = benchmarks[i].func();
+    if (status != ARES_SUCCESS) {
+      fprintf(stderr, "%s: %s\n", benchmarks[i].name,
+              ares_strerror((int)status));
+      rv = 1;
+    }
+  }
+
+  ares_library_cleanup();
+  return rv;
+}
+
+#else
+
+int main(void)
+{
+  fprintf(stderr, "benchmarks require internal symbols\n");
+  return 1;
+}
+
+#endif